@@ -24,6 +24,11 @@
 
 #include <fcntl.h>
 #include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 namespace libtas {
 
@@ -81,6 +86,12 @@ size_t Utils::getPageSize()
     return page_size;
 }
 
+size_t Utils::getHugePageSize()
+{
+    /* Each page of the page middle directory holds 64-bit entries */
+    return getPageSize() * (getPageSize() / sizeof(uint64_t));
+}
+
 uintptr_t Utils::alignDownToPageSize(uintptr_t addr)
 {
     return addr & ~(getPageSize() - 1);
@@ -91,20 +102,513 @@ uintptr_t Utils::alignUpToPageSize(uintptr_t addr)
     return (addr + getPageSize() - 1) & ~(getPageSize() - 1);
 }
 
-bool Utils::isZeroPage(void *addr)
+/* Page kernels
+ *
+ * The hash processes the page by stripes of 64 bytes, as 8 lanes of 64-bit
+ * words. Each word is mixed with a key that changes with each stripe, and
+ * the low and high halves of the result are multiplied together, which only
+ * needs a 32x32->64-bit multiplication available on all vector instruction
+ * sets. Lanes are combined at the end, so all implementations give the same
+ * hash.
+ */
+
+enum {
+    HASH_LANES = 8,
+    STRIPE_SIZE = HASH_LANES * sizeof(uint64_t),
+
+    /* Number of bytes read between each early exit check */
+    BLOCK_SIZE = 4 * STRIPE_SIZE,
+};
+
+static const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+static const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+
+alignas(64) static const uint64_t HASH_INIT[HASH_LANES] = {
+    0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL, 0xdb979083e96dd4deULL, 0x1f67b3b7a4a44072ULL,
+    0x78e5c0cc4ee679cbULL, 0x2172ffcc7dd05a82ULL, 0x8e2443f7744608b8ULL, 0x4c263a81e69035e0ULL,
+};
+
+alignas(64) static const uint64_t HASH_KEY[HASH_LANES] = {
+    0xcb79e64eccc0e578ULL, 0x82cbb29b4b3b3f3eULL, 0x7c01812cf721ad1cULL, 0xded46de9839097dbULL,
+    0x7240a4a43b32f2eaULL, 0xc71c3d8e15f11f2fULL, 0xd8e8b9a3ab31e38aULL, 0x6b27e8b7fb55c95eULL,
+};
+
+/* Added to each key lane after each stripe */
+static const uint64_t HASH_STEP = 0x9E3779B97F4A7C15ULL;
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t finalizeHash(const uint64_t* acc, size_t size)
 {
-    long long *buf = (long long *)addr;
-    size_t end = Utils::getPageSize() / sizeof(*buf);
-    long long res = 0;
+    uint64_t h = size * PRIME64_1;
+    for (int l = 0; l < HASH_LANES; l++) {
+        uint64_t a = acc[l];
+        a ^= a >> 47;
+        a *= PRIME64_2;
+        h ^= a;
+        h = rotl64(h, 31) * PRIME64_1 + PRIME64_4;
+    }
 
-    for (size_t i = 0; i + 7 < end; i += 8) {
-        res = buf[i + 0] | buf[i + 1] | buf[i + 2] | buf[i + 3] |
-        buf[i + 4] | buf[i + 5] | buf[i + 6] | buf[i + 7];
-        if (res != 0) {
-            break;
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+static bool isZeroScalar(const void* addr, size_t size)
+{
+    const uint64_t* buf = static_cast<const uint64_t*>(addr);
+    size_t end = size / sizeof(uint64_t);
+
+    for (size_t i = 0; i < end; i += 8) {
+        uint64_t res = buf[i + 0] | buf[i + 1] | buf[i + 2] | buf[i + 3] |
+                       buf[i + 4] | buf[i + 5] | buf[i + 6] | buf[i + 7];
+        if (res != 0)
+            return false;
+    }
+    return true;
+}
+
+static bool isZeroOrHashScalar(const void* addr, size_t size, uint64_t* hash)
+{
+    const uint64_t* buf = static_cast<const uint64_t*>(addr);
+    uint64_t acc[HASH_LANES];
+    uint64_t key[HASH_LANES];
+    uint64_t res = 0;
+
+    for (int l = 0; l < HASH_LANES; l++) {
+        acc[l] = HASH_INIT[l];
+        key[l] = HASH_KEY[l];
+    }
+
+    for (size_t i = 0; i < size / sizeof(uint64_t); i += HASH_LANES) {
+        for (int l = 0; l < HASH_LANES; l++) {
+            uint64_t d = buf[i + l];
+            uint64_t x = d ^ key[l];
+            res |= d;
+            acc[l] += (x & 0xffffffff) * (x >> 32) + d;
+            key[l] += HASH_STEP;
         }
     }
-    return res == 0;
+
+    if (res == 0)
+        return true;
+
+    *hash = finalizeHash(acc, size);
+    return false;
+}
+
+static bool isEqualScalar(const void* addr1, const void* addr2, size_t size)
+{
+    const uint64_t* buf1 = static_cast<const uint64_t*>(addr1);
+    const uint64_t* buf2 = static_cast<const uint64_t*>(addr2);
+    size_t end = size / sizeof(uint64_t);
+
+    for (size_t i = 0; i < end; i += 8) {
+        uint64_t res = (buf1[i + 0] ^ buf2[i + 0]) | (buf1[i + 1] ^ buf2[i + 1]) |
+                       (buf1[i + 2] ^ buf2[i + 2]) | (buf1[i + 3] ^ buf2[i + 3]) |
+                       (buf1[i + 4] ^ buf2[i + 4]) | (buf1[i + 5] ^ buf2[i + 5]) |
+                       (buf1[i + 6] ^ buf2[i + 6]) | (buf1[i + 7] ^ buf2[i + 7]);
+        if (res != 0)
+            return false;
+    }
+    return true;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("sse2")))
+static bool isZeroSSE2(const void* addr, size_t size)
+{
+    const __m128i* buf = static_cast<const __m128i*>(addr);
+    const __m128i zero = _mm_setzero_si128();
+
+    for (size_t i = 0; i < size / sizeof(__m128i); i += 16) {
+        __m128i r0 = _mm_or_si128(_mm_loadu_si128(buf + i + 0), _mm_loadu_si128(buf + i + 1));
+        __m128i r1 = _mm_or_si128(_mm_loadu_si128(buf + i + 2), _mm_loadu_si128(buf + i + 3));
+        __m128i r2 = _mm_or_si128(_mm_loadu_si128(buf + i + 4), _mm_loadu_si128(buf + i + 5));
+        __m128i r3 = _mm_or_si128(_mm_loadu_si128(buf + i + 6), _mm_loadu_si128(buf + i + 7));
+        __m128i r4 = _mm_or_si128(_mm_loadu_si128(buf + i + 8), _mm_loadu_si128(buf + i + 9));
+        __m128i r5 = _mm_or_si128(_mm_loadu_si128(buf + i + 10), _mm_loadu_si128(buf + i + 11));
+        __m128i r6 = _mm_or_si128(_mm_loadu_si128(buf + i + 12), _mm_loadu_si128(buf + i + 13));
+        __m128i r7 = _mm_or_si128(_mm_loadu_si128(buf + i + 14), _mm_loadu_si128(buf + i + 15));
+        __m128i res = _mm_or_si128(_mm_or_si128(_mm_or_si128(r0, r1), _mm_or_si128(r2, r3)),
+                                   _mm_or_si128(_mm_or_si128(r4, r5), _mm_or_si128(r6, r7)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(res, zero)) != 0xffff)
+            return false;
+    }
+    return true;
+}
+
+__attribute__((target("sse2")))
+static bool isZeroOrHashSSE2(const void* addr, size_t size, uint64_t* hash)
+{
+    const __m128i* buf = static_cast<const __m128i*>(addr);
+    const __m128i step = _mm_set1_epi64x(HASH_STEP);
+    __m128i acc[4], key[4];
+    __m128i res = _mm_setzero_si128();
+
+    for (int v = 0; v < 4; v++) {
+        acc[v] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(HASH_INIT) + v);
+        key[v] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(HASH_KEY) + v);
+    }
+
+    for (size_t i = 0; i < size / sizeof(__m128i); i += 4) {
+        for (int v = 0; v < 4; v++) {
+            __m128i d = _mm_loadu_si128(buf + i + v);
+            __m128i x = _mm_xor_si128(d, key[v]);
+            res = _mm_or_si128(res, d);
+            acc[v] = _mm_add_epi64(acc[v], _mm_add_epi64(_mm_mul_epu32(x, _mm_srli_epi64(x, 32)), d));
+            key[v] = _mm_add_epi64(key[v], step);
+        }
+    }
+
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(res, _mm_setzero_si128())) == 0xffff)
+        return true;
+
+    alignas(16) uint64_t lanes[HASH_LANES];
+    for (int v = 0; v < 4; v++)
+        _mm_store_si128(reinterpret_cast<__m128i*>(lanes) + v, acc[v]);
+    *hash = finalizeHash(lanes, size);
+    return false;
+}
+
+__attribute__((target("sse2")))
+static bool isEqualSSE2(const void* addr1, const void* addr2, size_t size)
+{
+    const __m128i* buf1 = static_cast<const __m128i*>(addr1);
+    const __m128i* buf2 = static_cast<const __m128i*>(addr2);
+
+    for (size_t i = 0; i < size / sizeof(__m128i); i += 4) {
+        __m128i c0 = _mm_cmpeq_epi8(_mm_loadu_si128(buf1 + i + 0), _mm_loadu_si128(buf2 + i + 0));
+        __m128i c1 = _mm_cmpeq_epi8(_mm_loadu_si128(buf1 + i + 1), _mm_loadu_si128(buf2 + i + 1));
+        __m128i c2 = _mm_cmpeq_epi8(_mm_loadu_si128(buf1 + i + 2), _mm_loadu_si128(buf2 + i + 2));
+        __m128i c3 = _mm_cmpeq_epi8(_mm_loadu_si128(buf1 + i + 3), _mm_loadu_si128(buf2 + i + 3));
+        __m128i c = _mm_and_si128(_mm_and_si128(c0, c1), _mm_and_si128(c2, c3));
+        if (_mm_movemask_epi8(c) != 0xffff)
+            return false;
+    }
+    return true;
+}
+
+__attribute__((target("avx2")))
+static bool isZeroAVX2(const void* addr, size_t size)
+{
+    const __m256i* buf = static_cast<const __m256i*>(addr);
+
+    for (size_t i = 0; i < size / sizeof(__m256i); i += 8) {
+        __m256i r0 = _mm256_or_si256(_mm256_loadu_si256(buf + i + 0), _mm256_loadu_si256(buf + i + 1));
+        __m256i r1 = _mm256_or_si256(_mm256_loadu_si256(buf + i + 2), _mm256_loadu_si256(buf + i + 3));
+        __m256i r2 = _mm256_or_si256(_mm256_loadu_si256(buf + i + 4), _mm256_loadu_si256(buf + i + 5));
+        __m256i r3 = _mm256_or_si256(_mm256_loadu_si256(buf + i + 6), _mm256_loadu_si256(buf + i + 7));
+        __m256i res = _mm256_or_si256(_mm256_or_si256(r0, r1), _mm256_or_si256(r2, r3));
+        if (!_mm256_testz_si256(res, res))
+            return false;
+    }
+    return true;
+}
+
+__attribute__((target("avx2")))
+static bool isZeroOrHashAVX2(const void* addr, size_t size, uint64_t* hash)
+{
+    const __m256i* buf = static_cast<const __m256i*>(addr);
+    const __m256i step = _mm256_set1_epi64x(HASH_STEP);
+    __m256i acc[2], key[2];
+    __m256i res = _mm256_setzero_si256();
+
+    for (int v = 0; v < 2; v++) {
+        acc[v] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(HASH_INIT) + v);
+        key[v] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(HASH_KEY) + v);
+    }
+
+    for (size_t i = 0; i < size / sizeof(__m256i); i += 2) {
+        for (int v = 0; v < 2; v++) {
+            __m256i d = _mm256_loadu_si256(buf + i + v);
+            __m256i x = _mm256_xor_si256(d, key[v]);
+            res = _mm256_or_si256(res, d);
+            acc[v] = _mm256_add_epi64(acc[v], _mm256_add_epi64(_mm256_mul_epu32(x, _mm256_srli_epi64(x, 32)), d));
+            key[v] = _mm256_add_epi64(key[v], step);
+        }
+    }
+
+    if (_mm256_testz_si256(res, res))
+        return true;
+
+    alignas(32) uint64_t lanes[HASH_LANES];
+    for (int v = 0; v < 2; v++)
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lanes) + v, acc[v]);
+    *hash = finalizeHash(lanes, size);
+    return false;
+}
+
+__attribute__((target("avx2")))
+static bool isEqualAVX2(const void* addr1, const void* addr2, size_t size)
+{
+    const __m256i* buf1 = static_cast<const __m256i*>(addr1);
+    const __m256i* buf2 = static_cast<const __m256i*>(addr2);
+
+    for (size_t i = 0; i < size / sizeof(__m256i); i += 4) {
+        __m256i d0 = _mm256_xor_si256(_mm256_loadu_si256(buf1 + i + 0), _mm256_loadu_si256(buf2 + i + 0));
+        __m256i d1 = _mm256_xor_si256(_mm256_loadu_si256(buf1 + i + 1), _mm256_loadu_si256(buf2 + i + 1));
+        __m256i d2 = _mm256_xor_si256(_mm256_loadu_si256(buf1 + i + 2), _mm256_loadu_si256(buf2 + i + 2));
+        __m256i d3 = _mm256_xor_si256(_mm256_loadu_si256(buf1 + i + 3), _mm256_loadu_si256(buf2 + i + 3));
+        __m256i d = _mm256_or_si256(_mm256_or_si256(d0, d1), _mm256_or_si256(d2, d3));
+        if (!_mm256_testz_si256(d, d))
+            return false;
+    }
+    return true;
+}
+
+__attribute__((target("avx512f")))
+static bool isZeroAVX512(const void* addr, size_t size)
+{
+    const __m512i* buf = static_cast<const __m512i*>(addr);
+
+    for (size_t i = 0; i < size / sizeof(__m512i); i += 4) {
+        __m512i r0 = _mm512_or_si512(_mm512_loadu_si512(buf + i + 0), _mm512_loadu_si512(buf + i + 1));
+        __m512i r1 = _mm512_or_si512(_mm512_loadu_si512(buf + i + 2), _mm512_loadu_si512(buf + i + 3));
+        __m512i res = _mm512_or_si512(r0, r1);
+        if (_mm512_test_epi64_mask(res, res) != 0)
+            return false;
+    }
+    return true;
+}
+
+__attribute__((target("avx512f")))
+static bool isZeroOrHashAVX512(const void* addr, size_t size, uint64_t* hash)
+{
+    const __m512i* buf = static_cast<const __m512i*>(addr);
+    const __m512i step = _mm512_set1_epi64(HASH_STEP);
+    __m512i acc = _mm512_loadu_si512(HASH_INIT);
+    __m512i key = _mm512_loadu_si512(HASH_KEY);
+    __m512i res = _mm512_setzero_si512();
+
+    for (size_t i = 0; i < size / sizeof(__m512i); i++) {
+        __m512i d = _mm512_loadu_si512(buf + i);
+        __m512i x = _mm512_xor_si512(d, key);
+        res = _mm512_or_si512(res, d);
+        acc = _mm512_add_epi64(acc, _mm512_add_epi64(_mm512_mul_epu32(x, _mm512_srli_epi64(x, 32)), d));
+        key = _mm512_add_epi64(key, step);
+    }
+
+    if (_mm512_test_epi64_mask(res, res) == 0)
+        return true;
+
+    alignas(64) uint64_t lanes[HASH_LANES];
+    _mm512_store_si512(lanes, acc);
+    *hash = finalizeHash(lanes, size);
+    return false;
+}
+
+__attribute__((target("avx512f")))
+static bool isEqualAVX512(const void* addr1, const void* addr2, size_t size)
+{
+    const __m512i* buf1 = static_cast<const __m512i*>(addr1);
+    const __m512i* buf2 = static_cast<const __m512i*>(addr2);
+
+    for (size_t i = 0; i < size / sizeof(__m512i); i += 4) {
+        __m512i d0 = _mm512_xor_si512(_mm512_loadu_si512(buf1 + i + 0), _mm512_loadu_si512(buf2 + i + 0));
+        __m512i d1 = _mm512_xor_si512(_mm512_loadu_si512(buf1 + i + 1), _mm512_loadu_si512(buf2 + i + 1));
+        __m512i d2 = _mm512_xor_si512(_mm512_loadu_si512(buf1 + i + 2), _mm512_loadu_si512(buf2 + i + 2));
+        __m512i d3 = _mm512_xor_si512(_mm512_loadu_si512(buf1 + i + 3), _mm512_loadu_si512(buf2 + i + 3));
+        __m512i d = _mm512_or_si512(_mm512_or_si512(d0, d1), _mm512_or_si512(d2, d3));
+        if (_mm512_test_epi64_mask(d, d) != 0)
+            return false;
+    }
+    return true;
+}
+
+#elif defined(__aarch64__)
+
+static inline bool isZeroNEON(uint64x2_t v)
+{
+    return vmaxvq_u32(vreinterpretq_u32_u64(v)) == 0;
+}
+
+static bool isZeroNEON(const void* addr, size_t size)
+{
+    const uint64_t* buf = static_cast<const uint64_t*>(addr);
+
+    for (size_t i = 0; i < size / sizeof(uint64_t); i += 32) {
+        uint64x2_t res = vdupq_n_u64(0);
+        for (int v = 0; v < 16; v++)
+            res = vorrq_u64(res, vld1q_u64(buf + i + 2 * v));
+        if (!isZeroNEON(res))
+            return false;
+    }
+    return true;
+}
+
+static bool isZeroOrHashNEON(const void* addr, size_t size, uint64_t* hash)
+{
+    const uint64_t* buf = static_cast<const uint64_t*>(addr);
+    const uint64x2_t step = vdupq_n_u64(HASH_STEP);
+    uint64x2_t acc[4], key[4];
+    uint64x2_t res = vdupq_n_u64(0);
+
+    for (int v = 0; v < 4; v++) {
+        acc[v] = vld1q_u64(HASH_INIT + 2 * v);
+        key[v] = vld1q_u64(HASH_KEY + 2 * v);
+    }
+
+    for (size_t i = 0; i < size / sizeof(uint64_t); i += HASH_LANES) {
+        for (int v = 0; v < 4; v++) {
+            uint64x2_t d = vld1q_u64(buf + i + 2 * v);
+            uint64x2_t x = veorq_u64(d, key[v]);
+            res = vorrq_u64(res, d);
+            acc[v] = vmlal_u32(vaddq_u64(acc[v], d), vmovn_u64(x), vshrn_n_u64(x, 32));
+            key[v] = vaddq_u64(key[v], step);
+        }
+    }
+
+    if (isZeroNEON(res))
+        return true;
+
+    uint64_t lanes[HASH_LANES];
+    for (int v = 0; v < 4; v++)
+        vst1q_u64(lanes + 2 * v, acc[v]);
+    *hash = finalizeHash(lanes, size);
+    return false;
+}
+
+static bool isEqualNEON(const void* addr1, const void* addr2, size_t size)
+{
+    const uint64_t* buf1 = static_cast<const uint64_t*>(addr1);
+    const uint64_t* buf2 = static_cast<const uint64_t*>(addr2);
+
+    for (size_t i = 0; i < size / sizeof(uint64_t); i += 8) {
+        uint64x2_t d0 = veorq_u64(vld1q_u64(buf1 + i + 0), vld1q_u64(buf2 + i + 0));
+        uint64x2_t d1 = veorq_u64(vld1q_u64(buf1 + i + 2), vld1q_u64(buf2 + i + 2));
+        uint64x2_t d2 = veorq_u64(vld1q_u64(buf1 + i + 4), vld1q_u64(buf2 + i + 4));
+        uint64x2_t d3 = veorq_u64(vld1q_u64(buf1 + i + 6), vld1q_u64(buf2 + i + 6));
+        if (!isZeroNEON(vorrq_u64(vorrq_u64(d0, d1), vorrq_u64(d2, d3))))
+            return false;
+    }
+    return true;
+}
+
+#endif
+
+struct PageKernels {
+    bool (*isZero)(const void* addr, size_t size);
+    bool (*isZeroOrHash)(const void* addr, size_t size, uint64_t* hash);
+    bool (*isEqual)(const void* addr1, const void* addr2, size_t size);
+};
+
+static PageKernels selectKernels()
+{
+    /* Pages are processed by blocks, which is fine for all page sizes */
+    if (Utils::getPageSize() % BLOCK_SIZE != 0)
+        return {isZeroScalar, isZeroOrHashScalar, isEqualScalar};
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+        return {isZeroAVX512, isZeroOrHashAVX512, isEqualAVX512};
+    if (__builtin_cpu_supports("avx2"))
+        return {isZeroAVX2, isZeroOrHashAVX2, isEqualAVX2};
+    if (__builtin_cpu_supports("sse2"))
+        return {isZeroSSE2, isZeroOrHashSSE2, isEqualSSE2};
+#elif defined(__aarch64__)
+    return {isZeroNEON, isZeroOrHashNEON, isEqualNEON};
+#endif
+
+    return {isZeroScalar, isZeroOrHashScalar, isEqualScalar};
+}
+
+/* Kernels set by Utils::setPageKernels(), if any */
+static PageKernels forced_kernels;
+
+static const PageKernels& getKernels()
+{
+    if (forced_kernels.isZero)
+        return forced_kernels;
+
+    static const PageKernels kernels = selectKernels();
+    return kernels;
+}
+
+bool Utils::setPageKernels(PageKernelSet set)
+{
+    if (set == PAGE_KERNELS_SCALAR) {
+        forced_kernels = {isZeroScalar, isZeroOrHashScalar, isEqualScalar};
+        return true;
+    }
+
+    if (getPageSize() % BLOCK_SIZE != 0)
+        return false;
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if ((set == PAGE_KERNELS_AVX512) && __builtin_cpu_supports("avx512f")) {
+        forced_kernels = {isZeroAVX512, isZeroOrHashAVX512, isEqualAVX512};
+        return true;
+    }
+    if ((set == PAGE_KERNELS_AVX2) && __builtin_cpu_supports("avx2")) {
+        forced_kernels = {isZeroAVX2, isZeroOrHashAVX2, isEqualAVX2};
+        return true;
+    }
+    if ((set == PAGE_KERNELS_SSE2) && __builtin_cpu_supports("sse2")) {
+        forced_kernels = {isZeroSSE2, isZeroOrHashSSE2, isEqualSSE2};
+        return true;
+    }
+#elif defined(__aarch64__)
+    if (set == PAGE_KERNELS_NEON) {
+        forced_kernels = {isZeroNEON, isZeroOrHashNEON, isEqualNEON};
+        return true;
+    }
+#endif
+
+    return false;
+}
+
+bool Utils::isZeroPage(const void *addr)
+{
+    return getKernels().isZero(addr, getPageSize());
+}
+
+bool Utils::isZeroPages(const void *addr, size_t nb_pages)
+{
+    return getKernels().isZero(addr, nb_pages * getPageSize());
+}
+
+uint64_t Utils::hashPage(const void *addr)
+{
+    uint64_t hash = 0;
+    if (getKernels().isZeroOrHash(addr, getPageSize(), &hash)) {
+        /* Zero pages still need a hash */
+        uint64_t acc[HASH_LANES];
+        uint64_t key[HASH_LANES];
+        for (int l = 0; l < HASH_LANES; l++) {
+            acc[l] = HASH_INIT[l];
+            key[l] = HASH_KEY[l];
+        }
+        for (size_t i = 0; i < getPageSize(); i += STRIPE_SIZE) {
+            for (int l = 0; l < HASH_LANES; l++) {
+                acc[l] += (key[l] & 0xffffffff) * (key[l] >> 32);
+                key[l] += HASH_STEP;
+            }
+        }
+        hash = finalizeHash(acc, getPageSize());
+    }
+    return hash;
+}
+
+bool Utils::isEqualPage(const void *addr1, const void *addr2)
+{
+    return getKernels().isEqual(addr1, addr2, getPageSize());
+}
+
+bool Utils::isZeroPageOrHash(const void *addr, uint64_t *hash)
+{
+    return getKernels().isZeroOrHash(addr, getPageSize(), hash);
 }
 
 }
@@ -41,17 +41,46 @@ namespace Utils
     /* Returns the system page size */
     size_t getPageSize();
 
+    /* Returns the size of a transparent huge page, which is mapped by a
+     * single entry of the page middle directory */
+    size_t getHugePageSize();
+
     /* Align address to page size */
     uintptr_t alignDownToPageSize(uintptr_t addr);
     uintptr_t alignUpToPageSize(uintptr_t addr);
 
-    /* This function detects if the given page is a zero page or not. There is
-     * scope of improving this function using some optimizations.
-     *
-     * TODO: One can use /proc/self/pagemap to detect if the page is backed by a
-     * shared zero page.
-     */
-    bool isZeroPage(void *addr);
+    /* Page kernels, which use the best vector instructions supported by the
+     * cpu, selected at runtime. All of them work on a full page. */
+
+    /* Returns if the given page is entirely zero */
+    bool isZeroPage(const void *addr);
+
+    /* Returns if the given range of pages is entirely zero */
+    bool isZeroPages(const void *addr, size_t nb_pages);
+
+    /* Returns a 64-bit hash of the page content. The hash does not depend on
+     * the selected instructions */
+    uint64_t hashPage(const void *addr);
+
+    /* Returns if both pages have the same content */
+    bool isEqualPage(const void *addr1, const void *addr2);
+
+    /* Returns if the given page is entirely zero, and otherwise stores its
+     * hash, reading the page only once */
+    bool isZeroPageOrHash(const void *addr, uint64_t *hash);
+
+    /* Instruction sets of the page kernels */
+    enum PageKernelSet {
+        PAGE_KERNELS_SCALAR,
+        PAGE_KERNELS_SSE2,
+        PAGE_KERNELS_AVX2,
+        PAGE_KERNELS_AVX512,
+        PAGE_KERNELS_NEON,
+    };
+
+    /* Force the instruction set of the page kernels instead of the best one,
+     * to compare implementations. Returns false if it is not supported */
+    bool setPageKernels(PageKernelSet set);
 }
 }
 
@@ -33,6 +33,12 @@
 #include "ReservedMemory.h"
 #include "SaveStateSaving.h"
 #include "SaveStateLoading.h"
+#include "SaveStateWorkers.h"
+#include "SaveStateMemory.h"
+#include "PageStore.h"
+#include "SaveStateCodec.h"
+#include "DirtyTracker.h"
+#include "PagemapScan.h"
 #include "CheckpointSavefiles.h"
 
 #include "TimeHolder.h"
@@ -59,6 +65,7 @@
 #include <climits>
 #include <stdint.h>
 #include <sys/statvfs.h>
+#include <sys/resource.h> // setpriority
 #include <cerrno>
 #ifdef __unix__
 #include <X11/Xlibint.h>
@@ -78,6 +85,11 @@
 
 #define ONE_MB 1024 * 1024
 
+/* From <linux/ioprio.h>, which is not available on older systems */
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_SHIFT 13
+
 #ifndef MADV_GUARD_INSTALL
 #define MADV_GUARD_INSTALL 102
 #endif
@@ -148,12 +160,53 @@ static _xstate ss_fpregset;
 #endif
 #endif
 
+/* Chunks of pages that were sent to worker threads when loading a state */
+struct LoadQueue {
+    int pushed;
+    int waited;
+    int max_pending;
+
+    /* Chunk being filled, or nullptr */
+    SaveStateWorkers::Chunk* current;
+
+    /* Codec of compressed pages */
+    int codec;
+
+    /* Number of pages that could not be decompressed */
+    int errors;
+
+    /* Time spent waiting for worker threads */
+    TimeHolder wait_time;
+};
+
 static void readAllAreas();
 static int reallocateArea(Area *saved_area, Area *current_area);
-static void readAnArea(SaveStateLoading &saved_area, int spmfd, PagemapCache &pagemap_cache, SaveStateLoading &parent_state, SaveStateLoading &base_state);
+static void readAnArea(SaveStateLoading &saved_area, int spmfd, PagemapCache &pagemap_cache, SaveStateLoading &parent_state, SaveStateLoading &base_state, LoadQueue *load_queue);
+static void queuePageLoad(LoadQueue &queue, char* addr, char flag, const char* data);
+static bool usesPageStore(const char* pagemappath);
+static void releaseStorePages(SaveStateLoading &state);
+static void pushLoadChunk(LoadQueue &queue);
+static void waitAllLoadChunks(LoadQueue &queue);
+
+/* Chunks of memory areas that were sent to worker threads when saving a
+ * state, which must be written in the same order */
+struct ChunkQueue {
+    int pushed;
+    int written;
+    int max_pending;
+
+    /* Stats of the area being written */
+    int pagecount_unmapped;
+    int pagecount_zero_or_file;
+    int pagecount_full;
+    size_t area_size;
+};
 
 static void writeAllAreas(bool base);
 static size_t writeAnArea(SaveStateSaving &state, Area &area, int spmfd, PagemapCache &pagemap_cache, SaveStateLoading &parent_state, SaveStateLoading &base_state, bool base);
+static size_t queueAnArea(SaveStateSaving &state, Area &area, int spmfd, ChunkQueue &queue);
+static size_t writeNextChunk(SaveStateSaving &state, ChunkQueue &queue);
+static size_t writeAllChunks(SaveStateSaving &state, ChunkQueue &queue);
 
 void Checkpoint::setSavestatePath(std::string path)
 {
@@ -249,16 +302,19 @@ int Checkpoint::checkCheckpoint()
 
 int Checkpoint::checkRestore()
 {
+    const char* statepagemappath = SaveStateMemory::pagemapPath(ss_index, pagemappath);
+    const char* statepagespath = SaveStateMemory::pagesPath(ss_index, pagespath);
+
     /* Check that the savestate files exist */
     struct stat sb;
-    if (stat(pagemappath, &sb) == -1) {
+    if (stat(statepagemappath, &sb) == -1) {
         return SaveStateManager::ESTATE_NOSTATE;
     }
-    if (stat(pagespath, &sb) == -1) {
+    if (stat(statepagespath, &sb) == -1) {
         return SaveStateManager::ESTATE_NOSTATE;
     }
 
-    int pmfd = open(pagemappath, O_RDONLY);
+    int pmfd = open(statepagemappath, O_RDONLY);
     if (pmfd == -1)
         return SaveStateManager::ESTATE_NOSTATE;
 
@@ -267,6 +323,11 @@ int Checkpoint::checkRestore()
     Utils::readAll(pmfd, &sh, sizeof(sh));
     close(pmfd);
 
+    /* The savestate references pages from another page store, which can
+     * happen with leftover savestates of a previous execution */
+    if ((sh.flags & StateHeader::SH_PAGE_STORE) && (sh.store_id != PageStore::id()))
+        return SaveStateManager::ESTATE_NOSTATE;
+
     return SaveStateManager::ESTATE_OK;
 }
 
@@ -388,7 +449,8 @@ void Checkpoint::getStateHeader(StateHeader* sh)
 {
     /* Thanks to checkRestore() being called before this, savestate is garanteed 
      * to be present */
-    SaveStateLoading saved_state(pagemappath, pagespath);
+    SaveStateLoading saved_state(SaveStateMemory::pagemapPath(ss_index, pagemappath),
+                                 SaveStateMemory::pagesPath(ss_index, pagespath));
     saved_state.readHeader(sh);
 }
 
@@ -400,13 +462,16 @@ static void readAllAreas()
      * file descriptors will be above a certain high value. */
     FileDescriptorManip::reserveUntilState();
     
-    SaveStateLoading saved_state(pagemappath, pagespath);
+    SaveStateLoading saved_state(SaveStateMemory::pagemapPath(ss_index, pagemappath),
+                                 SaveStateMemory::pagesPath(ss_index, pagespath));
+    SaveStateMemory::touch(ss_index);
 
     int spmfd = open("/proc/self/pagemap", O_RDONLY);
     MYASSERT(spmfd != -1);
 
     int crfd = -1;
-    if (Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL) {
+    bool track_writes = DirtyTracker::enabled();
+    if ((Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL) && !track_writes) {
         crfd = open("/proc/self/clear_refs", O_WRONLY);
         MYASSERT(crfd != -1);
     }
@@ -420,6 +485,8 @@ static void readAllAreas()
 
     LOG(LL_DEBUG, LCF_CHECKPOINT, "Performing restore.");
 
+    TimeHolder start_time = TimeHolder::now();
+
     /* Read the memory mapping */
 #ifdef __unix__
     ProcSelfMaps memMapLayout;
@@ -428,7 +495,8 @@ static void readAllAreas()
 #endif
 
     /* Load base and parent savestates */
-    SaveStateLoading parent_state(parentpagemappath, parentpagespath);
+    SaveStateLoading parent_state(SaveStateMemory::pagemapPath(parent_ss_index, parentpagemappath),
+                                  SaveStateMemory::pagesPath(parent_ss_index, parentpagespath));
     SaveStateLoading base_state(basepagemappath, basepagespath);
 
     /* Now that we have opened all files we need, and *before* doing the actual
@@ -460,21 +528,53 @@ static void readAllAreas()
         }
     }
     
+    TimeHolder remap_time = TimeHolder::now();
+
     /* Now that the memory layout matches the savestate, we load savestate into memory */
     saved_state.restart();
     saved_area = saved_state.getArea();
 
     PagemapCache pagemap_cache = {{0}, 0, 0};
-    
+
+    /* Pages can be copied and decompressed by worker threads only if each
+     * page was compressed independently. Workers read the pages directly from
+     * a mapping of the pages file. */
+    LoadQueue load_queue;
+    bool parallel = SaveStateWorkers::available() &&
+                    (sh.flags & StateHeader::SH_INDEPENDENT_BLOCKS) &&
+                    saved_state.mapPages();
+    if (parallel) {
+        load_queue.pushed = 0;
+        load_queue.waited = 0;
+        load_queue.max_pending = 2 * SaveStateWorkers::count();
+        if (load_queue.max_pending > SaveStateWorkers::NB_CHUNKS)
+            load_queue.max_pending = SaveStateWorkers::NB_CHUNKS;
+        load_queue.current = nullptr;
+        load_queue.codec = sh.codec;
+        load_queue.errors = 0;
+        load_queue.wait_time = TimeHolder(0, 0);
+    }
+
     /* If the loading savestate and the parent savestate are the same, pass the
     * same SaveStateLoading object to readAnArea because two SaveStateLoading objects
     * handling the same file descriptor will mess up the file offset. */
     bool same_state = (ss_index == parent_ss_index);
     while (saved_area.isStandard()) {
-        readAnArea(saved_state, spmfd, pagemap_cache, same_state?saved_state:parent_state, base_state);
+        readAnArea(saved_state, spmfd, pagemap_cache, same_state?saved_state:parent_state, base_state, parallel?&load_queue:nullptr);
         saved_area = saved_state.nextArea();
     }
-    
+
+    if (parallel) {
+        waitAllLoadChunks(load_queue);
+        saved_state.unmapPages();
+
+        if (load_queue.errors > 0) {
+            LOG(LL_ERROR, LCF_CHECKPOINT, "%d pages could not be decompressed", load_queue.errors);
+        }
+    }
+
+    TimeHolder pages_time = TimeHolder::now();
+
     /* Before restoring savefiles, we open and close file descriptors to be in 
      * sync with when the savestate was made. */
     FileHandleList::syncFileDescriptors();
@@ -490,8 +590,24 @@ static void readAllAreas()
         Utils::writeAll(crfd, "4\n", 2);
         close(crfd);
     }
+    else if (track_writes) {
+        DirtyTracker::reset();
+    }
 
     close(spmfd);
+
+    TimeHolder end_time = TimeHolder::now();
+    TimeHolder remap_delta = remap_time - start_time;
+    TimeHolder pages_delta = pages_time - remap_time;
+    TimeHolder files_delta = end_time - pages_time;
+    LOG(LL_INFO, LCF_CHECKPOINT, "Remapping memory: %f s, loading pages: %f s, loading savefiles: %f s",
+        remap_delta.tv_sec + ((double)remap_delta.tv_nsec) / 1000000000.0,
+        pages_delta.tv_sec + ((double)pages_delta.tv_nsec) / 1000000000.0,
+        files_delta.tv_sec + ((double)files_delta.tv_nsec) / 1000000000.0);
+    if (parallel) {
+        LOG(LL_INFO, LCF_CHECKPOINT, "Waiting for worker threads: %f s",
+            load_queue.wait_time.tv_sec + ((double)load_queue.wait_time.tv_nsec) / 1000000000.0);
+    }
 }
 
 static int reallocateArea(Area *saved_area, Area *current_area)
@@ -742,7 +858,7 @@ static int reallocateArea(Area *saved_area, Area *current_area)
     return 0;
 }
 
-static void readAnArea(SaveStateLoading &saved_state, int spmfd, PagemapCache &pagemap_cache, SaveStateLoading &parent_state, SaveStateLoading &base_state)
+static void readAnArea(SaveStateLoading &saved_state, int spmfd, PagemapCache &pagemap_cache, SaveStateLoading &parent_state, SaveStateLoading &base_state, LoadQueue *load_queue)
 {
     const Area& saved_area = saved_state.getArea();
 
@@ -755,6 +871,15 @@ static void readAnArea(SaveStateLoading &saved_state, int spmfd, PagemapCache &p
 
     saved_area.print("Restore");
 
+    /* Let the kernel back the restored pages of heap areas with transparent
+     * huge pages, instead of fragmenting them */
+    if ((Global::shared_config.savestate_settings & SharedConfig::SS_HUGEPAGE) &&
+        (saved_area.flags & Area::AREA_PRIV) && (saved_area.flags & Area::AREA_ANON) &&
+        (saved_area.size >= Utils::getHugePageSize())) {
+        if (madvise(saved_area.addr, saved_area.size, MADV_HUGEPAGE) != 0)
+            LOG(LL_DEBUG, LCF_CHECKPOINT, "     Could not use huge pages for area: %s", strerror(errno));
+    }
+
     /* Because adding write permission increases the commit charge, it can fail
      * on very large uncommitted memory (Celeste64 -> 274GB memory segment).
      * Also, lightweight guard pages (including in Linux 6.13) cannot have
@@ -815,15 +940,45 @@ static void readAnArea(SaveStateLoading &saved_state, int spmfd, PagemapCache &p
         }
     }
 
+    /* Pages modified since the last savestate, when not using soft-dirty bits */
+    DirtyRanges dirty_ranges(saved_area);
+
+    /* Classify pages using a few queries if supported */
+    bool incremental = Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL;
+    PagemapRanges pagemap_ranges(spmfd, saved_area, incremental && !dirty_ranges.active());
+
+    /* Pages not modified since the last savestate, and which are zero or
+     * identical to the base savestate like in the parent savestate, are
+     * skipped without reading them. Debug logging double-checks each page
+     * instead */
+    bool clean_runs = dirty_ranges.active() && pagemap_ranges.active() && incremental &&
+        (Global::shared_config.logging_level < LL_DEBUG);
+
+    /* End of the current run of modified or not modified pages */
+    char* run_end = static_cast<char*>(saved_area.addr);
+    bool run_modified = true;
+
     for (size_t page_i = 0; page_i < nb_pages; page_i++) {
         char* curAddr = static_cast<char*>(saved_area.addr) + page_i * page_size;
-        size_t pagemap_i = loadPagemapWindow(spmfd, pagemap_cache, curAddr, nb_pages - page_i);
 
         char flag = saved_area.uncommitted ? Area::NO_PAGE : saved_state.getNextPageFlag();
 
+        if (dirty_ranges.active() && (curAddr >= run_end))
+            run_end = curAddr + page_size * dirty_ranges.runPages(curAddr, nb_pages - page_i, &run_modified);
+
+        if (clean_runs && !run_modified && ((flag == Area::ZERO_PAGE) || (flag == Area::BASE_PAGE)) &&
+            (parent_state.getPageFlag(curAddr) == flag) && !(pagemap_ranges.entry(curAddr) & (0x1ull << 58))) {
+            pagecount_skip++;
+            continue;
+        }
+
         /* Gather the flag for the page map */
-        uint64_t page = pagemap_cache.entries[pagemap_i];
-        bool soft_dirty = page & (0x1ull << 55);
+        uint64_t page;
+        if (pagemap_ranges.active())
+            page = pagemap_ranges.entry(curAddr);
+        else
+            page = pagemap_cache.entries[loadPagemapWindow(spmfd, pagemap_cache, curAddr, nb_pages - page_i)];
+        bool page_dirty = dirty_ranges.active() ? run_modified : (page & (0x1ull << 55));
         bool page_guard_region = page & (0x1ull << 58);
         bool page_file = page & (0x1ull << 61);
         bool page_present = page & (0x1ull << 63);
@@ -925,7 +1080,7 @@ static void readAnArea(SaveStateLoading &saved_state, int spmfd, PagemapCache &p
                 /* In case incremental savestates is enabled, we can guess that
                  * the page is already zero if the parent page is zero and the
                  * page was not modified since. In that case, we can skip the memset. */
-                if (soft_dirty ||
+                if (page_dirty ||
                     parent_state.getPageFlag(curAddr) != Area::ZERO_PAGE) {
                     if (!(saved_area.prot & PROT_WRITE)) {
                         MYASSERT(mprotect(curAddr, page_size, saved_area.prot | PROT_WRITE) == 0)
@@ -1011,7 +1166,7 @@ static void readAnArea(SaveStateLoading &saved_state, int spmfd, PagemapCache &p
                 continue;
             }
             
-            if (soft_dirty) {
+            if (page_dirty) {
                 /* Memory page has been modified after parent state.
                  * We must read from the base savestate.
                  */
@@ -1032,12 +1187,24 @@ static void readAnArea(SaveStateLoading &saved_state, int spmfd, PagemapCache &p
         }
         else {
             pagecount_full++;
-            saved_state.queuePageLoad(curAddr);
+            const char* data = load_queue ? saved_state.currentPageData() : nullptr;
+            if (data)
+                queuePageLoad(*load_queue, curAddr, flag, data);
+            else
+                saved_state.queuePageLoad(curAddr);
         }
     }
     base_state.finishLoad();
     saved_state.finishLoad();
 
+    /* Pages must be written before recovering the area permission */
+    if (load_queue) {
+        if (!(saved_area.prot & PROT_WRITE) || !(saved_area.prot & PROT_READ))
+            waitAllLoadChunks(*load_queue);
+        else
+            pushLoadChunk(*load_queue);
+    }
+
     if (Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL) {
         LOG(LL_DEBUG, LCF_CHECKPOINT, "    Pagecount full: %d, zero/file: %d, base: %d, skipped: %d", pagecount_full, pagecount_zero_or_file, pagecount_base, pagecount_skip);
     }
@@ -1062,20 +1229,46 @@ static void readAnArea(SaveStateLoading &saved_state, int spmfd, PagemapCache &p
 
 static void writeAllAreas(bool base)
 {
-    if (Global::shared_config.savestate_settings & SharedConfig::SS_FORK) {
-        pid_t pid;
-        pid = fork();
-        if (pid != 0)
+    int pmfd, pfd;
+
+    /* Memory savestates are written into new memory files, which replace the
+     * previous ones only at the end, like temp files. For fork savestates,
+     * they are created before forking so that the parent keeps them. */
+    bool in_memory = !base && SaveStateMemory::enabled() && SaveStateMemory::open(&pmfd, &pfd);
+
+    bool forked = Global::shared_config.savestate_settings & SharedConfig::SS_FORK;
+    if (forked) {
+        TimeHolder fork_start = TimeHolder::now();
+        pid_t pid = fork();
+        if (pid != 0) {
+            if (!base)
+                SaveStateManager::registerFork(ss_index, fork_start, TimeHolder::now());
+
+            if (in_memory) {
+                /* Memory files are registered when the child has finished */
+                SaveStateMemory::setPending(ss_index, pmfd, pfd, pagemappath, pagespath);
+            }
+            else if (!base) {
+                /* The state is saved on disk by the child, so any state in
+                 * memory for that slot is outdated */
+                SaveStateMemory::discard(ss_index);
+            }
             return;
+        }
 
         ThreadManager::restoreTid();
+
+        /* The game keeps running while we write the state, so we must use
+         * as few resources as possible */
+        setpriority(PRIO_PROCESS, 0, 19);
+#ifdef __linux__
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | 7);
+#endif
     }
 
     TimeHolder old_time = TimeHolder::now();
     TimeHolder new_time, delta_time;
 
-    int pmfd, pfd;
-
     size_t savestate_size = 0;
 
     /* Because we may overwrite our parent state, we must save on a temp file
@@ -1085,7 +1278,18 @@ static void writeAllAreas(bool base)
     char temppagemappath[1024];
     char temppagespath[1024];
 
-    if (!(Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL)) {
+    /* Open the savestate that we are replacing, if its pages are inside the
+     * page store, so that they can be released once the new savestate is
+     * written. Doing it at the end keeps pages present in both states. */
+    const char* oldpagemappath = base ? basepagemappath : SaveStateMemory::pagemapPath(ss_index, pagemappath);
+    const char* oldpagespath = base ? basepagespath : SaveStateMemory::pagesPath(ss_index, pagespath);
+    bool release_old = !forked && usesPageStore(oldpagemappath);
+    SaveStateLoading old_state(release_old ? oldpagemappath : "", release_old ? oldpagespath : "");
+
+    if (in_memory) {
+        LOG(LL_DEBUG, LCF_CHECKPOINT, "Performing checkpoint in memory");
+    }
+    else if (!(Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL)) {
         LOG(LL_DEBUG, LCF_CHECKPOINT, "Performing checkpoint in %s and %s", pagemappath, pagespath);
 
         unlink(pagemappath);
@@ -1123,7 +1327,8 @@ static void writeAllAreas(bool base)
     MYASSERT(spmfd != -1);
 
     int crfd = -1;
-    if (Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL) {
+    bool track_writes = DirtyTracker::enabled();
+    if ((Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL) && !track_writes) {
         crfd = open("/proc/self/clear_refs", O_WRONLY);
         MYASSERT(crfd != -1);
     }
@@ -1143,12 +1348,31 @@ static void writeAllAreas(bool base)
         }
     }
     sh.thread_count = n;
+
+    /* Select the compression codec, which may depend on the slot */
+    SaveStateCodec::select(base ? base_ss_index : ss_index, &sh.codec, &sh.codec_level);
+
+    /* Compressed pages are independent if they are processed by worker
+     * threads, if the corresponding option was set, or if not using the
+     * LZ4 stream */
+    sh.flags = 0;
+    if ((Global::shared_config.savestate_settings & (SharedConfig::SS_INCREMENTAL | SharedConfig::SS_PARALLEL)) ||
+        (sh.codec != SharedConfig::SC_LZ4))
+        sh.flags |= StateHeader::SH_INDEPENDENT_BLOCKS;
+
+    sh.store_id = 0;
+    if (PageStore::enabled() && PageStore::init(base ? basepagemappath : pagemappath)) {
+        sh.flags |= StateHeader::SH_PAGE_STORE;
+        sh.store_id = PageStore::id();
+    }
+
     Utils::writeAll(pmfd, &sh, sizeof(sh));
     savestate_size += sizeof(sh);
 
     /* Load the parent savestate if any. */
-    SaveStateSaving state(pmfd, pfd, spmfd);
-    SaveStateLoading parent_state(parentpagemappath, parentpagespath);
+    SaveStateSaving state(pmfd, pfd, spmfd, sh);
+    SaveStateLoading parent_state(SaveStateMemory::pagemapPath(parent_ss_index, parentpagemappath),
+                                  SaveStateMemory::pagesPath(parent_ss_index, parentpagespath));
     SaveStateLoading base_state(basepagemappath, basepagespath);
 
     /* Read the memory mapping */
@@ -1164,6 +1388,17 @@ static void writeAllAreas(bool base)
 
     PagemapCache pagemap_cache = {{0}, 0, 0};
 
+    /* Pages of private areas can be processed by worker threads, unless we
+     * need to compare with the parent savestate, which must be read
+     * sequentially. */
+    bool parallel = SaveStateWorkers::available() &&
+        (base || !(Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL));
+
+    ChunkQueue chunk_queue = {};
+    chunk_queue.max_pending = 2 * SaveStateWorkers::count();
+    if (chunk_queue.max_pending > SaveStateWorkers::NB_CHUNKS)
+        chunk_queue.max_pending = SaveStateWorkers::NB_CHUNKS;
+
     /* Multiple shared areas can point to the same memory, so we detect and 
      * skip all those duplicate areas.
      * TODO: this code only covers the special case of consecutive areas to 
@@ -1178,11 +1413,20 @@ static void writeAllAreas(bool base)
             (area.size == previous_area.size)) {
             area.skip = true;    
         }
-        savestate_size += writeAnArea(state, area, spmfd, pagemap_cache, parent_state, base_state, base);
+        if (parallel && !(area.flags & Area::AREA_SHARED)) {
+            savestate_size += queueAnArea(state, area, spmfd, chunk_queue);
+        }
+        else {
+            /* Areas must be written in order */
+            savestate_size += writeAllChunks(state, chunk_queue);
+            savestate_size += writeAnArea(state, area, spmfd, pagemap_cache, parent_state, base_state, base);
+        }
         previous_area = area;
         not_eof = memMapLayout.getNextArea(&area);
     }
 
+    savestate_size += writeAllChunks(state, chunk_queue);
+
     savestate_size += writeSaveFiles(state);
 
     /* Area metadata and page flags are buffered in SaveStateSaving. Flush now
@@ -1195,23 +1439,40 @@ static void writeAllAreas(bool base)
     Utils::writeAll(pmfd, &area, sizeof(area));
     savestate_size += sizeof(area);
 
-    if (Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL) {
+    if (crfd != -1) {
         /* Clear soft-dirty bits */
         Utils::writeAll(crfd, "4\n", 2);
-    }
-
-    if (crfd != -1) {
         close(crfd);
     }
+    else if (track_writes) {
+        DirtyTracker::reset();
+    }
 
     close(spmfd);
 
-    /* Closing the savestate files */
-    close(pmfd);
-    close(pfd);
+    if (release_old)
+        releaseStorePages(old_state);
+
+    if (in_memory && forked) {
+        /* Memory files are registered by our parent */
+        close(pmfd);
+        close(pfd);
+    }
+    else if (in_memory) {
+        /* Memory files are now owned by the memory savestate storage */
+        SaveStateMemory::commit(ss_index, pmfd, pfd, pagemappath, pagespath);
+    }
+    else {
+        /* Closing the savestate files */
+        close(pmfd);
+        close(pfd);
+
+        if (!base)
+            SaveStateMemory::discard(ss_index);
+    }
 
     /* Rename the savestate files */
-    if ((Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL) && !base) {
+    if ((Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL) && !base && !in_memory) {
         rename(temppagemappath, pagemappath);
         rename(temppagespath, pagespath);
     }
@@ -1220,7 +1481,7 @@ static void writeAllAreas(bool base)
     delta_time = new_time - old_time;
     LOG(LL_INFO, LCF_CHECKPOINT, "Saved state %d of size %zu in %f seconds", base?0:ss_index, savestate_size, delta_time.tv_sec + ((double)delta_time.tv_nsec) / 1000000000.0);
 
-    if (Global::shared_config.savestate_settings & SharedConfig::SS_FORK) {
+    if (forked) {
         /* Store that we are the child, so that destructors may act differently */
         ThreadManager::setChildFork();
 
@@ -1302,17 +1563,123 @@ static size_t writeAnArea(SaveStateSaving &state, Area &area, int spmfd, Pagemap
         }
     }
 
+    /* Pages modified since the last savestate, when not using soft-dirty bits */
+    DirtyRanges dirty_ranges(area);
+
+    /* Classify pages using a few queries if supported */
+    bool incremental = Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL;
+    PagemapRanges pagemap_ranges(spmfd, area, incremental && !dirty_ranges.active());
+
+    /* Unpopulated pages of anonymous areas can be skipped in bulk */
+    bool skip_absent = pagemap_ranges.active() &&
+        (area.flags & Area::AREA_PRIV) && (area.flags & Area::AREA_ANON) &&
+        (Global::shared_config.savestate_settings & SharedConfig::SS_PRESENT);
+
+    /* Transparent huge pages of anonymous areas are checked for zero as a
+     * whole */
+    bool check_huge = pagemap_ranges.active() && (area.prot & PROT_READ) &&
+        (area.flags & Area::AREA_PRIV) && (area.flags & Area::AREA_ANON);
+    size_t huge_size = Utils::getHugePageSize();
+    size_t huge_pages = huge_size / page_size;
+
+    /* Runs of pages not modified since the last savestate are saved without
+     * reading them. Debug logging double-checks each page instead */
+    bool clean_runs = dirty_ranges.active() && pagemap_ranges.active() && incremental && !base &&
+        (area.prot & PROT_READ) && (Global::shared_config.logging_level < LL_DEBUG);
+
+    /* End of the current run of modified or not modified pages */
+    char* run_end = static_cast<char*>(area.addr);
+    bool run_modified = true;
+
     for (size_t page_i = 0; page_i < nb_pages; page_i++) {
         char* curAddr = static_cast<char*>(area.addr) + page_i * page_size;
-        size_t pagemap_i = loadPagemapWindow(spmfd, pagemap_cache, curAddr, nb_pages - page_i);
+
+        if (dirty_ranges.active() && (curAddr >= run_end))
+            run_end = curAddr + page_size * dirty_ranges.runPages(curAddr, nb_pages - page_i, &run_modified);
+
+        if (clean_runs && !run_modified) {
+            /* Pages that may have lost their content since (unpopulated,
+             * guard or mapping the zero page) are classified below */
+            size_t clean_pages = 0;
+            size_t max_pages = (run_end - curAddr) / page_size;
+            while (clean_pages < max_pages) {
+                char* pageAddr = curAddr + clean_pages * page_size;
+                uint64_t page = pagemap_ranges.entry(pageAddr);
+                if (!(page & (0x1ull << 63)) || (page & (0x1ull << 58)) || pagemap_ranges.isZeroPfn(pageAddr))
+                    break;
+                clean_pages++;
+            }
+
+            if (clean_pages > 0) {
+                /* Copy the flags of the parent savestate, by runs of the
+                 * same flag */
+                char run_flag = Area::NONE;
+                size_t run_count = 0;
+                for (size_t c = 0; c < clean_pages; c++) {
+                    char* pageAddr = curAddr + c * page_size;
+                    char parent_flag = parent_state ? parent_state.getPageFlag(pageAddr) : static_cast<char>(Area::BASE_PAGE);
+
+                    if ((run_count > 0) && (parent_flag != run_flag)) {
+                        state.savePageFlags(run_flag, run_count);
+                        run_count = 0;
+                    }
+
+                    if ((parent_flag == Area::NONE) || (parent_flag == Area::FULL_PAGE) ||
+                        (parent_flag == Area::COMPRESSED_PAGE) || (parent_flag == Area::STORE_PAGE)) {
+                        area_size += state.queuePageSave(pageAddr, nullptr);
+                        pagecount_full++;
+                        continue;
+                    }
+
+                    if (parent_flag == Area::ZERO_PAGE)
+                        pagecount_zero_or_file++;
+                    else
+                        pagecount_base++;
+                    run_flag = parent_flag;
+                    run_count++;
+                }
+                if (run_count > 0)
+                    state.savePageFlags(run_flag, run_count);
+
+                page_i += clean_pages - 1;
+                continue;
+            }
+        }
+
+        if (skip_absent) {
+            size_t absent_pages = pagemap_ranges.absentPages(curAddr, nb_pages - page_i);
+            if (absent_pages > 0) {
+                state.savePageFlags(Area::NO_PAGE, absent_pages);
+                pagecount_unmapped += absent_pages;
+                page_i += absent_pages - 1;
+                continue;
+            }
+        }
+
+        if (check_huge && ((reinterpret_cast<uintptr_t>(curAddr) & (huge_size - 1)) == 0) &&
+            ((nb_pages - page_i) >= huge_pages) && pagemap_ranges.isHuge(curAddr, huge_size) &&
+            Utils::isZeroPages(curAddr, huge_pages)) {
+            state.savePageFlags(Area::ZERO_PAGE, huge_pages);
+            pagecount_zero_or_file += huge_pages;
+            page_i += huge_pages - 1;
+            continue;
+        }
 
         /* Gather the flag for the current pagemap. */
-        uint64_t page = pagemap_cache.entries[pagemap_i];
-        bool soft_dirty = page & (0x1ull << 55);
+        uint64_t page;
+        if (pagemap_ranges.active())
+            page = pagemap_ranges.entry(curAddr);
+        else
+            page = pagemap_cache.entries[loadPagemapWindow(spmfd, pagemap_cache, curAddr, nb_pages - page_i)];
+        bool page_dirty = dirty_ranges.active() ? run_modified : (page & (0x1ull << 55));
         bool page_guard_region = page & (0x1ull << 58);
         bool page_file = page & (0x1ull << 61);
         bool page_present = page & (0x1ull << 63);
 
+        /* Hash of the page for the page store, if computed */
+        uint64_t hash;
+        const uint64_t* page_hash = nullptr;
+
         if (page_guard_region) {
             state.savePageFlag(Area::GUARD_PAGE);
             LOG(LL_DEBUG, LCF_CHECKPOINT, "    Skip saving guard page at %p", curAddr);
@@ -1333,12 +1700,17 @@ static size_t writeAnArea(SaveStateSaving &state, Area &area, int spmfd, Pagemap
                     continue;
                 }
                 
-                /* Check if page is zero */
-                if (Utils::isZeroPage(static_cast<void*>(curAddr))) {
+                /* Check if page is zero, without reading it if it maps
+                 * the shared zero page. The hash for the page store is
+                 * computed while reading the page. */
+                if ((pagemap_ranges.active() && pagemap_ranges.isZeroPfn(curAddr)) ||
+                    (state.storesPages() ? Utils::isZeroPageOrHash(curAddr, &hash) : Utils::isZeroPage(curAddr))) {
                     state.savePageFlag(Area::ZERO_PAGE);
                     pagecount_zero_or_file++;
                     continue;
                 }
+                if (state.storesPages())
+                    page_hash = &hash;
             }
             
             /* Check if page was mapped from file and was not modified since. */
@@ -1422,15 +1794,17 @@ static size_t writeAnArea(SaveStateSaving &state, Area &area, int spmfd, Pagemap
         }
 
         /* Check if page was not modified since last savestate */
-        if (!soft_dirty && (Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL) && !base) {
+        if (!page_dirty && (Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL) && !base) {
             /* Copy the value of the parent savestate if any */
             if (parent_state) {
                 char parent_flag = parent_state.getPageFlag(curAddr);
-                if ((parent_flag == Area::NONE) || (parent_flag == Area::FULL_PAGE) || (parent_flag == Area::COMPRESSED_PAGE)) {
+                if ((parent_flag == Area::NONE) || (parent_flag == Area::FULL_PAGE) ||
+                    (parent_flag == Area::COMPRESSED_PAGE) || (parent_flag == Area::STORE_PAGE)) {
                     /* Parent does not have the page or parent stores the memory page,
-                     * saving the full page. */
+                     * saving the full page. Pages of the page store are shared,
+                     * so this only adds a reference. */
 
-                    area_size += state.queuePageSave(curAddr);
+                    area_size += state.queuePageSave(curAddr, page_hash);
                     pagecount_full++;
                     continue;
                 }
@@ -1452,7 +1826,8 @@ static size_t writeAnArea(SaveStateSaving &state, Area &area, int spmfd, Pagemap
                     if (Global::shared_config.logging_level >= LL_DEBUG) {
                         char base_flag = base_state.getPageFlag(curAddr);
                         
-                        if ((base_flag != Area::FULL_PAGE) && (base_flag != Area::COMPRESSED_PAGE)) {
+                        if ((base_flag != Area::FULL_PAGE) && (base_flag != Area::COMPRESSED_PAGE) &&
+                            (base_flag != Area::STORE_PAGE)) {
                             LOG(LL_WARN, LCF_CHECKPOINT, "     No base page for %p, this should not happen!", curAddr);
                         }
 
@@ -1469,7 +1844,7 @@ static size_t writeAnArea(SaveStateSaving &state, Area &area, int spmfd, Pagemap
             }
         }
         else {
-            area_size += state.queuePageSave(curAddr);
+            area_size += state.queuePageSave(curAddr, page_hash);
             pagecount_full++;
         }
     }
@@ -1509,4 +1884,198 @@ static size_t writeAnArea(SaveStateSaving &state, Area &area, int spmfd, Pagemap
     return area_size;
 }
 
+/* Split the pages of an area into chunks that are processed by worker
+ * threads. Returns the size of the chunks that had to be written to make room
+ * for the new ones. */
+static size_t queueAnArea(SaveStateSaving &state, Area &area, int spmfd, ChunkQueue &queue)
+{
+    if (Global::shared_config.savestate_settings & SharedConfig::SS_PRESENT)
+        area.uncommitted = area.isUncommitted(spmfd);
+    else
+        area.uncommitted = false;
+
+    size_t page_size = Utils::getPageSize();
+    size_t nb_pages = (area.skip || area.uncommitted) ? 0 : (area.size / page_size);
+    size_t chunk_pages = SaveStateWorkers::CHUNK_SIZE / page_size;
+
+    size_t written_size = 0;
+    size_t page_i = 0;
+
+    /* Push at least one chunk, even for areas without pages, so that the area
+     * metadata is written in order */
+    do {
+        if ((queue.pushed - queue.written) >= queue.max_pending)
+            written_size += writeNextChunk(state, queue);
+
+        SaveStateWorkers::Chunk* chunk = SaveStateWorkers::getChunk(queue.pushed++);
+        chunk->area = area;
+        chunk->first = (page_i == 0);
+        chunk->addr = static_cast<char*>(area.addr) + page_i * page_size;
+        chunk->nb_pages = static_cast<int>((nb_pages - page_i) < chunk_pages ? (nb_pages - page_i) : chunk_pages);
+        page_i += chunk->nb_pages;
+        chunk->last = (page_i >= nb_pages);
+        chunk->spmfd = spmfd;
+        chunk->codec = state.codec();
+        chunk->codec_level = state.codecLevel();
+        chunk->run = SaveStateWorkers::saveChunk;
+
+        SaveStateWorkers::push(chunk);
+    } while (page_i < nb_pages);
+
+    return written_size;
+}
+
+/* Wait for the oldest chunk to be processed and write it. Returns the number
+ * of written bytes */
+static size_t writeNextChunk(SaveStateSaving &state, ChunkQueue &queue)
+{
+    SaveStateWorkers::Chunk* chunk = SaveStateWorkers::getChunk(queue.written++);
+    SaveStateWorkers::wait(chunk);
+
+    Area& area = chunk->area;
+    size_t size = 0;
+
+    if (chunk->first) {
+        state.processArea(&area);
+        size += sizeof(area);
+
+        if (!area.skip && !area.uncommitted)
+            area.print("Save");
+
+        queue.pagecount_unmapped = 0;
+        queue.pagecount_zero_or_file = 0;
+        queue.pagecount_full = 0;
+        queue.area_size = 0;
+    }
+
+    size += state.saveEncodedPages(chunk->flags, chunk->nb_pages, chunk->data, chunk->data_size);
+
+    /* Add the number of page flags to the total size */
+    size += chunk->nb_pages;
+
+    queue.pagecount_unmapped += chunk->pagecount_unmapped;
+    queue.pagecount_zero_or_file += chunk->pagecount_zero_or_file;
+    queue.pagecount_full += chunk->pagecount_full;
+    queue.area_size += size;
+
+    if (chunk->last && !area.skip && !area.uncommitted) {
+        size += state.finishSave();
+
+        if (!(area.prot & PROT_READ)) {
+            MYASSERT(mprotect(area.addr, area.size, area.prot) == 0)
+        }
+
+        if (Global::shared_config.savestate_settings & SharedConfig::SS_PRESENT) {
+            LOG(LL_DEBUG, LCF_CHECKPOINT, "    Pagecount full: %d, zero/file: %d, unmapped: %d. Size %zu", queue.pagecount_full, queue.pagecount_zero_or_file, queue.pagecount_unmapped, queue.area_size);
+        }
+        else {
+            LOG(LL_DEBUG, LCF_CHECKPOINT, "    Pagecount full: %d, zero/file: %d. Size %zu", queue.pagecount_full, queue.pagecount_zero_or_file, queue.area_size);
+        }
+    }
+
+    return size;
+}
+
+/* Write all remaining chunks. Returns the number of written bytes */
+static size_t writeAllChunks(SaveStateSaving &state, ChunkQueue &queue)
+{
+    size_t size = 0;
+    while (queue.written < queue.pushed)
+        size += writeNextChunk(state, queue);
+    return size;
+}
+
+/* Add a page to be loaded by a worker thread */
+static void queuePageLoad(LoadQueue &queue, char* addr, char flag, const char* data)
+{
+    if (!queue.current) {
+        /* Make sure that the chunk we are about to fill was processed */
+        while ((queue.pushed - queue.waited) >= queue.max_pending) {
+            TimeHolder old_time = TimeHolder::now();
+            SaveStateWorkers::Chunk* chunk = SaveStateWorkers::getChunk(queue.waited++);
+            SaveStateWorkers::wait(chunk);
+            queue.errors += chunk->errors;
+            queue.wait_time += TimeHolder::now() - old_time;
+        }
+
+        queue.current = SaveStateWorkers::getChunk(queue.pushed);
+        queue.current->run = SaveStateWorkers::loadChunk;
+        queue.current->codec = queue.codec;
+        queue.current->nb_pages = 0;
+    }
+
+    SaveStateWorkers::Chunk* chunk = queue.current;
+    chunk->page_addr[chunk->nb_pages] = addr;
+    chunk->page_src[chunk->nb_pages] = data;
+    chunk->flags[chunk->nb_pages] = flag;
+    chunk->nb_pages++;
+
+    if (static_cast<size_t>(chunk->nb_pages) >= SaveStateWorkers::CHUNK_SIZE / Utils::getPageSize())
+        pushLoadChunk(queue);
+}
+
+/* Send the chunk being filled to worker threads */
+static void pushLoadChunk(LoadQueue &queue)
+{
+    if (!queue.current)
+        return;
+
+    SaveStateWorkers::push(queue.current);
+    queue.pushed++;
+    queue.current = nullptr;
+}
+
+/* Wait for all pages to be loaded */
+static void waitAllLoadChunks(LoadQueue &queue)
+{
+    pushLoadChunk(queue);
+
+    TimeHolder old_time = TimeHolder::now();
+    while (queue.waited < queue.pushed) {
+        SaveStateWorkers::Chunk* chunk = SaveStateWorkers::getChunk(queue.waited++);
+        SaveStateWorkers::wait(chunk);
+        queue.errors += chunk->errors;
+    }
+    queue.wait_time += TimeHolder::now() - old_time;
+}
+
+/* Returns if a savestate references pages of the current page store */
+static bool usesPageStore(const char* pagemappath)
+{
+    if (PageStore::id() == 0)
+        return false;
+
+    int pmfd = open(pagemappath, O_RDONLY);
+    if (pmfd == -1)
+        return false;
+
+    StateHeader sh;
+    ssize_t ret = Utils::readAll(pmfd, &sh, sizeof(sh));
+    close(pmfd);
+
+    return (ret == sizeof(sh)) && (sh.flags & StateHeader::SH_PAGE_STORE) &&
+           (sh.store_id == PageStore::id());
+}
+
+/* Remove all references of a savestate to pages of the page store */
+static void releaseStorePages(SaveStateLoading &state)
+{
+    int pagecount = 0;
+    state.restart();
+    const Area& area = state.getArea();
+    while (area.isStandard()) {
+        if (!area.skip && !area.uncommitted) {
+            size_t nb_pages = area.size / Utils::getPageSize();
+            for (size_t page_i = 0; page_i < nb_pages; page_i++) {
+                if (state.getNextPageFlag() == Area::STORE_PAGE) {
+                    PageStore::release(state.storeIndex());
+                    pagecount++;
+                }
+            }
+        }
+        state.nextArea();
+    }
+    LOG(LL_DEBUG, LCF_CHECKPOINT, "Released %d pages from the page store", pagecount);
+}
+
 }
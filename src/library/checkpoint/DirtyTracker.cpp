@@ -0,0 +1,270 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "DirtyTracker.h"
+#include "PagemapScan.h"
+#include "MemArea.h"
+#include "ProcSelfMaps.h"
+#include "ReservedMemory.h"
+
+#include "Utils.h"
+#include "logging.h"
+#include "global.h"
+#include "fileio/FileDescriptorManip.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/userfaultfd.h>
+
+/* Definitions from recent kernel headers (6.7), which may not be available */
+#ifndef UFFD_USER_MODE_ONLY
+#define UFFD_USER_MODE_ONLY 1
+#endif
+#ifndef UFFD_FEATURE_WP_UNPOPULATED
+#define UFFD_FEATURE_WP_UNPOPULATED (1<<13)
+#endif
+#ifndef UFFD_FEATURE_WP_ASYNC
+#define UFFD_FEATURE_WP_ASYNC (1<<15)
+#endif
+
+namespace libtas {
+
+/* State of the tracker, stored in reserved memory to survive state loading */
+struct DirtyState {
+    /* Process that created the file descriptors. Registrations are not
+     * inherited by a forked process, and /proc/self/pagemap would still
+     * refer to the parent. */
+    pid_t pid;
+    int uffd;
+    int spmfd;
+
+    /* Set if the kernel does not support the tracker */
+    bool failed;
+};
+
+static_assert(sizeof(DirtyState) <= ReservedMemory::DIRTY_SIZE, "Reserved memory for dirty tracking is too small");
+
+static DirtyState* getState()
+{
+    return static_cast<DirtyState*>(ReservedMemory::getAddr(ReservedMemory::DIRTY_ADDR));
+}
+
+/* Move a file descriptor above the range of file descriptors that are synced
+ * or reserved when loading a state, so that it survives the loading */
+static int moveFd(int fd)
+{
+    if (fd < 0)
+        return fd;
+
+    int newfd = fcntl(fd, F_DUPFD_CLOEXEC, FileDescriptorManip::reserveState() + 16);
+    close(fd);
+    return newfd;
+}
+
+/* Only pages of private anonymous mappings can be write-protected */
+static bool isTracked(const Area& area)
+{
+    return !area.skip && (area.flags & Area::AREA_ANON) && (area.flags & Area::AREA_PRIV);
+}
+
+static bool init(DirtyState* state)
+{
+    int uffd = syscall(SYS_userfaultfd, O_CLOEXEC | O_NONBLOCK | UFFD_USER_MODE_ONLY);
+    if (uffd == -1) {
+        LOG(LL_WARN, LCF_CHECKPOINT, "Could not create userfaultfd: %s", strerror(errno));
+        return false;
+    }
+
+    /* Written pages are marked by the kernel without generating any event */
+    struct uffdio_api api;
+    api.api = UFFD_API;
+    api.features = UFFD_FEATURE_WP_ASYNC | UFFD_FEATURE_WP_UNPOPULATED;
+    api.ioctls = 0;
+    if (ioctl(uffd, UFFDIO_API, &api) == -1) {
+        LOG(LL_WARN, LCF_CHECKPOINT, "Asynchronous write-protect is not supported: %s", strerror(errno));
+        close(uffd);
+        return false;
+    }
+
+    int spmfd = open("/proc/self/pagemap", O_RDONLY | O_CLOEXEC);
+    if (spmfd == -1) {
+        close(uffd);
+        return false;
+    }
+
+    /* Check that the PAGEMAP_SCAN ioctl is supported, using an empty range */
+    PagemapScanArg arg = {};
+    arg.size = sizeof(arg);
+    if (ioctl(spmfd, LIBTAS_PAGEMAP_SCAN, &arg) == -1) {
+        LOG(LL_WARN, LCF_CHECKPOINT, "PAGEMAP_SCAN is not supported: %s", strerror(errno));
+        close(uffd);
+        close(spmfd);
+        return false;
+    }
+
+    state->pid = getpid();
+    state->uffd = moveFd(uffd);
+    state->spmfd = moveFd(spmfd);
+    return (state->uffd != -1) && (state->spmfd != -1);
+}
+
+bool DirtyTracker::enabled()
+{
+    if (!(Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL) ||
+        !(Global::shared_config.savestate_settings & SharedConfig::SS_WRITEPROTECT))
+        return false;
+
+    DirtyState* state = getState();
+    if (state->uffd > 0)
+        return state->pid == getpid();
+
+    if (state->failed)
+        return false;
+
+    if (!init(state)) {
+        LOG(LL_WARN, LCF_CHECKPOINT, "Falling back to soft-dirty bits for incremental savestates");
+        state->failed = true;
+        return false;
+    }
+
+    return true;
+}
+
+void DirtyTracker::reset()
+{
+    DirtyState* state = getState();
+
+    /* Register new areas. Registering an area that is already registered
+     * has no effect */
+    ProcSelfMaps memMapLayout;
+    Area area;
+    uint64_t start = UINT64_MAX;
+    uint64_t end = 0;
+    while (memMapLayout.getNextArea(&area)) {
+        if (!isTracked(area))
+            continue;
+
+        struct uffdio_register reg;
+        reg.range.start = reinterpret_cast<uint64_t>(area.addr);
+        reg.range.len = area.size;
+        reg.mode = UFFDIO_REGISTER_MODE_WP;
+        if (ioctl(state->uffd, UFFDIO_REGISTER, &reg) == -1) {
+            LOG(LL_DEBUG, LCF_CHECKPOINT, "Could not track area at %p: %s", area.addr, strerror(errno));
+            continue;
+        }
+
+        if (reg.range.start < start)
+            start = reg.range.start;
+        if (reg.range.start + reg.range.len > end)
+            end = reg.range.start + reg.range.len;
+    }
+
+    if (end == 0)
+        return;
+
+    /* Protect all written pages of registered areas in a single call. Pages
+     * of newly registered areas are all considered written. */
+    PagemapScanArg arg = {};
+    arg.size = sizeof(arg);
+    arg.flags = PM_SCAN_WP_MATCHING;
+    arg.start = start;
+    arg.end = end;
+    arg.category_mask = PAGE_IS_WPALLOWED | PAGE_IS_WRITTEN;
+    if (ioctl(state->spmfd, LIBTAS_PAGEMAP_SCAN, &arg) == -1) {
+        LOG(LL_ERROR, LCF_CHECKPOINT, "Could not write-protect pages: %s", strerror(errno));
+    }
+}
+
+DirtyRanges::DirtyRanges(const Area& area) : count(0), current(0)
+{
+    is_active = DirtyTracker::enabled();
+    walk_end = reinterpret_cast<uint64_t>(area.addr);
+    area_end = walk_end + area.size;
+
+    if (is_active && !isTracked(area)) {
+        /* The whole area is considered modified */
+        ranges[0].start = walk_end;
+        ranges[0].end = area_end;
+        count = 1;
+        walk_end = area_end;
+    }
+}
+
+void DirtyRanges::fetch()
+{
+    /* Return pages that were written, or that are not inside a registered
+     * area (new areas since the last reset) */
+    PagemapScanArg arg = {};
+    arg.size = sizeof(arg);
+    arg.start = walk_end;
+    arg.end = area_end;
+    arg.vec = reinterpret_cast<uint64_t>(ranges);
+    arg.vec_len = MAX_RANGES;
+    arg.category_inverted = PAGE_IS_WPALLOWED;
+    arg.category_anyof_mask = PAGE_IS_WPALLOWED | PAGE_IS_WRITTEN;
+    arg.return_mask = PAGE_IS_WRITTEN;
+
+    current = 0;
+    int ret = ioctl(getState()->spmfd, LIBTAS_PAGEMAP_SCAN, &arg);
+    if ((ret == -1) || (arg.walk_end <= walk_end)) {
+        LOG(LL_ERROR, LCF_CHECKPOINT, "Could not query written pages: %s", strerror(errno));
+
+        /* Consider all remaining pages as modified */
+        ranges[0].start = walk_end;
+        ranges[0].end = area_end;
+        count = 1;
+        walk_end = area_end;
+        return;
+    }
+
+    count = ret;
+    walk_end = arg.walk_end;
+}
+
+size_t DirtyRanges::runPages(const char* addr, size_t max_pages, bool* modified)
+{
+    uint64_t a = reinterpret_cast<uint64_t>(addr);
+    uint64_t end = a + max_pages * Utils::getPageSize();
+
+    while (true) {
+        while ((current < count) && (ranges[current].end <= a))
+            current++;
+
+        if (current < count) {
+            *modified = ranges[current].start <= a;
+            uint64_t run_end = *modified ? ranges[current].end : ranges[current].start;
+            if (run_end > end)
+                run_end = end;
+            return (run_end - a) / Utils::getPageSize();
+        }
+
+        /* No modified page up to where the last query stopped */
+        if ((walk_end >= end) || (walk_end >= area_end)) {
+            *modified = false;
+            return max_pages;
+        }
+
+        fetch();
+    }
+}
+
+}
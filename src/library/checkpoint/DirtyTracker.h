@@ -0,0 +1,91 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_DIRTYTRACKER_H
+#define LIBTAS_DIRTYTRACKER_H
+
+#include "PagemapScan.h"
+
+#include <cstdint>
+#include <cstddef>
+
+namespace libtas {
+
+struct Area;
+
+/* Tracking of memory pages modified since the last savestate was saved or
+ * loaded, used by incremental savestates.
+ *
+ * By default, the soft-dirty bit of each page is read from /proc/self/pagemap,
+ * and all bits are cleared by writing to /proc/self/clear_refs, which walks
+ * the whole address space.
+ *
+ * When enabled, pages of private anonymous mappings are instead registered to
+ * a userfaultfd in asynchronous write-protect mode, so that the kernel marks
+ * written pages without any fault handling. The PAGEMAP_SCAN ioctl then
+ * returns the list of written ranges of an area in one call, and protects
+ * them again. Pages of other mappings are always considered modified. */
+namespace DirtyTracker {
+
+    /* Returns if pages are tracked using userfaultfd instead of soft-dirty
+     * bits. Creates the userfaultfd the first time, and falls back to
+     * soft-dirty bits if the kernel does not support it */
+    bool enabled();
+
+    /* Start tracking all eligible areas and mark all pages as not modified.
+     * Must be called after a savestate was saved or loaded */
+    void reset();
+}
+
+/* List of modified ranges of a memory area, built at construction */
+class DirtyRanges
+{
+    public:
+        /* Query the modified ranges of an area, if the tracker is enabled */
+        explicit DirtyRanges(const Area& area);
+
+        /* Returns if ranges were queried, otherwise soft-dirty bits must be used */
+        bool active() const {return is_active;}
+
+        /* Returns the number of consecutive pages starting at `addr`, up to
+         * `max_pages`, that were all modified or all not modified, which is
+         * stored in `modified`. Addresses must be increasing between calls */
+        size_t runPages(const char* addr, size_t max_pages, bool* modified);
+
+    private:
+        /* Fetch the next ranges of the area */
+        void fetch();
+
+        enum {
+            MAX_RANGES = 512,
+        };
+
+        PagemapRegion ranges[MAX_RANGES];
+        int count;
+        int current;
+
+        /* Address where the last query stopped, and end of the area */
+        uint64_t walk_end;
+        uint64_t area_end;
+
+        bool is_active;
+};
+}
+
+#endif
@@ -23,6 +23,7 @@
 #include "ReservedMemory.h"
 
 #include "fileio/FileHandleList.h"
+#include "../shared/sockethelpers.h"
 #include "logging.h"
 #include "Utils.h"
 
@@ -104,6 +105,11 @@ bool Area::isSkipped() const
         return true;
     }
 
+    /* Don't save the ring buffers shared with the program */
+    if (isSocketSharedMemory(addr)) {
+        return true;
+    }
+
     /* Don't save area that cannot be promoted to read/write */
     if ((max_prot & (PROT_WRITE|PROT_READ)) != (PROT_WRITE|PROT_READ)) {
         return true;
@@ -44,6 +44,7 @@ struct Area {
         COMPRESSED_PAGE, /* Full page but compressed */
         FILE_PAGE, /* Page is identical to the original mapped file */
         GUARD_PAGE, /* A page causing a fatal signal on access, without a VMA backing it */
+        STORE_PAGE, /* Page is inside the page store, only its index is saved */
     };
 
     void* addr;
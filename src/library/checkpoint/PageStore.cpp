@@ -0,0 +1,324 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PageStore.h"
+#include "ReservedMemory.h"
+
+#include "Utils.h"
+#include "logging.h"
+#include "global.h"
+#include "fileio/FileDescriptorManip.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+namespace libtas {
+
+enum {
+    /* Number of entries of the hash table, must be a power of two */
+    STORE_CAPACITY = 1 << 22,
+
+    /* Maximum number of pages in the store. Keeping the table half empty
+     * keeps probe sequences short */
+    STORE_MAX_PAGES = STORE_CAPACITY / 2,
+
+    /* Number of parts of the hash table, each one protected by its own lock
+     * so that savestate workers can insert pages in parallel. Must be a power
+     * of two */
+    STORE_STRIPES = 64,
+    STORE_STRIPE_CAPACITY = STORE_CAPACITY / STORE_STRIPES,
+
+    /* Maximum number of entries looked at when searching for a page. Probing
+     * stays inside the stripe of the page */
+    STORE_MAX_PROBES = 64,
+
+    /* Largest supported page size */
+    STORE_MAX_PAGE_SIZE = 1 << 16,
+
+    /* Values of the page field of an entry, other values are page numbers + 1 */
+    ENTRY_EMPTY = 0,
+    ENTRY_REMOVED = 0xffffffff,
+};
+
+struct StoreEntry {
+    uint64_t hash;
+    uint32_t refcount;
+    uint32_t page;
+};
+
+/* Lock of a range of hash table entries, with the buffer used to compare a
+ * stored page with a new page with the same hash */
+struct StoreStripe {
+    alignas(64) std::atomic_flag lock;
+    alignas(64) char compare_page[STORE_MAX_PAGE_SIZE];
+};
+
+/* Everything is stored inside the reserved memory, which is zero until used */
+struct StoreTable {
+    int fd;
+    uint64_t id;
+
+    /* Protects the allocation of pages inside the store file */
+    alignas(64) std::atomic_flag pages_lock;
+
+    /* Number of allocated pages inside the store file */
+    uint32_t nb_pages;
+
+    /* List of page numbers that can be reused */
+    uint32_t nb_free;
+    uint32_t free_pages[STORE_MAX_PAGES];
+
+    StoreEntry entries[STORE_CAPACITY];
+
+    StoreStripe stripes[STORE_STRIPES];
+};
+
+static_assert(sizeof(StoreTable) <= ReservedMemory::PAGESTORE_SIZE, "Reserved memory for the page store is too small");
+
+static StoreTable* getTable()
+{
+    return static_cast<StoreTable*>(ReservedMemory::getAddr(ReservedMemory::PAGESTORE_ADDR));
+}
+
+static void lock(std::atomic_flag& flag)
+{
+    while (flag.test_and_set(std::memory_order_acquire)) {}
+}
+
+static void unlock(std::atomic_flag& flag)
+{
+    flag.clear(std::memory_order_release);
+}
+
+static StoreStripe& getStripe(StoreTable* table, uint32_t index)
+{
+    return table->stripes[index / STORE_STRIPE_CAPACITY];
+}
+
+/* Get a free page number inside the store file. Returns false if full */
+static bool allocatePage(StoreTable* table, uint32_t& page_number)
+{
+    bool success = true;
+    lock(table->pages_lock);
+    if (table->nb_free > 0)
+        page_number = table->free_pages[--table->nb_free];
+    else if (table->nb_pages < STORE_MAX_PAGES)
+        page_number = table->nb_pages++;
+    else
+        success = false;
+    unlock(table->pages_lock);
+    return success;
+}
+
+static void freePage(StoreTable* table, uint32_t page_number)
+{
+    lock(table->pages_lock);
+    table->free_pages[table->nb_free++] = page_number;
+    unlock(table->pages_lock);
+}
+
+bool PageStore::enabled()
+{
+    /* A forked process cannot update the table of its parent */
+    return (Global::shared_config.savestate_settings & SharedConfig::SS_DEDUP) &&
+           !(Global::shared_config.savestate_settings & SharedConfig::SS_FORK);
+}
+
+bool PageStore::init(const char* path)
+{
+    StoreTable* table = getTable();
+    if (table->fd > 0)
+        return true;
+
+    if (Utils::getPageSize() > STORE_MAX_PAGE_SIZE)
+        return false;
+
+    int fd;
+    if (Global::shared_config.savestate_settings & SharedConfig::SS_MEMORY) {
+        fd = syscall(SYS_memfd_create, "libtas_pagestore", MFD_CLOEXEC);
+    }
+    else {
+        /* Create the store next to the savestates, and unlink it right away
+         * so that it is removed when the game exits */
+        char storepath[1024];
+        const char* sep = strrchr(path, '/');
+        int dirlen = sep ? static_cast<int>(sep - path) : 1;
+        snprintf(storepath, sizeof(storepath), "%.*s/.libtas_pagestore_%d", dirlen, sep ? path : ".", getpid());
+
+        fd = ::open(storepath, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+        if (fd != -1)
+            unlink(storepath);
+    }
+
+    if (fd == -1) {
+        LOG(LL_WARN, LCF_CHECKPOINT, "Could not create the page store: %s", strerror(errno));
+        return false;
+    }
+
+    /* Keep the file descriptor out of the range synced when loading a state */
+    int newfd = fcntl(fd, F_DUPFD_CLOEXEC, FileDescriptorManip::reserveState() + 16);
+    close(fd);
+    if (newfd == -1)
+        return false;
+
+    struct stat sb;
+    fstat(newfd, &sb);
+
+    table->fd = newfd;
+    table->id = (static_cast<uint64_t>(getpid()) << 32) ^ static_cast<uint64_t>(sb.st_ino);
+    return true;
+}
+
+uint64_t PageStore::id()
+{
+    StoreTable* table = getTable();
+    return (table->fd > 0) ? table->id : 0;
+}
+
+int64_t PageStore::insert(const char* page)
+{
+    return insert(page, Utils::hashPage(page));
+}
+
+int64_t PageStore::insert(const char* page, uint64_t hash)
+{
+    StoreTable* table = getTable();
+    if (table->fd <= 0)
+        return -1;
+
+    size_t page_size = Utils::getPageSize();
+
+    uint32_t index = static_cast<uint32_t>(hash) & (STORE_CAPACITY - 1);
+    uint32_t stripe_base = index & ~static_cast<uint32_t>(STORE_STRIPE_CAPACITY - 1);
+    StoreStripe& stripe = getStripe(table, index);
+
+    lock(stripe.lock);
+
+    int64_t removed = -1;
+    unsigned int probe;
+    for (probe = 0; probe < STORE_MAX_PROBES; probe++, index = stripe_base + ((index + 1) & (STORE_STRIPE_CAPACITY - 1))) {
+        StoreEntry& entry = table->entries[index];
+        if (entry.page == ENTRY_EMPTY)
+            break;
+        if (entry.page == ENTRY_REMOVED) {
+            if (removed == -1)
+                removed = index;
+            continue;
+        }
+        if (entry.hash == hash) {
+            /* Compare the content, in case of a hash collision */
+            off_t offset = static_cast<off_t>(entry.page - 1) * page_size;
+            if ((pread(table->fd, stripe.compare_page, page_size, offset) != static_cast<ssize_t>(page_size)) ||
+                !Utils::isEqualPage(page, stripe.compare_page))
+                continue;
+
+            entry.refcount++;
+            unlock(stripe.lock);
+            return index;
+        }
+    }
+
+    if (removed != -1)
+        index = static_cast<uint32_t>(removed);
+    else if (probe == STORE_MAX_PROBES) {
+        unlock(stripe.lock);
+        return -1;
+    }
+
+    uint32_t page_number;
+    if (!allocatePage(table, page_number)) {
+        unlock(stripe.lock);
+        return -1;
+    }
+
+    /* The page is written while holding the stripe lock, so that other
+     * threads never reference a page that is not stored yet */
+    off_t offset = static_cast<off_t>(page_number) * page_size;
+    if (pwrite(table->fd, page, page_size, offset) != static_cast<ssize_t>(page_size)) {
+        freePage(table, page_number);
+        unlock(stripe.lock);
+        return -1;
+    }
+
+    StoreEntry& entry = table->entries[index];
+    entry.hash = hash;
+    entry.refcount = 1;
+    entry.page = page_number + 1;
+
+    unlock(stripe.lock);
+    return index;
+}
+
+void PageStore::release(uint32_t index)
+{
+    StoreTable* table = getTable();
+    if (table->fd <= 0 || index >= STORE_CAPACITY)
+        return;
+
+    StoreStripe& stripe = getStripe(table, index);
+    lock(stripe.lock);
+
+    StoreEntry& entry = table->entries[index];
+    if (entry.page == ENTRY_EMPTY || entry.page == ENTRY_REMOVED || entry.refcount == 0) {
+        unlock(stripe.lock);
+        LOG(LL_WARN, LCF_CHECKPOINT, "Releasing page %u which is not in the page store", index);
+        return;
+    }
+
+    if (--entry.refcount == 0) {
+        uint32_t page_number = entry.page - 1;
+        entry.page = ENTRY_REMOVED;
+
+        /* Give the space back to the filesystem before the page can be
+         * reused by another thread */
+        size_t page_size = Utils::getPageSize();
+        fallocate(table->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+            static_cast<off_t>(page_number) * page_size, page_size);
+        freePage(table, page_number);
+    }
+
+    unlock(stripe.lock);
+}
+
+bool PageStore::load(uint32_t index, char* addr)
+{
+    StoreTable* table = getTable();
+    if (table->fd <= 0 || index >= STORE_CAPACITY)
+        return false;
+
+    const StoreEntry& entry = table->entries[index];
+    if (entry.page == ENTRY_EMPTY || entry.page == ENTRY_REMOVED)
+        return false;
+
+    size_t page_size = Utils::getPageSize();
+    off_t offset = static_cast<off_t>(entry.page - 1) * page_size;
+    return pread(table->fd, addr, page_size, offset) == static_cast<ssize_t>(page_size);
+}
+
+}
@@ -0,0 +1,69 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_PAGESTORE_H
+#define LIBTAS_PAGESTORE_H
+
+#include <cstdint>
+
+namespace libtas {
+
+/* Store of memory pages shared by all savestates, so that a page which is
+ * identical in several savestates is only stored once.
+ *
+ * Pages are identified by a hash of their content, confirmed by comparing
+ * with the stored page, and are referenced from savestates by their index in
+ * a hash table. Each entry holds the number of savestates referencing it, and
+ * the page is removed from the store when it drops to zero.
+ *
+ * The hash table is stored inside ReservedMemory, and the page content inside
+ * an unlinked file (or a memory file for memory savestates) whose file
+ * descriptor is kept above the range synced when loading a state, so that the
+ * store survives state loading. */
+namespace PageStore {
+
+    /* Returns if new savestates must store pages inside the store */
+    bool enabled();
+
+    /* Create the store if needed, inside the directory of the given path.
+     * Returns if the store is available */
+    bool init(const char* path);
+
+    /* Returns an identifier of the store, which is saved in savestates to
+     * check that they reference the current store. 0 if no store */
+    uint64_t id();
+
+    /* Add a page to the store, or add a reference to an identical page.
+     * Returns the index of the page, or -1 if the page could not be stored.
+     * Can be called from several threads */
+    int64_t insert(const char* page);
+
+    /* Same as above, with the hash of the page already computed by
+     * Utils::hashPage() */
+    int64_t insert(const char* page, uint64_t hash);
+
+    /* Remove a reference to the page at the given index */
+    void release(uint32_t index);
+
+    /* Copy the page at the given index. Returns if succeeded */
+    bool load(uint32_t index, char* addr);
+}
+}
+
+#endif
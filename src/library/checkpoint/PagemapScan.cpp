@@ -0,0 +1,179 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PagemapScan.h"
+#include "MemArea.h"
+
+#include "Utils.h"
+#include "logging.h"
+
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+namespace libtas {
+
+/* Support of the ioctl by the kernel, which is the same for all states of
+ * the process */
+enum ScanSupport {
+    SCAN_UNKNOWN,
+    SCAN_SUPPORTED,
+    SCAN_NO_GUARD, /* Kernel does not know about guard regions */
+    SCAN_UNSUPPORTED,
+};
+
+static ScanSupport scan_support = SCAN_UNKNOWN;
+
+PagemapRanges::PagemapRanges(int fd, const Area& area, bool dirty) : count(0), current(0), spmfd(fd), failed(false)
+{
+    walk_end = reinterpret_cast<uint64_t>(area.addr);
+    area_end = walk_end + area.size;
+
+    /* Pages not returned by the kernel have an empty pagemap entry */
+    categories = PAGE_IS_PRESENT | PAGE_IS_SWAPPED;
+    if (dirty)
+        categories |= PAGE_IS_SOFT_DIRTY;
+    if (scan_support != SCAN_NO_GUARD)
+        categories |= PAGE_IS_GUARD;
+
+    is_active = (scan_support != SCAN_UNSUPPORTED) && fetch();
+}
+
+bool PagemapRanges::fetch()
+{
+    PagemapScanArg arg = {};
+    arg.size = sizeof(arg);
+    arg.start = walk_end;
+    arg.end = area_end;
+    arg.vec = reinterpret_cast<uint64_t>(ranges);
+    arg.vec_len = MAX_RANGES;
+    arg.category_anyof_mask = categories;
+    arg.return_mask = categories | PAGE_IS_FILE | PAGE_IS_PFNZERO | PAGE_IS_HUGE;
+
+    current = 0;
+    count = 0;
+    int ret = ioctl(spmfd, LIBTAS_PAGEMAP_SCAN, &arg);
+
+    if ((ret == -1) && (errno == EINVAL) && (categories & PAGE_IS_GUARD) && (scan_support == SCAN_UNKNOWN)) {
+        /* Kernels before 6.14 reject the guard category, but they also
+         * don't report guard regions in pagemap entries */
+        categories &= ~static_cast<uint64_t>(PAGE_IS_GUARD);
+        arg.category_anyof_mask = categories;
+        arg.return_mask = categories | PAGE_IS_FILE | PAGE_IS_PFNZERO | PAGE_IS_HUGE;
+        ret = ioctl(spmfd, LIBTAS_PAGEMAP_SCAN, &arg);
+        if (ret != -1)
+            scan_support = SCAN_NO_GUARD;
+    }
+
+    if (ret == -1) {
+        if (scan_support == SCAN_UNKNOWN) {
+            LOG(LL_DEBUG, LCF_CHECKPOINT, "PAGEMAP_SCAN is not supported, reading pagemap entries instead");
+            scan_support = SCAN_UNSUPPORTED;
+        }
+        else {
+            LOG(LL_ERROR, LCF_CHECKPOINT, "Could not scan pages at %p: %s", reinterpret_cast<void*>(walk_end), strerror(errno));
+        }
+        failed = true;
+        return false;
+    }
+
+    if (scan_support == SCAN_UNKNOWN)
+        scan_support = SCAN_SUPPORTED;
+
+    count = ret;
+    walk_end = arg.walk_end;
+    return true;
+}
+
+const PagemapRegion* PagemapRanges::find(uint64_t addr)
+{
+    while (true) {
+        while ((current < count) && (ranges[current].end <= addr))
+            current++;
+
+        if (current < count)
+            return &ranges[current];
+
+        if ((walk_end >= area_end) || failed || !fetch())
+            return nullptr;
+    }
+}
+
+uint64_t PagemapRanges::entry(const char* addr)
+{
+    uint64_t a = reinterpret_cast<uint64_t>(addr);
+    const PagemapRegion* region = find(a);
+
+    if (region) {
+        uint64_t page = 0;
+        if (region->start <= a) {
+            if (region->categories & PAGE_IS_PRESENT) page |= 0x1ull << 63;
+            if (region->categories & PAGE_IS_FILE) page |= 0x1ull << 61;
+            if (region->categories & PAGE_IS_GUARD) page |= 0x1ull << 58;
+            if (region->categories & PAGE_IS_SOFT_DIRTY) page |= 0x1ull << 55;
+        }
+        return page;
+    }
+
+    if (!failed)
+        return 0;
+
+    /* The scan failed in the middle of the area, read the entry instead */
+    uint64_t page;
+    off_t offset = static_cast<off_t>((a / Utils::getPageSize()) * sizeof(uint64_t));
+    if (pread(spmfd, &page, sizeof(page), offset) != sizeof(page))
+        page = 0;
+    return page;
+}
+
+bool PagemapRanges::isZeroPfn(const char* addr)
+{
+    uint64_t a = reinterpret_cast<uint64_t>(addr);
+    const PagemapRegion* region = find(a);
+    return region && (region->start <= a) && (region->categories & PAGE_IS_PFNZERO);
+}
+
+bool PagemapRanges::isHuge(const char* addr, size_t size)
+{
+    uint64_t a = reinterpret_cast<uint64_t>(addr);
+    const PagemapRegion* region = find(a);
+    return region && (region->start <= a) && (region->end >= a + size) && (region->categories & PAGE_IS_HUGE);
+}
+
+size_t PagemapRanges::absentPages(const char* addr, size_t max_pages)
+{
+    uint64_t a = reinterpret_cast<uint64_t>(addr);
+    const PagemapRegion* region = find(a);
+
+    uint64_t next;
+    if (region)
+        next = region->start;
+    else if (!failed)
+        next = area_end;
+    else
+        return 0;
+
+    if (next <= a)
+        return 0;
+
+    size_t pages = (next - a) / Utils::getPageSize();
+    return (pages < max_pages) ? pages : max_pages;
+}
+
+}
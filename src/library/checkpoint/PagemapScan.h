@@ -0,0 +1,134 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_PAGEMAPSCAN_H
+#define LIBTAS_PAGEMAPSCAN_H
+
+#include <cstdint>
+#include <cstddef>
+#include <sys/ioctl.h>
+
+namespace libtas {
+
+struct Area;
+
+/* Definitions for the PAGEMAP_SCAN ioctl of /proc/self/pagemap (Linux 6.7),
+ * which returns in one call the ranges of pages matching some categories.
+ * They are copied from <linux/fs.h>, which may not be recent enough. */
+struct PagemapScanArg {
+    uint64_t size;
+    uint64_t flags;
+    uint64_t start;
+    uint64_t end;
+    uint64_t walk_end;
+    uint64_t vec;
+    uint64_t vec_len;
+    uint64_t max_pages;
+    uint64_t category_inverted;
+    uint64_t category_mask;
+    uint64_t category_anyof_mask;
+    uint64_t return_mask;
+};
+
+struct PagemapRegion {
+    uint64_t start;
+    uint64_t end;
+    uint64_t categories;
+};
+
+enum PagemapScanFlags {
+    PM_SCAN_WP_MATCHING = 1 << 0,
+};
+
+enum PagemapCategory {
+    PAGE_IS_WPALLOWED = 1 << 0,
+    PAGE_IS_WRITTEN = 1 << 1,
+    PAGE_IS_FILE = 1 << 2,
+    PAGE_IS_PRESENT = 1 << 3,
+    PAGE_IS_SWAPPED = 1 << 4,
+    PAGE_IS_PFNZERO = 1 << 5,
+    PAGE_IS_HUGE = 1 << 6,
+    PAGE_IS_SOFT_DIRTY = 1 << 7,
+    PAGE_IS_GUARD = 1 << 8, /* Linux 6.14 */
+};
+
+#define LIBTAS_PAGEMAP_SCAN _IOWR('f', 16, PagemapScanArg)
+
+/* Classification of the pages of an area using PAGEMAP_SCAN, as an
+ * alternative to reading the 64-bit pagemap entry of each page.
+ *
+ * Only ranges of pages that are present, swapped, guard or soft-dirty are
+ * returned by the kernel, so that large runs of unpopulated pages are
+ * skipped in bulk. If the ioctl is not supported, the object is not active
+ * and pagemap entries must be read instead. */
+class PagemapRanges
+{
+    public:
+        /* Query the ranges of an area. `dirty` indicates if soft-dirty bits
+         * are needed */
+        PagemapRanges(int spmfd, const Area& area, bool dirty);
+
+        bool active() const {return is_active;}
+
+        /* Returns the pagemap entry of the page at `addr`, with the present,
+         * file, guard and soft-dirty bits. Addresses must be increasing
+         * between calls */
+        uint64_t entry(const char* addr);
+
+        /* Returns if the page at `addr` maps the shared zero page */
+        bool isZeroPfn(const char* addr);
+
+        /* Returns if the whole range starting at `addr` is mapped by
+         * transparent huge pages */
+        bool isHuge(const char* addr, size_t size);
+
+        /* Returns the number of consecutive pages starting at `addr`, up to
+         * `max_pages`, that are not populated at all */
+        size_t absentPages(const char* addr, size_t max_pages);
+
+    private:
+        /* Fetch the next ranges of the area. Returns false on error */
+        bool fetch();
+
+        /* Returns the range containing `addr` or the next one, or nullptr */
+        const PagemapRegion* find(uint64_t addr);
+
+        enum {
+            MAX_RANGES = 512,
+        };
+
+        PagemapRegion ranges[MAX_RANGES];
+        int count;
+        int current;
+
+        int spmfd;
+        uint64_t categories;
+
+        /* Address where the last query stopped, and end of the area */
+        uint64_t walk_end;
+        uint64_t area_end;
+
+        /* Set if a query failed after the first one */
+        bool failed;
+
+        bool is_active;
+};
+}
+
+#endif
@@ -28,6 +28,7 @@
 
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/syscall.h>
 #include <sys/mman.h>
 #include <cstring>
 
@@ -39,7 +40,8 @@ ProcSelfMaps::ProcSelfMaps() : off(0)
     int fd;
     NATIVECALL(fd = open("/proc/self/maps", O_RDONLY));
     MYASSERT(fd != -1);
-    NATIVECALL(tmp_fd = open("/tmp/libtas-maps", O_RDWR | O_CREAT | O_TRUNC, 0666));
+    /* Use an anonymous file, so that several games don't share the copy */
+    NATIVECALL(tmp_fd = syscall(SYS_memfd_create, "libtas_maps", MFD_CLOEXEC));
     MYASSERT(tmp_fd != -1);
     
     ssize_t sz = 1;
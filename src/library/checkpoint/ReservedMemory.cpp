@@ -44,12 +44,17 @@ void ReservedMemory::init()
         /* Take the next multiplier of page size */
         restoreLength = Utils::alignUpToPageSize(restoreLength);
         
+        /* Most of the memory is only used with some savestate options, so we
+         * don't reserve swap space for it */
         void* addr = mmap(nullptr, restoreLength + (2 * Utils::getPageSize()), PROT_NONE,
-            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
         MYASSERT(addr != MAP_FAILED)
         restoreAddr = reinterpret_cast<intptr_t>(addr) + Utils::getPageSize();
         MYASSERT(mprotect(reinterpret_cast<void*>(restoreAddr), restoreLength, PROT_READ | PROT_WRITE) == 0)
-        memset(reinterpret_cast<void*>(restoreAddr), 0, restoreLength);
+        /* The sections used by savestate worker threads, the page store and
+         * compression contexts are large and only touched when enabled, so
+         * we don't commit them here */
+        memset(reinterpret_cast<void*>(restoreAddr), 0, WORKERS_ADDR);
     }
 }
 
@@ -36,13 +36,25 @@ namespace ReservedMemory {
         STACK_SIZE = 5 * ONE_MB,
         SS_SLOTS_SIZE = 16*sizeof(bool),
         SH_SIZE = sizeof(StateHeader),
+        SS_TIMINGS_SIZE = 4096,
+        DIRTY_SIZE = 64,
+        MEMSTATES_SIZE = 64 * 1024,
+        WORKERS_SIZE = 19 * ONE_MB,
+        PAGESTORE_SIZE = 105 * ONE_MB,
+        CODEC_SIZE = 6 * ONE_MB,
     };
     enum Addresses {
         COMPRESSED_ADDR = 0,
         STACK_ADDR = COMPRESSED_ADDR + COMPRESSED_SIZE,
         SS_SLOTS_ADDR = STACK_ADDR + STACK_SIZE,
         SH_ADDR = SS_SLOTS_ADDR + SS_SLOTS_SIZE,
-        RESTORE_TOTAL_SIZE = SH_ADDR + SH_SIZE,
+        SS_TIMINGS_ADDR = SH_ADDR + SH_SIZE,
+        DIRTY_ADDR = SS_TIMINGS_ADDR + SS_TIMINGS_SIZE,
+        MEMSTATES_ADDR = DIRTY_ADDR + DIRTY_SIZE,
+        WORKERS_ADDR = MEMSTATES_ADDR + MEMSTATES_SIZE,
+        PAGESTORE_ADDR = WORKERS_ADDR + WORKERS_SIZE,
+        CODEC_ADDR = PAGESTORE_ADDR + PAGESTORE_SIZE,
+        RESTORE_TOTAL_SIZE = CODEC_ADDR + CODEC_SIZE,
     };
 
     void init();
@@ -0,0 +1,242 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SaveStateCodec.h"
+#include "ReservedMemory.h"
+
+#include "Utils.h"
+#include "logging.h"
+#include "global.h"
+#include "GlobalState.h"
+#include "../external/lz4.h"
+
+#include <cstddef>
+#include <dlfcn.h>
+
+namespace libtas {
+
+enum {
+    /* Workspace sizes of each context, checked against the size required
+     * by the libraries when they are loaded */
+    CCTX_SIZE = 512 * 1024,
+    DCTX_SIZE = 128 * 1024,
+};
+
+/* Compression context of one thread, stored inside ReservedMemory */
+struct CodecContext {
+    /* Codec that the compression workspace was last used for */
+    int codec;
+
+    /* zstd contexts built inside the workspaces */
+    void* cctx;
+    void* dctx;
+
+    alignas(64) char cworkspace[CCTX_SIZE];
+    alignas(64) char dworkspace[DCTX_SIZE];
+};
+
+static_assert(SaveStateCodec::NB_CONTEXTS * sizeof(CodecContext) <= ReservedMemory::CODEC_SIZE, "Reserved memory for compression contexts is too small");
+
+static CodecContext* getContext(int context)
+{
+    return static_cast<CodecContext*>(ReservedMemory::getAddr(ReservedMemory::CODEC_ADDR)) + context;
+}
+
+/* Parameters of a zstd compression level, copied from <zstd.h> */
+struct ZstdCParams {
+    unsigned windowLog;
+    unsigned chainLog;
+    unsigned hashLog;
+    unsigned searchLog;
+    unsigned minMatch;
+    unsigned targetLength;
+    int strategy;
+};
+
+/* Functions imported from the libraries. They are loaded at startup, so they
+ * are the same in every state of the process */
+static int (*lz4_sizeofStateHC)(void) = nullptr;
+static int (*lz4_compress_HC_extStateHC)(void*, const char*, char*, int, int, int) = nullptr;
+
+static int (*zstd_minCLevel)(void) = nullptr;
+static int (*zstd_maxCLevel)(void) = nullptr;
+static ZstdCParams (*zstd_getCParams)(int, unsigned long long, size_t) = nullptr;
+static size_t (*zstd_estimateCCtxSize_usingCParams)(ZstdCParams) = nullptr;
+static size_t (*zstd_estimateDCtxSize)(void) = nullptr;
+static void* (*zstd_initStaticCCtx)(void*, size_t) = nullptr;
+static void* (*zstd_initStaticDCtx)(void*, size_t) = nullptr;
+static size_t (*zstd_compressCCtx)(void*, void*, size_t, const void*, size_t, int) = nullptr;
+static size_t (*zstd_decompressDCtx)(void*, void*, size_t, const void*, size_t) = nullptr;
+static unsigned (*zstd_isError)(size_t) = nullptr;
+
+static bool has_lz4hc = false;
+static bool has_zstd = false;
+
+template <typename F>
+static bool importSymbol(void* handle, const char* symbol, F* function)
+{
+    void* addr;
+    NATIVECALL(addr = dlsym(handle, symbol));
+    *function = reinterpret_cast<F>(addr);
+    return addr != nullptr;
+}
+
+void SaveStateCodec::init()
+{
+    void* handle;
+    NATIVECALL(handle = dlopen("liblz4.so.1", RTLD_LAZY | RTLD_LOCAL));
+    if (handle) {
+        has_lz4hc = importSymbol(handle, "LZ4_sizeofStateHC", &lz4_sizeofStateHC) &&
+                    importSymbol(handle, "LZ4_compress_HC_extStateHC", &lz4_compress_HC_extStateHC) &&
+                    (static_cast<size_t>(lz4_sizeofStateHC()) <= CCTX_SIZE);
+    }
+    if (!has_lz4hc)
+        LOG(LL_DEBUG, LCF_CHECKPOINT, "liblz4 could not be loaded, LZ4-HC savestate compression is not available");
+
+    NATIVECALL(handle = dlopen("libzstd.so.1", RTLD_LAZY | RTLD_LOCAL));
+    if (handle) {
+        has_zstd = importSymbol(handle, "ZSTD_minCLevel", &zstd_minCLevel) &&
+                   importSymbol(handle, "ZSTD_maxCLevel", &zstd_maxCLevel) &&
+                   importSymbol(handle, "ZSTD_getCParams", &zstd_getCParams) &&
+                   importSymbol(handle, "ZSTD_estimateCCtxSize_usingCParams", &zstd_estimateCCtxSize_usingCParams) &&
+                   importSymbol(handle, "ZSTD_estimateDCtxSize", &zstd_estimateDCtxSize) &&
+                   importSymbol(handle, "ZSTD_initStaticCCtx", &zstd_initStaticCCtx) &&
+                   importSymbol(handle, "ZSTD_initStaticDCtx", &zstd_initStaticDCtx) &&
+                   importSymbol(handle, "ZSTD_compressCCtx", &zstd_compressCCtx) &&
+                   importSymbol(handle, "ZSTD_decompressDCtx", &zstd_decompressDCtx) &&
+                   importSymbol(handle, "ZSTD_isError", &zstd_isError) &&
+                   (zstd_estimateDCtxSize() <= DCTX_SIZE);
+    }
+    if (!has_zstd)
+        LOG(LL_DEBUG, LCF_CHECKPOINT, "libzstd could not be loaded, zstd savestate compression is not available");
+}
+
+/* Returns if the codec can be used at the given level */
+static bool usable(int codec, int level)
+{
+    switch (codec) {
+        case SharedConfig::SC_LZ4:
+            return true;
+        case SharedConfig::SC_LZ4HC:
+            return has_lz4hc;
+        case SharedConfig::SC_ZSTD:
+            /* Compression tables are sized for a single page */
+            return has_zstd &&
+                   (zstd_estimateCCtxSize_usingCParams(zstd_getCParams(level, Utils::getPageSize(), 0)) <= CCTX_SIZE);
+        default:
+            return false;
+    }
+}
+
+void SaveStateCodec::select(int slot, int* codec, int* level)
+{
+    if ((slot >= 0) && (slot < 32) && (Global::shared_config.savestate_archive_slots & (1 << slot))) {
+        *codec = Global::shared_config.savestate_archive_codec;
+        *level = Global::shared_config.savestate_archive_level;
+    }
+    else {
+        *codec = Global::shared_config.savestate_codec;
+        *level = Global::shared_config.savestate_codec_level;
+    }
+
+    if ((*codec == SharedConfig::SC_ZSTD) && has_zstd) {
+        if (*level < zstd_minCLevel()) *level = zstd_minCLevel();
+        if (*level > zstd_maxCLevel()) *level = zstd_maxCLevel();
+    }
+
+    if (!usable(*codec, *level)) {
+        LOG(LL_WARN, LCF_CHECKPOINT, "Savestate compression %s at level %d is not available, using LZ4 instead", name(*codec), *level);
+        *codec = SharedConfig::SC_LZ4;
+        *level = 1;
+    }
+}
+
+int SaveStateCodec::compress(int context, int codec, int level, const char* src, char* dst, int size, int capacity)
+{
+    CodecContext* ctx = getContext(context);
+
+    switch (codec) {
+        case SharedConfig::SC_LZ4:
+            /* Level is the acceleration factor */
+            return LZ4_compress_fast(src, dst, size, capacity, (level > 0) ? level : 1);
+
+        case SharedConfig::SC_LZ4HC:
+            ctx->codec = codec;
+            return lz4_compress_HC_extStateHC(ctx->cworkspace, src, dst, size, capacity, level);
+
+        case SharedConfig::SC_ZSTD: {
+            if (!ctx->cctx || (ctx->codec != codec)) {
+                /* The LZ4-HC state shares the workspace, so the context is
+                 * rebuilt whenever the codec changes */
+                ctx->cctx = zstd_initStaticCCtx(ctx->cworkspace, CCTX_SIZE);
+                ctx->codec = codec;
+                if (!ctx->cctx)
+                    return 0;
+            }
+            size_t ret = zstd_compressCCtx(ctx->cctx, dst, capacity, src, size, level);
+            return zstd_isError(ret) ? 0 : static_cast<int>(ret);
+        }
+
+        default:
+            return 0;
+    }
+}
+
+int SaveStateCodec::decompress(int context, int codec, const char* src, char* dst, int compressed_size, int size)
+{
+    switch (codec) {
+        case SharedConfig::SC_LZ4:
+        case SharedConfig::SC_LZ4HC:
+            /* Both share the same format */
+            return LZ4_decompress_safe(src, dst, compressed_size, size);
+
+        case SharedConfig::SC_ZSTD: {
+            if (!has_zstd)
+                return -1;
+
+            CodecContext* ctx = getContext(context);
+            if (!ctx->dctx)
+                ctx->dctx = zstd_initStaticDCtx(ctx->dworkspace, DCTX_SIZE);
+            if (!ctx->dctx)
+                return -1;
+
+            size_t ret = zstd_decompressDCtx(ctx->dctx, dst, size, src, compressed_size);
+            return zstd_isError(ret) ? -1 : static_cast<int>(ret);
+        }
+
+        default:
+            return -1;
+    }
+}
+
+const char* SaveStateCodec::name(int codec)
+{
+    switch (codec) {
+        case SharedConfig::SC_LZ4:
+            return "LZ4";
+        case SharedConfig::SC_LZ4HC:
+            return "LZ4-HC";
+        case SharedConfig::SC_ZSTD:
+            return "zstd";
+        default:
+            return "unknown";
+    }
+}
+
+}
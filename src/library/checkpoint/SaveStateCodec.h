@@ -0,0 +1,73 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_SAVESTATECODEC_H
+#define LIBTAS_SAVESTATECODEC_H
+
+#include "SaveStateWorkers.h"
+
+namespace libtas {
+
+/* Compression of savestate pages.
+ *
+ * Besides the fast LZ4 compression included in libTAS, pages can be
+ * compressed with the high compression mode of LZ4 or with zstd, using the
+ * system liblz4 and libzstd. The codec is recorded inside the savestate
+ * header, and all pages of a savestate are compressed independently with it,
+ * so that loading does not depend on the current settings.
+ *
+ * Libraries are loaded at startup, so that they are mapped in every
+ * savestate. Compression contexts cannot be allocated while saving or loading
+ * a state, so they are built inside ReservedMemory, one for the checkpoint
+ * thread and one for each worker thread. */
+namespace SaveStateCodec {
+
+    enum {
+        /* Context of the checkpoint thread, worker threads use the next ones */
+        MAIN_CONTEXT = 0,
+        NB_CONTEXTS = 1 + SaveStateWorkers::MAX_WORKERS,
+    };
+
+    /* Maximum size of a compressed page, for all codecs */
+    constexpr int compressBound(int size)
+    {
+        return size + (size / 255) + 64;
+    }
+
+    /* Load the compression libraries if available. Must be called at startup */
+    void init();
+
+    /* Returns the codec and level used to compress a savestate in the given
+     * slot, falling back to LZ4 if the configured codec is not available */
+    void select(int slot, int* codec, int* level);
+
+    /* Compress a page. Returns the compressed size, or 0 if the compressed
+     * page does not fit inside `capacity` bytes */
+    int compress(int context, int codec, int level, const char* src, char* dst, int size, int capacity);
+
+    /* Decompress a page. Returns the decompressed size, or a negative value
+     * on error */
+    int decompress(int context, int codec, const char* src, char* dst, int compressed_size, int size);
+
+    /* Returns the name of a codec */
+    const char* name(int codec);
+}
+}
+
+#endif
@@ -25,6 +25,8 @@
 #include "Utils.h"
 #include "logging.h"
 #include "../external/lz4.h"
+#include "PageStore.h"
+#include "SaveStateCodec.h"
 #define XXH_INLINE_ALL
 #define XXH_STATIC_LINKING_ONLY
 #define XXH_NO_STDLIB
@@ -36,6 +38,8 @@
 
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /* Upper bound of possible page size values */
 static const size_t MAX_PAGE_SIZE = 65536;
@@ -47,6 +51,10 @@ SaveStateLoading::SaveStateLoading(const char* pagemappath, const char* pagespat
     queued_size = 0;
     pmfd = -1;
     pfd = -1;
+    pages_map = nullptr;
+    pages_map_size = 0;
+    codec = SharedConfig::SC_LZ4;
+    independent_blocks = false;
 
     if (pagemappath[0] == '\0') {
         return;
@@ -58,12 +66,19 @@ SaveStateLoading::SaveStateLoading(const char* pagemappath, const char* pagespat
     pfd = open(pagespath, O_RDONLY);
     MYASSERT(pfd != -1)
 
+    /* Read how pages were compressed */
+    StateHeader sh;
+    Utils::readAll(pmfd, &sh, sizeof(sh));
+    codec = sh.codec;
+    independent_blocks = sh.flags & StateHeader::SH_INDEPENDENT_BLOCKS;
+
     memset(&lz4s, 0, sizeof(LZ4_streamDecode_t));
     restart();
 }
 
 SaveStateLoading::~SaveStateLoading()
 {
+    unmapPages();
     if (pmfd >= 0)
         close(pmfd);
     if (pfd >= 0)
@@ -72,13 +87,98 @@ SaveStateLoading::~SaveStateLoading()
 
 bool SaveStateLoading::validateCompressedLength() const
 {
-    if (compressed_length <= 0 || compressed_length > LZ4_COMPRESSBOUND(page_size)) {
+    if (compressed_length <= 0 || compressed_length > SaveStateCodec::compressBound(page_size)) {
         LOG(LL_ERROR, LCF_CHECKPOINT, "Invalid compressed page length %d", compressed_length);
         return false;
     }
     return true;
 }
 
+void SaveStateLoading::readCompressedLength()
+{
+    if (pages_map) {
+        compressed_length = 0;
+        if (static_cast<size_t>(next_pfd_offset) + sizeof(int) <= pages_map_size)
+            memcpy(&compressed_length, pages_map + next_pfd_offset, sizeof(int));
+
+        /* Invalidate a length that would read past the end of the file */
+        if (static_cast<size_t>(next_pfd_offset) + sizeof(int) + compressed_length > pages_map_size)
+            compressed_length = 0;
+    }
+    else {
+        lseek(pfd, next_pfd_offset, SEEK_SET);
+        Utils::readAll(pfd, &compressed_length, sizeof(int));
+    }
+}
+
+void SaveStateLoading::readStoreIndex()
+{
+    store_index = 0;
+    if (pages_map) {
+        if (static_cast<size_t>(next_pfd_offset) + sizeof(uint32_t) <= pages_map_size)
+            memcpy(&store_index, pages_map + next_pfd_offset, sizeof(uint32_t));
+    }
+    else {
+        /* Don't move the file offset, which is used to read compressed pages */
+        pread(pfd, &store_index, sizeof(uint32_t), next_pfd_offset);
+    }
+}
+
+uint32_t SaveStateLoading::storeIndex() const
+{
+    return store_index;
+}
+
+bool SaveStateLoading::mapPages()
+{
+    if (pfd == -1)
+        return false;
+
+    struct stat sb;
+    if (fstat(pfd, &sb) == -1 || sb.st_size == 0)
+        return false;
+
+    void* addr = mmap(nullptr, sb.st_size, PROT_READ, MAP_PRIVATE, pfd, 0);
+    if (addr == MAP_FAILED) {
+        LOG(LL_DEBUG, LCF_CHECKPOINT, "Could not map the pages file: errno %d", errno);
+        return false;
+    }
+
+    /* The file is read sequentially */
+    madvise(addr, sb.st_size, MADV_SEQUENTIAL);
+
+    pages_map = static_cast<char*>(addr);
+    pages_map_size = sb.st_size;
+    return true;
+}
+
+void SaveStateLoading::unmapPages()
+{
+    if (pages_map) {
+        munmap(pages_map, pages_map_size);
+        pages_map = nullptr;
+        pages_map_size = 0;
+    }
+}
+
+const char* SaveStateLoading::currentPageData() const
+{
+    if (!pages_map)
+        return nullptr;
+
+    /* Page data ends at the next page offset */
+    if (static_cast<size_t>(next_pfd_offset) > pages_map_size)
+        return nullptr;
+
+    if (current_flag == Area::FULL_PAGE)
+        return pages_map + (next_pfd_offset - page_size);
+
+    if (current_flag == Area::COMPRESSED_PAGE)
+        return pages_map + (next_pfd_offset - compressed_length - sizeof(int));
+
+    return nullptr;
+}
+
 void SaveStateLoading::readHeader(StateHeader* sh)
 {
     lseek(pmfd, 0, SEEK_SET);
@@ -177,14 +277,17 @@ char SaveStateLoading::getPageFlag(char* addr)
             next_pfd_offset += page_size;
         }
         else if (flag == Area::COMPRESSED_PAGE) {
-            lseek(pfd, next_pfd_offset, SEEK_SET);
-            Utils::readAll(pfd, &compressed_length, sizeof(int));
+            readCompressedLength();
             if (!validateCompressedLength()) {
                 current_flag = Area::NONE;
                 return Area::NONE;
             }
             next_pfd_offset += sizeof(int) + compressed_length;
         }
+        else if (flag == Area::STORE_PAGE) {
+            readStoreIndex();
+            next_pfd_offset += sizeof(uint32_t);
+        }
         current_addr += page_size;
     } while (current_addr <= addr);
 
@@ -200,14 +303,17 @@ char SaveStateLoading::getNextPageFlag()
         next_pfd_offset += page_size;
     }
     else if (flag == Area::COMPRESSED_PAGE) {
-        lseek(pfd, next_pfd_offset, SEEK_SET);
-        Utils::readAll(pfd, &compressed_length, sizeof(int));
+        readCompressedLength();
         if (!validateCompressedLength()) {
             current_flag = Area::NONE;
             return Area::NONE;
         }
         next_pfd_offset += sizeof(int) + compressed_length;
     }
+    else if (flag == Area::STORE_PAGE) {
+        readStoreIndex();
+        next_pfd_offset += sizeof(uint32_t);
+    }
     current_addr += page_size;
     return flag;
 }
@@ -241,18 +347,24 @@ void SaveStateLoading::queuePageLoad(char* addr)
         queued_size = page_size;
     }
     else if (current_flag == Area::COMPRESSED_PAGE) {
-        char compressed[LZ4_COMPRESSBOUND(MAX_PAGE_SIZE)];
+        char compressed_buf[SaveStateCodec::compressBound(MAX_PAGE_SIZE)];
         if (!validateCompressedLength()) {
             memset(addr, 0, page_size);
             return;
         }
-        Utils::readAll(pfd, compressed, compressed_length);
+        const char* compressed = currentPageData();
+        if (compressed) {
+            compressed += sizeof(int);
+        }
+        else {
+            Utils::readAll(pfd, compressed_buf, compressed_length);
+            compressed = compressed_buf;
+        }
         
-        if (Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL) {
-            /* For incremental savestates, block compression is independant */
-            int ret = LZ4_decompress_safe(compressed, addr, compressed_length, page_size);
+        if (independent_blocks) {
+            int ret = SaveStateCodec::decompress(SaveStateCodec::MAIN_CONTEXT, codec, compressed, addr, compressed_length, page_size);
             if (ret != page_size) {
-                LOG(LL_ERROR, LCF_CHECKPOINT, "LZ4_decompress_safe failed with return code %d", ret);
+                LOG(LL_ERROR, LCF_CHECKPOINT, "%s decompression failed with return code %d", SaveStateCodec::name(codec), ret);
                 memset(addr, 0, page_size);
             }
         }
@@ -264,6 +376,12 @@ void SaveStateLoading::queuePageLoad(char* addr)
             }
         }
     }
+    else if (current_flag == Area::STORE_PAGE) {
+        if (!PageStore::load(store_index, addr)) {
+            LOG(LL_ERROR, LCF_CHECKPOINT, "Could not load page %u from the page store", store_index);
+            memset(addr, 0, page_size);
+        }
+    }
 }
 
 bool SaveStateLoading::debugIsMatchingPage(char* addr)
@@ -275,21 +393,32 @@ bool SaveStateLoading::debugIsMatchingPage(char* addr)
         Utils::readAll(pfd, current_page, page_size);
     }
     else if (current_flag == Area::COMPRESSED_PAGE) {
-        char compressed[LZ4_COMPRESSBOUND(MAX_PAGE_SIZE)];
+        char compressed_buf[SaveStateCodec::compressBound(MAX_PAGE_SIZE)];
         if (!validateCompressedLength()) {
             memset(current_page, 0, page_size);
             return false;
         }
-        Utils::readAll(pfd, compressed, compressed_length);
-        int ret = LZ4_decompress_safe(compressed, current_page, compressed_length, page_size);
+        const char* compressed = currentPageData();
+        if (compressed) {
+            compressed += sizeof(int);
+        }
+        else {
+            Utils::readAll(pfd, compressed_buf, compressed_length);
+            compressed = compressed_buf;
+        }
+        int ret = SaveStateCodec::decompress(SaveStateCodec::MAIN_CONTEXT, codec, compressed, current_page, compressed_length, page_size);
         if (ret != page_size) {
-            LOG(LL_ERROR, LCF_CHECKPOINT, "LZ4_decompress_safe failed with return code %d", ret);
+            LOG(LL_ERROR, LCF_CHECKPOINT, "%s decompression failed with return code %d", SaveStateCodec::name(codec), ret);
             memset(current_page, 0, page_size);
             return false;
         }
     }
+    else if (current_flag == Area::STORE_PAGE) {
+        if (!PageStore::load(store_index, current_page))
+            return false;
+    }
     
-    return 0 == memcmp(addr, current_page, page_size);
+    return Utils::isEqualPage(addr, current_page);
 }
 
 }
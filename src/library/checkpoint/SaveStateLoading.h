@@ -25,6 +25,8 @@
 #include "MemArea.h"
 #include "../external/lz4.h"
 
+#include <cstdint>
+
 namespace libtas {
     
 struct StateHeader;
@@ -53,6 +55,20 @@ class SaveStateLoading
 
     bool debugIsMatchingPage(char* addr);
 
+    /* Map the whole pages file into memory, so that page content can be
+     * accessed without any syscall. Must be called after the memory layout
+     * was restored. Returns if succeeded */
+    bool mapPages();
+    void unmapPages();
+
+    /* Returns a pointer to the data of the current page inside the mapped
+     * pages file. For compressed pages, it points to the compressed length
+     * followed by the compressed data. */
+    const char* currentPageData() const;
+
+    /* Returns the index inside the page store of the current page */
+    uint32_t storeIndex() const;
+
     explicit operator bool() const {
         return (pmfd != -1);
     }
@@ -60,6 +76,8 @@ class SaveStateLoading
     private:
     char nextFlag();
     bool validateCompressedLength() const;
+    void readCompressedLength();
+    void readStoreIndex();
 
     enum {
         FLAGS_CHUNK = 4096,
@@ -77,11 +95,20 @@ class SaveStateLoading
     char* current_addr;
     off_t next_pfd_offset;
 
+    /* Mapped pages file, if any */
+    char* pages_map;
+    size_t pages_map_size;
+
     int compressed_length;
+    uint32_t store_index;
     char* queued_addr;
     off_t queued_offset;
     int queued_size;
     LZ4_streamDecode_t lz4s;
+
+    /* Codec of compressed pages, and are compressed pages independent */
+    int codec;
+    bool independent_blocks;
 };
 }
 
@@ -25,6 +25,9 @@
 #include "Checkpoint.h"
 #include "AltStack.h"
 #include "ReservedMemory.h"
+#include "SaveStateWorkers.h"
+#include "SaveStateMemory.h"
+#include "SaveStateCodec.h"
 #include "ThreadInfo.h"
 #include "clone_wrapper.h"
 
@@ -87,6 +90,9 @@ static int numThreads;
 static int sig_suspend_threads = SIGXFSZ;
 static int sig_checkpoint = SIGSYS;
 static bool* state_dirty;
+static SaveStateManager::SaveTimings* timings;
+
+static_assert(sizeof(SaveStateManager::SaveTimings) <= ReservedMemory::SS_TIMINGS_SIZE, "Reserved memory for savestate timings is too small");
 
 static bool has_clone3_set_tid = false;
 static bool can_set_last_pid = false;
@@ -162,6 +168,13 @@ void SaveStateManager::init()
     state_dirty = static_cast<bool*>(ReservedMemory::getAddr(ReservedMemory::SS_SLOTS_ADDR));
     memset(state_dirty, 0, ReservedMemory::SS_SLOTS_SIZE);
 
+    timings = static_cast<SaveTimings*>(ReservedMemory::getAddr(ReservedMemory::SS_TIMINGS_ADDR));
+    memset(static_cast<void*>(timings), 0, ReservedMemory::SS_TIMINGS_SIZE);
+    timings->slot = -1;
+
+    /* Compression libraries must be loaded before any savestate */
+    SaveStateCodec::init();
+
     /* Check for clone3 support */
 
     {
@@ -279,6 +292,15 @@ int SaveStateManager::waitChild()
     }
 
     state_dirty[status] = false;
+
+    /* Memory savestates written by the child replace the previous ones */
+    SaveStateMemory::commitPending(status);
+
+    if ((timings->slot == status) && (timings->dump_ms < 0)) {
+        TimeHolder dump_time = TimeHolder::now() - timings->fork_time[status];
+        timings->dump_ms = dump_time.toMs();
+    }
+
     return status;
 }
 
@@ -294,6 +316,22 @@ bool SaveStateManager::stateReady(int slot)
     return !state_dirty[slot];
 }
 
+void SaveStateManager::registerFork(int slot, const TimeHolder& start, const TimeHolder& end)
+{
+    if ((slot < 0) || (slot > 10))
+        return;
+
+    TimeHolder fork_time = end - start;
+    timings->fork_ms = fork_time.toMs();
+    timings->dump_ms = -1;
+    timings->fork_time[slot] = end;
+}
+
+const SaveStateManager::SaveTimings& SaveStateManager::lastTimings()
+{
+    return *timings;
+}
+
 void SaveStateManager::stateStatus(int slot, bool dirty)
 {
     if (Global::shared_config.savestate_settings & SharedConfig::SS_FORK)
@@ -307,6 +345,8 @@ int SaveStateManager::checkpoint(int slot)
     if (!stateReady(slot))
         return ESTATE_NOTCOMPLETE;
 
+    TimeHolder start_time = TimeHolder::now();
+
     ThreadInfo *current_thread = ThreadManager::getCurrentThread();
     MYASSERT(current_thread->state == ThreadInfo::ST_CKPNTHREAD)
 
@@ -330,6 +370,11 @@ int SaveStateManager::checkpoint(int slot)
         return ret;
     }
 
+    /* Spawn the savestate worker threads if needed. Must be done BEFORE
+     * suspending threads, because a suspended thread may hold the malloc lock.
+     */
+    SaveStateWorkers::init();
+
     /* We save the alternate stack if the game did set one */
     AltStack::saveStack();
 
@@ -369,7 +414,9 @@ int SaveStateManager::checkpoint(int slot)
     ThreadManager::updateStackInfo();
 
     /* Sending a suspend signal to all threads */
+    TimeHolder suspend_time = TimeHolder::now();
     suspendThreads();
+    TimeHolder suspended_time = TimeHolder::now();
 
 #ifdef __unix__
     /* Do not carry Xlib locks across checkpoint/restore memory changes. */
@@ -444,10 +491,22 @@ int SaveStateManager::checkpoint(int slot)
 
     ThreadSync::releaseLocks();
 
-    /* Mark the savestate as dirty in case of fork savestate */
-    if (!restoreInProgress)
+    if (!restoreInProgress) {
+        /* Mark the savestate as dirty in case of fork savestate */
         stateStatus(slot, true);
 
+        TimeHolder end_time = TimeHolder::now();
+        TimeHolder delta_time = suspended_time - suspend_time;
+        timings->suspend_ms = delta_time.toMs();
+        delta_time = end_time - start_time;
+        timings->blocking_ms = delta_time.toMs();
+        timings->slot = slot;
+        if (!(Global::shared_config.savestate_settings & SharedConfig::SS_FORK)) {
+            timings->fork_ms = 0;
+            timings->dump_ms = 0;
+        }
+    }
+
     return ESTATE_OK;
 }
 
@@ -478,6 +537,10 @@ int SaveStateManager::restore(int slot)
         return ret;
     }
 
+    /* Spawn the savestate worker threads if needed, for the same reason as
+     * in checkpoint() */
+    SaveStateWorkers::init();
+
     /* We save the alternate stack if the game did set one */
     AltStack::saveStack();
 
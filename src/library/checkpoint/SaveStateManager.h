@@ -20,6 +20,8 @@
 #ifndef LIBTAS_SAVESTATE_MANAGER_H
 #define LIBTAS_SAVESTATE_MANAGER_H
 
+#include "TimeHolder.h"
+
 #include <set>
 #include <map>
 #include <vector>
@@ -45,6 +47,27 @@ enum Error {
     ESTATE_NOTCOMPLETE = -5, // State still being saved
 };
 
+/* Timings of the last savestate, displayed in the profiler window */
+struct SaveTimings {
+    /* Slot of the last savestate, or -1 if no state was saved yet */
+    int slot;
+
+    /* Time to suspend all game threads */
+    float suspend_ms;
+
+    /* Time spent in fork(), for fork savestates */
+    float fork_ms;
+
+    /* Total time the game was stopped */
+    float blocking_ms;
+
+    /* Time for the forked process to write the state, or -1 if it is still
+     * running */
+    float dump_ms;
+
+    /* Time when each forked process was spawned, by slot */
+    TimeHolder fork_time[16];
+};
 
 void init();
 
@@ -62,6 +85,12 @@ bool stateReady(int slot);
 /* Change the dirty state of savestate when doing forked savestate */
 void stateStatus(int slot, bool dirty);
 
+/* Register the time when a process was forked to save state `slot` */
+void registerFork(int slot, const TimeHolder& start, const TimeHolder& end);
+
+/* Returns the timings of the last savestate */
+const SaveTimings& lastTimings();
+
 /* Save a savestate and returns if succeeded */
 int checkpoint(int slot);
 
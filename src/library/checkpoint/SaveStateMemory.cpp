@@ -0,0 +1,321 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SaveStateMemory.h"
+#include "ReservedMemory.h"
+
+#include "logging.h"
+#include "global.h"
+#include "fileio/FileDescriptorManip.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 0x0001U
+#endif
+
+namespace libtas {
+
+/* One savestate stored in memory */
+struct MemorySlot {
+    /* Memory files of the pagemap and pages, or 0 if the state is not in
+     * memory */
+    int pmfd;
+    int pfd;
+
+    /* Memory files being written by a forked process, or 0 */
+    int pending_pmfd;
+    int pending_pfd;
+
+    /* Total size of both files */
+    size_t size;
+
+    /* Value of the use counter when the state was last saved or loaded */
+    uint64_t last_use;
+
+    /* Paths to open the memory files */
+    char pagemap_fdpath[32];
+    char pages_fdpath[32];
+
+    /* Paths of the state on disk, used when spilling */
+    char pagemappath[1024];
+    char pagespath[1024];
+};
+
+struct MemoryTable {
+    uint64_t use_counter;
+    MemorySlot slots[SaveStateMemory::MAX_SLOTS];
+};
+
+static_assert(sizeof(MemoryTable) <= ReservedMemory::MEMSTATES_SIZE, "Reserved memory for memory savestates is too small");
+
+static MemoryTable* getTable()
+{
+    return static_cast<MemoryTable*>(ReservedMemory::getAddr(ReservedMemory::MEMSTATES_ADDR));
+}
+
+static MemorySlot* getSlot(int slot)
+{
+    if (slot < 0 || slot >= SaveStateMemory::MAX_SLOTS)
+        return nullptr;
+
+    MemorySlot* ms = &getTable()->slots[slot];
+    if (ms->pmfd <= 0)
+        return nullptr;
+
+    return ms;
+}
+
+/* Move a file descriptor above the range of file descriptors that are synced
+ * or reserved when loading a state, so that it survives the loading */
+static int moveFd(int fd)
+{
+    if (fd < 0)
+        return fd;
+
+    int newfd = fcntl(fd, F_DUPFD_CLOEXEC, FileDescriptorManip::reserveState() + 16);
+    close(fd);
+    return newfd;
+}
+
+static size_t fileSize(int fd)
+{
+    struct stat sb;
+    if (fstat(fd, &sb) == -1)
+        return 0;
+    return sb.st_size;
+}
+
+/* Copy the content of a memory file into a file on disk */
+static bool copyToFile(int fd, const char* path)
+{
+    unlink(path);
+    int out = creat(path, 0644);
+    if (out == -1) {
+        LOG(LL_ERROR, LCF_CHECKPOINT, "Could not create %s: %s", path, strerror(errno));
+        return false;
+    }
+
+    off_t offset = 0;
+    off_t size = fileSize(fd);
+    while (offset < size) {
+        ssize_t ret = sendfile(out, fd, &offset, size - offset);
+        if (ret == -1 && errno == EINTR)
+            continue;
+        if (ret <= 0) {
+            LOG(LL_ERROR, LCF_CHECKPOINT, "Could not write %s: %s", path, strerror(errno));
+            close(out);
+            return false;
+        }
+    }
+
+    close(out);
+    return true;
+}
+
+static void release(MemorySlot* ms)
+{
+    close(ms->pmfd);
+    close(ms->pfd);
+    ms->pmfd = 0;
+    ms->pfd = 0;
+    ms->size = 0;
+}
+
+bool SaveStateMemory::enabled()
+{
+    return Global::shared_config.savestate_settings & SharedConfig::SS_MEMORY;
+}
+
+bool SaveStateMemory::open(int* pmfd, int* pfd)
+{
+    *pmfd = moveFd(syscall(SYS_memfd_create, "libtas_pagemap", MFD_CLOEXEC));
+    *pfd = moveFd(syscall(SYS_memfd_create, "libtas_pages", MFD_CLOEXEC));
+
+    if (*pmfd == -1 || *pfd == -1) {
+        LOG(LL_WARN, LCF_CHECKPOINT, "Could not create memory files for the savestate: %s", strerror(errno));
+        if (*pmfd != -1) close(*pmfd);
+        if (*pfd != -1) close(*pfd);
+        return false;
+    }
+
+    return true;
+}
+
+void SaveStateMemory::commit(int slot, int pmfd, int pfd, const char* pagemappath, const char* pagespath)
+{
+    if (slot < 0 || slot >= MAX_SLOTS) {
+        /* Should not happen, but we can still write the state on disk */
+        copyToFile(pmfd, pagemappath);
+        copyToFile(pfd, pagespath);
+        close(pmfd);
+        close(pfd);
+        return;
+    }
+
+    MemorySlot* ms = &getTable()->slots[slot];
+    if (ms->pmfd > 0)
+        release(ms);
+
+    ms->pmfd = pmfd;
+    ms->pfd = pfd;
+    ms->size = fileSize(pmfd) + fileSize(pfd);
+    snprintf(ms->pagemap_fdpath, sizeof(ms->pagemap_fdpath), "/proc/self/fd/%d", pmfd);
+    snprintf(ms->pages_fdpath, sizeof(ms->pages_fdpath), "/proc/self/fd/%d", pfd);
+    if (pagemappath != ms->pagemappath) {
+        strncpy(ms->pagemappath, pagemappath, sizeof(ms->pagemappath) - 1);
+        ms->pagemappath[sizeof(ms->pagemappath) - 1] = '\0';
+    }
+    if (pagespath != ms->pagespath) {
+        strncpy(ms->pagespath, pagespath, sizeof(ms->pagespath) - 1);
+        ms->pagespath[sizeof(ms->pagespath) - 1] = '\0';
+    }
+
+    /* Remove any older state on disk, which would be outdated */
+    unlink(pagemappath);
+    unlink(pagespath);
+
+    touch(slot);
+
+    if (Global::shared_config.savestate_memory_budget <= 0)
+        return;
+
+    /* Spill least recently used states until we fit in the budget. The
+     * current state is spilled last, if it is too big by itself. */
+    size_t budget = static_cast<size_t>(Global::shared_config.savestate_memory_budget) * 1024 * 1024;
+    while (true) {
+        size_t total = 0;
+        int lru = -1;
+        for (int s = 0; s < MAX_SLOTS; s++) {
+            MemorySlot* other = getSlot(s);
+            if (!other)
+                continue;
+            total += other->size;
+            if ((s != slot) && ((lru == -1) || (other->last_use < getTable()->slots[lru].last_use)))
+                lru = s;
+        }
+
+        if (total <= budget)
+            break;
+
+        if (lru == -1)
+            lru = slot;
+
+        LOG(LL_DEBUG, LCF_CHECKPOINT, "Memory budget exceeded, spilling state %d to disk", lru);
+        if (!spill(lru) || (lru == slot))
+            break;
+    }
+}
+
+void SaveStateMemory::setPending(int slot, int pmfd, int pfd, const char* pagemappath, const char* pagespath)
+{
+    if (slot < 0 || slot >= MAX_SLOTS) {
+        close(pmfd);
+        close(pfd);
+        return;
+    }
+
+    MemorySlot* ms = &getTable()->slots[slot];
+
+    /* A previous forked process may have died without completing its state */
+    if (ms->pending_pmfd > 0) {
+        close(ms->pending_pmfd);
+        close(ms->pending_pfd);
+    }
+
+    ms->pending_pmfd = pmfd;
+    ms->pending_pfd = pfd;
+
+    /* Paths are the same for a given slot, so the current state can already
+     * be spilled to the new paths */
+    strncpy(ms->pagemappath, pagemappath, sizeof(ms->pagemappath) - 1);
+    ms->pagemappath[sizeof(ms->pagemappath) - 1] = '\0';
+    strncpy(ms->pagespath, pagespath, sizeof(ms->pagespath) - 1);
+    ms->pagespath[sizeof(ms->pagespath) - 1] = '\0';
+}
+
+void SaveStateMemory::commitPending(int slot)
+{
+    if (slot < 0 || slot >= MAX_SLOTS)
+        return;
+
+    MemorySlot* ms = &getTable()->slots[slot];
+    if (ms->pending_pmfd <= 0)
+        return;
+
+    int pmfd = ms->pending_pmfd;
+    int pfd = ms->pending_pfd;
+    ms->pending_pmfd = 0;
+    ms->pending_pfd = 0;
+
+    commit(slot, pmfd, pfd, ms->pagemappath, ms->pagespath);
+}
+
+void SaveStateMemory::discard(int slot)
+{
+    MemorySlot* ms = getSlot(slot);
+    if (ms)
+        release(ms);
+}
+
+const char* SaveStateMemory::pagemapPath(int slot, const char* path)
+{
+    MemorySlot* ms = getSlot(slot);
+    return ms ? ms->pagemap_fdpath : path;
+}
+
+const char* SaveStateMemory::pagesPath(int slot, const char* path)
+{
+    MemorySlot* ms = getSlot(slot);
+    return ms ? ms->pages_fdpath : path;
+}
+
+void SaveStateMemory::touch(int slot)
+{
+    MemorySlot* ms = getSlot(slot);
+    if (ms)
+        ms->last_use = ++getTable()->use_counter;
+}
+
+bool SaveStateMemory::spill(int slot)
+{
+    MemorySlot* ms = getSlot(slot);
+    if (!ms)
+        return true;
+
+    if (!copyToFile(ms->pmfd, ms->pagemappath) || !copyToFile(ms->pfd, ms->pagespath)) {
+        /* Keep the state in memory rather than losing it */
+        unlink(ms->pagemappath);
+        unlink(ms->pagespath);
+        return false;
+    }
+
+    release(ms);
+    return true;
+}
+
+}
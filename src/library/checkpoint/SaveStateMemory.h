@@ -0,0 +1,81 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_SAVESTATEMEMORY_H
+#define LIBTAS_SAVESTATEMEMORY_H
+
+namespace libtas {
+
+/* Storage of savestates inside anonymous memory files (memfd) owned by the
+ * game process, instead of files on disk.
+ *
+ * Memory files are kept open with file descriptors above the range that is
+ * synced when loading a state, and the table describing them is stored
+ * inside ReservedMemory, so that both survive a state loading. Savestate code
+ * keeps working with paths, using the `/proc/self/fd/` link of each memory
+ * file.
+ *
+ * States are spilled to their regular path on disk, least recently used
+ * first, when the total size exceeds the configured budget. */
+namespace SaveStateMemory {
+
+    enum {
+        MAX_SLOTS = 16,
+    };
+
+    /* Returns if new savestates must be stored in memory */
+    bool enabled();
+
+    /* Create a pair of memory files to write a new savestate into. Returns
+     * false if they could not be created, in which case the state must be
+     * saved on disk */
+    bool open(int* pmfd, int* pfd);
+
+    /* Register the written memory files as savestate `slot`, replacing the
+     * previous one. Savestate files at the given paths are removed, and
+     * states are spilled to disk if the memory budget is exceeded */
+    void commit(int slot, int pmfd, int pfd, const char* pagemappath, const char* pagespath);
+
+    /* Register memory files that a forked process is writing savestate `slot`
+     * into. They replace the current state when calling commitPending() */
+    void setPending(int slot, int pmfd, int pfd, const char* pagemappath, const char* pagespath);
+
+    /* Register the memory files written by a forked process that completed
+     * savestate `slot` */
+    void commitPending(int slot);
+
+    /* Release the memory of savestate `slot` without saving it, when a newer
+     * state was saved on disk instead */
+    void discard(int slot);
+
+    /* Returns the paths to open savestate `slot`, which are the given paths
+     * if the state is not stored in memory */
+    const char* pagemapPath(int slot, const char* path);
+    const char* pagesPath(int slot, const char* path);
+
+    /* Mark savestate `slot` as being used, for the eviction policy */
+    void touch(int slot);
+
+    /* Write savestate `slot` to disk and release its memory. Returns false if
+     * the state could not be written, in which case it stays in memory */
+    bool spill(int slot);
+}
+}
+
+#endif
@@ -21,6 +21,9 @@
 
 #include "SaveStateSaving.h"
 #include "ReservedMemory.h"
+#include "PageStore.h"
+#include "SaveStateCodec.h"
+#include "StateHeader.h"
 
 #include "Utils.h"
 #include "logging.h"
@@ -41,7 +44,7 @@
 
 namespace libtas {
 
-SaveStateSaving::SaveStateSaving(int pagemapfd, int pagesfd, int selfpagemapfd)
+SaveStateSaving::SaveStateSaving(int pagemapfd, int pagesfd, int selfpagemapfd, const StateHeader& sh)
 {
     page_size = Utils::getPageSize();
     ss_pagemap_i = 0;
@@ -57,6 +60,12 @@ SaveStateSaving::SaveStateSaving(int pagemapfd, int pagesfd, int selfpagemapfd)
     pfd = pagesfd;
     spmfd = selfpagemapfd;
 
+    store_pages = PageStore::enabled() && (PageStore::id() != 0);
+
+    page_codec = sh.codec;
+    page_codec_level = sh.codec_level;
+    independent_blocks = sh.flags & StateHeader::SH_INDEPENDENT_BLOCKS;
+
     current_pages_offset = lseek(pfd, 0, SEEK_CUR);
     MYASSERT(current_pages_offset != -1)
 
@@ -127,9 +136,45 @@ void SaveStateSaving::savePageFlag(char flag)
     ss_pagemaps[ss_pagemap_i++] = flag;
 }
 
-size_t SaveStateSaving::queuePageSave(char* addr)
+void SaveStateSaving::savePageFlags(char flag, size_t count)
+{
+    while (count > 0) {
+        if (ss_pagemap_i >= PAGEMAP_CHUNK) {
+            appendPagemapData(ss_pagemaps, PAGEMAP_CHUNK);
+            ss_pagemap_i = 0;
+        }
+
+        size_t room = PAGEMAP_CHUNK - ss_pagemap_i;
+        size_t n = (count < room) ? count : room;
+        memset(ss_pagemaps + ss_pagemap_i, flag, n);
+        ss_pagemap_i += n;
+        count -= n;
+    }
+}
+
+size_t SaveStateSaving::queuePageSave(char* addr, const uint64_t* hash)
 {
     size_t returned_size = 0;
+
+    if (store_pages) {
+        int64_t index = hash ? PageStore::insert(addr, *hash) : PageStore::insert(addr);
+        if (index >= 0) {
+            /* Only the page index is saved, which is queued in the same
+             * buffer as compressed pages */
+            returned_size = flushSave();
+
+            savePageFlag(Area::STORE_PAGE);
+            uint32_t store_index = static_cast<uint32_t>(index);
+            memcpy(queued_compressed_base_addr + queued_compressed_size, &store_index, sizeof(uint32_t));
+            queued_compressed_size += sizeof(uint32_t);
+            queued_target_addr = addr + page_size;
+
+            if ((queued_compressed_max_size - queued_compressed_size) < SaveStateCodec::compressBound(page_size)) {
+                returned_size += flushCompressedSave();
+            }
+            return returned_size;
+        }
+    }
     
     if (Global::shared_config.savestate_settings & SharedConfig::SS_COMPRESSED) {
         /* Try to compress the memory page */
@@ -140,13 +185,14 @@ size_t SaveStateSaving::queuePageSave(char* addr)
             
         /* Append the compressed data to the current stream */
         int compressed_size;
-        if (Global::shared_config.savestate_settings & SharedConfig::SS_INCREMENTAL) {
+        if (independent_blocks) {
             /* For incremental savestates, not all blocks may be decompressed, so
-             * we must compress each block independantly */
-            compressed_size = LZ4_compress_fast(addr, queued_compressed_base_addr + queued_compressed_size + sizeof(int), page_size, queued_compressed_max_size - (queued_compressed_size + sizeof(int)), 1);
+             * we must compress each block independantly. This is also
+             * required for blocks to be decompressed by several threads. */
+            compressed_size = SaveStateCodec::compress(SaveStateCodec::MAIN_CONTEXT, page_codec, page_codec_level, addr, queued_compressed_base_addr + queued_compressed_size + sizeof(int), page_size, queued_compressed_max_size - (queued_compressed_size + sizeof(int)));
         }
         else {
-            compressed_size = LZ4_compress_fast_continue(&lz4s, addr, queued_compressed_base_addr + queued_compressed_size + sizeof(int), page_size, queued_compressed_max_size - (queued_compressed_size + sizeof(int)), 1);
+            compressed_size = LZ4_compress_fast_continue(&lz4s, addr, queued_compressed_base_addr + queued_compressed_size + sizeof(int), page_size, queued_compressed_max_size - (queued_compressed_size + sizeof(int)), page_codec_level);
         }
         if (compressed_size) {
             /* Flush the uncompressed buffer if any */
@@ -158,7 +204,7 @@ size_t SaveStateSaving::queuePageSave(char* addr)
             queued_target_addr = addr + page_size;
 
             /* Check for remaining size */
-            if ((queued_compressed_max_size - queued_compressed_size) < LZ4_COMPRESSBOUND(page_size)) {
+            if ((queued_compressed_max_size - queued_compressed_size) < SaveStateCodec::compressBound(page_size)) {
                 returned_size += flushCompressedSave();
             }
             return returned_size;
@@ -188,6 +234,24 @@ size_t SaveStateSaving::queuePageSave(char* addr)
     return returned_size;
 }
 
+size_t SaveStateSaving::saveEncodedPages(const char* flags, int nb_pages, const char* data, size_t size)
+{
+    /* Flush any page queued by queuePageSave(), so that the pages file
+     * stays in the same order as page flags */
+    size_t returned_size = flushSave();
+    returned_size += flushCompressedSave();
+
+    for (int i = 0; i < nb_pages; i++)
+        savePageFlag(flags[i]);
+
+    if (size > 0) {
+        Utils::writeAll(pfd, data, size);
+        current_pages_offset += static_cast<off_t>(size);
+        returned_size += size;
+    }
+    return returned_size;
+}
+
 size_t SaveStateSaving::flushSave()
 {
     if (queued_size > 0) {
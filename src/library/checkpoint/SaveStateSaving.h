@@ -32,20 +32,36 @@ struct StateHeader;
 class SaveStateSaving
 {
 public:
-    SaveStateSaving(int pagemapfd, int pagesfd, int selfpagemapfd);
+    /* Pages are compressed using the codec of the savestate header */
+    SaveStateSaving(int pagemapfd, int pagesfd, int selfpagemapfd, const StateHeader& sh);
 
     /* Import an area and fill some missing members */
     void processArea(Area* area);
     
     /* Saving the page flag */
     void savePageFlag(char flag);
+
+    /* Saving the same page flag for several consecutive pages */
+    void savePageFlags(char flag, size_t count);
     
-    /* Save the entire memory page and the associated page flag */
-    size_t queuePageSave(char* addr);
+    /* Save the entire memory page and the associated page flag. `hash` is
+     * the hash of the page if already computed */
+    size_t queuePageSave(char* addr, const uint64_t* hash = nullptr);
+
+    /* Returns if pages are saved inside the page store */
+    bool storesPages() const {return store_pages;}
+
+    /* Returns the codec and level used to compress pages */
+    int codec() const {return page_codec;}
+    int codecLevel() const {return page_codec_level;}
     
     /* Finish processing a memory area */
     size_t finishSave();
 
+    /* Save page flags and page content that were already encoded by a
+     * worker thread, and returns the number of written bytes */
+    size_t saveEncodedPages(const char* flags, int nb_pages, const char* data, size_t size);
+
     /* Flush buffered writes to the pagemap file */
     void flushPagemapWrites();
 
@@ -80,6 +96,16 @@ private:
 
     LZ4_stream_t lz4s;
 
+    /* Compression codec and level */
+    int page_codec;
+    int page_codec_level;
+
+    /* Are compressed pages independent */
+    bool independent_blocks;
+
+    /* Are pages saved inside the page store */
+    bool store_pages;
+
     /* File descriptors */
     int pmfd, pfd, spmfd;
 
@@ -0,0 +1,338 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SaveStateWorkers.h"
+#include "ReservedMemory.h"
+#include "PageStore.h"
+#include "SaveStateCodec.h"
+
+#include "Utils.h"
+#include "logging.h"
+#include "global.h"
+#include "GlobalState.h"
+
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace libtas {
+
+/* Control structure of the pool, stored at the beginning of the reserved
+ * memory section. It is followed by the worker stacks and chunk buffers. */
+struct WorkerPool {
+    /* Process that spawned the worker threads. Threads do not survive a
+     * fork(), so the pool cannot be used from a child process. */
+    pid_t pid;
+
+    int nb_workers;
+
+    /* Index given to the next spawned worker thread */
+    std::atomic<int> next_worker;
+
+    /* Posted once for each pushed chunk */
+    sem_t work;
+
+    /* Queue of pushed chunks. Its size never exceeds the number of chunks */
+    SaveStateWorkers::Chunk* queue[SaveStateWorkers::NB_CHUNKS];
+    std::atomic<unsigned int> queue_head;
+    unsigned int queue_tail;
+
+    SaveStateWorkers::Chunk chunks[SaveStateWorkers::NB_CHUNKS];
+};
+
+enum {
+    POOL_CONTROL_SIZE = 128 * 1024,
+    POOL_STACKS_SIZE = SaveStateWorkers::MAX_WORKERS * SaveStateWorkers::WORKER_STACK_SIZE,
+    POOL_BUFFERS_SIZE = SaveStateWorkers::NB_CHUNKS * SaveStateWorkers::CHUNK_SIZE,
+};
+
+static_assert(sizeof(WorkerPool) <= POOL_CONTROL_SIZE, "Worker pool control structure is too big");
+static_assert(POOL_CONTROL_SIZE + POOL_STACKS_SIZE + POOL_BUFFERS_SIZE + 65536 <= ReservedMemory::WORKERS_SIZE, "Reserved memory for worker threads is too small");
+
+static char* poolBase()
+{
+    /* Align on page size so that thread stacks are properly aligned */
+    uintptr_t addr = reinterpret_cast<uintptr_t>(ReservedMemory::getAddr(ReservedMemory::WORKERS_ADDR));
+    return reinterpret_cast<char*>(Utils::alignUpToPageSize(addr));
+}
+
+static WorkerPool* getPool()
+{
+    return reinterpret_cast<WorkerPool*>(poolBase());
+}
+
+static void* workerLoop(void* arg)
+{
+    WorkerPool* pool = static_cast<WorkerPool*>(arg);
+    int worker = pool->next_worker.fetch_add(1);
+
+    /* Signals sent to the process must be handled by game threads */
+    sigset_t mask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+
+    while (true) {
+        while (sem_wait(&pool->work) == -1 && errno == EINTR) {}
+
+        unsigned int index = pool->queue_head.fetch_add(1);
+        SaveStateWorkers::Chunk* chunk = pool->queue[index % SaveStateWorkers::NB_CHUNKS];
+
+        chunk->worker = worker;
+        chunk->run(chunk);
+        sem_post(&chunk->done);
+    }
+
+    return nullptr;
+}
+
+void SaveStateWorkers::init()
+{
+    if (!(Global::shared_config.savestate_settings & SharedConfig::SS_PARALLEL))
+        return;
+
+    WorkerPool* pool = getPool();
+    if (pool->nb_workers > 0 && pool->pid == getpid())
+        return;
+
+    GlobalNative gn;
+
+    long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int nb_workers = (nb_cpus > 1) ? static_cast<int>(nb_cpus - 1) : 1;
+    if (nb_workers > MAX_WORKERS)
+        nb_workers = MAX_WORKERS;
+
+    pool->pid = getpid();
+    pool->queue_head = 0;
+    pool->queue_tail = 0;
+    pool->next_worker = 0;
+    sem_init(&pool->work, 0, 0);
+
+    char* buffers = poolBase() + POOL_CONTROL_SIZE + POOL_STACKS_SIZE;
+    for (int c = 0; c < NB_CHUNKS; c++) {
+        pool->chunks[c].data = buffers + c * CHUNK_SIZE;
+        sem_init(&pool->chunks[c].done, 0, 0);
+    }
+
+    pool->nb_workers = 0;
+    char* stacks = poolBase() + POOL_CONTROL_SIZE;
+    for (int w = 0; w < nb_workers; w++) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setstack(&attr, stacks + w * WORKER_STACK_SIZE, WORKER_STACK_SIZE);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+        pthread_t thread;
+        int ret = pthread_create(&thread, &attr, workerLoop, pool);
+        pthread_attr_destroy(&attr);
+
+        if (ret != 0) {
+            LOG(LL_WARN, LCF_CHECKPOINT, "Could not create savestate worker thread: %s", strerror(ret));
+            break;
+        }
+        pool->nb_workers++;
+    }
+
+    LOG(LL_DEBUG, LCF_CHECKPOINT, "Spawned %d savestate worker threads", pool->nb_workers);
+}
+
+bool SaveStateWorkers::available()
+{
+    if (!(Global::shared_config.savestate_settings & SharedConfig::SS_PARALLEL))
+        return false;
+
+    WorkerPool* pool = getPool();
+    return (pool->nb_workers > 0) && (pool->pid == getpid());
+}
+
+int SaveStateWorkers::count()
+{
+    return getPool()->nb_workers;
+}
+
+SaveStateWorkers::Chunk* SaveStateWorkers::getChunk(int index)
+{
+    return &getPool()->chunks[index % NB_CHUNKS];
+}
+
+void SaveStateWorkers::push(Chunk* chunk)
+{
+    WorkerPool* pool = getPool();
+    pool->queue[pool->queue_tail++ % NB_CHUNKS] = chunk;
+    sem_post(&pool->work);
+}
+
+void SaveStateWorkers::wait(Chunk* chunk)
+{
+    while (sem_wait(&chunk->done) == -1 && errno == EINTR) {}
+}
+
+/* Read the pagemap entries of a range of pages */
+static void readPagemap(int spmfd, const char* addr, int nb_pages, uint64_t* entries)
+{
+    size_t page_size = Utils::getPageSize();
+    off_t offset = static_cast<off_t>((reinterpret_cast<uintptr_t>(addr) / page_size) * sizeof(uint64_t));
+    size_t size = nb_pages * sizeof(uint64_t);
+    char* buf = reinterpret_cast<char*>(entries);
+
+    while (size > 0) {
+        ssize_t ret = pread(spmfd, buf, size, offset);
+        if (ret == -1 && errno == EINTR)
+            continue;
+        if (ret <= 0) {
+            /* Mark remaining pages as present, so that they are saved */
+            uint64_t* remaining = reinterpret_cast<uint64_t*>(buf);
+            for (size_t i = 0; i < size / sizeof(uint64_t); i++)
+                remaining[i] = (0x1ull << 63);
+            return;
+        }
+        buf += ret;
+        offset += ret;
+        size -= ret;
+    }
+}
+
+void SaveStateWorkers::saveChunk(Chunk* chunk)
+{
+    const Area& area = chunk->area;
+    size_t page_size = Utils::getPageSize();
+
+    chunk->data_size = 0;
+    chunk->pagecount_unmapped = 0;
+    chunk->pagecount_zero_or_file = 0;
+    chunk->pagecount_full = 0;
+
+    if (chunk->nb_pages == 0)
+        return;
+
+    uint64_t pagemap[MAX_CHUNK_PAGES];
+    readPagemap(chunk->spmfd, chunk->addr, chunk->nb_pages, pagemap);
+
+    bool compressed = Global::shared_config.savestate_settings & SharedConfig::SS_COMPRESSED;
+    bool skip_unmapped = Global::shared_config.savestate_settings & SharedConfig::SS_PRESENT;
+    bool store_pages = PageStore::enabled() && (PageStore::id() != 0);
+
+    for (int page_i = 0; page_i < chunk->nb_pages; page_i++) {
+        char* curAddr = chunk->addr + page_i * page_size;
+        bool has_hash = false;
+        uint64_t hash;
+
+        uint64_t page = pagemap[page_i];
+        bool page_guard_region = page & (0x1ull << 58);
+        bool page_file = page & (0x1ull << 61);
+        bool page_present = page & (0x1ull << 63);
+
+        if (page_guard_region) {
+            chunk->flags[page_i] = Area::GUARD_PAGE;
+            continue;
+        }
+
+        /* Page is not a lightweight guard page, we can turn on read protection.
+         * Protections are restored by the checkpoint thread when the whole area
+         * has been processed. */
+        if (!(area.prot & PROT_READ)) {
+            MYASSERT(mprotect(curAddr, page_size, area.prot | PROT_READ) == 0)
+        }
+
+        if (area.flags & Area::AREA_ANON) {
+            if (skip_unmapped && !page_present) {
+                chunk->flags[page_i] = Area::NO_PAGE;
+                chunk->pagecount_unmapped++;
+                continue;
+            }
+
+            /* Compute the hash for the page store while reading the page */
+            if (store_pages ? Utils::isZeroPageOrHash(curAddr, &hash) : Utils::isZeroPage(curAddr)) {
+                chunk->flags[page_i] = Area::ZERO_PAGE;
+                chunk->pagecount_zero_or_file++;
+                continue;
+            }
+            has_hash = store_pages;
+        }
+
+        if ((area.flags & Area::AREA_FILE) && (!page_present || page_file)) {
+            chunk->flags[page_i] = Area::FILE_PAGE;
+            chunk->pagecount_zero_or_file++;
+            continue;
+        }
+
+        chunk->pagecount_full++;
+        char* dst = chunk->data + chunk->data_size;
+
+        if (store_pages) {
+            int64_t index = has_hash ? PageStore::insert(curAddr, hash) : PageStore::insert(curAddr);
+            if (index >= 0) {
+                uint32_t store_index = static_cast<uint32_t>(index);
+                memcpy(dst, &store_index, sizeof(uint32_t));
+                chunk->data_size += sizeof(uint32_t);
+                chunk->flags[page_i] = Area::STORE_PAGE;
+                continue;
+            }
+        }
+
+        if (compressed) {
+            /* Each page is compressed independently. We only keep the
+             * compressed page if it is smaller than the original, so that
+             * the chunk buffer never overflows. */
+            int compressed_size = SaveStateCodec::compress(SaveStateCodec::MAIN_CONTEXT + 1 + chunk->worker,
+                chunk->codec, chunk->codec_level, curAddr, dst + sizeof(int), page_size, page_size - sizeof(int));
+            if (compressed_size > 0) {
+                memcpy(dst, &compressed_size, sizeof(int));
+                chunk->data_size += sizeof(int) + compressed_size;
+                chunk->flags[page_i] = Area::COMPRESSED_PAGE;
+                continue;
+            }
+        }
+
+        memcpy(dst, curAddr, page_size);
+        chunk->data_size += page_size;
+        chunk->flags[page_i] = Area::FULL_PAGE;
+    }
+}
+
+void SaveStateWorkers::loadChunk(Chunk* chunk)
+{
+    size_t page_size = Utils::getPageSize();
+    chunk->errors = 0;
+
+    for (int i = 0; i < chunk->nb_pages; i++) {
+        char* dst = chunk->page_addr[i];
+        const char* src = chunk->page_src[i];
+
+        if (chunk->flags[i] == Area::FULL_PAGE) {
+            memcpy(dst, src, page_size);
+        }
+        else {
+            /* Compressed length was already validated when queuing the page */
+            int compressed_length;
+            memcpy(&compressed_length, src, sizeof(int));
+            int ret = SaveStateCodec::decompress(SaveStateCodec::MAIN_CONTEXT + 1 + chunk->worker,
+                chunk->codec, src + sizeof(int), dst, compressed_length, page_size);
+            if (ret != static_cast<int>(page_size)) {
+                memset(dst, 0, page_size);
+                chunk->errors++;
+            }
+        }
+    }
+}
+
+}
@@ -0,0 +1,128 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_SAVESTATEWORKERS_H
+#define LIBTAS_SAVESTATEWORKERS_H
+
+#include "MemArea.h"
+
+#include <cstddef>
+#include <semaphore.h>
+
+namespace libtas {
+
+/* Pool of helper threads used to split the processing of memory pages when
+ * saving or loading a state.
+ *
+ * Threads must not be created while game threads are suspended (a suspended
+ * thread may hold the malloc lock), so the pool is spawned beforehand, from
+ * SaveStateManager. Threads are created as native threads, so they are not
+ * registered by ThreadManager and are not suspended with game threads.
+ *
+ * Everything used by the pool (control structure, thread stacks and chunk
+ * buffers) is stored inside ReservedMemory, so that it is neither saved into
+ * nor overwritten by a savestate. */
+namespace SaveStateWorkers {
+
+    enum {
+        MAX_WORKERS = 8,
+        NB_CHUNKS = 2 * MAX_WORKERS,
+        CHUNK_SIZE = 1024 * 1024, // size in bytes of the memory processed by one job
+        MAX_CHUNK_PAGES = CHUNK_SIZE / 4096,
+        WORKER_STACK_SIZE = 256 * 1024,
+    };
+
+    /* One unit of work, a contiguous range of pages from a single area */
+    struct Chunk {
+        /* Copy of the area the pages belong to */
+        Area area;
+
+        /* Is this the first/last chunk of the area */
+        bool first;
+        bool last;
+
+        /* Range of pages to process */
+        char* addr;
+        int nb_pages;
+
+        /* File descriptor of /proc/self/pagemap, only accessed with pread() */
+        int spmfd;
+
+        /* Function executed by the worker thread */
+        void (*run)(Chunk* chunk);
+
+        /* Codec and level of compressed pages */
+        int codec;
+        int codec_level;
+
+        /* Index of the worker thread processing the chunk, starting at 0 */
+        int worker;
+
+        /* Resulting page flags and page content, in the savestate format */
+        char flags[MAX_CHUNK_PAGES];
+        char* data;
+        size_t data_size;
+
+        /* When loading a state, target address and data of each page inside
+         * the mapped pages file */
+        char* page_addr[MAX_CHUNK_PAGES];
+        const char* page_src[MAX_CHUNK_PAGES];
+
+        /* Number of pages that could not be decompressed */
+        int errors;
+
+        /* Page statistics */
+        int pagecount_unmapped;
+        int pagecount_zero_or_file;
+        int pagecount_full;
+
+        /* Posted when the chunk has been processed */
+        sem_t done;
+    };
+
+    /* Spawn the worker threads if needed. Must be called before suspending
+     * game threads */
+    void init();
+
+    /* Returns if the worker threads are available */
+    bool available();
+
+    /* Returns the number of worker threads */
+    int count();
+
+    /* Returns the chunk at the given position of the ring */
+    Chunk* getChunk(int index);
+
+    /* Send a chunk to be processed by a worker thread */
+    void push(Chunk* chunk);
+
+    /* Wait for a chunk to be processed */
+    void wait(Chunk* chunk);
+
+    /* Job to classify, compress and copy memory pages of a chunk, the same way
+     * as the savestate code does */
+    void saveChunk(Chunk* chunk);
+
+    /* Job to copy or decompress pages from a mapped pages file into their
+     * target address */
+    void loadChunk(Chunk* chunk);
+}
+}
+
+#endif
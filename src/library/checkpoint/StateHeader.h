@@ -22,12 +22,26 @@
 #ifndef LIBTAS_STATEHEADER_H
 #define LIBTAS_STATEHEADER_H
 
+#include <cstdint>
 #include <pthread.h>
 
 #define STATEMAXTHREADS 1000
 
 namespace libtas {
 struct StateHeader {
+    enum Flags {
+        SH_INDEPENDENT_BLOCKS = 0x01, /* Each compressed page can be decompressed on its own */
+        SH_PAGE_STORE = 0x02, /* Some pages are stored inside the page store */
+    };
+    int flags;
+
+    /* Codec and level used to compress pages, from SharedConfig::SaveStateCodec */
+    int codec;
+    int codec_level;
+
+    /* Identifier of the page store referenced by the savestate */
+    uint64_t store_id;
+
     int thread_count;
     pthread_t pthread_ids[STATEMAXTHREADS];
     pid_t tids[STATEMAXTHREADS];
@@ -19,6 +19,7 @@
 
 #include "AVEncoder.h"
 #include "NutMuxer.h"
+#include "LibavMuxer.h"
 #include "ImageScaling.h"
 #include "ImageScalingSws.h"
 
@@ -36,6 +37,8 @@
 #include <sstream>
 #include <iomanip>
 #include <sys/wait.h> // waitpid
+#include <csignal>
+#include <pthread.h>
 
 namespace libtas {
 
@@ -55,57 +58,28 @@ AVEncoder::~AVEncoder() {
 }
 
 void AVEncoder::init() {
-    std::ostringstream commandline;
-    commandline << "ffmpeg -xerror -hide_banner -y -f nut -i - ";
-    commandline << ffmpeg_options;
-    commandline << " \"";
+    std::ostringstream filename;
     char* dumpfile_ext = strrchr(dumpfile, '.');
     if (dumpfile_ext == NULL) dumpfile_ext = dumpfile + strnlen(dumpfile, 4096);
     
-    commandline.write(dumpfile, static_cast<int>(dumpfile_ext - dumpfile));
+    filename.write(dumpfile, static_cast<int>(dumpfile_ext - dumpfile));
     /* Add segment number to filename if not the first */
     if (segment_number > 0) {
-        commandline << "_" << segment_number;
+        filename << "_" << segment_number;
     }
-    commandline << dumpfile_ext;
-    commandline << "\"";
-
-    {
-        GlobalNative gn;
-        
-        int pipefd[2] = {-1, -1};
-        if (pipe(pipefd) < 0) {
-            LOG(LL_ERROR, LCF_DUMP, "Could not create a pipe to ffmpeg");
-            return;
-        }
+    filename << dumpfile_ext;
+    encode_path = filename.str();
 
-        ffmpeg_pid = fork();
-        if (ffmpeg_pid < 0) {
-            LOG(LL_ERROR, LCF_DUMP, "Could not fork the ffmpeg process");
-            close(pipefd[0]);
-            close(pipefd[1]);
-            return;
-        }
-
-        if (ffmpeg_pid == 0) {
-            close(pipefd[1]);
-            dup2(pipefd[0], STDIN_FILENO);
-            close(pipefd[0]);
-            execlp("sh", "sh", "-c", commandline.str().c_str(), nullptr);
-            _exit(127);
-        }
-
-        close(pipefd[0]);
-        ffmpeg_pipe = fdopen(pipefd[1], "w");
-        if (!ffmpeg_pipe) {
-            LOG(LL_ERROR, LCF_DUMP, "Could not open the ffmpeg pipe stream");
-            close(pipefd[1]);
-            waitpid(ffmpeg_pid, nullptr, 0);
-            ffmpeg_pid = -1;
-            return;
-        }
+    use_libav = (Global::shared_config.encode_backend == SharedConfig::ENCODE_BACKEND_LIBAV);
+    if (use_libav && !LibavMuxer::isAvailable()) {
+        LOG(LL_WARN, LCF_DUMP, "In-process encoding is not available, using an ffmpeg process instead");
+        use_libav = false;
     }
 
+    /* Start the ffmpeg process that receives the frames */
+    if (!use_libav && !startFfmpeg())
+        return;
+
     if (ScreenCapture::isInited()) {
         initMuxer();
     }
@@ -116,11 +90,56 @@ void AVEncoder::init() {
     sendData(&segment_number, sizeof(int));
 }
 
-void AVEncoder::initMuxer() {
-    if (nutMuxer) {
-        nutMuxer->finish();
-        delete nutMuxer;
-        nutMuxer = nullptr;
+bool AVEncoder::startFfmpeg() {
+    std::ostringstream commandline;
+    commandline << "ffmpeg -xerror -hide_banner -y -f nut -i - ";
+    commandline << ffmpeg_options;
+    commandline << " \"" << encode_path << "\"";
+
+    GlobalNative gn;
+    
+    int pipefd[2] = {-1, -1};
+    if (pipe(pipefd) < 0) {
+        LOG(LL_ERROR, LCF_DUMP, "Could not create a pipe to ffmpeg");
+        return false;
+    }
+
+    ffmpeg_pid = fork();
+    if (ffmpeg_pid < 0) {
+        LOG(LL_ERROR, LCF_DUMP, "Could not fork the ffmpeg process");
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return false;
+    }
+
+    if (ffmpeg_pid == 0) {
+        close(pipefd[1]);
+        dup2(pipefd[0], STDIN_FILENO);
+        close(pipefd[0]);
+        execlp("sh", "sh", "-c", commandline.str().c_str(), nullptr);
+        _exit(127);
+    }
+
+    close(pipefd[0]);
+    ffmpeg_pipe = fdopen(pipefd[1], "w");
+    if (!ffmpeg_pipe) {
+        LOG(LL_ERROR, LCF_DUMP, "Could not open the ffmpeg pipe stream");
+        close(pipefd[1]);
+        waitpid(ffmpeg_pid, nullptr, 0);
+        ffmpeg_pid = -1;
+        return false;
+    }
+
+    return true;
+}
+
+bool AVEncoder::initMuxer() {
+    flushQueue();
+
+    if (muxer) {
+        muxer->finish();
+        delete muxer;
+        muxer = nullptr;
     }
 
     int width, height;
@@ -165,48 +184,83 @@ void AVEncoder::initMuxer() {
     int encode_framerate_num = Global::shared_config.video_framerate_num ? Global::shared_config.video_framerate_num : Global::shared_config.initial_framerate_num;
     int encode_framerate_den = Global::shared_config.video_framerate_num ? Global::shared_config.video_framerate_den : Global::shared_config.initial_framerate_den;
 
-    nutMuxer = new NutMuxer(encode_width, encode_height, encode_framerate_num, encode_framerate_den, ScreenCapture::pixelFormatToFourCC(pixfmt), audiocontext.frequency, audiocontext.bytes_per_sample, audiocontext.channels, ffmpeg_pipe);
+    if (use_libav) {
+        LibavMuxer* libav_muxer = new LibavMuxer(encode_path.c_str(), encode_width, encode_height, encode_framerate_num, encode_framerate_den, pixfmt, audiocontext.frequency, audiocontext.bytes_per_sample, audiocontext.channels, ffmpeg_options);
+        if (libav_muxer->isInited()) {
+            muxer = libav_muxer;
+        }
+        else {
+            /* Bad codec options, or output file that could not be opened */
+            delete libav_muxer;
+            LOG(LL_WARN, LCF_DUMP, "In-process encoding could not start, using an ffmpeg process instead");
+            use_libav = false;
+            if (!startFfmpeg()) {
+                fini();
+                /* The socket may be locked here, the alert is sent by
+                 * encodeOneFrame() */
+                start_failed = true;
+                return false;
+            }
+        }
+    }
+
+    if (!use_libav) {
+        muxer = new NutMuxer(encode_width, encode_height, encode_framerate_num, encode_framerate_den, ScreenCapture::pixelFormatToFourCC(pixfmt), audiocontext.frequency, audiocontext.bytes_per_sample, audiocontext.channels, ffmpeg_pipe);
+    }
 
     pixels_size = encode_width * encode_height * ScreenCapture::getPixelFormatDepth(pixfmt);
+
+    /* The encoder thread has no previous image to repeat */
+    last_image = nullptr;
+    need_new_image = true;
+    return true;
 }
 
 void AVEncoder::encodeOneFrame(bool is_draw_frame, TimeHolder frametime) {
-    if (!ffmpeg_pipe)
+    if (start_failed) {
+        sendAlertMsg("Encoding could not start, check the log for details");
+        start_failed = false;
+    }
+
+    if (!ffmpeg_pipe && !use_libav)
         return;
     
     /* Check if ffmpeg did exit for some reason */
-    int ret_pid = waitpid(ffmpeg_pid, nullptr, WNOHANG);
-    if (ret_pid == ffmpeg_pid) {
-        LOG(LL_WARN, LCF_DUMP, "ffmpeg process exited, encoding stopped");
-        ffmpeg_pid = 0;
-        fini();
-        return;
+    if (!use_libav) {
+        int ret_pid = waitpid(ffmpeg_pid, nullptr, WNOHANG);
+        if (ret_pid == ffmpeg_pid) {
+            LOG(LL_WARN, LCF_DUMP, "ffmpeg process exited, encoding stopped");
+            ffmpeg_pid = 0;
+            fini();
+            return;
+        }
     }
 
     /* If the muxer is not initialized, try to initialize it. Otherwise, store
      * that we skipped one frame and we need to encode it later.
      */
     AudioContext& audiocontext = AudioContext::get();
-    if (!nutMuxer) {
+    if (!muxer) {
         if (ScreenCapture::isInited()) {
-            initMuxer();
+            if (!initMuxer())
+                return;
 
             /* Encode audio samples that we skipped */
             if (startup_audio_frames > 0) {
                 std::vector<uint8_t> empty_samples(audiocontext.samples_byte_size, AudioBuffer::formatToSilenceByte(audiocontext.format));
                 for (int i=0; i<startup_audio_frames; i++) {
-                    nutMuxer->writeAudioFrame(empty_samples.data(), audiocontext.samples_byte_size);
+                    muxer->writeAudioFrame(empty_samples.data(), audiocontext.samples_byte_size);
                 }
             }
 
-            nutMuxer->writeAudioFrame(startup_audio_bytes.data(), startup_audio_bytes.size());
+            muxer->writeAudioFrame(startup_audio_bytes.data(), startup_audio_bytes.size());
 
             /* Encode startup frames that we skipped */
 
             /* Just getting the size of an image */
             startup_audio_bytes.resize(pixels_size, 0); // reusing the audio samples vector
             for (int i=0; i<startup_video_frames; i++) {
-                nutMuxer->writeVideoFrame(startup_audio_bytes.data(), pixels_size);
+                muxer->writeVideoFrame(startup_audio_bytes.data(), pixels_size);
             }
         }
         else {
@@ -223,12 +277,7 @@ void AVEncoder::encodeOneFrame(bool is_draw_frame, TimeHolder frametime) {
         }
     }
 
-    /*** Audio ***/
-    nutMuxer->writeAudioFrame(audiocontext.samples_data.data(), audiocontext.samples_byte_size);
-
-    /*** Video ***/
-
-    /* Number of frames to encode */
+    /* Number of video frames to encode */
     int frames = 1;
 
     if (Global::shared_config.video_framerate_num) {
@@ -239,6 +288,19 @@ void AVEncoder::encodeOneFrame(bool is_draw_frame, TimeHolder frametime) {
         frame_remainder -= frames;
     }
 
+    /* Scaling and muxing are done by the encoder thread */
+    if (Global::shared_config.video_queue_size > 0) {
+        queueFrame(is_draw_frame, frames);
+        return;
+    }
+
+    flushQueue();
+
+    /*** Audio ***/
+    muxer->writeAudioFrame(audiocontext.samples_data.data(), audiocontext.samples_byte_size);
+
+    /*** Video ***/
+
     /* Access to the screen pixels, or last screen pixels if not a draw frame */
     ScreenCapture::getPixelsFromSurface(&pixels, is_draw_frame);
 
@@ -249,11 +311,163 @@ void AVEncoder::encodeOneFrame(bool is_draw_frame, TimeHolder frametime) {
     }
 
     for (int f=0; f<frames; f++) {
-        nutMuxer->writeVideoFrame(pixel_ptr, pixels_size);
+        muxer->writeVideoFrame(pixel_ptr, pixels_size);
+    }
+}
+
+void AVEncoder::queueFrame(bool is_draw_frame, int frames) {
+    AudioContext& audiocontext = AudioContext::get();
+
+    /* Access to the screen pixels, or last screen pixels if not a draw frame */
+    int capture_size = ScreenCapture::getPixelsFromSurface(&pixels, is_draw_frame);
+    bool new_image = is_draw_frame || need_new_image;
+
+    GlobalNative gn;
+
+    /* Restart the encoder thread if the queue size has changed */
+    size_t queue_size = Global::shared_config.video_queue_size;
+    if (encoder_thread.joinable() && (queue.size() != queue_size))
+        flushQueue();
+
+    if (!encoder_thread.joinable()) {
+        queue.resize(queue_size);
+        queue_head = 0;
+        queue_tail = 0;
+        queue_stop = false;
+        encoder_thread = std::thread(&AVEncoder::encoderLoop, this);
+    }
+
+    /* Audio of frames that were not queued is sent with the next frame */
+    pending_frame.audio.insert(pending_frame.audio.end(), audiocontext.samples_data.data(), audiocontext.samples_data.data() + audiocontext.samples_byte_size);
+
+    std::unique_lock<std::mutex> lock(queue_mutex);
+
+    stats.last_stall_ms = 0;
+    if ((queue_tail - queue_head) == queue.size()) {
+        if (Global::shared_config.video_queue_policy == SharedConfig::ENCODE_QUEUE_DROP) {
+            /* Don't wait, and encode the previous image instead */
+            pending_frame.repeat_frames += frames;
+            stats.dropped_frames += frames;
+            if (new_image)
+                need_new_image = true;
+            return;
+        }
+
+        TimeHolder wait_start = TimeHolder::now();
+        queue_cond.wait(lock, [this]() {return (queue_tail - queue_head) < queue.size();});
+        TimeHolder wait_time = TimeHolder::now() - wait_start;
+        stats.last_stall_ms = wait_time.toMs();
+        stats.total_stall_ms += stats.last_stall_ms;
+    }
+
+    /* The encoder thread does not access the free frames, so we can fill
+     * this one without holding the lock */
+    QueuedFrame& frame = queue[queue_tail % queue.size()];
+    lock.unlock();
+
+    frame.new_image = new_image;
+    if (new_image)
+        frame.pixels.assign(pixels, pixels + capture_size);
+    std::swap(frame.audio, pending_frame.audio);
+    pending_frame.audio.clear();
+    frame.repeat_frames = pending_frame.repeat_frames;
+    pending_frame.repeat_frames = 0;
+    frame.frames = frames;
+    need_new_image = false;
+
+    lock.lock();
+    queue_tail++;
+    lock.unlock();
+    queue_cond.notify_all();
+}
+
+void AVEncoder::encodeQueuedFrame(QueuedFrame& frame) {
+    muxer->writeAudioFrame(frame.audio.data(), frame.audio.size());
+
+    for (int f=0; f<frame.repeat_frames; f++) {
+        muxer->writeVideoFrame(last_image, pixels_size);
+    }
+
+    if (frame.new_image) {
+        /* Keep the image for the next frames, and give the buffer of the
+         * previous image back to the queue */
+        std::swap(frame.pixels, last_pixels);
+        last_image = last_pixels.data();
+
+        if (image_scaling && image_scaling->isInited()) {
+            last_image = image_scaling->convertFrame(last_pixels.data());
+        }
+    }
+
+    for (int f=0; f<frame.frames; f++) {
+        muxer->writeVideoFrame(last_image, pixels_size);
+    }
+}
+
+void AVEncoder::encoderLoop() {
+    /* This thread only runs our own code */
+    GlobalNative gn;
+
+    /* Signals sent to the process must be handled by game threads. This
+     * also makes writes to a closed pipe fail instead of raising SIGPIPE */
+    sigset_t mask;
+    sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    while (true) {
+        queue_cond.wait(lock, [this]() {return queue_stop || (queue_head != queue_tail);});
+
+        /* Encode all queued frames before stopping */
+        if (queue_head == queue_tail)
+            break;
+
+        QueuedFrame& frame = queue[queue_head % queue.size()];
+        lock.unlock();
+        encodeQueuedFrame(frame);
+        lock.lock();
+
+        queue_head++;
+        queue_cond.notify_all();
     }
 }
 
+void AVEncoder::flushQueue() {
+    if (!encoder_thread.joinable())
+        return;
+
+    GlobalNative gn;
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        queue_stop = true;
+    }
+    queue_cond.notify_all();
+    encoder_thread.join();
+
+    /* Encode the frames that were dropped after the last queued frame */
+    if (!pending_frame.audio.empty() || (pending_frame.repeat_frames > 0)) {
+        pending_frame.new_image = false;
+        pending_frame.frames = 0;
+        encodeQueuedFrame(pending_frame);
+        pending_frame.audio.clear();
+        pending_frame.repeat_frames = 0;
+    }
+}
+
+AVEncoder::QueueStats AVEncoder::queueStats() {
+    GlobalNative gn;
+    std::lock_guard<std::mutex> lock(queue_mutex);
+
+    QueueStats queue_stats = stats;
+    queue_stats.depth = queue_tail - queue_head;
+    queue_stats.size = encoder_thread.joinable() ? queue.size() : 0;
+    return queue_stats;
+}
+
 void AVEncoder::resize(int width, int height) {
+    flushQueue();
+
     if (image_scaling && image_scaling->isInited()) {
         image_scaling->sourceHasResized(width, height);
     }
@@ -265,10 +479,12 @@ void AVEncoder::resize(int width, int height) {
 }
 
 void AVEncoder::fini() {
-    if (nutMuxer) {
-        nutMuxer->finish();
-        delete nutMuxer;
-        nutMuxer = nullptr;
+    flushQueue();
+
+    if (muxer) {
+        muxer->finish();
+        delete muxer;
+        muxer = nullptr;
     }
 
     if (image_scaling) {
@@ -289,6 +505,8 @@ void AVEncoder::fini() {
         waitpid(ffmpeg_pid, nullptr, 0);
         ffmpeg_pid = -1;
     }
+
+    use_libav = false;
 }
 
 }
@@ -23,12 +23,16 @@
 #include "TimeHolder.h"
 
 #include <vector>
+#include <string>
 #include <memory> // std::unique_ptr
 #include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 namespace libtas {
 
-class NutMuxer;
+class Muxer;
 class ImageScaling;
 
 class AVEncoder {
@@ -37,8 +41,9 @@ class AVEncoder {
         ~AVEncoder();
 
         /* Initialize the encoder.
-         * It sets the pipe to an ffmpeg process, and initialize the muxer
-         * with the proper image/sound parameters.
+         * It sets the pipe to an ffmpeg process, unless frames are encoded
+         * inside the game process, and initialize the muxer with the proper
+         * image/sound parameters.
          */
         void init();
 
@@ -46,10 +51,18 @@ class AVEncoder {
          */
         void fini();
 
+        /* Start the ffmpeg process and the pipe that receives the frames.
+         * Returns false if it could not be started.
+         */
+        bool startFfmpeg();
+
         /* Initialize the muxer. Called by the constructor if parameters are
-         * available, or later if parameters are not available yet.
+         * available, or later if parameters are not available yet. If frames
+         * cannot be encoded inside the game process, it uses an ffmpeg
+         * process instead. Returns false if encoding could not start, in
+         * which case the encode is closed.
          */
-        void initMuxer();
+        bool initMuxer();
 
         /* Encode a video and audio frame.
          * @param draw           Is this a draw frame?
@@ -63,6 +76,23 @@ class AVEncoder {
          */
         void resize(int width, int height);
 
+        /* Wait for the encoder thread to encode all queued frames, and stop
+         * it. It must be called before the encoder is modified by another
+         * thread, and before saving or loading a state, so that the thread
+         * does not run while the game memory is saved or restored.
+         */
+        void flushQueue();
+
+        /* Statistics of the encode queue, shown in the profiler */
+        struct QueueStats {
+            int depth; // number of frames waiting to be encoded
+            int size; // size of the queue, or 0 if frames are encoded by the game thread
+            float last_stall_ms; // time the game waited for the encoder on the last frame
+            float total_stall_ms; // time the game waited for the encoder since the start
+            int dropped_frames; // frames encoded with the previous image
+        };
+
+        QueueStats queueStats();
 
         /* Filename of the encode. We use a static array because it can be set
          * very early in the game execution, before objects like std::string
@@ -75,9 +105,36 @@ class AVEncoder {
 
         static int segment_number;
     private:
+        /* Frame handed over to the encoder thread */
+        struct QueuedFrame {
+            std::vector<uint8_t> pixels; // captured pixels, if a new image
+            bool new_image;
+            std::vector<uint8_t> audio;
+            int repeat_frames; // frames of the previous image, encoded first
+            int frames; // frames of the new image, or of the previous one
+        };
+
+        /* Hand over the current frame to the encoder thread */
+        void queueFrame(bool is_draw_frame, int frames);
+
+        /* Scale and mux a frame from the queue */
+        void encodeQueuedFrame(QueuedFrame& frame);
+
+        /* Main loop of the encoder thread */
+        void encoderLoop();
+
         FILE *ffmpeg_pipe = nullptr;
         pid_t ffmpeg_pid = -1;
-        NutMuxer* nutMuxer = nullptr;
+        Muxer* muxer = nullptr;
+
+        /* Frames are encoded by libavcodec instead of an ffmpeg process */
+        bool use_libav = false;
+
+        /* Encoding could not start, and the user must be alerted */
+        bool start_failed = false;
+
+        /* Path of the encode file, with the segment number */
+        std::string encode_path;
         ImageScaling* image_scaling = nullptr;
 
         uint8_t* pixels = nullptr;
@@ -89,6 +146,29 @@ class AVEncoder {
 
         /* remainder of the number of video frames to send */
         double frame_remainder = 0;
+
+        /* Ring of frames encoded by the encoder thread. Frames between
+         * queue_head and queue_tail are waiting to be encoded */
+        std::vector<QueuedFrame> queue;
+        uint64_t queue_head = 0;
+        uint64_t queue_tail = 0;
+        bool queue_stop = false;
+        std::mutex queue_mutex;
+        std::condition_variable queue_cond;
+        std::thread encoder_thread;
+
+        /* Last image sent by the encoder thread */
+        std::vector<uint8_t> last_pixels;
+        const uint8_t* last_image = nullptr;
+
+        /* Frames that could not be queued because the queue was full */
+        QueuedFrame pending_frame = {};
+
+        /* If the next queued frame must hold an image, because the last drawn
+         * image was dropped, or no image was sent yet */
+        bool need_new_image = true;
+
+        QueueStats stats = {};
 };
 
 extern std::unique_ptr<AVEncoder> avencoder;
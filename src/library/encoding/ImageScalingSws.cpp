@@ -87,46 +87,42 @@ bool ImageScalingSws::isInited()
     return sws_context;
 }
 
-void ImageScalingSws::init(int src_width, int src_height, int src_pixfmt, int dst_width, int dst_height, int video_filter)
+AVPixelFormat ImageScalingSws::avPixelFormat(int pixfmt)
 {
-    sws_format = AV_PIX_FMT_NONE;
-    switch(src_pixfmt) {
+    switch(pixfmt) {
         case ScreenCapture::PIXELFORMAT_RGBA8:
-            sws_format = AV_PIX_FMT_RGBA;
-            break;
+            return AV_PIX_FMT_RGBA;
         case ScreenCapture::PIXELFORMAT_BGRA8:
-            sws_format = AV_PIX_FMT_BGRA;
-            break;
+            return AV_PIX_FMT_BGRA;
         case ScreenCapture::PIXELFORMAT_ARGB8:
-            sws_format = AV_PIX_FMT_ARGB;
-            break;
+            return AV_PIX_FMT_ARGB;
         case ScreenCapture::PIXELFORMAT_ABGR8:
-            sws_format = AV_PIX_FMT_ABGR;
-            break;
+            return AV_PIX_FMT_ABGR;
         case ScreenCapture::PIXELFORMAT_RGBX8:
-            sws_format = AV_PIX_FMT_RGB0;
-            break;
+            return AV_PIX_FMT_RGB0;
         case ScreenCapture::PIXELFORMAT_BGRX8:
-            sws_format = AV_PIX_FMT_BGR0;
-            break;
+            return AV_PIX_FMT_BGR0;
         case ScreenCapture::PIXELFORMAT_XRGB8:
-            sws_format = AV_PIX_FMT_0RGB;
-            break;
+            return AV_PIX_FMT_0RGB;
         case ScreenCapture::PIXELFORMAT_XBGR8:
-            sws_format = AV_PIX_FMT_0BGR;
-            break;
+            return AV_PIX_FMT_0BGR;
         case ScreenCapture::PIXELFORMAT_RGB24:
-            sws_format = AV_PIX_FMT_RGB24;
-            break;
+            return AV_PIX_FMT_RGB24;
         case ScreenCapture::PIXELFORMAT_BGR24:
-            sws_format = AV_PIX_FMT_BGR24;
-            break;
+            return AV_PIX_FMT_BGR24;
         case ScreenCapture::PIXELFORMAT_RGBA16:
-            sws_format = AV_PIX_FMT_BGR48LE;
-            break;
+            return AV_PIX_FMT_BGR48LE;
         default:
-            LOG(LL_ERROR, LCF_DUMP, "Unsupported pixel format for scaling");
-            return;
+            return AV_PIX_FMT_NONE;
+    }
+}
+
+void ImageScalingSws::init(int src_width, int src_height, int src_pixfmt, int dst_width, int dst_height, int video_filter)
+{
+    sws_format = avPixelFormat(src_pixfmt);
+    if (sws_format == AV_PIX_FMT_NONE) {
+        LOG(LL_ERROR, LCF_DUMP, "Unsupported pixel format for scaling");
+        return;
     }
 
     sws_flags = 0;
@@ -46,6 +46,10 @@ public:
 
     void sourceHasResized(int width, int height);
 
+    /* Returns the libav pixel format of a screen pixel format, or
+     * AV_PIX_FMT_NONE if not supported */
+    static AVPixelFormat avPixelFormat(int pixfmt);
+
 private:
     /* Context for scaling images */
     struct SwsContext *sws_context;
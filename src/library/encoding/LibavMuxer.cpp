@@ -0,0 +1,862 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "LibavMuxer.h"
+#include "ImageScalingSws.h"
+
+#include "logging.h"
+#include "hook.h"
+#include "GlobalState.h"
+#include "screencapture/ScreenCapture.h"
+
+#ifdef LIBTAS_HAS_LIBAV
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/channel_layout.h>
+#include <libavutil/pixdesc.h>
+#include <libswscale/swscale.h>
+}
+
+/* The channel layout API was added in ffmpeg 5.1 */
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(59,37,100)
+#define LIBTAS_LIBAV_ENCODING
+#endif
+#endif
+
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+namespace libtas {
+
+#ifdef LIBTAS_LIBAV_ENCODING
+
+/* Link dynamically to libav functions, so that libTAS does not depend on
+ * these libraries when in-process encoding is not used.
+ */
+DEFINE_ORIG_POINTER(avcodec_version)
+DEFINE_ORIG_POINTER(avcodec_find_encoder)
+DEFINE_ORIG_POINTER(avcodec_find_encoder_by_name)
+DEFINE_ORIG_POINTER(avcodec_alloc_context3)
+DEFINE_ORIG_POINTER(avcodec_open2)
+DEFINE_ORIG_POINTER(avcodec_parameters_from_context)
+DEFINE_ORIG_POINTER(avcodec_send_frame)
+DEFINE_ORIG_POINTER(avcodec_receive_packet)
+DEFINE_ORIG_POINTER(avcodec_free_context)
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(61,13,100)
+DEFINE_ORIG_POINTER(avcodec_get_supported_config)
+#endif
+DEFINE_ORIG_POINTER(av_packet_alloc)
+DEFINE_ORIG_POINTER(av_packet_free)
+DEFINE_ORIG_POINTER(av_packet_rescale_ts)
+
+DEFINE_ORIG_POINTER(avformat_version)
+DEFINE_ORIG_POINTER(avformat_alloc_output_context2)
+DEFINE_ORIG_POINTER(avformat_new_stream)
+DEFINE_ORIG_POINTER(avformat_write_header)
+DEFINE_ORIG_POINTER(avformat_free_context)
+DEFINE_ORIG_POINTER(av_interleaved_write_frame)
+DEFINE_ORIG_POINTER(av_write_trailer)
+DEFINE_ORIG_POINTER(avio_open)
+DEFINE_ORIG_POINTER(avio_closep)
+
+DEFINE_ORIG_POINTER(avutil_version)
+DEFINE_ORIG_POINTER(av_frame_alloc)
+DEFINE_ORIG_POINTER(av_frame_free)
+DEFINE_ORIG_POINTER(av_frame_get_buffer)
+DEFINE_ORIG_POINTER(av_frame_make_writable)
+DEFINE_ORIG_POINTER(av_dict_set)
+DEFINE_ORIG_POINTER(av_dict_get)
+DEFINE_ORIG_POINTER(av_dict_free)
+DEFINE_ORIG_POINTER(av_get_pix_fmt)
+DEFINE_ORIG_POINTER(av_channel_layout_default)
+DEFINE_ORIG_POINTER(av_strerror)
+
+/* Shared with ImageScalingSws */
+DECLARE_ORIG_POINTER(sws_getContext)
+DECLARE_ORIG_POINTER(sws_scale)
+DECLARE_ORIG_POINTER(sws_freeContext)
+
+static void logError(const char* message, int error)
+{
+    char error_string[AV_ERROR_MAX_STRING_SIZE] = {0};
+    orig::av_strerror(error, error_string, AV_ERROR_MAX_STRING_SIZE);
+    LOG(LL_ERROR, LCF_DUMP, "%s: %s", message, error_string);
+}
+
+/* Returns the pixel formats or the sample formats supported by an encoder,
+ * or an empty list if any format is supported */
+static std::vector<int> supportedFormats(const AVCodecContext* context, const AVCodec* codec, bool video)
+{
+    std::vector<int> formats;
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(61,13,100)
+    const void* configs = nullptr;
+    int count = 0;
+    if (orig::avcodec_get_supported_config(context, codec, video ? AV_CODEC_CONFIG_PIX_FORMAT : AV_CODEC_CONFIG_SAMPLE_FORMAT, 0, &configs, &count) < 0)
+        return formats;
+    for (int i = 0; configs && (i < count); i++) {
+        if (video)
+            formats.push_back(static_cast<const AVPixelFormat*>(configs)[i]);
+        else
+            formats.push_back(static_cast<const AVSampleFormat*>(configs)[i]);
+    }
+#else
+    (void) context;
+    if (video && codec->pix_fmts) {
+        for (const AVPixelFormat* f = codec->pix_fmts; *f != AV_PIX_FMT_NONE; f++)
+            formats.push_back(*f);
+    }
+    if (!video && codec->sample_fmts) {
+        for (const AVSampleFormat* f = codec->sample_fmts; *f != AV_SAMPLE_FMT_NONE; f++)
+            formats.push_back(*f);
+    }
+#endif
+    return formats;
+}
+
+/* Returns if audio samples can be converted to this sample format */
+static bool isSupportedSampleFormat(int format)
+{
+    switch (format) {
+        case AV_SAMPLE_FMT_U8:
+        case AV_SAMPLE_FMT_U8P:
+        case AV_SAMPLE_FMT_S16:
+        case AV_SAMPLE_FMT_S16P:
+        case AV_SAMPLE_FMT_S32:
+        case AV_SAMPLE_FMT_S32P:
+        case AV_SAMPLE_FMT_FLT:
+        case AV_SAMPLE_FMT_FLTP:
+        case AV_SAMPLE_FMT_DBL:
+        case AV_SAMPLE_FMT_DBLP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* Write a float sample into a frame, converted to the frame sample format */
+static void writeSample(AVFrame* frame, int channels, int index, int channel, float value)
+{
+    value = std::clamp(value, -1.0f, 1.0f);
+    int interleaved = index * channels + channel;
+
+    switch (frame->format) {
+        case AV_SAMPLE_FMT_U8:
+            frame->data[0][interleaved] = static_cast<uint8_t>(std::lrint(value * 127.0f) + 128);
+            break;
+        case AV_SAMPLE_FMT_U8P:
+            frame->data[channel][index] = static_cast<uint8_t>(std::lrint(value * 127.0f) + 128);
+            break;
+        case AV_SAMPLE_FMT_S16:
+            reinterpret_cast<int16_t*>(frame->data[0])[interleaved] = static_cast<int16_t>(std::lrint(value * 32767.0f));
+            break;
+        case AV_SAMPLE_FMT_S16P:
+            reinterpret_cast<int16_t*>(frame->data[channel])[index] = static_cast<int16_t>(std::lrint(value * 32767.0f));
+            break;
+        case AV_SAMPLE_FMT_S32:
+            reinterpret_cast<int32_t*>(frame->data[0])[interleaved] = static_cast<int32_t>(std::llrint(value * 2147483647.0));
+            break;
+        case AV_SAMPLE_FMT_S32P:
+            reinterpret_cast<int32_t*>(frame->data[channel])[index] = static_cast<int32_t>(std::llrint(value * 2147483647.0));
+            break;
+        case AV_SAMPLE_FMT_FLT:
+            reinterpret_cast<float*>(frame->data[0])[interleaved] = value;
+            break;
+        case AV_SAMPLE_FMT_FLTP:
+            reinterpret_cast<float*>(frame->data[channel])[index] = value;
+            break;
+        case AV_SAMPLE_FMT_DBL:
+            reinterpret_cast<double*>(frame->data[0])[interleaved] = value;
+            break;
+        case AV_SAMPLE_FMT_DBLP:
+            reinterpret_cast<double*>(frame->data[channel])[index] = value;
+            break;
+    }
+}
+
+LibavMuxer::LibavMuxer(const char* filename, int width, int height, int fpsnum, int fpsden, int pixfmt, int samplerate, int samplesize, int channels, const char* options)
+{
+    if (!isAvailable())
+        return;
+
+    GlobalNative gn;
+
+    parseOptions(options);
+
+    int ret = orig::avformat_alloc_output_context2(&format_context, nullptr, format_name.empty() ? nullptr : format_name.c_str(), filename);
+    if (ret < 0 || !format_context) {
+        LOG(LL_ERROR, LCF_DUMP, "Could not find an output format for %s", filename);
+        format_context = nullptr;
+        close();
+        return;
+    }
+
+    packet = orig::av_packet_alloc();
+    if (!packet) {
+        LOG(LL_ERROR, LCF_DUMP, "Could not allocate a packet");
+        close();
+        return;
+    }
+
+    if (!openVideo(width, height, fpsnum, fpsden, pixfmt) || !openAudio(samplerate, samplesize, channels)) {
+        close();
+        return;
+    }
+
+    checkUnusedOptions();
+
+    if (!(format_context->oformat->flags & AVFMT_NOFILE)) {
+        ret = orig::avio_open(&format_context->pb, filename, AVIO_FLAG_WRITE);
+        if (ret < 0) {
+            logError("Could not open the encode file", ret);
+            close();
+            return;
+        }
+    }
+
+    ret = orig::avformat_write_header(format_context, nullptr);
+    if (ret < 0) {
+        logError("Could not write the encode header", ret);
+        close();
+        return;
+    }
+
+    inited = true;
+}
+
+LibavMuxer::~LibavMuxer()
+{
+    GlobalNative gn;
+    close();
+}
+
+bool LibavMuxer::isAvailable()
+{
+    static int available = -1;
+    if (available != -1)
+        return available;
+
+    available = 0;
+
+    /* Structures are accessed directly, so we first look for the major
+     * versions that we were built with */
+
+    /* Disabling logging because we expect some of these to fail */
+    {
+        GlobalNoLog gnl;
+        LINK_NAMESPACE_FULLNAME(avcodec_version, "libavcodec.so." AV_STRINGIFY(LIBAVCODEC_VERSION_MAJOR));
+        LINK_NAMESPACE(avcodec_version, "avcodec");
+        LINK_NAMESPACE_FULLNAME(avformat_version, "libavformat.so." AV_STRINGIFY(LIBAVFORMAT_VERSION_MAJOR));
+        LINK_NAMESPACE(avformat_version, "avformat");
+        LINK_NAMESPACE_FULLNAME(avutil_version, "libavutil.so." AV_STRINGIFY(LIBAVUTIL_VERSION_MAJOR));
+        LINK_NAMESPACE(avutil_version, "avutil");
+    }
+
+    if (!orig::avcodec_version || !orig::avformat_version || !orig::avutil_version) {
+        LOG(LL_WARN, LCF_DUMP, "Could not link to libavcodec and libavformat, in-process encoding will not be available");
+        return false;
+    }
+
+    if ((AV_VERSION_MAJOR(orig::avcodec_version()) != LIBAVCODEC_VERSION_MAJOR) ||
+        (AV_VERSION_MAJOR(orig::avformat_version()) != LIBAVFORMAT_VERSION_MAJOR) ||
+        (AV_VERSION_MAJOR(orig::avutil_version()) != LIBAVUTIL_VERSION_MAJOR)) {
+        LOG(LL_WARN, LCF_DUMP, "Linked libavcodec or libavformat has a different major version than the one libTAS was built with, in-process encoding will not be available");
+        return false;
+    }
+
+    LINK_NAMESPACE(avcodec_find_encoder, "avcodec");
+    LINK_NAMESPACE(avcodec_find_encoder_by_name, "avcodec");
+    LINK_NAMESPACE(avcodec_alloc_context3, "avcodec");
+    LINK_NAMESPACE(avcodec_open2, "avcodec");
+    LINK_NAMESPACE(avcodec_parameters_from_context, "avcodec");
+    LINK_NAMESPACE(avcodec_send_frame, "avcodec");
+    LINK_NAMESPACE(avcodec_receive_packet, "avcodec");
+    LINK_NAMESPACE(avcodec_free_context, "avcodec");
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(61,13,100)
+    LINK_NAMESPACE(avcodec_get_supported_config, "avcodec");
+#endif
+    LINK_NAMESPACE(av_packet_alloc, "avcodec");
+    LINK_NAMESPACE(av_packet_free, "avcodec");
+    LINK_NAMESPACE(av_packet_rescale_ts, "avcodec");
+
+    LINK_NAMESPACE(avformat_alloc_output_context2, "avformat");
+    LINK_NAMESPACE(avformat_new_stream, "avformat");
+    LINK_NAMESPACE(avformat_write_header, "avformat");
+    LINK_NAMESPACE(avformat_free_context, "avformat");
+    LINK_NAMESPACE(av_interleaved_write_frame, "avformat");
+    LINK_NAMESPACE(av_write_trailer, "avformat");
+    LINK_NAMESPACE(avio_open, "avformat");
+    LINK_NAMESPACE(avio_closep, "avformat");
+
+    LINK_NAMESPACE(av_frame_alloc, "avutil");
+    LINK_NAMESPACE(av_frame_free, "avutil");
+    LINK_NAMESPACE(av_frame_get_buffer, "avutil");
+    LINK_NAMESPACE(av_frame_make_writable, "avutil");
+    LINK_NAMESPACE(av_dict_set, "avutil");
+    LINK_NAMESPACE(av_dict_get, "avutil");
+    LINK_NAMESPACE(av_dict_free, "avutil");
+    LINK_NAMESPACE(av_get_pix_fmt, "avutil");
+    LINK_NAMESPACE(av_channel_layout_default, "avutil");
+    LINK_NAMESPACE(av_strerror, "avutil");
+
+    /* Pixel format conversion uses the same swscale functions as image scaling */
+    {
+        GlobalNoLog gnl;
+        LINK_NAMESPACE(sws_getContext, "swscale");
+        LINK_NAMESPACE_FULLNAME(sws_getContext, "libswscale.so.9");
+        LINK_NAMESPACE_FULLNAME(sws_getContext, "libswscale.so.8");
+        LINK_NAMESPACE_FULLNAME(sws_getContext, "libswscale.so.7");
+        LINK_NAMESPACE_FULLNAME(sws_getContext, "libswscale.so.6");
+    }
+    LINK_NAMESPACE(sws_scale, "swscale");
+    LINK_NAMESPACE(sws_freeContext, "swscale");
+
+    const void* functions[] = {
+        reinterpret_cast<void*>(orig::avcodec_find_encoder),
+        reinterpret_cast<void*>(orig::avcodec_find_encoder_by_name),
+        reinterpret_cast<void*>(orig::avcodec_alloc_context3),
+        reinterpret_cast<void*>(orig::avcodec_open2),
+        reinterpret_cast<void*>(orig::avcodec_parameters_from_context),
+        reinterpret_cast<void*>(orig::avcodec_send_frame),
+        reinterpret_cast<void*>(orig::avcodec_receive_packet),
+        reinterpret_cast<void*>(orig::avcodec_free_context),
+#if LIBAVCODEC_VERSION_INT >= AV_VERSION_INT(61,13,100)
+        reinterpret_cast<void*>(orig::avcodec_get_supported_config),
+#endif
+        reinterpret_cast<void*>(orig::av_packet_alloc),
+        reinterpret_cast<void*>(orig::av_packet_free),
+        reinterpret_cast<void*>(orig::av_packet_rescale_ts),
+        reinterpret_cast<void*>(orig::avformat_alloc_output_context2),
+        reinterpret_cast<void*>(orig::avformat_new_stream),
+        reinterpret_cast<void*>(orig::avformat_write_header),
+        reinterpret_cast<void*>(orig::avformat_free_context),
+        reinterpret_cast<void*>(orig::av_interleaved_write_frame),
+        reinterpret_cast<void*>(orig::av_write_trailer),
+        reinterpret_cast<void*>(orig::avio_open),
+        reinterpret_cast<void*>(orig::avio_closep),
+        reinterpret_cast<void*>(orig::av_frame_alloc),
+        reinterpret_cast<void*>(orig::av_frame_free),
+        reinterpret_cast<void*>(orig::av_frame_get_buffer),
+        reinterpret_cast<void*>(orig::av_frame_make_writable),
+        reinterpret_cast<void*>(orig::av_dict_set),
+        reinterpret_cast<void*>(orig::av_dict_get),
+        reinterpret_cast<void*>(orig::av_dict_free),
+        reinterpret_cast<void*>(orig::av_get_pix_fmt),
+        reinterpret_cast<void*>(orig::av_channel_layout_default),
+        reinterpret_cast<void*>(orig::av_strerror),
+        reinterpret_cast<void*>(orig::sws_getContext),
+        reinterpret_cast<void*>(orig::sws_scale),
+        reinterpret_cast<void*>(orig::sws_freeContext),
+    };
+
+    for (const void* function : functions) {
+        if (!function) {
+            LOG(LL_WARN, LCF_DUMP, "Could not link to all libav functions, in-process encoding will not be available");
+            return false;
+        }
+    }
+
+    available = 1;
+    return true;
+}
+
+bool LibavMuxer::isInited()
+{
+    return inited;
+}
+
+void LibavMuxer::parseOptions(const char* options)
+{
+    std::istringstream iss(options);
+    std::string option;
+    std::string value;
+
+    /* All supported options have a value */
+    while (iss >> option) {
+        if ((option.size() < 2) || (option[0] != '-') || !(iss >> value)) {
+            LOG(LL_WARN, LCF_DUMP, "Ignoring ffmpeg option %s", option.c_str());
+            continue;
+        }
+        option.erase(0, 1);
+
+        /* Separate the stream specifier */
+        std::string stream;
+        size_t colon = option.find(':');
+        if (colon != std::string::npos) {
+            stream = option.substr(colon + 1);
+            option.resize(colon);
+        }
+
+        if (option == "vcodec") {
+            option = "c";
+            stream = "v";
+        }
+        else if (option == "acodec") {
+            option = "c";
+            stream = "a";
+        }
+        else if (option == "codec") {
+            option = "c";
+        }
+
+        if ((stream != "") && (stream != "v") && (stream != "a")) {
+            LOG(LL_WARN, LCF_DUMP, "Ignoring ffmpeg option %s with unsupported stream specifier %s", option.c_str(), stream.c_str());
+        }
+        else if (option == "f") {
+            format_name = value;
+        }
+        else if (option == "c") {
+            if (stream != "a")
+                video_codec_name = value;
+            if (stream != "v")
+                audio_codec_name = value;
+        }
+        else if (option == "pix_fmt") {
+            pix_fmt_name = value;
+        }
+        else {
+            /* Everything else is given to the encoders */
+            if (stream != "a")
+                orig::av_dict_set(&video_options, option.c_str(), value.c_str(), 0);
+            if (stream != "v")
+                orig::av_dict_set(&audio_options, option.c_str(), value.c_str(), 0);
+            if (stream == "")
+                common_options.push_back(option);
+        }
+    }
+}
+
+bool LibavMuxer::openVideo(int width, int height, int fpsnum, int fpsden, int pixfmt)
+{
+    const AVCodec* codec = video_codec_name.empty() ?
+        orig::avcodec_find_encoder(format_context->oformat->video_codec) :
+        orig::avcodec_find_encoder_by_name(video_codec_name.c_str());
+    if (!codec) {
+        LOG(LL_ERROR, LCF_DUMP, "Could not find video encoder %s", video_codec_name.c_str());
+        return false;
+    }
+
+    video_stream = orig::avformat_new_stream(format_context, nullptr);
+    video_context = orig::avcodec_alloc_context3(codec);
+    if (!video_stream || !video_context) {
+        LOG(LL_ERROR, LCF_DUMP, "Could not allocate the video encoder");
+        return false;
+    }
+
+    AVPixelFormat src_format = ImageScalingSws::avPixelFormat(pixfmt);
+    if (src_format == AV_PIX_FMT_NONE) {
+        LOG(LL_ERROR, LCF_DUMP, "Unsupported pixel format for encoding");
+        return false;
+    }
+
+    /* Use the pixel format from the options, or keep the screen format if
+     * the encoder supports it, to avoid a conversion */
+    AVPixelFormat dst_format = src_format;
+    if (!pix_fmt_name.empty()) {
+        dst_format = orig::av_get_pix_fmt(pix_fmt_name.c_str());
+        if (dst_format == AV_PIX_FMT_NONE) {
+            LOG(LL_ERROR, LCF_DUMP, "Unknown pixel format %s", pix_fmt_name.c_str());
+            return false;
+        }
+    }
+    else {
+        std::vector<int> formats = supportedFormats(video_context, codec, true);
+        if (!formats.empty() && (std::find(formats.begin(), formats.end(), src_format) == formats.end()))
+            dst_format = static_cast<AVPixelFormat>(formats[0]);
+    }
+
+    video_context->width = width;
+    video_context->height = height;
+    video_context->pix_fmt = dst_format;
+    video_context->time_base = AVRational{fpsden, fpsnum};
+    video_context->framerate = AVRational{fpsnum, fpsden};
+    if (format_context->oformat->flags & AVFMT_GLOBALHEADER)
+        video_context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    int ret = orig::avcodec_open2(video_context, codec, &video_options);
+    if (ret < 0) {
+        logError("Could not open the video encoder", ret);
+        return false;
+    }
+
+    video_stream->time_base = video_context->time_base;
+    ret = orig::avcodec_parameters_from_context(video_stream->codecpar, video_context);
+    if (ret < 0) {
+        logError("Could not set the video stream parameters", ret);
+        return false;
+    }
+
+    video_frame = orig::av_frame_alloc();
+    if (!video_frame) {
+        LOG(LL_ERROR, LCF_DUMP, "Could not allocate a video frame");
+        return false;
+    }
+    video_frame->format = dst_format;
+    video_frame->width = width;
+    video_frame->height = height;
+    ret = orig::av_frame_get_buffer(video_frame, 0);
+    if (ret < 0) {
+        logError("Could not allocate a video frame", ret);
+        return false;
+    }
+
+    /* Same as the default conversion of ffmpeg */
+    if (dst_format != src_format) {
+        sws_context = orig::sws_getContext(width, height, src_format, width, height, dst_format, SWS_BICUBIC, nullptr, nullptr, nullptr);
+        if (!sws_context) {
+            LOG(LL_ERROR, LCF_DUMP, "Error initializing sws context");
+            return false;
+        }
+    }
+
+    video_stride = width * ScreenCapture::getPixelFormatDepth(pixfmt);
+    return true;
+}
+
+bool LibavMuxer::openAudio(int samplerate, int samplesize, int channels)
+{
+    const AVCodec* codec = audio_codec_name.empty() ?
+        orig::avcodec_find_encoder(format_context->oformat->audio_codec) :
+        orig::avcodec_find_encoder_by_name(audio_codec_name.c_str());
+    if (!codec) {
+        LOG(LL_ERROR, LCF_DUMP, "Could not find audio encoder %s", audio_codec_name.c_str());
+        return false;
+    }
+
+    audio_stream = orig::avformat_new_stream(format_context, nullptr);
+    audio_context = orig::avcodec_alloc_context3(codec);
+    if (!audio_stream || !audio_context) {
+        LOG(LL_ERROR, LCF_DUMP, "Could not allocate the audio encoder");
+        return false;
+    }
+
+    /* Sample format is inferred from the sample size, like NutMuxer */
+    audio_channels = channels;
+    audio_sample_size = (channels > 0) ? (samplesize / channels) : 0;
+
+    AVSampleFormat src_format;
+    switch (audio_sample_size) {
+        case 1:
+            src_format = AV_SAMPLE_FMT_U8;
+            break;
+        case 2:
+            src_format = AV_SAMPLE_FMT_S16;
+            break;
+        case 4:
+            src_format = AV_SAMPLE_FMT_FLT;
+            break;
+        default:
+            LOG(LL_ERROR, LCF_DUMP, "Unsupported audio sample size %d", samplesize);
+            return false;
+    }
+
+    /* Use the first encoder sample format that we can convert to */
+    AVSampleFormat dst_format = src_format;
+    std::vector<int> formats = supportedFormats(audio_context, codec, false);
+    if (!formats.empty()) {
+        auto format = std::find_if(formats.begin(), formats.end(), isSupportedSampleFormat);
+        if (format == formats.end()) {
+            LOG(LL_ERROR, LCF_DUMP, "Audio encoder %s does not support any usable sample format", codec->name);
+            return false;
+        }
+        dst_format = static_cast<AVSampleFormat>(*format);
+    }
+
+    audio_context->sample_fmt = dst_format;
+    audio_context->sample_rate = samplerate;
+    orig::av_channel_layout_default(&audio_context->ch_layout, channels);
+    audio_context->time_base = AVRational{1, samplerate};
+    if (format_context->oformat->flags & AVFMT_GLOBALHEADER)
+        audio_context->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+
+    int ret = orig::avcodec_open2(audio_context, codec, &audio_options);
+    if (ret < 0) {
+        logError("Could not open the audio encoder", ret);
+        return false;
+    }
+
+    audio_stream->time_base = audio_context->time_base;
+    ret = orig::avcodec_parameters_from_context(audio_stream->codecpar, audio_context);
+    if (ret < 0) {
+        logError("Could not set the audio stream parameters", ret);
+        return false;
+    }
+
+    /* Encoders accepting any number of samples don't set a frame size */
+    if ((codec->capabilities & AV_CODEC_CAP_VARIABLE_FRAME_SIZE) || (audio_context->frame_size <= 0))
+        audio_frame_size = 1024;
+    else
+        audio_frame_size = audio_context->frame_size;
+
+    audio_frame = orig::av_frame_alloc();
+    if (!audio_frame) {
+        LOG(LL_ERROR, LCF_DUMP, "Could not allocate an audio frame");
+        return false;
+    }
+    audio_frame->format = dst_format;
+    audio_frame->sample_rate = samplerate;
+    audio_frame->nb_samples = audio_frame_size;
+    orig::av_channel_layout_default(&audio_frame->ch_layout, channels);
+    ret = orig::av_frame_get_buffer(audio_frame, 0);
+    if (ret < 0) {
+        logError("Could not allocate an audio frame", ret);
+        return false;
+    }
+
+    return true;
+}
+
+void LibavMuxer::checkUnusedOptions()
+{
+    /* Options for all streams only need to be used by one encoder */
+    const AVDictionaryEntry* entry = nullptr;
+    while ((entry = orig::av_dict_get(video_options, "", entry, AV_DICT_IGNORE_SUFFIX))) {
+        bool common = std::find(common_options.begin(), common_options.end(), entry->key) != common_options.end();
+        if (!common || orig::av_dict_get(audio_options, entry->key, nullptr, 0))
+            LOG(LL_WARN, LCF_DUMP, "Option %s was not used by the encoders", entry->key);
+    }
+
+    entry = nullptr;
+    while ((entry = orig::av_dict_get(audio_options, "", entry, AV_DICT_IGNORE_SUFFIX))) {
+        bool common = std::find(common_options.begin(), common_options.end(), entry->key) != common_options.end();
+        if (!common)
+            LOG(LL_WARN, LCF_DUMP, "Option %s was not used by the audio encoder", entry->key);
+    }
+}
+
+void LibavMuxer::writeVideoFrame(const uint8_t* video, unsigned int len)
+{
+    if (!inited)
+        return;
+
+    GlobalNative gn;
+
+    if (len < static_cast<unsigned int>(video_stride * video_frame->height)) {
+        LOG(LL_ERROR, LCF_DUMP, "Video frame is too small");
+        return;
+    }
+
+    /* The encoder may still reference the previous frame */
+    int ret = orig::av_frame_make_writable(video_frame);
+    if (ret < 0) {
+        logError("Could not write the video frame", ret);
+        return;
+    }
+
+    if (sws_context) {
+        const uint8_t* src_planes[4] = {video, nullptr, nullptr, nullptr};
+        int src_stride[4] = {video_stride, 0, 0, 0};
+        orig::sws_scale(sws_context, src_planes, src_stride, 0, video_frame->height, video_frame->data, video_frame->linesize);
+    }
+    else {
+        /* Frame lines may be padded */
+        for (int y = 0; y < video_frame->height; y++)
+            memcpy(video_frame->data[0] + y * video_frame->linesize[0], video + y * video_stride, video_stride);
+    }
+
+    video_frame->pts = video_pts++;
+    encodeFrame(video_context, video_stream, video_frame);
+}
+
+void LibavMuxer::writeAudioFrame(const uint8_t* samples, unsigned int len)
+{
+    if (!inited)
+        return;
+
+    GlobalNative gn;
+
+    unsigned int count = len / audio_sample_size;
+    size_t offset = audio_samples.size();
+    audio_samples.resize(offset + count);
+
+    for (unsigned int i = 0; i < count; i++) {
+        switch (audio_sample_size) {
+            case 1:
+                audio_samples[offset + i] = (samples[i] - 128) / 128.0f;
+                break;
+            case 2: {
+                int16_t sample;
+                memcpy(&sample, samples + 2*i, sizeof(int16_t));
+                audio_samples[offset + i] = sample / 32768.0f;
+                break;
+            }
+            case 4:
+                memcpy(&audio_samples[offset + i], samples + 4*i, sizeof(float));
+                break;
+        }
+    }
+
+    encodeAudioSamples(false);
+}
+
+void LibavMuxer::encodeAudioSamples(bool flush)
+{
+    /* Only some encoders accept a smaller last frame, the others get a frame
+     * padded with silence */
+    bool small_frames = audio_context->codec->capabilities & (AV_CODEC_CAP_VARIABLE_FRAME_SIZE | AV_CODEC_CAP_SMALL_LAST_FRAME);
+
+    size_t position = 0;
+    while (true) {
+        int available = (audio_samples.size() - position) / audio_channels;
+        if ((available == 0) || ((available < audio_frame_size) && !flush))
+            break;
+
+        int nb_samples = std::min(available, audio_frame_size);
+
+        /* A new buffer may be allocated, so it must have the full size */
+        audio_frame->nb_samples = audio_frame_size;
+        int ret = orig::av_frame_make_writable(audio_frame);
+        if (ret < 0) {
+            logError("Could not write the audio frame", ret);
+            break;
+        }
+
+        if (small_frames)
+            audio_frame->nb_samples = nb_samples;
+        for (int s = 0; s < audio_frame->nb_samples; s++) {
+            for (int c = 0; c < audio_channels; c++) {
+                float value = (s < nb_samples) ? audio_samples[position + s * audio_channels + c] : 0.0f;
+                writeSample(audio_frame, audio_channels, s, c, value);
+            }
+        }
+
+        audio_frame->pts = audio_pts;
+        audio_pts += audio_frame->nb_samples;
+        encodeFrame(audio_context, audio_stream, audio_frame);
+
+        position += nb_samples * audio_channels;
+    }
+
+    audio_samples.erase(audio_samples.begin(), audio_samples.begin() + position);
+}
+
+void LibavMuxer::encodeFrame(AVCodecContext* codec_context, AVStream* stream, AVFrame* frame)
+{
+    int ret = orig::avcodec_send_frame(codec_context, frame);
+    if (ret < 0) {
+        logError("Could not send a frame to the encoder", ret);
+        return;
+    }
+
+    while (true) {
+        ret = orig::avcodec_receive_packet(codec_context, packet);
+        if ((ret == AVERROR(EAGAIN)) || (ret == AVERROR_EOF))
+            return;
+        if (ret < 0) {
+            logError("Could not encode a frame", ret);
+            return;
+        }
+
+        orig::av_packet_rescale_ts(packet, codec_context->time_base, stream->time_base);
+        packet->stream_index = stream->index;
+
+        /* The packet is given to the muxer and reset */
+        ret = orig::av_interleaved_write_frame(format_context, packet);
+        if (ret < 0) {
+            logError("Could not write a packet", ret);
+            return;
+        }
+    }
+}
+
+void LibavMuxer::finish()
+{
+    if (!inited)
+        return;
+
+    GlobalNative gn;
+
+    /* Encode remaining samples and flush the encoders */
+    encodeAudioSamples(true);
+    encodeFrame(video_context, video_stream, nullptr);
+    encodeFrame(audio_context, audio_stream, nullptr);
+
+    int ret = orig::av_write_trailer(format_context);
+    if (ret < 0) {
+        logError("Could not write the encode trailer", ret);
+    }
+
+    close();
+}
+
+void LibavMuxer::close()
+{
+    inited = false;
+
+    if (sws_context) {
+        orig::sws_freeContext(sws_context);
+        sws_context = nullptr;
+    }
+
+    if (video_frame)
+        orig::av_frame_free(&video_frame);
+    if (audio_frame)
+        orig::av_frame_free(&audio_frame);
+    if (video_context)
+        orig::avcodec_free_context(&video_context);
+    if (audio_context)
+        orig::avcodec_free_context(&audio_context);
+    if (packet)
+        orig::av_packet_free(&packet);
+
+    if (format_context) {
+        if (!(format_context->oformat->flags & AVFMT_NOFILE))
+            orig::avio_closep(&format_context->pb);
+        orig::avformat_free_context(format_context);
+        format_context = nullptr;
+    }
+    video_stream = nullptr;
+    audio_stream = nullptr;
+
+    if (video_options)
+        orig::av_dict_free(&video_options);
+    if (audio_options)
+        orig::av_dict_free(&audio_options);
+}
+
+#else
+
+/* Built without libavcodec and libavformat, or with a version too old */
+
+LibavMuxer::LibavMuxer(const char*, int, int, int, int, int, int, int, int, const char*) {}
+
+LibavMuxer::~LibavMuxer() {}
+
+bool LibavMuxer::isAvailable()
+{
+    return false;
+}
+
+bool LibavMuxer::isInited()
+{
+    return false;
+}
+
+void LibavMuxer::writeVideoFrame(const uint8_t*, unsigned int) {}
+
+void LibavMuxer::writeAudioFrame(const uint8_t*, unsigned int) {}
+
+void LibavMuxer::finish() {}
+
+#endif
+
+}
@@ -0,0 +1,122 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_LIBAVMUXER_H_INCL
+#define LIBTAS_LIBAVMUXER_H_INCL
+
+#include "Muxer.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+struct AVFormatContext;
+struct AVCodecContext;
+struct AVStream;
+struct AVFrame;
+struct AVPacket;
+struct AVDictionary;
+struct SwsContext;
+
+namespace libtas {
+
+/* Muxer that encodes frames inside the game process using libavcodec and
+ * libavformat, instead of sending raw frames to an ffmpeg process. Libraries
+ * are linked at runtime, and the ffmpeg command-line options are translated
+ * into encoder options. */
+class LibavMuxer : public Muxer
+{
+public:
+    LibavMuxer(const char* filename, int width, int height, int fpsnum, int fpsden, int pixfmt, int samplerate, int samplesize, int channels, const char* options);
+    ~LibavMuxer();
+
+    /* Returns if libavcodec and libavformat could be linked */
+    static bool isAvailable();
+
+    /* Returns if the encoders and the output file were opened */
+    bool isInited();
+
+    void writeVideoFrame(const uint8_t* video, unsigned int len) override;
+
+    void writeAudioFrame(const uint8_t* samples, unsigned int len) override;
+
+    void finish() override;
+
+private:
+    /* Split the ffmpeg options into the output format, codecs, pixel format
+     * and encoder options */
+    void parseOptions(const char* options);
+
+    bool openVideo(int width, int height, int fpsnum, int fpsden, int pixfmt);
+
+    bool openAudio(int samplerate, int samplesize, int channels);
+
+    /* Warn about options that were not used by any encoder */
+    void checkUnusedOptions();
+
+    /* Encode the audio samples stored so far, by frames of the encoder
+     * size. If `flush` is set, also encode the remaining samples */
+    void encodeAudioSamples(bool flush);
+
+    /* Send a frame to the encoder, or flush the encoder if `frame` is null,
+     * and write all available packets to the output file */
+    void encodeFrame(AVCodecContext* codec_context, AVStream* stream, AVFrame* frame);
+
+    /* Free all allocated objects and close the output file */
+    void close();
+
+    bool inited = false;
+
+    AVFormatContext* format_context = nullptr;
+    AVPacket* packet = nullptr;
+
+    /* Options taken from the ffmpeg command-line */
+    std::string format_name;
+    std::string video_codec_name;
+    std::string audio_codec_name;
+    std::string pix_fmt_name;
+    AVDictionary* video_options = nullptr;
+    AVDictionary* audio_options = nullptr;
+
+    /* Options given for all streams */
+    std::vector<std::string> common_options;
+
+    /* Video encoding */
+    AVCodecContext* video_context = nullptr;
+    AVStream* video_stream = nullptr;
+    AVFrame* video_frame = nullptr;
+    SwsContext* sws_context = nullptr;
+    int video_stride = 0;
+    int64_t video_pts = 0;
+
+    /* Audio encoding */
+    AVCodecContext* audio_context = nullptr;
+    AVStream* audio_stream = nullptr;
+    AVFrame* audio_frame = nullptr;
+    int audio_channels = 0;
+    int audio_sample_size = 0; // size of a sample of one channel
+    int audio_frame_size = 0;
+    int64_t audio_pts = 0;
+
+    /* Audio samples converted to float, waiting for a full encoder frame */
+    std::vector<float> audio_samples;
+};
+}
+
+#endif
@@ -0,0 +1,73 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_MUXER_H_INCL
+#define LIBTAS_MUXER_H_INCL
+
+#include <cstdint>
+
+namespace libtas {
+
+/**
+ * @class Muxer
+ * @brief Abstract interface for the destination of encoded frames.
+ *
+ * Muxer receives the raw video and audio frames of an encode, in the
+ * parameters given when the muxer was created.
+ *
+ * @see NutMuxer for muxing raw frames to an ffmpeg process
+ * @see LibavMuxer for encoding frames inside the game process
+ */
+class Muxer
+{
+public:
+    /**
+     * @brief Virtual destructor.
+     */
+    virtual ~Muxer() = default;
+
+    /**
+     * @brief Writes a video frame.
+     *
+     * @param[in] video Pointer to the frame pixels
+     * @param[in] len   Size of the frame pixels in bytes
+     */
+    virtual void writeVideoFrame(const uint8_t* video, unsigned int len) = 0;
+
+    /**
+     * @brief Writes audio samples.
+     *
+     * Samples are interleaved, and can have any length.
+     *
+     * @param[in] samples Pointer to the audio samples
+     * @param[in] len     Size of the audio samples in bytes
+     */
+    virtual void writeAudioFrame(const uint8_t* samples, unsigned int len) = 0;
+
+    /**
+     * @brief Ends the encode.
+     *
+     * No frame can be written after this call.
+     */
+    virtual void finish() = 0;
+
+};
+} // namespace libtas
+
+#endif
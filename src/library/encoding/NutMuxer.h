@@ -22,6 +22,8 @@
 #ifndef LIBTAS_NUTMUXER_H_INCL
 #define LIBTAS_NUTMUXER_H_INCL
 
+#include "Muxer.h"
+
 #include <vector>
 #include <cstdint>
 #include <cstdio> // FILE
@@ -29,7 +31,7 @@
 
 namespace libtas {
 
-class NutMuxer {
+class NutMuxer : public Muxer {
 public:
 
 	static void writeVarU(uint64_t v, std::vector<uint8_t> &stream);
@@ -121,13 +123,13 @@ public:
 
     void writeFrame(const uint8_t* payload, unsigned int payloadlen, uint64_t pts, uint64_t ptsnum, uint64_t ptsden, int ptsindex, FILE *underlying);
 
-    void writeVideoFrame(const uint8_t* video, unsigned int len);
+    void writeVideoFrame(const uint8_t* video, unsigned int len) override;
 
-    void writeAudioFrame(const uint8_t* samples, unsigned int len);
+    void writeAudioFrame(const uint8_t* samples, unsigned int len) override;
 
 	NutMuxer(int width, int height, int fpsnum, int fpsden, const char* pixfmt, int samplerate, int samplesize, int channels, FILE *underlying);
 
-	void finish();
+	void finish() override;
 
 };
 }
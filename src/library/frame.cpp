@@ -236,6 +236,9 @@ void frameBoundary(std::function<void()> draw, RenderHUD& hud)
     /* Other threads may send socket messages, so we lock the socket */
     lockSocket();
 
+    /* Messages of the frame boundary are sent together */
+    bufferSocket();
+
     /* Send framecount and internal time */    
     sendFrameCountTime();
 
@@ -303,6 +306,7 @@ void frameBoundary(std::function<void()> draw, RenderHUD& hud)
         }
         message = receiveMessage();
     }
+    flushSocket();
     perfTimer.switchTimer(PerfTimer::FrameTimer);
 
     /*** Rendering ***/
@@ -737,6 +741,12 @@ static void receive_messages(std::function<void()> draw, RenderHUD& hud)
                     // screen_redraw(draw, hud, preview_ai, true);
                 }
 
+                /* The encoder thread must not run and no screen readback must be
+                 * pending while memory is saved */
+                if (avencoder)
+                    avencoder->flushQueue();
+                ScreenCapture::finishReadback();
+
                 status = SaveStateManager::checkpoint(slot);
 
                 if (status == 0) {
@@ -796,6 +806,12 @@ static void receive_messages(std::function<void()> draw, RenderHUD& hud)
                 // Force redraw because screen refresh won't happen during state loading
                 screen_redraw(draw, hud, preview_ai, true);
 
+                /* The encoder thread must not run and no screen readback must be
+                 * pending while memory is restored */
+                if (avencoder)
+                    avencoder->flushQueue();
+                ScreenCapture::finishReadback();
+
                 status = SaveStateManager::restore(slot);
 
                 SaveStateManager::printError(status);
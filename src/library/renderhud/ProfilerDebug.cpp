@@ -22,6 +22,8 @@
 #include "logging.h"
 
 #include "checkpoint/ThreadManager.h"
+#include "checkpoint/SaveStateManager.h"
+#include "encoding/AVEncoder.h"
 #include "../external/imgui/imgui.h"
 #include "global.h"
 
@@ -177,6 +179,34 @@ void ProfilerDebug::draw(uint64_t framecount, bool* p_open = nullptr)
 
     ImGui::EndChild();
 
+    const SaveStateManager::SaveTimings& timings = SaveStateManager::lastTimings();
+    if (timings.slot >= 0) {
+        ImGui::SeparatorText("Last savestate");
+        if (Global::shared_config.savestate_settings & SharedConfig::SS_FORK) {
+            ImGui::Text("State %d: game stopped for %.2f ms (suspending threads %.2f ms, fork %.2f ms)", timings.slot, timings.blocking_ms, timings.suspend_ms, timings.fork_ms);
+            if (timings.dump_ms < 0)
+                ImGui::Text("Writing state in background...");
+            else
+                ImGui::Text("State written in background in %.2f ms", timings.dump_ms);
+        }
+        else {
+            ImGui::Text("State %d: game stopped for %.2f ms (suspending threads %.2f ms)", timings.slot, timings.blocking_ms, timings.suspend_ms);
+        }
+    }
+
+    if (avencoder) {
+        AVEncoder::QueueStats stats = avencoder->queueStats();
+        ImGui::SeparatorText("Encoding");
+        if (stats.size > 0) {
+            ImGui::Text("Queue: %d / %d frames, game waited %.2f ms on last frame (%.2f ms total)", stats.depth, stats.size, stats.last_stall_ms, stats.total_stall_ms);
+            if (stats.dropped_frames > 0)
+                ImGui::Text("%d frames encoded with the previous image", stats.dropped_frames);
+        }
+        else {
+            ImGui::Text("Frames are encoded by the game thread");
+        }
+    }
+
     ImGui::SeparatorText("Tasks");
 
     /* We need to specify the size of the table, so that X scrolling will work.
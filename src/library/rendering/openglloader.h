@@ -89,6 +89,11 @@ struct GLProcs {
     DEFINE_GL_POINTER(BindVertexArray)
     DEFINE_GL_POINTER(BindBuffer)
     DEFINE_GL_POINTER(BufferData)
+    DEFINE_GL_POINTER(MapBufferRange)
+    DEFINE_GL_POINTER(UnmapBuffer)
+    DEFINE_GL_POINTER(FenceSync)
+    DEFINE_GL_POINTER(ClientWaitSync)
+    DEFINE_GL_POINTER(DeleteSync)
     DEFINE_GL_POINTER(VertexAttribPointer)
     DEFINE_GL_POINTER(EnableVertexAttribArray)
     DEFINE_GL_POINTER(CreateShader)
@@ -75,6 +75,11 @@ VK_PROC(DestroySampler)
 VK_PROC(DestroyFramebuffer)
 VK_PROC(DestroySwapchainKHR)
 VK_PROC(CmdClearColorImage)
+VK_PROC(CreateBuffer)
+VK_PROC(DestroyBuffer)
+VK_PROC(GetBufferMemoryRequirements)
+VK_PROC(BindBufferMemory)
+VK_PROC(CmdCopyImageToBuffer)
 VK_PROC(CmdDraw)
 VK_PROC(CmdDrawIndirect)
 // VK_PROC(CmdDrawIndirectCount)
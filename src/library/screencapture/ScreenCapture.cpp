@@ -216,6 +216,16 @@ int ScreenCapture::getPixelsFromSurface(uint8_t **pixels, bool draw)
     return 0;
 }
 
+void ScreenCapture::finishReadback()
+{
+    if (!inited)
+        return;
+
+    if (impl) {
+        impl->finishReadback();
+    }
+}
+
 int ScreenCapture::copySurfaceToScreen()
 {
     if (!inited)
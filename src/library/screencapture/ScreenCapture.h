@@ -157,6 +157,14 @@ public:
      */
     static int getPixelsFromSurface(uint8_t **pixels, bool draw);
 
+    /**
+     * @brief Completes any pixel transfer still running on the GPU.
+     *
+     * Must be called before saving or loading a state, so that no transfer
+     * started before the state is used after it.
+     */
+    static void finishReadback();
+
     /**
      * @brief Restores the stored capture surface back into the screen.
      *
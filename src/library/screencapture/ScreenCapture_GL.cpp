@@ -84,17 +84,62 @@ void ScreenCapture_GL::initScreenSurface()
         GL_CALL(GenTextures, (1, &screenTex));
     }
 
+    GLenum color_format = (default_fb_color_encoding == GL_SRGB) ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+
     GL_CALL(BindTexture, (GL_TEXTURE_2D, screenTex));
-    GL_CALL(TexImage2D, (GL_TEXTURE_2D, 0,
-        default_fb_color_encoding == GL_SRGB ? GL_SRGB8_ALPHA8 : GL_RGBA8, 
+    GL_CALL(TexImage2D, (GL_TEXTURE_2D, 0, color_format, 
         width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL));
     GL_CALL(TexParameteri, (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR));
     GL_CALL(TexParameteri, (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
     GL_CALL(FramebufferTexture2D, (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, screenTex, 0));
 
+    /* Asynchronous readback needs buffer mapping and fences, which are
+     * available from OpenGL 3.2 and OpenGL ES 3.0. Older contexts don't know
+     * the version queries, so that the version stays at 0 */
+    GLint major = 0, minor = 0;
+    glProcs.GetIntegerv(GL_MAJOR_VERSION, &major);
+    glProcs.GetIntegerv(GL_MINOR_VERSION, &minor);
+    glProcs.GetError();
+    int version = 10*major + minor;
+    readbackSupported = (Global::game_info.opengl_profile == GameInfo::ES) ? (version >= 30) : (version >= 32);
+
+    if (readbackSupported) {
+        /* Generate the FBO and RBO for the flipped screen */
+        if (flipFBO == 0) {
+            GL_CALL(GenFramebuffers, (1, &flipFBO));
+        }
+        if (flipRBO == 0) {
+            GL_CALL(GenRenderbuffers, (1, &flipRBO));
+        }
+
+        GLint render_buffer;
+        GL_CALL(GetIntegerv, (GL_RENDERBUFFER_BINDING, &render_buffer));
+
+        GL_CALL(BindFramebuffer, (GL_FRAMEBUFFER, flipFBO));
+        GL_CALL(BindRenderbuffer, (GL_RENDERBUFFER, flipRBO));
+        GL_CALL(RenderbufferStorage, (GL_RENDERBUFFER, color_format, width, height));
+        GL_CALL(FramebufferRenderbuffer, (GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, flipRBO));
+        GL_CALL(BindRenderbuffer, (GL_RENDERBUFFER, render_buffer));
+
+        /* Generate the pixel buffer */
+        GLint pixel_buffer;
+        GL_CALL(GetIntegerv, (GL_PIXEL_PACK_BUFFER_BINDING, &pixel_buffer));
+
+        if (readbackPBO == 0) {
+            GL_CALL(GenBuffers, (1, &readbackPBO));
+        }
+
+        GL_CALL(BindBuffer, (GL_PIXEL_PACK_BUFFER, readbackPBO));
+        GL_CALL(BufferData, (GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ));
+
+        GL_CALL(BindBuffer, (GL_PIXEL_PACK_BUFFER, pixel_buffer));
+    }
+
     GL_CALL(BindFramebuffer, (GL_DRAW_FRAMEBUFFER, draw_buffer));
     GL_CALL(BindFramebuffer, (GL_READ_FRAMEBUFFER, read_buffer));
 
+    pendingReadback = false;
+
     gllinepixels.resize(pitch);
 }
 
@@ -103,6 +148,19 @@ void ScreenCapture_GL::destroyScreenSurface()
     LINK_GL_POINTER(DeleteFramebuffers)
     LINK_GL_POINTER(DeleteRenderbuffers)
     LINK_GL_POINTER(DeleteTextures)
+    LINK_GL_POINTER(DeleteBuffers)
+    LINK_GL_POINTER(DeleteSync)
+
+    /* Delete the pixel buffer and the fence of its pending transfer */
+    if (readbackFence) {
+        glProcs.DeleteSync(static_cast<GLsync>(readbackFence));
+        readbackFence = nullptr;
+    }
+    if (readbackPBO != 0) {
+        glProcs.DeleteBuffers(1, &readbackPBO);
+        readbackPBO = 0;
+    }
+    pendingReadback = false;
 
     /* Delete openGL framebuffers */
     if (screenFBO != 0) {
@@ -117,6 +175,14 @@ void ScreenCapture_GL::destroyScreenSurface()
         glProcs.DeleteTextures(1, &screenTex);
         screenTex = 0;
     }
+    if (flipFBO != 0) {
+        glProcs.DeleteFramebuffers(1, &flipFBO);
+        flipFBO = 0;
+    }
+    if (flipRBO != 0) {
+        glProcs.DeleteRenderbuffers(1, &flipRBO);
+        flipRBO = 0;
+    }
 }
 
 uint64_t ScreenCapture_GL::screenTexture()
@@ -160,9 +226,109 @@ int ScreenCapture_GL::copyScreenToSurface()
     if (scissor_test_active)
         glProcs.Enable(GL_SCISSOR_TEST);
 
+    /* Start reading the pixels that will be encoded at the end of the frame,
+     * so that the transfer runs while the frame is being drawn. A transfer
+     * of a previous screen is not valid anymore */
+    if (readbackSupported && Global::shared_config.av_dumping)
+        startReadback();
+    else
+        pendingReadback = false;
+
     return size;
 }
 
+void ScreenCapture_GL::startReadback()
+{
+    /* Disable the scissor test if needed */
+    GLboolean scissor_test_active = glProcs.IsEnabled(GL_SCISSOR_TEST);
+    if (scissor_test_active)
+        glProcs.Disable(GL_SCISSOR_TEST);
+
+    /* Copy the original draw/read framebuffers, pixel buffer and pack row length */
+    GLint draw_buffer, read_buffer, pixel_buffer, pack_row;
+    glProcs.GetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &draw_buffer);
+    glProcs.GetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_buffer);
+    glProcs.GetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &pixel_buffer);
+    glProcs.GetIntegerv(GL_PACK_ROW_LENGTH, &pack_row);
+
+    glProcs.GetError();
+
+    /* Flip the image vertically on the GPU, because OpenGL has a different
+     * reference point */
+    GL_CALL(BindFramebuffer, (GL_READ_FRAMEBUFFER, screenFBO));
+    GL_CALL(BindFramebuffer, (GL_DRAW_FRAMEBUFFER, flipFBO));
+    GL_CALL(BlitFramebuffer, (0, 0, width, height, 0, height, width, 0, GL_COLOR_BUFFER_BIT, GL_NEAREST));
+
+    /* Read into the pixel buffer. This returns without waiting for the
+     * transfer, and the fence is signaled when it is done */
+    if (readbackFence) {
+        glProcs.DeleteSync(static_cast<GLsync>(readbackFence));
+        readbackFence = nullptr;
+    }
+
+    GL_CALL(BindFramebuffer, (GL_READ_FRAMEBUFFER, flipFBO));
+    GL_CALL(BindBuffer, (GL_PIXEL_PACK_BUFFER, readbackPBO));
+
+    if (pack_row != 0)
+        glProcs.PixelStorei(GL_PACK_ROW_LENGTH, 0);
+
+    GL_CALL(ReadPixels, (0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr));
+
+    LINK_GL_POINTER(FenceSync)
+    readbackFence = glProcs.FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    pendingReadback = true;
+
+    if (pack_row != 0)
+        glProcs.PixelStorei(GL_PACK_ROW_LENGTH, pack_row);
+
+    /* Restore the original state */
+    GL_CALL(BindBuffer, (GL_PIXEL_PACK_BUFFER, pixel_buffer));
+    GL_CALL(BindFramebuffer, (GL_DRAW_FRAMEBUFFER, draw_buffer));
+    GL_CALL(BindFramebuffer, (GL_READ_FRAMEBUFFER, read_buffer));
+
+    if (scissor_test_active)
+        glProcs.Enable(GL_SCISSOR_TEST);
+}
+
+void ScreenCapture_GL::finishReadback()
+{
+    if (!pendingReadback)
+        return;
+
+    GlobalNative gn;
+
+    pendingReadback = false;
+
+    /* Wait for the transfer, flushing the commands so that it does complete */
+    GLsync fence = static_cast<GLsync>(readbackFence);
+    readbackFence = nullptr;
+    if (fence) {
+        LINK_GL_POINTER(ClientWaitSync)
+        glProcs.ClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+        glProcs.DeleteSync(fence);
+    }
+
+    /* Copy the original pixel buffer */
+    GLint pixel_buffer;
+    glProcs.GetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &pixel_buffer);
+
+    glProcs.GetError();
+
+    GL_CALL(BindBuffer, (GL_PIXEL_PACK_BUFFER, readbackPBO));
+
+    LINK_GL_POINTER(MapBufferRange)
+    const void* mapped = glProcs.MapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+    if (mapped) {
+        memcpy(winpixels.data(), mapped, size);
+        GL_CALL(UnmapBuffer, (GL_PIXEL_PACK_BUFFER));
+    }
+    else {
+        LOG(LL_ERROR, LCF_WINDOW | LCF_OGL, "Could not map the pixel buffer");
+    }
+
+    GL_CALL(BindBuffer, (GL_PIXEL_PACK_BUFFER, pixel_buffer));
+}
+
 int ScreenCapture_GL::getPixelsFromSurface(uint8_t **pixels, bool draw)
 {
     if (pixels) {
@@ -174,6 +340,15 @@ int ScreenCapture_GL::getPixelsFromSurface(uint8_t **pixels, bool draw)
 
     GlobalNative gn;
 
+    /* Pixels are usually being transferred since the screen was copied.
+     * Otherwise, we start the transfer now */
+    if (readbackSupported) {
+        if (!pendingReadback)
+            startReadback();
+        finishReadback();
+        return size;
+    }
+
     /* Copy the original read framebuffer */
     GLint read_buffer;
     glProcs.GetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &read_buffer);
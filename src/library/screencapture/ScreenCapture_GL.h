@@ -57,6 +57,9 @@ public:
      * Returns the size of the array. */
     int getPixelsFromSurface(uint8_t **pixels, bool draw);
 
+    /* Wait for the pixel transfer started when copying the screen */
+    void finishReadback();
+
     /* Copy back the stored screen buffer/surface/texture into the screen. */
     int copySurfaceToScreen();
 
@@ -65,9 +68,32 @@ public:
     uint64_t screenTexture();
 
 private:    
-    /* Single line of pixels to swap GL array that has different reference point */
+    /* Flip the screen texture and start reading it into the pixel buffer,
+     * without waiting for the transfer */
+    void startReadback();
+
+    /* Single line of pixels to swap GL array that has different reference point,
+     * used when pixel buffers are not supported */
     std::vector<uint8_t> gllinepixels;
 
+    /* If the context supports mapping pixel buffers and fences */
+    bool readbackSupported = false;
+
+    /* Pixel buffer receiving the screen pixels. The transfer is always
+     * finished within the same frame, so one buffer is enough */
+    uint32_t readbackPBO = 0;
+
+    /* Fence signaled when the transfer into the pixel buffer is done */
+    void* readbackFence = nullptr;
+
+    /* If a transfer was started and not finished yet */
+    bool pendingReadback = false;
+
+    /* Framebuffer holding the screen flipped vertically, because OpenGL has
+     * a different reference point */
+    uint32_t flipFBO = 0;
+    uint32_t flipRBO = 0;
+
     /* OpenGL framebuffer */
     uint32_t screenFBO = 0;
 
@@ -141,6 +141,14 @@ public:
      */
     virtual int getPixelsFromSurface(uint8_t **pixels, bool draw) = 0;
 
+    /**
+     * @brief Completes a pixel transfer started by copyScreenToSurface().
+     *
+     * By default this is a no-op. Backends that read pixels asynchronously
+     * must override it so that no transfer is pending across a savestate.
+     */
+    virtual void finishReadback() {}
+
     /**
      * @brief Restores the stored capture surface back to the screen.
      *
@@ -162,10 +162,152 @@ void ScreenCapture_Vulkan::initScreenSurface()
      * `ImGui_ImplVulkan_Init()` has been called! We will run this on the first
      * query of the textureId in `ScreenCapture_Vulkan::screenTexture()` */
     // vkScreenDescriptorSet = ImGui_ImplVulkan_AddTexture(vkScreenSampler, vkScreenImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+
+    stagingSupported = initStaging();
+    if (!stagingSupported) {
+        LOG(LL_WARN, LCF_VULKAN, "Could not create staging buffers, screen pixels will be read from the screen image");
+        destroyStaging();
+    }
+
+    capturedPixels = winpixels.data();
+}
+
+/* Returns a memory type with all `properties`, or -1 if there is none */
+static int findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties)
+{
+    uint32_t index = vk::getMemoryTypeIndex(typeBits, properties);
+    if (!(typeBits & (1u << index)) ||
+        ((vk::context.deviceMemoryProperties.memoryTypes[index].propertyFlags & properties) != properties))
+        return -1;
+    return index;
+}
+
+bool ScreenCapture_Vulkan::initStaging()
+{
+    VkResult res;
+
+    stagingIndex = 0;
+    pendingStaging = -1;
+
+    for (int i = 0; i < STAGING_COUNT; i++) {
+        VkBufferCreateInfo bufferInfo{};
+        bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        bufferInfo.size = size;
+        bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+        if ((res = vkProcs.CreateBuffer(vk::context.device, &bufferInfo, vk::context.allocator, &vkStagingBuffers[i])) != VK_SUCCESS) {
+            LOG(LL_ERROR, LCF_VULKAN, "vkCreateBuffer failed with error %d", res);
+            return false;
+        }
+
+        VkMemoryRequirements memRequirements;
+        vkProcs.GetBufferMemoryRequirements(vk::context.device, vkStagingBuffers[i], &memRequirements);
+
+        /* Pixels are read by the CPU, which is much faster on cached memory */
+        int memoryType = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT);
+        if (memoryType < 0)
+            memoryType = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+        if (memoryType < 0) {
+            LOG(LL_ERROR, LCF_VULKAN, "No host visible memory for staging buffers");
+            return false;
+        }
+
+        VkMemoryAllocateInfo allocInfo{};
+        allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        allocInfo.allocationSize = memRequirements.size;
+        allocInfo.memoryTypeIndex = memoryType;
+
+        if ((res = vkProcs.AllocateMemory(vk::context.device, &allocInfo, vk::context.allocator, &vkStagingMemory[i])) != VK_SUCCESS) {
+            LOG(LL_ERROR, LCF_VULKAN, "vkAllocateMemory failed with error %d", res);
+            return false;
+        }
+
+        if ((res = vkProcs.BindBufferMemory(vk::context.device, vkStagingBuffers[i], vkStagingMemory[i], 0)) != VK_SUCCESS) {
+            LOG(LL_ERROR, LCF_VULKAN, "vkBindBufferMemory failed with error %d", res);
+            return false;
+        }
+
+        /* Buffers stay mapped until they are destroyed */
+        if ((res = vkProcs.MapMemory(vk::context.device, vkStagingMemory[i], 0, VK_WHOLE_SIZE, 0, (void**)&stagingPixels[i])) != VK_SUCCESS) {
+            LOG(LL_ERROR, LCF_VULKAN, "vkMapMemory failed with error %d", res);
+            return false;
+        }
+
+        VkFenceCreateInfo fenceInfo{};
+        fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        if ((res = vkProcs.CreateFence(vk::context.device, &fenceInfo, vk::context.allocator, &vkStagingFences[i])) != VK_SUCCESS) {
+            LOG(LL_ERROR, LCF_VULKAN, "vkCreateFence failed with error %d", res);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void ScreenCapture_Vulkan::destroyStaging()
+{
+    for (int i = 0; i < STAGING_COUNT; i++) {
+        waitStaging(i);
+
+        if (vkStagingFences[i] != VK_NULL_HANDLE) {
+            vkProcs.DestroyFence(vk::context.device, vkStagingFences[i], nullptr);
+            vkStagingFences[i] = VK_NULL_HANDLE;
+        }
+        if (stagingPixels[i]) {
+            vkProcs.UnmapMemory(vk::context.device, vkStagingMemory[i]);
+            stagingPixels[i] = nullptr;
+        }
+        if (vkStagingBuffers[i] != VK_NULL_HANDLE) {
+            vkProcs.DestroyBuffer(vk::context.device, vkStagingBuffers[i], nullptr);
+            vkStagingBuffers[i] = VK_NULL_HANDLE;
+        }
+        if (vkStagingMemory[i] != VK_NULL_HANDLE) {
+            vkProcs.FreeMemory(vk::context.device, vkStagingMemory[i], nullptr);
+            vkStagingMemory[i] = VK_NULL_HANDLE;
+        }
+    }
+
+    pendingStaging = -1;
+    capturedPixels = winpixels.data();
+}
+
+void ScreenCapture_Vulkan::waitStaging(int index)
+{
+    if (!stagingSubmitted[index])
+        return;
+
+    VkResult res;
+    if ((res = vkProcs.WaitForFences(vk::context.device, 1, &vkStagingFences[index], VK_TRUE, UINT64_MAX)) != VK_SUCCESS) {
+        LOG(LL_ERROR, LCF_VULKAN, "vkWaitForFences failed with error %d", res);
+    }
+    stagingSubmitted[index] = false;
+}
+
+void ScreenCapture_Vulkan::finishReadback()
+{
+    if (!stagingSupported)
+        return;
+
+    GlobalNative gn;
+
+    for (int i = 0; i < STAGING_COUNT; i++)
+        waitStaging(i);
+
+    /* Keep the last pixels inside our own buffer, and read the screen image
+     * again after the state is saved or loaded, because staging buffers are
+     * not part of the state */
+    if (capturedPixels != winpixels.data()) {
+        memcpy(winpixels.data(), capturedPixels, size);
+        capturedPixels = winpixels.data();
+    }
+    pendingStaging = -1;
 }
 
 void ScreenCapture_Vulkan::destroyScreenSurface()
 {
+    destroyStaging();
+
     /* Delete the Vulkan image and all associated objects */
     if (vkScreenDescriptorSet != VK_NULL_HANDLE) {
         ImGui_ImplVulkan_RemoveTexture(vkScreenDescriptorSet);
@@ -342,6 +484,64 @@ int ScreenCapture_Vulkan::copyScreenToSurface()
         1, &srcBarrier
     );
 
+    /* Copy the screen image into the next staging buffer, with tightly
+     * packed rows, so that the pixels are ready at the end of the frame.
+     * A copy of a previous screen is not valid anymore */
+    VkFence fence = VK_NULL_HANDLE;
+    int staging = -1;
+    pendingStaging = -1;
+    if (stagingSupported && Global::shared_config.av_dumping) {
+        staging = stagingIndex;
+        stagingIndex = (stagingIndex + 1) % STAGING_COUNT;
+
+        /* The buffer was used by an older copy, which is already done */
+        waitStaging(staging);
+
+        VkBufferImageCopy bufferCopyRegion{};
+        bufferCopyRegion.bufferOffset = 0;
+        bufferCopyRegion.bufferRowLength = 0;
+        bufferCopyRegion.bufferImageHeight = 0;
+        bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        bufferCopyRegion.imageSubresource.layerCount = 1;
+        bufferCopyRegion.imageExtent.width = width;
+        bufferCopyRegion.imageExtent.height = height;
+        bufferCopyRegion.imageExtent.depth = 1;
+
+        vkProcs.CmdCopyImageToBuffer(cmdBuffer,
+            vkScreenImage, VK_IMAGE_LAYOUT_GENERAL,
+            vkStagingBuffers[staging],
+            1,
+            &bufferCopyRegion);
+
+        /* Make the buffer visible to the host */
+        VkBufferMemoryBarrier hostBarrier{};
+        hostBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+        hostBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        hostBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        hostBarrier.buffer = vkStagingBuffers[staging];
+        hostBarrier.offset = 0;
+        hostBarrier.size = VK_WHOLE_SIZE;
+
+        vkProcs.CmdPipelineBarrier(cmdBuffer,
+            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+            0,
+            0, nullptr,
+            1, &hostBarrier,
+            0, nullptr
+        );
+
+        /* If the fence cannot be used, pixels are read from the screen image
+         * instead */
+        fence = vkStagingFences[staging];
+        if ((res = vkProcs.ResetFences(vk::context.device, 1, &fence)) != VK_SUCCESS) {
+            LOG(LL_ERROR, LCF_VULKAN, "vkResetFences failed with error %d", res);
+            fence = VK_NULL_HANDLE;
+            staging = -1;
+        }
+    }
+
     /* Flush the command buffer */
     if ((res = vkProcs.EndCommandBuffer(cmdBuffer)) != VK_SUCCESS) {
         LOG(LL_ERROR, LCF_VULKAN, "vkEndCommandBuffer failed with error %d", res);
@@ -367,8 +567,13 @@ int ScreenCapture_Vulkan::copyScreenToSurface()
 
     LOG(LL_DEBUG, LCF_VULKAN, "vkQueueSubmit wait on %llx and signal %llx and semindex %d", submitInfo.pWaitSemaphores[0], submitInfo.pSignalSemaphores[0], vk::context.semaphoreIndex);
 
-    if ((res = vkProcs.QueueSubmit(vk::context.graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE)) != VK_SUCCESS) {
-        LOG(LL_ERROR, LCF_VULKAN, "vkEndCommandBuffer failed with error %d", res);
+    if ((res = vkProcs.QueueSubmit(vk::context.graphicsQueue, 1, &submitInfo, fence)) != VK_SUCCESS) {
+        LOG(LL_ERROR, LCF_VULKAN, "vkQueueSubmit failed with error %d", res);
+    }
+    else if (staging >= 0) {
+        /* The staging buffer is only waited on once its copy was submitted */
+        stagingSubmitted[staging] = true;
+        pendingStaging = staging;
     }
 
     vk::context.currentSemaphore = submitInfo.pSignalSemaphores[0];
@@ -378,14 +583,30 @@ int ScreenCapture_Vulkan::copyScreenToSurface()
 
 int ScreenCapture_Vulkan::getPixelsFromSurface(uint8_t **pixels, bool draw)
 {
-    if (pixels) {
-        *pixels = winpixels.data();
+    if (!draw) {
+        if (pixels) {
+            *pixels = capturedPixels;
+        }
+        return size;
     }
 
-    if (!draw)
+    GlobalNative gn;
+
+    /* Pixels of the copied screen are sent directly from the staging buffer.
+     * It is not written again before two other screen copies */
+    if (pendingStaging >= 0) {
+        waitStaging(pendingStaging);
+        capturedPixels = stagingPixels[pendingStaging];
+        if (pixels) {
+            *pixels = capturedPixels;
+        }
         return size;
+    }
 
-    GlobalNative gn;
+    capturedPixels = winpixels.data();
+    if (pixels) {
+        *pixels = capturedPixels;
+    }
 
     VkResult res;
 
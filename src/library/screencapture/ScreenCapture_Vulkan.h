@@ -59,6 +59,9 @@ public:
      * Returns the size of the array. */
     int getPixelsFromSurface(uint8_t **pixels, bool draw);
 
+    /* Wait for the pixel transfers started when copying the screen */
+    void finishReadback();
+
     /* Copy back the stored screen buffer/surface/texture into the screen. */
     int copySurfaceToScreen();
 
@@ -74,6 +77,36 @@ private:
     VkSampler vkScreenSampler = VK_NULL_HANDLE;
     VkDescriptorSet vkScreenDescriptorSet = VK_NULL_HANDLE;
     VkDeviceMemory vkScreenImageMemory = VK_NULL_HANDLE;
+
+    /* Ring of staging buffers that stay mapped, receiving the screen image
+     * with tightly packed rows. Each transfer signals the fence of its buffer */
+    static const int STAGING_COUNT = 3;
+    VkBuffer vkStagingBuffers[STAGING_COUNT] = {};
+    VkDeviceMemory vkStagingMemory[STAGING_COUNT] = {};
+    VkFence vkStagingFences[STAGING_COUNT] = {};
+    uint8_t* stagingPixels[STAGING_COUNT] = {};
+
+    /* If a transfer was submitted and its fence was not waited yet */
+    bool stagingSubmitted[STAGING_COUNT] = {};
+
+    /* If the staging buffers could be created */
+    bool stagingSupported = false;
+
+    /* Next staging buffer to use, and staging buffer holding the pixels of
+     * the last copied screen, or -1 */
+    int stagingIndex = 0;
+    int pendingStaging = -1;
+
+    /* Pixels returned to the encoder, which are either inside a staging
+     * buffer or inside `winpixels` */
+    uint8_t* capturedPixels = nullptr;
+
+    /* Create and destroy the staging buffers */
+    bool initStaging();
+    void destroyStaging();
+
+    /* Wait for the transfer into a staging buffer */
+    void waitStaging(int index);
 }; 
 }
 
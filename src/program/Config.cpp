@@ -86,7 +86,16 @@ bool Config::applyCliSetting(const std::string& key, const std::string& value)
     else if (key == "video_filter")             sc.video_filter = intValue;
     else if (key == "audio_codec")              sc.audio_codec = intValue;
     else if (key == "audio_bitrate")            sc.audio_bitrate = intValue;
+    else if (key == "video_queue_size")         sc.video_queue_size = intValue;
+    else if (key == "video_queue_policy")       sc.video_queue_policy = intValue;
+    else if (key == "encode_backend")           sc.encode_backend = intValue;
     else if (key == "savestate_settings")       sc.savestate_settings = intValue;
+    else if (key == "savestate_memory_budget")  sc.savestate_memory_budget = intValue;
+    else if (key == "savestate_codec")          sc.savestate_codec = intValue;
+    else if (key == "savestate_codec_level")    sc.savestate_codec_level = intValue;
+    else if (key == "savestate_archive_slots")  sc.savestate_archive_slots = intValue;
+    else if (key == "savestate_archive_codec")  sc.savestate_archive_codec = intValue;
+    else if (key == "savestate_archive_level")  sc.savestate_archive_level = intValue;
     /* Initial time fields (come from movie, not from ini, so no existing key) */
     else if (key == "initial_time_sec")         sc.initial_time_sec = int64Value;
     else if (key == "initial_time_nsec")        sc.initial_time_nsec = int64Value;
@@ -133,9 +142,12 @@ void Config::save(const std::filesystem::path& gamepath) {
 
     general_settings.setValue("datadir", datadir.c_str());
     general_settings.setValue("steamuserdir", steamuserdir.c_str());
-    general_settings.setValue("tempmoviedir", tempmoviedir.c_str());
-    general_settings.setValue("savestatedir", savestatedir.c_str());
-    general_settings.setValue("ramsearchdir", ramsearchdir.c_str());
+    /* Directories of other instances are derived from the ones of instance 0 */
+    if (instance == 0) {
+        general_settings.setValue("tempmoviedir", tempmoviedir.c_str());
+        general_settings.setValue("savestatedir", savestatedir.c_str());
+        general_settings.setValue("ramsearchdir", ramsearchdir.c_str());
+    }
     general_settings.setValue("extralib32dir", extralib32dir.c_str());
     general_settings.setValue("extralib64dir", extralib64dir.c_str());
 
@@ -162,11 +174,13 @@ void Config::save(const std::filesystem::path& gamepath) {
     settings.setValue("libdir", libdir.c_str());
     settings.setValue("rundir", rundir.c_str());
     settings.setValue("on_movie_end", on_movie_end);
+    settings.setValue("movie_format", movie_format);
     settings.setValue("autosave", autosave);
     settings.setValue("autosave_delay_sec", autosave_delay_sec);
     settings.setValue("autosave_frames", autosave_frames);
     settings.setValue("autosave_count", autosave_count);
     settings.setValue("auto_restart", auto_restart);
+    settings.setValue("shared_memory_transport", shared_memory_transport);
     settings.setValue("mouse_warp", mouse_warp);
     settings.setValue("use_proton", use_proton);
     settings.setValue("proton_path", proton_path.c_str());
@@ -247,6 +261,9 @@ void Config::save(const std::filesystem::path& gamepath) {
     settings.setValue("video_filter", sc.video_filter);
     settings.setValue("audio_codec", sc.audio_codec);
     settings.setValue("audio_bitrate", sc.audio_bitrate);
+    settings.setValue("video_queue_size", sc.video_queue_size);
+    settings.setValue("video_queue_policy", sc.video_queue_policy);
+    settings.setValue("encode_backend", sc.encode_backend);
     settings.setValue("locale", sc.locale);
     settings.setValue("virtual_steam", sc.virtual_steam);
     settings.setValue("openal_soft", sc.openal_soft);
@@ -266,6 +283,12 @@ void Config::save(const std::filesystem::path& gamepath) {
     settings.endArray();
 
     settings.setValue("savestate_settings", sc.savestate_settings);
+    settings.setValue("savestate_memory_budget", sc.savestate_memory_budget);
+    settings.setValue("savestate_codec", sc.savestate_codec);
+    settings.setValue("savestate_codec_level", sc.savestate_codec_level);
+    settings.setValue("savestate_archive_slots", sc.savestate_archive_slots);
+    settings.setValue("savestate_archive_codec", sc.savestate_archive_codec);
+    settings.setValue("savestate_archive_level", sc.savestate_archive_level);
 
     settings.endGroup();
 }
@@ -342,6 +365,13 @@ void Config::load(const std::filesystem::path& gamepath) {
     subpath = datadir / "ramsearch";
     ramsearchdir = general_settings.value("ramsearchdir", subpath.c_str()).toString().toStdString();
 
+    if (instance != 0) {
+        std::string suffix = "-" + std::to_string(instance);
+        tempmoviedir += suffix;
+        savestatedir += suffix;
+        ramsearchdir += suffix;
+    }
+
     subpath = datadir / "lib_i386";
     extralib32dir = general_settings.value("extralib32dir", subpath.c_str()).toString().toStdString();
 
@@ -385,11 +415,13 @@ void Config::load(const std::filesystem::path& gamepath) {
     rundir = settings.value("rundir", "").toString().toStdString();
 
     on_movie_end = settings.value("on_movie_end", on_movie_end).toInt();
+    movie_format = settings.value("movie_format", movie_format).toInt();
     autosave = settings.value("autosave", autosave).toBool();
     autosave_delay_sec = settings.value("autosave_delay_sec", autosave_delay_sec).toDouble();
     autosave_frames = settings.value("autosave_frames", autosave_frames).toInt();
     autosave_count = settings.value("autosave_count", autosave_count).toInt();
     auto_restart = settings.value("auto_restart", auto_restart).toBool();
+    shared_memory_transport = settings.value("shared_memory_transport", shared_memory_transport).toBool();
     mouse_warp = settings.value("mouse_warp", mouse_warp).toBool();
     use_proton = settings.value("use_proton", use_proton).toBool();
     proton_path = settings.value("proton_path", "").toString().toStdString();
@@ -483,7 +515,16 @@ void Config::load(const std::filesystem::path& gamepath) {
     sc.video_filter = settings.value("video_filter", sc.video_filter).toInt();
     sc.audio_codec = settings.value("audio_codec", sc.audio_codec).toInt();
     sc.audio_bitrate = settings.value("audio_bitrate", sc.audio_bitrate).toInt();
+    sc.video_queue_size = settings.value("video_queue_size", sc.video_queue_size).toInt();
+    sc.video_queue_policy = settings.value("video_queue_policy", sc.video_queue_policy).toInt();
+    sc.encode_backend = settings.value("encode_backend", sc.encode_backend).toInt();
     sc.savestate_settings = settings.value("savestate_settings", sc.savestate_settings).toInt();
+    sc.savestate_memory_budget = settings.value("savestate_memory_budget", sc.savestate_memory_budget).toInt();
+    sc.savestate_codec = settings.value("savestate_codec", sc.savestate_codec).toInt();
+    sc.savestate_codec_level = settings.value("savestate_codec_level", sc.savestate_codec_level).toInt();
+    sc.savestate_archive_slots = settings.value("savestate_archive_slots", sc.savestate_archive_slots).toInt();
+    sc.savestate_archive_codec = settings.value("savestate_archive_codec", sc.savestate_archive_codec).toInt();
+    sc.savestate_archive_level = settings.value("savestate_archive_level", sc.savestate_archive_level).toInt();
     sc.opengl_soft = settings.value("opengl_soft", sc.opengl_soft).toBool();
     sc.opengl_quality = settings.value("opengl_quality", sc.opengl_quality).toInt();
 
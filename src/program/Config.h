@@ -105,6 +105,11 @@ public:
     /* Directory holding extra amd64 libs required by some games */
     std::filesystem::path extralib64dir;
 
+    /* Instance number, so that several libTAS can run at the same time. Each
+     * instance other than 0 uses its own socket, and its own directories for
+     * movies, savestates and ram search. Not saved */
+    int instance = 0;
+
     /* Flags when end of movie */
     enum MovieEnd {
         MOVIEEND_READ = 0,
@@ -113,6 +118,14 @@ public:
 
     int on_movie_end = MOVIEEND_READ;
 
+    /* Format of saved movies */
+    enum MovieFormat {
+        MOVIEFORMAT_LEGACY = 0,
+        MOVIEFORMAT_NATIVE = 1,
+    };
+
+    int movie_format = MOVIEFORMAT_LEGACY;
+
     /* Do we enable autosaving? */
     bool autosave = true;
 
@@ -134,6 +147,9 @@ public:
     /* Do we restart the game when it exits? */
     bool auto_restart = false;
 
+    /* Exchange data with the game through shared memory instead of the socket */
+    bool shared_memory_transport = false;
+
     /* Warp the pointer at the center of the game screen after each frame */
     bool mouse_warp = false;
 
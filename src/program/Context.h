@@ -134,6 +134,11 @@ struct Context {
 
     /* Interactive mode */
     bool interactive = true;
+
+    /* Input search parameter file, and index and count of search workers */
+    std::filesystem::path searchfile;
+    int search_worker = 0;
+    int search_workers = 1;
     
     /* Indicate if the current frame is a draw frame */
     bool draw_frame;
@@ -62,7 +62,7 @@
 #include <cstdlib>
 #include <filesystem>
 
-GameLoop::GameLoop(Context* c) : movie(MovieFile(c)), context(c)
+GameLoop::GameLoop(Context* c) : movie(MovieFile(c)), context(c), inputSearch(c)
 {
 #ifdef __unix__
     gameEvents = new GameEventsXcb(c, &movie);
@@ -116,6 +116,10 @@ void GameLoop::start()
             }
         } while (!endInnerLoop);
 
+        /* Play the next branch of the input search, which may load a state */
+        if (inputSearch.update(movie) & InputSearch::RETURN_FLAG_CONFIG)
+            emit sharedConfigChanged();
+
         AllInputs ai;
         processInputs(ai);
 
@@ -127,7 +131,7 @@ void GameLoop::start()
         bool shouldQuit = false;
 
         /* Toggle pause when reaching a marker */
-        if (context->config.editor_marker_pause) {
+        if (context->config.editor_marker_pause && !inputSearch.active()) {
             if (movie.editor->markers.count(context->framecount+1)) {
                 context->config.sc.running = false;
                 context->config.sc.fastforward = false;
@@ -136,10 +140,12 @@ void GameLoop::start()
             }
         }
 
-        /* Pause if needed */
-        if ((context->pause_frame == (context->framecount + 1)) ||
+        /* Pause if needed, except during the input search which continues
+         * after the end of the movie */
+        if (!inputSearch.active() &&
+            ((context->pause_frame == (context->framecount + 1)) ||
             ((context->config.sc.recording == SharedConfig::RECORDING_READ) &&
-            ((context->config.sc.movie_framecount + context->pause_frame) == (context->framecount + 1)))) {
+            ((context->config.sc.movie_framecount + context->pause_frame) == (context->framecount + 1))))) {
 
             if (!context->interactive) {
                 /* Quit at the end of the movie if non-interactive */
@@ -209,7 +215,7 @@ void GameLoop::init()
     /* Remove the file socket */
     int err = removeSocket();
     if (err != 0)
-        emit alertToShow(QString("Could not remove socket file /tmp/libTAS.socket: %2").arg(strerror(err)));
+        emit alertToShow(QString("Could not remove socket file: %1").arg(strerror(err)));
 
     /* Clear addresses of loaded files */
     BaseAddresses::clear();
@@ -217,6 +223,12 @@ void GameLoop::init()
     /* Init savestate list */
     SaveStateList::init(context);
 
+    /* Load the input search parameters, except when restarting */
+    if (!context->searchfile.empty() && (context->status != Context::RESTARTING)) {
+        if (!inputSearch.load(context->searchfile, context->search_worker, context->search_workers))
+            emit alertToShow(QString("Could not load the input search file %1").arg(context->searchfile.c_str()));
+    }
+
     /* Compute the MD5 hash of the game binary */
     context->md5_game.clear();
     std::ostringstream cmd;
@@ -300,7 +312,7 @@ void GameLoop::init()
 void GameLoop::initProcessMessages()
 {
     /* Connect to the socket between the program and the game */
-    bool inited = initSocketProgram(fork_pid);
+    bool inited = initSocketProgram(fork_pid, context->config.shared_memory_transport);
     if (!inited) {
         loopExit();
         return;
@@ -582,6 +594,9 @@ bool GameLoop::startFrameMessages()
         message = receiveMessage();
     }
 
+    /* Messages until the end of the frame boundary are sent together */
+    bufferSocket();
+
     Lua::Callbacks::call(Lua::NamedLuaFunction::CallbackFrame);
 
     /* Store in movie and indicate the input editor if the current frame
@@ -604,6 +619,7 @@ bool GameLoop::startFrameMessages()
         Lua::Callbacks::call(Lua::NamedLuaFunction::CallbackPaint);
 
     sendMessage(MSGN_START_FRAMEBOUNDARY);
+    flushSocket();
 
     return false;
 }
@@ -614,6 +630,8 @@ void GameLoop::sleepSendPreview()
     struct timespec tim = {0, 33L*1000L*1000L};
     nanosleep(&tim, NULL);
 
+    bufferSocket();
+
     /* Send marker text if it has changed */
     static std::string old_marker_text;
     std::string text;
@@ -630,6 +648,7 @@ void GameLoop::sleepSendPreview()
     /* Don't preview when reading inputs */
     if (context->config.sc.recording == SharedConfig::RECORDING_READ) {
         sendMessage(MSGN_EXPOSE);
+        flushSocket();
         return;
     }
 
@@ -653,11 +672,14 @@ void GameLoop::sleepSendPreview()
     }
 
     sendMessage(MSGN_EXPOSE);
+    flushSocket();
 }
 
 
 void GameLoop::processInputs(AllInputs &ai)
 {
+    bufferSocket();
+
     ai.clear();
 
     /* Don't record inputs if we are quitting */
@@ -725,6 +747,9 @@ void GameLoop::processInputs(AllInputs &ai)
             Lua::Callbacks::call(Lua::NamedLuaFunction::CallbackInput);
             Lua::Input::clearInputs();
 
+            /* Inputs of the current input search branch */
+            inputSearch.applyInputs(ai);
+
             if (context->config.sc.recording == SharedConfig::RECORDING_WRITE) {
                 /* If the input editor is visible, we should keep future inputs.
                  * If not, we truncate inputs if necessary.
@@ -873,6 +898,7 @@ void GameLoop::endFrameMessages(AllInputs &ai)
     }
 
     sendMessage(MSGN_END_FRAMEBOUNDARY);
+    flushSocket();
 }
 
 void GameLoop::loopExit()
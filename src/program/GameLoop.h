@@ -24,6 +24,7 @@
 #include <cstdint>
 
 #include "movie/MovieFile.h"
+#include "InputSearch.h"
 #include "../shared/GameInfo.h"
 
 /* Forward declaration */
@@ -48,6 +49,9 @@ public:
 private:
     Context* context;
 
+    /* Brute-force search of inputs, if requested */
+    InputSearch inputSearch;
+
     /* Last saved/loaded savestate */
     int current_savestate;
 
@@ -90,6 +90,9 @@ void GameThread::set_env_variables(Context *context, int gameArch)
 
     setenv("LIBTAS_START_FRAME", std::to_string(context->framecount).c_str(), 1);
 
+    /* Pass our instance, so that the game uses the same socket */
+    setenv("LIBTAS_INSTANCE", std::to_string(context->config.instance).c_str(), 1);
+
     /* Override timezone for determinism */
     setenv("TZ", "UTC0", 1);
 
@@ -0,0 +1,657 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "InputSearch.h"
+
+#include "Context.h"
+#include "SaveState.h"
+#include "SaveStateList.h"
+#include "movie/MovieFile.h"
+#include "movie/InputSerialization.h"
+#include "ramsearch/MemAccess.h"
+#include "ramsearch/MemValue.h"
+#include "ramsearch/BaseAddresses.h"
+
+#include "../shared/SharedConfig.h"
+#include "../shared/messages.h"
+
+#include <QtCore/QSettings>
+#include <iostream>
+#include <sstream>
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <signal.h> // kill
+
+/* Savestate slots that can be used, slot 0 being reserved */
+static const int SLOT_COUNT = 10;
+
+/* Highest number of choices for a single frame */
+static const uint64_t MAX_FRAME_CHOICES = 1ULL << 32;
+
+/* Highest number of frame choices stored when sampling branches, which is
+ * the budget multiplied by the number of frames */
+static const uint64_t MAX_SAMPLE_VALUES = 1ULL << 26;
+
+bool InputSearch::load(const std::filesystem::path& path, int w, int wc)
+{
+    state = INACTIVE;
+
+    if (!std::filesystem::exists(path)) {
+        std::cerr << "Search file " << path << " was not found" << std::endl;
+        return false;
+    }
+
+    QSettings settings(QString(path.c_str()), QSettings::IniFormat);
+    settings.setFallbacksEnabled(false);
+
+    settings.beginGroup("search");
+    start_frame = settings.value("start_frame", -1).toLongLong();
+    frames = settings.value("frames", 1).toInt();
+    root_slot = settings.value("root_slot", 1).toInt();
+    checkpoint_count = settings.value("checkpoints", SLOT_COUNT-1).toInt();
+    budget = settings.value("budget", 100000).toULongLong();
+    time_limit = settings.value("time_limit", 0).toInt();
+    seed = settings.value("seed", 0).toULongLong();
+    report_count = settings.value("report_count", 10).toInt();
+    settings.endGroup();
+
+    columns.clear();
+    int size = settings.beginReadArray("inputs");
+    for (int i = 0; i < size; ++i) {
+        settings.setArrayIndex(i);
+        Column column;
+        column.si.type = settings.value("type").toInt();
+        column.si.which = settings.value("which").toUInt();
+        column.min = settings.value("min", 0).toInt();
+        column.step = settings.value("step", 1).toInt();
+        int max = settings.value("max", 1).toInt();
+        if ((column.step <= 0) || (max < column.min)) {
+            std::cerr << "Search input " << i+1 << " has an invalid range of values" << std::endl;
+            settings.endArray();
+            return false;
+        }
+        column.count = (static_cast<int64_t>(max) - column.min) / column.step + 1;
+        columns.push_back(column);
+    }
+    settings.endArray();
+
+    settings.beginGroup("objective");
+    objective_address = settings.value("address", 0).toULongLong();
+    objective_base_file = settings.value("base_file").toString().toStdString();
+    objective_base_file_offset = settings.value("base_file_offset", 0).toLongLong();
+    objective_type = settings.value("type", RamInt).toInt();
+    maximize = settings.value("maximize", true).toBool();
+    objective_offsets.clear();
+    size = settings.beginReadArray("offsets");
+    for (int i = 0; i < size; ++i) {
+        settings.setArrayIndex(i);
+        objective_offsets.push_back(settings.value("offset").toInt());
+    }
+    settings.endArray();
+    settings.endGroup();
+
+    if (columns.empty()) {
+        std::cerr << "Search file has no input to search" << std::endl;
+        return false;
+    }
+
+    if ((frames <= 0) || (budget == 0) || (report_count <= 0) || (time_limit < 0)) {
+        std::cerr << "Search file has invalid frames, budget, time_limit or report_count" << std::endl;
+        return false;
+    }
+
+    if ((root_slot < 1) || (root_slot > SLOT_COUNT) ||
+        (checkpoint_count < 0) || (checkpoint_count > SLOT_COUNT-1)) {
+        std::cerr << "Search file has invalid savestate slots" << std::endl;
+        return false;
+    }
+
+    if ((objective_address == 0) && objective_base_file.empty()) {
+        std::cerr << "Search file has no objective address" << std::endl;
+        return false;
+    }
+
+    if ((objective_type < RamUnsignedChar) || (objective_type > RamDouble)) {
+        std::cerr << "Search objective must have a numeric type" << std::endl;
+        return false;
+    }
+
+    frame_choices = 1;
+    for (const Column& column : columns) {
+        if (frame_choices > MAX_FRAME_CHOICES / column.count) {
+            std::cerr << "Too many input values to search in a single frame" << std::endl;
+            return false;
+        }
+        frame_choices *= column.count;
+    }
+
+    if ((wc <= 0) || (w < 0) || (w >= wc)) {
+        std::cerr << "Invalid search worker " << w << "/" << wc << std::endl;
+        return false;
+    }
+
+    if (frame_choices < static_cast<uint64_t>(wc)) {
+        std::cerr << "Not enough input values in a single frame for " << wc << " search workers" << std::endl;
+        return false;
+    }
+
+    worker = w;
+    worker_count = wc;
+    search_path = path;
+
+    /* Remove the results of a previous search, so that they are not merged */
+    std::error_code ec;
+    std::filesystem::remove(resultsPath(worker), ec);
+
+    /* Use the slots after the root slot as checkpoints, spread evenly along
+     * the branch */
+    checkpoint_slots.clear();
+    checkpoint_depths.clear();
+    for (int c = 1; c <= checkpoint_count; c++) {
+        int depth = c * frames / (checkpoint_count + 1);
+        if ((depth == 0) || (!checkpoint_depths.empty() && (checkpoint_depths.back() == depth)))
+            continue;
+        checkpoint_depths.push_back(depth);
+        checkpoint_slots.push_back((root_slot + c - 1) % SLOT_COUNT + 1);
+    }
+
+    if (!prepareBranches())
+        return false;
+
+    state = WAITING;
+    return true;
+}
+
+bool InputSearch::prepareBranches()
+{
+    /* Number of first frame choices of this worker */
+    uint64_t first_choices = (frame_choices - worker + worker_count - 1) / worker_count;
+
+    /* Size of the search space of this worker, saturated above the budget */
+    uint64_t space = first_choices;
+    for (int f = 1; (f < frames) && (space <= budget); f++) {
+        if (space > budget / frame_choices)
+            space = budget + 1;
+        else
+            space *= frame_choices;
+    }
+
+    samples.clear();
+    sample_index = 0;
+
+    if (space <= budget) {
+        /* Play all branches, starting from the first choice of the worker */
+        budget = space;
+        current.assign(frames, 0);
+        current[0] = worker;
+        return true;
+    }
+
+    /* Search space is too large, play a random sample of branches. Only the
+     * sample is stored, so the budget must fit in memory */
+    if (budget > MAX_SAMPLE_VALUES / frames) {
+        std::cerr << "Search budget " << budget << " is too large to sample " << frames << " frames, the maximum is " << MAX_SAMPLE_VALUES / frames << std::endl;
+        return false;
+    }
+
+    /* Branches are sorted so that consecutive branches share their first
+     * frames */
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<uint64_t> first_dist(0, first_choices - 1);
+    std::uniform_int_distribution<uint64_t> dist(0, frame_choices - 1);
+
+    samples.resize(budget);
+    for (std::vector<uint64_t>& branch : samples) {
+        branch.resize(frames);
+        branch[0] = worker + worker_count * first_dist(rng);
+        for (int f = 1; f < frames; f++)
+            branch[f] = dist(rng);
+    }
+    std::sort(samples.begin(), samples.end());
+    samples.erase(std::unique(samples.begin(), samples.end()), samples.end());
+
+    current = samples[0];
+    return true;
+}
+
+int InputSearch::nextBranch()
+{
+    if (!samples.empty()) {
+        if (++sample_index >= samples.size())
+            return -1;
+
+        const std::vector<uint64_t>& next = samples[sample_index];
+        int f = 0;
+        while (next[f] == current[f])
+            f++;
+        current = next;
+        return f;
+    }
+
+    /* Increment the last frame first, first frame choices are distributed
+     * between workers */
+    for (int f = frames - 1; f >= 0; f--) {
+        current[f] += (f == 0) ? worker_count : 1;
+        if (current[f] < frame_choices)
+            return f;
+        current[f] = 0;
+    }
+    return -1;
+}
+
+void InputSearch::applyInputs(AllInputs& ai) const
+{
+    if (state != RUNNING)
+        return;
+
+    uint64_t depth = context->framecount - root_frame;
+    if (depth >= static_cast<uint64_t>(frames))
+        return;
+
+    uint64_t choice = current[depth];
+    for (const Column& column : columns) {
+        ai.setInput(column.si, column.min + column.step * static_cast<int>(choice % column.count));
+        choice /= column.count;
+    }
+}
+
+int InputSearch::update(MovieFile& movie)
+{
+    if (state == WAITING) {
+        /* Wait for the game window, which indicates that the game is ready */
+        if (!context->game_window)
+            return 0;
+
+        /* Wait for the start frame, or for the end of the movie being read */
+        if (start_frame >= 0) {
+            if (context->framecount < static_cast<uint64_t>(start_frame))
+                return 0;
+        }
+        else if ((context->config.sc.recording == SharedConfig::RECORDING_READ) &&
+                 (context->framecount < context->config.sc.movie_framecount)) {
+            return 0;
+        }
+        return start(movie);
+    }
+
+    if (state != RUNNING)
+        return 0;
+
+    /* Stop if another state was loaded in the meantime */
+    if ((context->framecount < root_frame) ||
+        (context->framecount > (root_frame + frames))) {
+        std::cerr << "Input search was interrupted at frame " << context->framecount << std::endl;
+        return stop();
+    }
+
+    uint64_t depth = context->framecount - root_frame;
+
+    if (depth == static_cast<uint64_t>(frames)) {
+        double score;
+        if (readObjective(score))
+            record(score, movie);
+        branch_count++;
+
+        int first_frame = -1;
+        if ((time_limit == 0) ||
+            (std::chrono::steady_clock::now() - start_time < std::chrono::seconds(time_limit)))
+            first_frame = nextBranch();
+
+        if (first_frame < 0)
+            return finish(movie);
+
+        /* Checkpoints after the first different frame hold states of the
+         * previous branch. Start from the deepest one that is still valid */
+        int slot = root_slot;
+        int slot_depth = 0;
+        for (size_t c = 0; c < checkpoint_slots.size(); c++) {
+            if (checkpoint_depths[c] > first_frame)
+                checkpoint_valid[c] = false;
+            else if (checkpoint_valid[c] && (checkpoint_depths[c] > slot_depth)) {
+                slot = checkpoint_slots[c];
+                slot_depth = checkpoint_depths[c];
+            }
+        }
+
+        if (!loadState(slot, movie)) {
+            std::cerr << "Input search could not load savestate " << slot << std::endl;
+            return stop();
+        }
+
+        depth = context->framecount - root_frame;
+    }
+
+    /* Save a checkpoint of the current branch */
+    for (size_t c = 0; c < checkpoint_slots.size(); c++) {
+        if (!checkpoint_valid[c] && (static_cast<uint64_t>(checkpoint_depths[c]) == depth)) {
+            int message = SaveStateList::save(checkpoint_slots[c], context, movie);
+            checkpoint_valid[c] = (message == MSGB_SAVING_SUCCEEDED);
+        }
+    }
+
+    return 0;
+}
+
+int InputSearch::start(MovieFile& movie)
+{
+    state = INACTIVE;
+
+    if (context->config.sc.av_dumping) {
+        std::cerr << "Input search is not allowed when encoding" << std::endl;
+        return 0;
+    }
+
+    if (context->config.sc.recording == SharedConfig::NO_RECORDING) {
+        std::cerr << "Input search requires a movie" << std::endl;
+        return 0;
+    }
+
+    root_frame = context->framecount;
+    int message = SaveStateList::save(root_slot, context, movie);
+    if (message != MSGB_SAVING_SUCCEEDED) {
+        std::cerr << "Input search could not save the root state" << std::endl;
+        return 0;
+    }
+
+    checkpoint_valid.assign(checkpoint_slots.size(), false);
+    results.clear();
+    branch_count = 0;
+    start_time = std::chrono::steady_clock::now();
+
+    std::cout << "Input search started at frame " << root_frame << " with ";
+    if (samples.empty())
+        std::cout << "all branches";
+    else
+        std::cout << samples.size() << " sampled branches";
+    std::cout << " (worker " << worker << "/" << worker_count << ")" << std::endl;
+
+    /* Record the branches as fast as possible */
+    old_fastforward = context->config.sc.fastforward;
+    context->config.sc.recording = SharedConfig::RECORDING_WRITE;
+    context->config.sc.running = true;
+    context->config.sc.fastforward = true;
+    context->config.sc_modified = true;
+
+    state = RUNNING;
+    return RETURN_FLAG_CONFIG;
+}
+
+bool InputSearch::readObjective(double& score) const
+{
+    uintptr_t addr = objective_address;
+    if (!objective_base_file.empty())
+        addr = BaseAddresses::getAddress(objective_base_file, objective_base_file_offset);
+
+    for (int offset : objective_offsets) {
+        bool valid;
+        addr = MemAccess::readAddr(reinterpret_cast<void*>(addr), &valid);
+        if (!valid)
+            return false;
+        addr += offset;
+    }
+
+    MemValueType value;
+    size_t size = MemValue::type_size(objective_type);
+    if (MemAccess::read(&value, reinterpret_cast<void*>(addr), size) != size)
+        return false;
+
+    switch (objective_type) {
+        case RamUnsignedChar: score = value.v_uint8_t; break;
+        case RamChar: score = value.v_int8_t; break;
+        case RamUnsignedShort: score = value.v_uint16_t; break;
+        case RamShort: score = value.v_int16_t; break;
+        case RamUnsignedInt: score = value.v_uint32_t; break;
+        case RamInt: score = value.v_int32_t; break;
+        case RamUnsignedLong: score = value.v_uint64_t; break;
+        case RamLong: score = value.v_int64_t; break;
+        case RamFloat: score = value.v_float; break;
+        case RamDouble: score = value.v_double; break;
+        default: return false;
+    }
+    return true;
+}
+
+void InputSearch::record(double score, MovieFile& movie)
+{
+    auto better = [this](double a, double b) {
+        return maximize ? (a > b) : (a < b);
+    };
+
+    if ((results.size() >= static_cast<size_t>(report_count)) && !better(score, results.back().score))
+        return;
+
+    Result result;
+    result.score = score;
+    result.choices = current;
+    for (int f = 0; f < frames; f++)
+        result.inputs.push_back(movie.inputs->getInputs(root_frame + f));
+
+    insertResult(std::move(result));
+}
+
+void InputSearch::insertResult(Result&& result)
+{
+    auto better = [this](double a, double b) {
+        return maximize ? (a > b) : (a < b);
+    };
+
+    /* Insert after branches of the same score, so that the first one stays first */
+    auto it = std::upper_bound(results.begin(), results.end(), result.score,
+        [&](double s, const Result& r) {return better(s, r.score);});
+    results.insert(it, std::move(result));
+
+    if (results.size() > static_cast<size_t>(report_count))
+        results.pop_back();
+}
+
+void InputSearch::printResults() const
+{
+    for (size_t r = 0; r < results.size(); r++) {
+        std::cout << "  " << r+1 << ": score " << results[r].score << ", inputs";
+        for (uint64_t choice : results[r].choices) {
+            std::cout << " [";
+            for (size_t c = 0; c < columns.size(); c++) {
+                std::cout << (c ? "," : "") << columns[c].min + columns[c].step * static_cast<int>(choice % columns[c].count);
+                choice /= columns[c].count;
+            }
+            std::cout << "]";
+        }
+        std::cout << std::endl;
+    }
+}
+
+std::filesystem::path InputSearch::resultsPath(int w) const
+{
+    std::filesystem::path path = search_path;
+    path.replace_extension(".worker" + std::to_string(w) + ".results");
+    return path;
+}
+
+void InputSearch::saveResults() const
+{
+    /* Write a temporary file first, so that worker 0 never reads an
+     * incomplete file */
+    std::filesystem::path path = resultsPath(worker);
+    std::filesystem::path temp_path = path;
+    temp_path += ".tmp";
+
+    {
+        QSettings settings(QString(temp_path.c_str()), QSettings::IniFormat);
+        settings.clear();
+
+        settings.beginGroup("search");
+        settings.setValue("worker", worker);
+        settings.setValue("workers", worker_count);
+        settings.setValue("root_frame", static_cast<qulonglong>(root_frame));
+        settings.setValue("frames", frames);
+        settings.setValue("branches", static_cast<qulonglong>(branch_count));
+        settings.endGroup();
+
+        settings.beginWriteArray("results");
+        for (size_t r = 0; r < results.size(); r++) {
+            settings.setArrayIndex(r);
+            settings.setValue("score", results[r].score);
+
+            std::ostringstream choices;
+            for (uint64_t choice : results[r].choices)
+                choices << choice << " ";
+            settings.setValue("choices", QString(choices.str().c_str()));
+
+            std::ostringstream inputs;
+            InputSerialization::writeInputs(inputs, results[r].inputs);
+            settings.setValue("inputs", QString(inputs.str().c_str()));
+        }
+        settings.endArray();
+
+        settings.sync();
+        if (settings.status() != QSettings::NoError) {
+            std::cerr << "Could not write the search results " << temp_path << std::endl;
+            return;
+        }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(temp_path, path, ec);
+    if (ec)
+        std::cerr << "Could not write the search results " << path << ": " << ec.message() << std::endl;
+}
+
+bool InputSearch::mergeResults()
+{
+    for (int w = 1; w < worker_count; w++) {
+        std::filesystem::path path = resultsPath(w);
+
+        /* Wait for the worker to finish, while the game is still there */
+        if (!std::filesystem::exists(path))
+            std::cout << "Input search is waiting for the results of worker " << w << std::endl;
+        while (!std::filesystem::exists(path)) {
+            if ((context->status == Context::QUITTING) || (kill(context->game_pid, 0) != 0)) {
+                std::cerr << "Input search stopped waiting for the results of other workers" << std::endl;
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
+        QSettings settings(QString(path.c_str()), QSettings::IniFormat);
+        settings.setFallbacksEnabled(false);
+
+        settings.beginGroup("search");
+        bool valid = (settings.value("worker").toInt() == w) &&
+            (settings.value("workers").toInt() == worker_count) &&
+            (settings.value("root_frame").toULongLong() == root_frame) &&
+            (settings.value("frames").toInt() == frames);
+        uint64_t worker_branches = settings.value("branches").toULongLong();
+        settings.endGroup();
+
+        if (!valid) {
+            std::cerr << "Search results " << path << " do not belong to this search, skipping them" << std::endl;
+            continue;
+        }
+
+        branch_count += worker_branches;
+
+        int size = settings.beginReadArray("results");
+        for (int i = 0; i < size; ++i) {
+            settings.setArrayIndex(i);
+            Result result;
+            result.score = settings.value("score").toDouble();
+
+            std::istringstream choices(settings.value("choices").toString().toStdString());
+            uint64_t choice;
+            while (choices >> choice)
+                result.choices.push_back(choice);
+
+            std::istringstream inputs(settings.value("inputs").toString().toStdString());
+            InputSerialization::readInputs(inputs, result.inputs);
+
+            if ((result.choices.size() != static_cast<size_t>(frames)) ||
+                (result.inputs.size() != static_cast<size_t>(frames))) {
+                std::cerr << "Search results " << path << " have an invalid branch " << i+1 << std::endl;
+                continue;
+            }
+            insertResult(std::move(result));
+        }
+        settings.endArray();
+    }
+    return true;
+}
+
+bool InputSearch::loadState(int slot, MovieFile& movie)
+{
+    if (SaveStateList::load(slot, context, movie, false, false) != 0)
+        return false;
+
+    return SaveStateList::postLoad(slot, context, movie, false, false) == MSGB_LOADING_SUCCEEDED;
+}
+
+int InputSearch::stop()
+{
+    state = INACTIVE;
+    context->config.sc.fastforward = old_fastforward;
+    context->config.sc_modified = true;
+    return RETURN_FLAG_CONFIG;
+}
+
+int InputSearch::finish(MovieFile& movie)
+{
+    stop();
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+    std::cout << "Input search played " << branch_count << " branches in " << elapsed.count() << " seconds" << std::endl;
+
+    printResults();
+
+    /* Share the results between workers, worker 0 gets the best branches of
+     * all workers */
+    if (worker_count > 1) {
+        saveResults();
+        if (worker == 0) {
+            if (!mergeResults())
+                return RETURN_FLAG_CONFIG;
+            std::cout << "Input search merged the results of " << worker_count << " workers, with " << branch_count << " branches in total" << std::endl;
+            printResults();
+        }
+    }
+
+    if (results.empty()) {
+        std::cout << "Input search could not read any score" << std::endl;
+        return RETURN_FLAG_CONFIG;
+    }
+
+    std::cout << "Best score: " << results[0].score << std::endl;
+
+    /* Write the best branch after the root frame */
+    if (!loadState(root_slot, movie)) {
+        std::cerr << "Input search could not load the root state" << std::endl;
+        return RETURN_FLAG_CONFIG;
+    }
+
+    for (int f = 0; f < frames; f++) {
+        movie.inputs->setInputs(results[0].inputs[f], root_frame + f, false);
+        movie.inputs->processPendingActions();
+    }
+
+    /* Play back the best branch */
+    context->config.sc.recording = SharedConfig::RECORDING_READ;
+    context->config.sc.movie_framecount = movie.inputs->nbFrames();
+    context->config.sc.running = true;
+
+    return RETURN_FLAG_CONFIG;
+}
@@ -0,0 +1,227 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_INPUTSEARCH_H_INCLUDED
+#define LIBTAS_INPUTSEARCH_H_INCLUDED
+
+#include "../shared/inputs/SingleInput.h"
+#include "../shared/inputs/AllInputs.h"
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <chrono>
+#include <filesystem>
+
+/* Forward declaration */
+class MovieFile;
+struct Context;
+
+/* Brute-force search of the inputs of a few frames, driven by savestates.
+ *
+ * Starting from a root savestate, every branch plays a sequence of values for
+ * a set of inputs during a fixed number of frames, then reads a value from the
+ * game memory which is the score of the branch. Branches are played in
+ * lexicographic order, so that consecutive branches share their first frames.
+ * Intermediate savestates (checkpoints) are saved along the current branch, and
+ * the next branch starts from the deepest checkpoint it shares with the
+ * previous one instead of the root.
+ *
+ * The search space can be split between several libTAS instances, each one
+ * running a worker which only plays the branches whose first frame choice
+ * matches its index. Each worker then writes its best branches into a results
+ * file next to the search file (<name>.worker<I>.results), and worker 0 waits
+ * for the results of the other workers and merges them. When the search is
+ * over, the best branch is written into the movie after the root frame, and
+ * the movie is played back. For worker 0 this is the best branch of all
+ * workers, other workers only use their own branches.
+ *
+ * Parameters are read from an ini file:
+ *
+ *   [search]
+ *   start_frame=100     frame to start from, default is the end of the movie
+ *   frames=8            number of frames of each branch
+ *   root_slot=1         savestate slot of the root state
+ *   checkpoints=8       number of other savestate slots used as checkpoints
+ *   budget=100000       maximum number of branches. Sampling is limited to
+ *                       about 64 million frame choices in total
+ *   time_limit=0        maximum duration of the search in seconds, or 0
+ *   seed=0              seed of the random sample, when the budget is lower
+ *                       than the size of the search space
+ *   report_count=10     number of best branches printed at the end
+ *
+ *   [inputs]            one SingleInput for each input to search
+ *   size=2
+ *   1\type=0            SingleInput type and value, keyboard here
+ *   1\which=65363       (XK_Right)
+ *   1\min=0             range of values, with min, max and step
+ *   1\max=1
+ *   2\type=...
+ *
+ *   [objective]
+ *   address=...         address of the score, or:
+ *   base_file=...       file and offset of the score address, and
+ *   base_file_offset=...
+ *   offsets\size=1      offsets of a pointer chain starting from there
+ *   offsets\1\offset=...
+ *   type=5              RamType of the score
+ *   maximize=true       if the score must be maximized or minimized
+ */
+class InputSearch {
+public:
+    enum ReturnFlag {
+        RETURN_FLAG_CONFIG = 0x01, // shared config was modified
+    };
+
+    InputSearch(Context* c) : context(c) {}
+
+    /* Load the search parameters from a file, for the worker `worker` of
+     * `worker_count`. Returns false if parameters are invalid */
+    bool load(const std::filesystem::path& path, int worker, int worker_count);
+
+    /* Returns if the search was loaded and did not finish yet */
+    bool active() const {return (state == WAITING) || (state == RUNNING);}
+
+    /* Called on each frame boundary before inputs are processed. Starts the
+     * search, scores the current branch and loads the state of the next one.
+     * Returns a combination of ReturnFlag */
+    int update(MovieFile& movie);
+
+    /* Set the searched inputs of the current branch */
+    void applyInputs(AllInputs& ai) const;
+
+private:
+    enum State {
+        INACTIVE,
+        WAITING,
+        RUNNING,
+    };
+
+    /* Searched input with its range of values */
+    struct Column {
+        SingleInput si;
+        int min;
+        int step;
+        uint64_t count;
+    };
+
+    /* Branch with its score, and the inputs that were played */
+    struct Result {
+        double score;
+        std::vector<uint64_t> choices;
+        std::vector<AllInputs> inputs;
+    };
+
+    Context* context;
+
+    State state = INACTIVE;
+
+    /* Search file, next to which results files are written */
+    std::filesystem::path search_path;
+
+    std::vector<Column> columns;
+    int frames = 1;
+    int64_t start_frame = -1;
+    int root_slot = 1;
+    int checkpoint_count = 0;
+    uint64_t budget = 0;
+    int time_limit = 0;
+    uint64_t seed = 0;
+    int report_count = 10;
+
+    uintptr_t objective_address = 0;
+    std::string objective_base_file;
+    off_t objective_base_file_offset = 0;
+    std::vector<int> objective_offsets;
+    int objective_type = 0;
+    bool maximize = true;
+
+    int worker = 0;
+    int worker_count = 1;
+
+    /* Number of choices for a single frame, combining all columns */
+    uint64_t frame_choices = 1;
+
+    /* Sorted list of sampled branches, or empty for an exhaustive search */
+    std::vector<std::vector<uint64_t>> samples;
+    uint64_t sample_index = 0;
+
+    /* Choice of each frame of the current branch */
+    std::vector<uint64_t> current;
+
+    /* Savestate slot and depth of each checkpoint, and if it holds a state
+     * of the current branch */
+    std::vector<int> checkpoint_slots;
+    std::vector<int> checkpoint_depths;
+    std::vector<bool> checkpoint_valid;
+
+    uint64_t root_frame = 0;
+    uint64_t branch_count = 0;
+    bool old_fastforward = false;
+    std::chrono::steady_clock::time_point start_time;
+
+    /* Best branches, from best to worst */
+    std::vector<Result> results;
+
+    /* Save the root state and play the first branch */
+    int start(MovieFile& movie);
+
+    /* Build the list of branches to play. Returns false if the sample of
+     * branches is too large */
+    bool prepareBranches();
+
+    /* Move to the next branch. Returns the first frame that differs from the
+     * previous branch, or -1 if there is no branch left */
+    int nextBranch();
+
+    /* Read the score of the current branch. Returns false if it could not
+     * be read */
+    bool readObjective(double& score) const;
+
+    /* Store the current branch if it belongs to the best branches */
+    void record(double score, MovieFile& movie);
+
+    /* Insert a branch into the list of best branches */
+    void insertResult(Result&& result);
+
+    /* Print the list of best branches */
+    void printResults() const;
+
+    /* Path of the results file of a worker */
+    std::filesystem::path resultsPath(int w) const;
+
+    /* Write the best branches of this worker into its results file */
+    void saveResults() const;
+
+    /* Wait for the results files of the other workers, and merge their best
+     * branches. Returns false if the wait was interrupted */
+    bool mergeResults();
+
+    /* Load a savestate from its slot. Returns false if loading failed */
+    bool loadState(int slot, MovieFile& movie);
+
+    /* Stop the search and restore the fast-forward state */
+    int stop();
+
+    /* Print the best branches, write the best one into the movie and play
+     * it back */
+    int finish(MovieFile& movie);
+};
+
+#endif
@@ -121,9 +121,11 @@ int SaveState::load(Context* context, const MovieFile& m, bool branch, bool inpu
 {
     /* Check that the savestate exists (check for both savestate files and 
      * framecount, because there can be leftover savestate files from
-     * forked savestate of previous execution). */
-    if (!std::filesystem::exists(pagemap_path) || !std::filesystem::exists(pages_path) ||
-        (framecount == 0)) {
+     * forked savestate of previous execution). Savestates stored in memory
+     * have no file, the game will report if the state is missing. */
+    bool files_exist = (context->config.sc.savestate_settings & SharedConfig::SS_MEMORY) ||
+        (std::filesystem::exists(pagemap_path) && std::filesystem::exists(pages_path));
+    if (!files_exist || (framecount == 0)) {
         /* If there is no savestate but a movie file, offer to load
          * the movie and fast-forward to the savestate movie frame.
          */
@@ -274,5 +276,5 @@ int SaveState::postLoad(Context* context, MovieFile& m, bool branch, bool inputE
 void SaveState::backupMovie()
 {
     if (framecount) // 0 means no state has been made
-        movie->saveMovie(movie_path);
+        movie->saveSavestateMovie(movie_path);
 }
@@ -23,6 +23,10 @@
 #include "ramsearch/BaseAddresses.h"
 
 #include <iostream>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <type_traits>
 extern "C" {
 #include <lua.h>
 #include <lauxlib.h>
@@ -42,6 +46,7 @@ static const luaL_Reg memory_functions[] =
     { "readf", Lua::Memory::readf},
     { "readd", Lua::Memory::readd},
     { "readcstring", Lua::Memory::readcstring},
+    { "readlist", Lua::Memory::readlist},
     { "write8", Lua::Memory::write8},
     { "write16", Lua::Memory::write16},
     { "write32", Lua::Memory::write32},
@@ -115,6 +120,67 @@ int Lua::Memory::readcstring(lua_State *L)
     return 1;
 }
 
+/* Convert a value read from memory into the type of readlist() */
+template <typename T>
+static void pushvalue(lua_State *L, const uint64_t* buffer, bool valid)
+{
+    T value = 0;
+    if (valid)
+        memcpy(&value, buffer, sizeof(T));
+    if constexpr (std::is_floating_point_v<T>)
+        lua_pushnumber(L, static_cast<lua_Number>(value));
+    else
+        lua_pushinteger(L, static_cast<lua_Integer>(value));
+}
+
+int Lua::Memory::readlist(lua_State *L)
+{
+    luaL_checktype(L, 1, LUA_TTABLE);
+    std::string type = luaL_checkstring(L, 2);
+
+    int size;
+    if ((type == "u8") || (type == "s8"))
+        size = 1;
+    else if ((type == "u16") || (type == "s16"))
+        size = 2;
+    else if ((type == "u32") || (type == "s32") || (type == "f"))
+        size = 4;
+    else if ((type == "u64") || (type == "s64") || (type == "d"))
+        size = 8;
+    else
+        return luaL_argerror(L, 2, "unknown type");
+
+    /* All addresses are read in a few calls */
+    lua_Integer count = luaL_len(L, 1);
+    std::vector<MemAccess::Request> requests(count);
+    std::vector<uint64_t> values(count, 0);
+    for (lua_Integer i = 0; i < count; i++) {
+        lua_rawgeti(L, 1, i+1);
+        uintptr_t addr = static_cast<uintptr_t>(lua_tointeger(L, -1));
+        lua_pop(L, 1);
+        requests[i] = {&values[i], addr, static_cast<size_t>(size), 0};
+    }
+
+    MemAccess::readv(requests.data(), requests.size());
+
+    lua_createtable(L, static_cast<int>(count), 0);
+    for (lua_Integer i = 0; i < count; i++) {
+        bool valid = (requests[i].result == requests[i].size);
+        if (type == "u8") pushvalue<uint8_t>(L, &values[i], valid);
+        else if (type == "u16") pushvalue<uint16_t>(L, &values[i], valid);
+        else if (type == "u32") pushvalue<uint32_t>(L, &values[i], valid);
+        else if (type == "u64") pushvalue<uint64_t>(L, &values[i], valid);
+        else if (type == "s8") pushvalue<int8_t>(L, &values[i], valid);
+        else if (type == "s16") pushvalue<int16_t>(L, &values[i], valid);
+        else if (type == "s32") pushvalue<int32_t>(L, &values[i], valid);
+        else if (type == "s64") pushvalue<int64_t>(L, &values[i], valid);
+        else if (type == "f") pushvalue<float>(L, &values[i], valid);
+        else pushvalue<double>(L, &values[i], valid);
+        lua_rawseti(L, -2, i+1);
+    }
+    return 1;
+}
+
 void Lua::Memory::write(uintptr_t addr, void* value, int size)
 {
     MemAccess::write(value, reinterpret_cast<void*>(addr), size);
@@ -68,6 +68,9 @@ namespace Memory {
     /* Read a null-terminating string */
     int readcstring(lua_State *L);
 
+    /* Read values of the same type at a list of addresses */
+    int readlist(lua_State *L);
+
     /* Helper function for reading an integer */
     void write(uintptr_t addr, void* value, int size);
 
@@ -25,6 +25,7 @@
 #include "lua/Callbacks.h"
 #include "KeyMapping.h"
 #include "ramsearch/MemScanner.h"
+#include "../shared/sockethelpers.h"
 #ifdef __unix__
 #include "KeyMappingXcb.h"
 #elif defined(__APPLE__) && defined(__MACH__)
@@ -38,11 +39,13 @@
 #include <signal.h> // kill
 #include <unistd.h>
 #include <string.h>
+#include <stdio.h> // sscanf
 #include <string>
 #include <fstream>
 #include <iostream>
 #include <fcntl.h>
 #include <getopt.h>
+#include <sys/file.h> // flock
 #include <stdint.h>
 #include <sys/capability.h>
 #include <linux/sched.h>
@@ -87,6 +90,28 @@ struct clone_args {
 
 Context context;
 
+/* Lock an instance number, so that two libTAS don't use the same socket and
+ * directories. The lock is released when we exit */
+static bool lock_instance(const std::filesystem::path& lockpath)
+{
+    int fd = open(lockpath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        std::cerr << "Could not open the instance lock " << lockpath << std::endl;
+        return true;
+    }
+
+    if (flock(fd, LOCK_EX | LOCK_NB) != 0) {
+        close(fd);
+        return false;
+    }
+    return true;
+}
+
+static std::filesystem::path instance_lock_path(const std::filesystem::path& configdir, int instance)
+{
+    return configdir / ("instance" + std::to_string(instance) + ".lock");
+}
+
 static void print_usage(void)
 {
     std::cout << "Usage: libTAS [options] game_executable_relative_path [game_cmdline_arguments]" << std::endl;
@@ -102,6 +127,10 @@ static void print_usage(void)
     std::cout << "  -i, --input-editor      Open Input Editor window at startup" << std::endl;
     std::cout << "  -L, --lua-console       Open Lua Console window at startup" << std::endl;
     std::cout << "  -s, --set KEY=VALUE     Override any config setting (KEY matches ini key names)" << std::endl;
+    std::cout << "      --instance N        Use the socket and working directories of instance N, to run several libTAS at once" << std::endl;
+    std::cout << "      --search FILE       Search the inputs described in FILE using savestates, and write the best ones into the movie" << std::endl;
+    std::cout << "      --search-worker I/N Only search the part I of N of the inputs, to split a search between several instances." << std::endl;
+    std::cout << "                          Worker 0 waits for the results of the other workers and writes the best of all into its movie" << std::endl;
     std::cout << "  -h, --help              Show this message" << std::endl;
 }
 
@@ -128,6 +157,7 @@ int main(int argc, char **argv)
     bool test_mode = false;
     int recordingmode = SharedConfig::RECORDING_WRITE;
     std::vector<std::pair<std::string,std::string>> pending_cli_settings;
+    int instance = -1;
 
     static struct option long_options[] =
     {
@@ -143,6 +173,9 @@ int main(int argc, char **argv)
         {"input-editor", no_argument, nullptr, 'i'},
         {"lua-console", no_argument, nullptr, 'L'},
         {"set", required_argument, nullptr, 's'},
+        {"instance", required_argument, nullptr, 'I'},
+        {"search", required_argument, nullptr, 'S'},
+        {"search-worker", required_argument, nullptr, 'W'},
         {nullptr, 0, nullptr, 0}
     };
     int option_index = 0;
@@ -213,6 +246,27 @@ int main(int argc, char **argv)
                 pending_cli_settings.emplace_back(arg.substr(0, eq), arg.substr(eq + 1));
                 break;
             }
+            case 'I': {
+                char* end;
+                long value = strtol(optarg, &end, 10);
+                if ((*end != '\0') || (value < 0) || (value > INT_MAX)) {
+                    std::cerr << "--instance requires a non-negative number" << std::endl;
+                    return 1;
+                }
+                instance = value;
+                break;
+            }
+            case 'S':
+                context.searchfile = std::filesystem::weakly_canonical(optarg);
+                break;
+            case 'W':
+                if ((sscanf(optarg, "%d/%d", &context.search_worker, &context.search_workers) != 2) ||
+                    (context.search_workers <= 0) || (context.search_worker < 0) ||
+                    (context.search_worker >= context.search_workers)) {
+                    std::cerr << "--search-worker requires I/N with 0 <= I < N" << std::endl;
+                    return 1;
+                }
+                break;
             default:
                 return 1;
         }
@@ -350,6 +404,24 @@ int main(int argc, char **argv)
         return 1;
     }
 
+    /* Select the instance. Without one on the command line, we use the
+     * default instance, or our PID if another libTAS is already using it */
+    bool temporary_instance = false;
+    if (instance >= 0) {
+        if (!lock_instance(instance_lock_path(context.config.configdir, instance))) {
+            std::cerr << "Instance " << instance << " is already used by another libTAS" << std::endl;
+            return 1;
+        }
+        context.config.instance = instance;
+    }
+    else if (!lock_instance(instance_lock_path(context.config.configdir, 0))) {
+        context.config.instance = getpid();
+        lock_instance(instance_lock_path(context.config.configdir, context.config.instance));
+        temporary_instance = true;
+        std::cout << "Another libTAS is running, using instance " << context.config.instance << std::endl;
+    }
+    setSocketInstance(context.config.instance);
+
     /* Now that we have the config dir, we load the game-specific config */
     context.config.load(context.gamepath);
 
@@ -451,6 +523,15 @@ int main(int argc, char **argv)
         }
     }
 
+    /* Remove the directories of a temporary instance if they are empty */
+    if (temporary_instance) {
+        std::error_code ec;
+        std::filesystem::remove(context.config.savestatedir, ec);
+        std::filesystem::remove(context.config.ramsearchdir, ec);
+        std::filesystem::remove(context.config.tempmoviedir, ec);
+        std::filesystem::remove(instance_lock_path(context.config.configdir, context.config.instance), ec);
+    }
+
 #ifdef __unix__
     xcb_disconnect(context.conn);
 #endif
@@ -26,6 +26,23 @@
 #include "../shared/inputs/MouseInputs.h"
 
 #include <sstream>
+#include <cstring>
+
+/* Fields present in a frame of the binary format */
+enum BinaryField {
+    FIELD_EVENTS = 0x01,
+    FIELD_KEYBOARD = 0x02,
+    FIELD_POINTER = 0x04,
+    FIELD_CONTROLLER1 = 0x08, // and the next bits for the other controllers
+    FIELD_MISC = 0x80,
+};
+
+/* Fields present in the misc inputs of the binary format */
+enum BinaryMiscField {
+    FIELD_FLAGS = 0x01,
+    FIELD_FRAMERATE = 0x02,
+    FIELD_REALTIME = 0x04,
+};
 
 /* Initial framerate values */
 static unsigned int framerate_num, framerate_den;
@@ -64,6 +81,222 @@ void InputSerialization::readInputs(std::istream& stream, std::vector<AllInputs>
     }
 }
 
+template <typename T>
+static void appendValue(std::string& data, T value)
+{
+    data.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static bool readValue(const std::string& data, size_t& pos, T& value)
+{
+    if (data.size() - pos < sizeof(T))
+        return false;
+    memcpy(&value, &data[pos], sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+void InputSerialization::writeBinaryInputs(std::string& data, std::span<const AllInputs> input_list)
+{
+    /* Each frame is a byte of BinaryField followed by the present fields. The
+     * same fields as the text format are stored, so that both formats give
+     * the same inputs when loaded */
+    appendValue<uint64_t>(data, input_list.size());
+
+    for (const AllInputs& inputs : input_list) {
+        uint8_t fields = 0;
+
+        if (!inputs.events.empty()) {
+            /* Write only events if present */
+            appendValue<uint8_t>(data, FIELD_EVENTS);
+            appendValue<uint32_t>(data, inputs.events.size());
+            for (const auto& event : inputs.events) {
+                appendValue<int32_t>(data, event.type);
+                appendValue<uint32_t>(data, event.which);
+                appendValue<int32_t>(data, event.value);
+            }
+            continue;
+        }
+
+        int key_count = 0;
+        while ((key_count < AllInputs::MAXKEYS) && inputs.keyboard[key_count])
+            key_count++;
+        if (key_count)
+            fields |= FIELD_KEYBOARD;
+
+        if (context->config.sc.mouse_support && inputs.pointer)
+            fields |= FIELD_POINTER;
+
+        for (int joy=0; joy<context->config.sc.nb_controllers; joy++) {
+            if (!inputs.isDefaultController(joy))
+                fields |= FIELD_CONTROLLER1 << joy;
+        }
+
+        uint8_t misc_fields = 0;
+        if (inputs.misc) {
+            if (inputs.misc->flags)
+                misc_fields |= FIELD_FLAGS;
+            if ((inputs.misc->framerate_num && (inputs.misc->framerate_num != framerate_num)) ||
+                (inputs.misc->framerate_den && (inputs.misc->framerate_den != framerate_den)))
+                misc_fields |= FIELD_FRAMERATE;
+            if (inputs.misc->realtime_sec)
+                misc_fields |= FIELD_REALTIME;
+        }
+        if (misc_fields)
+            fields |= FIELD_MISC;
+
+        appendValue<uint8_t>(data, fields);
+
+        if (fields & FIELD_KEYBOARD) {
+            appendValue<uint8_t>(data, key_count);
+            data.append(reinterpret_cast<const char*>(inputs.keyboard.data()), key_count * sizeof(uint32_t));
+        }
+
+        if (fields & FIELD_POINTER) {
+            appendValue<int32_t>(data, inputs.pointer->x);
+            appendValue<int32_t>(data, inputs.pointer->y);
+            appendValue<int32_t>(data, inputs.pointer->wheel);
+            appendValue<uint8_t>(data, inputs.pointer->mode);
+            appendValue<uint8_t>(data, inputs.pointer->mask);
+        }
+
+        for (int joy=0; joy<AllInputs::MAXJOYS; joy++) {
+            if (fields & (FIELD_CONTROLLER1 << joy)) {
+                for (int axis=0; axis<ControllerInputs::MAXAXES; axis++)
+                    appendValue<int16_t>(data, inputs.controllers[joy]->axes[axis]);
+                appendValue<uint16_t>(data, inputs.controllers[joy]->buttons);
+            }
+        }
+
+        if (fields & FIELD_MISC) {
+            appendValue<uint8_t>(data, misc_fields);
+            if (misc_fields & FIELD_FLAGS)
+                appendValue<uint32_t>(data, inputs.misc->flags);
+            if (misc_fields & FIELD_FRAMERATE) {
+                appendValue<uint32_t>(data, inputs.misc->framerate_num ? inputs.misc->framerate_num : framerate_num);
+                appendValue<uint32_t>(data, inputs.misc->framerate_den ? inputs.misc->framerate_den : framerate_den);
+            }
+            if (misc_fields & FIELD_REALTIME) {
+                appendValue<uint32_t>(data, inputs.misc->realtime_sec);
+                appendValue<uint32_t>(data, inputs.misc->realtime_nsec);
+            }
+        }
+    }
+}
+
+/* Read a single frame of inputs in the binary format */
+static bool readBinaryFrame(const std::string& data, size_t& pos, AllInputs& inputs)
+{
+    uint8_t fields;
+    if (!readValue(data, pos, fields))
+        return false;
+
+    if (fields & FIELD_EVENTS) {
+        uint32_t event_count;
+        if (!readValue(data, pos, event_count) || (event_count > data.size()))
+            return false;
+        inputs.events.resize(event_count);
+        for (InputEvent& event : inputs.events) {
+            int32_t type, value;
+            uint32_t which;
+            if (!readValue(data, pos, type) || !readValue(data, pos, which) || !readValue(data, pos, value))
+                return false;
+            event.type = type;
+            event.which = which;
+            event.value = value;
+        }
+
+        /* Fill the state at the end of event processing */
+        inputs.processEvents();
+        return true;
+    }
+
+    if (fields & FIELD_KEYBOARD) {
+        uint8_t key_count;
+        if (!readValue(data, pos, key_count) || (key_count > AllInputs::MAXKEYS) ||
+            (data.size() - pos < key_count * sizeof(uint32_t)))
+            return false;
+        memcpy(inputs.keyboard.data(), &data[pos], key_count * sizeof(uint32_t));
+        pos += key_count * sizeof(uint32_t);
+    }
+
+    if (fields & FIELD_POINTER) {
+        int32_t x, y, wheel;
+        uint8_t mode, mask;
+        if (!readValue(data, pos, x) || !readValue(data, pos, y) || !readValue(data, pos, wheel) ||
+            !readValue(data, pos, mode) || !readValue(data, pos, mask))
+            return false;
+        inputs.pointer.reset(new MouseInputs{});
+        inputs.pointer->x = x;
+        inputs.pointer->y = y;
+        inputs.pointer->wheel = wheel;
+        inputs.pointer->mode = mode;
+        inputs.pointer->mask = mask;
+    }
+
+    for (int joy=0; joy<AllInputs::MAXJOYS; joy++) {
+        if (fields & (FIELD_CONTROLLER1 << joy)) {
+            if (!inputs.controllers[joy])
+                inputs.controllers[joy].reset(new ControllerInputs{});
+            for (int axis=0; axis<ControllerInputs::MAXAXES; axis++) {
+                int16_t value;
+                if (!readValue(data, pos, value))
+                    return false;
+                inputs.controllers[joy]->axes[axis] = value;
+            }
+            uint16_t buttons;
+            if (!readValue(data, pos, buttons))
+                return false;
+            inputs.controllers[joy]->buttons = buttons;
+        }
+    }
+
+    if (fields & FIELD_MISC) {
+        uint8_t misc_fields;
+        if (!readValue(data, pos, misc_fields))
+            return false;
+        if (!inputs.misc)
+            inputs.misc.reset(new MiscInputs{});
+        if ((misc_fields & FIELD_FLAGS) && !readValue(data, pos, inputs.misc->flags))
+            return false;
+        if ((misc_fields & FIELD_FRAMERATE) &&
+            (!readValue(data, pos, inputs.misc->framerate_num) || !readValue(data, pos, inputs.misc->framerate_den)))
+            return false;
+        if ((misc_fields & FIELD_REALTIME) &&
+            (!readValue(data, pos, inputs.misc->realtime_sec) || !readValue(data, pos, inputs.misc->realtime_nsec)))
+            return false;
+    }
+
+    return true;
+}
+
+bool InputSerialization::readBinaryInputs(const std::string& data, std::vector<AllInputs>& input_list)
+{
+    size_t pos = 0;
+    uint64_t count;
+    if (!readValue(data, pos, count))
+        return false;
+
+    /* Each frame takes at least one byte */
+    if (count > data.size())
+        return false;
+
+    /* Build frames in place, because AllInputs is expensive to copy */
+    input_list.reserve(input_list.size() + count);
+
+    for (uint64_t f = 0; f < count; f++) {
+        AllInputs& inputs = input_list.emplace_back();
+        inputs.clear();
+        if (!readBinaryFrame(data, pos, inputs)) {
+            input_list.pop_back();
+            return false;
+        }
+    }
+
+    return true;
+}
+
 int InputSerialization::writeFrame(std::ostream& stream, const AllInputs& inputs)
 {
     /* Write only events if present */
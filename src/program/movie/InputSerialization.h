@@ -42,6 +42,13 @@ void writeInputs(std::ostream& stream, std::span<const AllInputs> input_list);
 /* Read a list of inputs from a stream */
 void readInputs(std::istream& stream, std::vector<AllInputs>& input_list);
 
+/* Write a list of inputs in the binary format, used by native movie files */
+void writeBinaryInputs(std::string& data, std::span<const AllInputs> input_list);
+
+/* Read a list of inputs in the binary format. Returns false if the data is
+ * invalid */
+bool readBinaryInputs(const std::string& data, std::vector<AllInputs>& input_list);
+
 /* Write a single frame of inputs into the input stream */
 int writeFrame(std::ostream& input_stream, const AllInputs& inputs);
 
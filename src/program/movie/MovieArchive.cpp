@@ -0,0 +1,490 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MovieArchive.h"
+
+#include "../external/lz4.h"
+
+#include <zlib.h>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <cstdint>
+#include <climits>
+#include <ctime>
+#include <errno.h>
+#include <fcntl.h> // O_RDONLY, O_WRONLY, O_CREAT
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* Native format: magic, version and number of files, then for each file its
+ * name size, name, size and number of blocks, then for each block its
+ * uncompressed and stored sizes followed by the block. A block is stored
+ * uncompressed when lz4 does not make it smaller. Integers are stored in the
+ * host byte order, which is little-endian on all supported architectures. */
+static const char NATIVE_MAGIC[4] = {'L', 'T', 'M', 'B'};
+static const uint32_t NATIVE_VERSION = 1;
+static const size_t NATIVE_BLOCK_SIZE = 1 << 20;
+
+/* Size of tar blocks, and of tar records that the archive is padded to */
+static const size_t TAR_BLOCK_SIZE = 512;
+static const size_t TAR_RECORD_SIZE = 20 * TAR_BLOCK_SIZE;
+
+static bool readFile(const std::filesystem::path& path, std::string& data)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+
+    data.resize(st.st_size);
+    size_t pos = 0;
+    while (pos < data.size()) {
+        ssize_t ret = ::read(fd, &data[pos], data.size() - pos);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            close(fd);
+            return false;
+        }
+        if (ret == 0)
+            break;
+        pos += ret;
+    }
+    data.resize(pos);
+    close(fd);
+    return true;
+}
+
+static bool writeFile(const std::filesystem::path& path, const std::string& data)
+{
+    /* Write into a temporary file that replaces the archive when complete */
+    std::filesystem::path temppath = path;
+    temppath += ".tmp";
+
+    int fd = open(temppath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return false;
+
+    size_t pos = 0;
+    while (pos < data.size()) {
+        ssize_t ret = ::write(fd, &data[pos], data.size() - pos);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            int err = errno;
+            close(fd);
+            unlink(temppath.c_str());
+            errno = err;
+            return false;
+        }
+        pos += ret;
+    }
+
+    if ((close(fd) != 0) || (rename(temppath.c_str(), path.c_str()) != 0)) {
+        int err = errno;
+        unlink(temppath.c_str());
+        errno = err;
+        return false;
+    }
+    return true;
+}
+
+template <typename T>
+static void appendValue(std::string& out, T value)
+{
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static bool readValue(const std::string& in, size_t& pos, T& value)
+{
+    if (in.size() - pos < sizeof(T))
+        return false;
+    memcpy(&value, &in[pos], sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+static bool readNative(const std::string& in, std::vector<MovieArchive::Entry>& entries)
+{
+    size_t pos = sizeof(NATIVE_MAGIC);
+    uint32_t version, count;
+    if (!readValue(in, pos, version) || (version != NATIVE_VERSION))
+        return false;
+    if (!readValue(in, pos, count))
+        return false;
+
+    for (uint32_t e = 0; e < count; e++) {
+        MovieArchive::Entry entry;
+        uint32_t name_size;
+        if (!readValue(in, pos, name_size) || (in.size() - pos < name_size))
+            return false;
+        entry.name.assign(&in[pos], name_size);
+        pos += name_size;
+
+        uint64_t size;
+        uint32_t block_count;
+        if (!readValue(in, pos, size) || !readValue(in, pos, block_count))
+            return false;
+
+        /* Don't trust the sizes of a corrupted file: each block needs at
+         * least its two size fields, and the buffer is only grown for blocks
+         * that are actually present */
+        if ((block_count > (in.size() - pos) / (2 * sizeof(uint32_t))) ||
+            (size > static_cast<uint64_t>(block_count) * NATIVE_BLOCK_SIZE))
+            return false;
+
+        size_t data_pos = 0;
+        for (uint32_t b = 0; b < block_count; b++) {
+            uint32_t raw_size, stored_size;
+            if (!readValue(in, pos, raw_size) || !readValue(in, pos, stored_size))
+                return false;
+            if ((raw_size > NATIVE_BLOCK_SIZE) || (raw_size > size - data_pos) ||
+                (stored_size > raw_size) || (in.size() - pos < stored_size))
+                return false;
+
+            entry.data.resize(data_pos + raw_size);
+            if (stored_size == raw_size) {
+                memcpy(&entry.data[data_pos], &in[pos], raw_size);
+            }
+            else {
+                int ret = LZ4_decompress_safe(&in[pos], &entry.data[data_pos], stored_size, raw_size);
+                if (ret != static_cast<int>(raw_size))
+                    return false;
+            }
+            pos += stored_size;
+            data_pos += raw_size;
+        }
+
+        if (data_pos != size)
+            return false;
+
+        entries.push_back(std::move(entry));
+    }
+    return true;
+}
+
+static void writeNative(const std::vector<MovieArchive::Entry>& entries, std::string& out)
+{
+    out.append(NATIVE_MAGIC, sizeof(NATIVE_MAGIC));
+    appendValue<uint32_t>(out, NATIVE_VERSION);
+    appendValue<uint32_t>(out, entries.size());
+
+    std::string compressed(LZ4_compressBound(NATIVE_BLOCK_SIZE), '\0');
+
+    for (const MovieArchive::Entry& entry : entries) {
+        appendValue<uint32_t>(out, entry.name.size());
+        out.append(entry.name);
+        appendValue<uint64_t>(out, entry.data.size());
+        appendValue<uint32_t>(out, (entry.data.size() + NATIVE_BLOCK_SIZE - 1) / NATIVE_BLOCK_SIZE);
+
+        for (size_t pos = 0; pos < entry.data.size(); pos += NATIVE_BLOCK_SIZE) {
+            int raw_size = std::min(NATIVE_BLOCK_SIZE, entry.data.size() - pos);
+            int stored_size = LZ4_compress_default(&entry.data[pos], &compressed[0], raw_size, compressed.size());
+
+            appendValue<uint32_t>(out, raw_size);
+            if ((stored_size > 0) && (stored_size < raw_size)) {
+                appendValue<uint32_t>(out, stored_size);
+                out.append(compressed, 0, stored_size);
+            }
+            else {
+                appendValue<uint32_t>(out, raw_size);
+                out.append(entry.data, pos, raw_size);
+            }
+        }
+    }
+}
+
+/* Decompress gzip data, including concatenated gzip members */
+static bool gunzip(const std::string& in, std::string& out)
+{
+    z_stream zs = {};
+    if (inflateInit2(&zs, 15 + 16) != Z_OK)
+        return false;
+
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in = (in.size() > UINT_MAX) ? UINT_MAX : in.size();
+    size_t consumed = 0;
+
+    out.resize(std::max<size_t>(4 * in.size(), 1 << 16));
+    size_t produced = 0;
+
+    bool success = false;
+    while (true) {
+        if (produced == out.size())
+            out.resize(2 * out.size());
+
+        uInt avail_out = ((out.size() - produced) > UINT_MAX) ? UINT_MAX : (out.size() - produced);
+        uInt avail_in = zs.avail_in;
+        zs.next_out = reinterpret_cast<Bytef*>(&out[produced]);
+        zs.avail_out = avail_out;
+
+        int ret = inflate(&zs, Z_NO_FLUSH);
+        produced += avail_out - zs.avail_out;
+        consumed += avail_in - zs.avail_in;
+
+        if (ret == Z_STREAM_END) {
+            /* Decompress the next member if any, and ignore trailing garbage */
+            if (((in.size() - consumed) >= 2) &&
+                (static_cast<uint8_t>(in[consumed]) == 0x1f) &&
+                (static_cast<uint8_t>(in[consumed+1]) == 0x8b)) {
+                inflateReset(&zs);
+            }
+            else {
+                success = true;
+                break;
+            }
+        }
+        else if ((ret != Z_OK) && !((ret == Z_BUF_ERROR) && (zs.avail_out == 0))) {
+            break;
+        }
+
+        /* Refill the input for large archives */
+        if ((zs.avail_in == 0) && (consumed < in.size())) {
+            zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(&in[consumed]));
+            zs.avail_in = ((in.size() - consumed) > UINT_MAX) ? UINT_MAX : (in.size() - consumed);
+        }
+    }
+
+    inflateEnd(&zs);
+    out.resize(produced);
+    return success;
+}
+
+/* Compress data using gzip */
+static bool gzip(const std::string& in, std::string& out)
+{
+    z_stream zs = {};
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        return false;
+
+    if (in.size() > UINT_MAX) {
+        deflateEnd(&zs);
+        return false;
+    }
+
+    out.resize(deflateBound(&zs, in.size()));
+    zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in.data()));
+    zs.avail_in = in.size();
+    zs.next_out = reinterpret_cast<Bytef*>(&out[0]);
+    zs.avail_out = out.size();
+
+    int ret = deflate(&zs, Z_FINISH);
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+    return ret == Z_STREAM_END;
+}
+
+/* Parse an octal or base-256 number from a tar header field */
+static uint64_t tarNumber(const char* field, size_t size)
+{
+    uint64_t value = 0;
+    if (static_cast<uint8_t>(field[0]) & 0x80) {
+        for (size_t i = 1; i < size; i++)
+            value = (value << 8) | static_cast<uint8_t>(field[i]);
+        return value;
+    }
+
+    size_t i = 0;
+    while ((i < size) && (field[i] == ' '))
+        i++;
+    for (; (i < size) && (field[i] >= '0') && (field[i] <= '7'); i++)
+        value = (value << 3) | (field[i] - '0');
+    return value;
+}
+
+static unsigned int tarChecksum(const char* header)
+{
+    unsigned int sum = 0;
+    for (size_t i = 0; i < TAR_BLOCK_SIZE; i++) {
+        /* The checksum field counts as spaces */
+        if ((i >= 148) && (i < 156))
+            sum += ' ';
+        else
+            sum += static_cast<uint8_t>(header[i]);
+    }
+    return sum;
+}
+
+/* Returns the string of a tar header field, which may not be null-terminated */
+static std::string tarString(const char* field, size_t size)
+{
+    return std::string(field, strnlen(field, size));
+}
+
+static bool readTar(const std::string& in, std::vector<MovieArchive::Entry>& entries)
+{
+    std::string long_name;
+    size_t pos = 0;
+
+    while (in.size() - pos >= TAR_BLOCK_SIZE) {
+        const char* header = &in[pos];
+
+        /* The archive ends with empty blocks */
+        if (header[0] == '\0')
+            return true;
+
+        if (tarChecksum(header) != tarNumber(header + 148, 8))
+            return false;
+
+        uint64_t size = tarNumber(header + 124, 12);
+        char type = header[156];
+        pos += TAR_BLOCK_SIZE;
+
+        if (in.size() - pos < size)
+            return false;
+
+        switch (type) {
+            case '0':
+            case '\0': {
+                MovieArchive::Entry entry;
+                if (!long_name.empty()) {
+                    entry.name = long_name;
+                    long_name.clear();
+                }
+                else {
+                    entry.name = tarString(header, 100);
+                    if (memcmp(header + 257, "ustar", 5) == 0) {
+                        std::string prefix = tarString(header + 345, 155);
+                        if (!prefix.empty())
+                            entry.name = prefix + "/" + entry.name;
+                    }
+                }
+                /* Files are stored relative to the archive root */
+                if (entry.name.compare(0, 2, "./") == 0)
+                    entry.name.erase(0, 2);
+                entry.data.assign(in, pos, size);
+                entries.push_back(std::move(entry));
+                break;
+            }
+            case 'L':
+                /* GNU long name of the next file */
+                long_name = tarString(&in[pos], size);
+                break;
+            case 'x': {
+                /* pax extended header, only the path of the next file is used.
+                 * Records are "<length> <key>=<value>\n" */
+                size_t record = pos;
+                while (record < pos + size) {
+                    size_t length = strtoul(&in[record], nullptr, 10);
+                    if ((length == 0) || (length > pos + size - record))
+                        break;
+
+                    /* Only look inside the current record */
+                    const char* begin = &in[record];
+                    const char* end = begin + length;
+                    const char* key = static_cast<const char*>(memchr(begin, ' ', length));
+                    const char* value = key ? static_cast<const char*>(memchr(key, '=', end - key)) : nullptr;
+                    if (value && (end[-1] == '\n') && (value - key == 5) && (memcmp(key + 1, "path", 4) == 0))
+                        long_name.assign(value + 1, end - 1);
+                    record += length;
+                }
+                break;
+            }
+            default:
+                /* Directories, links and others are not used */
+                break;
+        }
+
+        pos += (size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE;
+    }
+
+    /* Missing end blocks */
+    return !entries.empty();
+}
+
+static void writeTar(const std::vector<MovieArchive::Entry>& entries, std::string& out)
+{
+    time_t mtime = time(nullptr);
+
+    for (const MovieArchive::Entry& entry : entries) {
+        char header[TAR_BLOCK_SIZE] = {};
+        strncpy(header, entry.name.c_str(), 100);
+        snprintf(header + 100, 8, "%07o", 0644);
+        snprintf(header + 108, 8, "%07o", 0);
+        snprintf(header + 116, 8, "%07o", 0);
+        snprintf(header + 124, 12, "%011llo", static_cast<unsigned long long>(entry.data.size()));
+        snprintf(header + 136, 12, "%011llo", static_cast<unsigned long long>(mtime));
+        header[156] = '0';
+        memcpy(header + 257, "ustar", 6);
+        memcpy(header + 263, "00", 2);
+        snprintf(header + 148, 8, "%06o", tarChecksum(header));
+        header[155] = ' ';
+
+        out.append(header, TAR_BLOCK_SIZE);
+        out.append(entry.data);
+        out.append((TAR_BLOCK_SIZE - entry.data.size() % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE, '\0');
+    }
+
+    /* Two empty blocks, then padding to a full record like tar does */
+    out.append(2 * TAR_BLOCK_SIZE, '\0');
+    out.append((TAR_RECORD_SIZE - out.size() % TAR_RECORD_SIZE) % TAR_RECORD_SIZE, '\0');
+}
+
+bool MovieArchive::read(const std::filesystem::path& path, std::vector<Entry>& entries)
+{
+    entries.clear();
+
+    std::string in;
+    if (!readFile(path, in))
+        return false;
+
+    bool success;
+    if ((in.size() >= sizeof(NATIVE_MAGIC)) && (memcmp(in.data(), NATIVE_MAGIC, sizeof(NATIVE_MAGIC)) == 0)) {
+        success = readNative(in, entries);
+    }
+    else if ((in.size() >= 2) && (static_cast<uint8_t>(in[0]) == 0x1f) && (static_cast<uint8_t>(in[1]) == 0x8b)) {
+        std::string tar;
+        success = gunzip(in, tar) && readTar(tar, entries);
+    }
+    else {
+        /* Uncompressed tar archive */
+        success = readTar(in, entries);
+    }
+
+    if (!success)
+        errno = EINVAL;
+    return success;
+}
+
+bool MovieArchive::write(const std::filesystem::path& path, const std::vector<Entry>& entries, Format format)
+{
+    std::string out;
+
+    if (format == FORMAT_NATIVE) {
+        writeNative(entries, out);
+    }
+    else {
+        std::string tar;
+        writeTar(entries, tar);
+        if (!gzip(tar, out)) {
+            errno = EFBIG;
+            return false;
+        }
+    }
+
+    return writeFile(path, out);
+}
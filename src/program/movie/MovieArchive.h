@@ -0,0 +1,57 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_MOVIEARCHIVE_H_INCLUDED
+#define LIBTAS_MOVIEARCHIVE_H_INCLUDED
+
+#include <string>
+#include <vector>
+#include <filesystem>
+
+/* Reading and writing of movie files, without calling external programs.
+ *
+ * Two formats are supported:
+ * - the legacy format, which is a gzip-compressed tar archive,
+ * - the native format, which starts with a small header followed by each
+ *   file split into blocks compressed with lz4.
+ * The format is detected when reading. */
+namespace MovieArchive {
+
+    enum Format {
+        FORMAT_LEGACY = 0,
+        FORMAT_NATIVE = 1,
+    };
+
+    /* A file stored inside the archive */
+    struct Entry {
+        std::string name;
+        std::string data;
+    };
+
+    /* Read all files of an archive. Returns false if the archive could not
+     * be read, with errno set */
+    bool read(const std::filesystem::path& path, std::vector<Entry>& entries);
+
+    /* Write files into an archive of the given format. The archive is first
+     * written to a temporary file, so that it is never left incomplete.
+     * Returns false if the archive could not be written, with errno set */
+    bool write(const std::filesystem::path& path, const std::vector<Entry>& entries, Format format);
+}
+
+#endif
@@ -22,11 +22,11 @@
 #include "../shared/inputs/AllInputs.h"
 #include "Context.h"
 
-#include <sstream>
+#include <fstream>
 #include <iostream>
-#include <fcntl.h> // O_RDONLY, O_WRONLY, O_CREAT
+#include <iterator>
+#include <cstring> // strerror
 #include <errno.h>
-#include <unistd.h>
 
 MovieFile::MovieFile(Context* c) : context(c)
 {
@@ -67,6 +67,9 @@ void MovieFile::clear()
     changelog->clear();
 }
 
+/* Files stored inside a movie, besides the inputs */
+static const char* const movie_files[] = {"config.ini", "editor.ini", "annotations.txt"};
+
 int MovieFile::extractMovie(const std::filesystem::path& moviefile)
 {
     if (moviefile.empty())
@@ -77,34 +80,39 @@ int MovieFile::extractMovie(const std::filesystem::path& moviefile)
         return ENOMOVIE;
 
     /* Empty the temp directory */
-    std::filesystem::path configfile = context->config.tempmoviedir / "config.ini";
-    std::filesystem::path editorfile = context->config.tempmoviedir / "editor.ini";
-    std::filesystem::path inputfile = context->config.tempmoviedir / "inputs";
-    std::filesystem::path annotationsfile = context->config.tempmoviedir / "annotations.txt";
-    std::filesystem::remove(configfile);
-    std::filesystem::remove(editorfile);
-    std::filesystem::remove(inputfile);
-    std::filesystem::remove(annotationsfile);
-
-    /* Build the tar command */
-    std::ostringstream oss;
-    /* Piping gzip -> tar to avoid gzip warnings on old movie files */
-    oss << "gzip -dq < ";
-    oss << moviefile;
-    oss << " | tar -xUf - -C ";
-    oss << context->config.tempmoviedir;
-
-    /* Execute the tar command */
-    // std::cout << oss.str() << std::endl;
-    int ret = system(oss.str().c_str());
-
-    if (!WIFEXITED(ret) || (WEXITSTATUS(ret) != 0))
+    for (const char* name : movie_files)
+        std::filesystem::remove(context->config.tempmoviedir / name);
+
+    std::vector<MovieArchive::Entry> entries;
+    if (!MovieArchive::read(moviefile, entries))
         return EBADARCHIVE;
 
+    bool has_inputs = false;
+    for (MovieArchive::Entry& entry : entries) {
+        /* Keep the inputs in memory, text inputs of legacy movies or binary
+         * inputs of native movies */
+        if ((entry.name == "inputs") || (entry.name == "inputs.bin")) {
+            archived_inputs = std::move(entry.data);
+            archived_inputs_binary = (entry.name == "inputs.bin");
+            has_inputs = true;
+            continue;
+        }
+
+        /* Only extract known files */
+        for (const char* name : movie_files) {
+            if (entry.name == name) {
+                std::ofstream file(context->config.tempmoviedir / name, std::ios::binary | std::ios::trunc);
+                file.write(entry.data.data(), entry.data.size());
+                if (!file)
+                    return EBADARCHIVE;
+            }
+        }
+    }
+
     /* Check the presence of the inputs and config files */
-    if (!std::filesystem::exists(configfile))
+    if (!std::filesystem::exists(context->config.tempmoviedir / "config.ini"))
         return ENOCONFIG;
-    if (!std::filesystem::exists(inputfile))
+    if (!has_inputs)
         return ENOINPUTS;
 
     return 0;
@@ -115,6 +123,19 @@ int MovieFile::extractMovie()
     return extractMovie(context->config.moviefile);
 }
 
+int MovieFile::loadArchivedInputs()
+{
+    bool success = inputs->load(archived_inputs, archived_inputs_binary);
+    archived_inputs.clear();
+    archived_inputs.shrink_to_fit();
+
+    if (!success) {
+        errno = EINVAL;
+        return EBADARCHIVE;
+    }
+    return 0;
+}
+
 int MovieFile::loadMovie(const std::filesystem::path& moviefile)
 {
     /* Extract the moviefile in the temp directory */
@@ -130,9 +151,12 @@ int MovieFile::loadMovie(const std::filesystem::path& moviefile)
      * Then it resets the input editor view */
     editor->load();
     header->load();
-    inputs->load();
+    ret = loadArchivedInputs();
     annotations->load();
 
+    if (ret < 0)
+        return ret;
+
     /* Copy framerate values to inputs */
     inputs->setFramerate(header->framerate_num, header->framerate_den, header->variable_framerate);
     inputs->length_sec = header->length_sec;
@@ -158,7 +182,10 @@ int MovieFile::loadSavestateMovie(const std::filesystem::path& moviefile)
     if (ret < 0)
         return ret;
 
-    inputs->load();
+    ret = loadArchivedInputs();
+    if (ret < 0)
+        return ret;
+
     editor->load();
     header->loadSavestate();
     inputs->length_sec = header->length_sec;
@@ -167,13 +194,12 @@ int MovieFile::loadSavestateMovie(const std::filesystem::path& moviefile)
     return 0;
 }
 
-int MovieFile::saveMovie(const std::filesystem::path& moviefile, uint64_t nb_frames)
+int MovieFile::writeMovie(const std::filesystem::path& moviefile, uint64_t nb_frames, MovieArchive::Format format)
 {
     /* Skip empty moviefiles, if user tested the annotations without specifying a movie */
     if (moviefile.empty())
         return ENOMOVIE;
 
-    inputs->save();
     header->variable_framerate = inputs->variable_framerate;
     header->length_sec = inputs->length_sec;
     header->length_nsec = inputs->length_nsec;
@@ -181,19 +207,22 @@ int MovieFile::saveMovie(const std::filesystem::path& moviefile, uint64_t nb_fra
     annotations->save();
     editor->save();
 
-    /* Build the tar command */
-    std::ostringstream oss;
-    oss << "tar -czUf ";
-    oss << moviefile;
-    oss << " -C ";
-    oss << context->config.tempmoviedir;
-    oss << " inputs config.ini editor.ini annotations.txt";
-
-    /* Execute the tar command */
-    // std::cout << oss.str() << std::endl;
-    int ret = system(oss.str().c_str());
+    /* Inputs are stored as text in legacy movies */
+    std::vector<MovieArchive::Entry> entries(1);
+    bool binary = (format == MovieArchive::FORMAT_NATIVE);
+    entries[0].name = binary ? "inputs.bin" : "inputs";
+    inputs->save(entries[0].data, binary);
+
+    for (const char* name : movie_files) {
+        std::ifstream file(context->config.tempmoviedir / name, std::ios::binary);
+        if (!file)
+            continue;
+        MovieArchive::Entry& entry = entries.emplace_back();
+        entry.name = name;
+        entry.data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
 
-    if (!WIFEXITED(ret) || (WEXITSTATUS(ret) != 0))
+    if (!MovieArchive::write(moviefile, entries, format))
         return EBADARCHIVE;
 
     if (moviefile == context->config.moviefile)
@@ -202,6 +231,18 @@ int MovieFile::saveMovie(const std::filesystem::path& moviefile, uint64_t nb_fra
     return 0;
 }
 
+int MovieFile::saveMovie(const std::filesystem::path& moviefile, uint64_t nb_frames)
+{
+    MovieArchive::Format format = (context->config.movie_format == Config::MOVIEFORMAT_NATIVE) ?
+        MovieArchive::FORMAT_NATIVE : MovieArchive::FORMAT_LEGACY;
+    return writeMovie(moviefile, nb_frames, format);
+}
+
+int MovieFile::saveSavestateMovie(const std::filesystem::path& moviefile)
+{
+    return writeMovie(moviefile, inputs->nbFrames(), MovieArchive::FORMAT_NATIVE);
+}
+
 int MovieFile::saveMovie(const std::filesystem::path& moviefile)
 {
     return saveMovie(moviefile, inputs->nbFrames());
@@ -25,6 +25,7 @@
 #include "MovieFileHeader.h"
 #include "MovieFileInputs.h"
 #include "MovieFileChangeLog.h"
+#include "MovieArchive.h"
 
 #include <string>
 #include <stdint.h>
@@ -59,7 +60,8 @@ public:
     /* Clear */
     void clear();
 
-    /* Extract a moviefile into the temp directory
+    /* Read a moviefile, extract its settings files into the temp directory
+     * and keep its inputs until they are loaded.
      * Returns 0 if no error, or a negative value if an error occured */
     int extractMovie();
     int extractMovie(const std::filesystem::path& moviefile);
@@ -81,6 +83,10 @@ public:
     /* Write only the n first frames of input into the movie file. Used for savestate movies */
     int saveMovie(const std::filesystem::path& moviefile, uint64_t frame_nb);
 
+    /* Write a savestate movie, always in the native format because it is
+     * only read back by libTAS */
+    int saveSavestateMovie(const std::filesystem::path& moviefile);
+
     /* Copy movie to another one */
     void copyFrom(const MovieFile& movie);
 
@@ -100,6 +106,16 @@ public:
 private:
     Context* context;    
 
+    /* Inputs read by extractMovie(), and if they are in binary format */
+    std::string archived_inputs;
+    bool archived_inputs_binary = false;
+
+    /* Import the inputs read by extractMovie() */
+    int loadArchivedInputs();
+
+    /* Write the movie file in the given format */
+    int writeMovie(const std::filesystem::path& moviefile, uint64_t frame_nb, MovieArchive::Format format);
+
 };
 
 #endif
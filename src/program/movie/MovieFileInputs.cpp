@@ -74,7 +74,7 @@ void MovieFileInputs::clear()
     emit inputsReset();
 }
 
-void MovieFileInputs::load()
+bool MovieFileInputs::load(const std::string& data, bool binary)
 {
     emit inputsToBeReset();
 
@@ -85,28 +85,32 @@ void MovieFileInputs::load()
     /* Clear structures */
     input_list.clear();
     
-    /* Open the input file and parse each line to fill our input list */
-    std::filesystem::path input_file = context->config.tempmoviedir / "inputs";
-    std::ifstream input_stream(input_file);
-    
-    InputSerialization::readInputs(input_stream, input_list);
-
-    input_stream.close();
+    bool success = true;
+    if (binary) {
+        success = InputSerialization::readBinaryInputs(data, input_list);
+    }
+    else {
+        /* Parse each line of the input file to fill our input list */
+        std::istringstream input_stream(data);
+        InputSerialization::readInputs(input_stream, input_list);
+    }
 
     movie_changelog->clear();
     emit inputsReset();
-    return;
+    return success;
 }
 
-void MovieFileInputs::save()
+void MovieFileInputs::save(std::string& data, bool binary)
 {
-    /* Format and write input frames into the input file */
-    std::filesystem::path input_file = context->config.tempmoviedir / "inputs";
-    std::ofstream input_stream(input_file, std::ofstream::trunc);
-
-    InputSerialization::writeInputs(input_stream, input_list);
-
-    input_stream.close();
+    /* Format and write input frames */
+    if (binary) {
+        InputSerialization::writeBinaryInputs(data, input_list);
+    }
+    else {
+        std::ostringstream input_stream;
+        InputSerialization::writeInputs(input_stream, input_list);
+        data = input_stream.str();
+    }
 }
 
 uint64_t MovieFileInputs::nbFrames()
@@ -71,12 +71,12 @@ public:
     /* Clear */
     void clear();
 
-    /* Import the inputs into a list, and all the parameters.
-     * Returns 0 if no error, or a negative value if an error occured */
-    void load();
+    /* Import the inputs from the input file of a movie, in text or binary
+     * format. Returns false if the binary inputs are invalid */
+    bool load(const std::string& data, bool binary);
 
-    /* Write the inputs into a file and compress to the whole moviefile */
-    void save();
+    /* Write the inputs into the input file of a movie, in text or binary format */
+    void save(std::string& data, bool binary);
 
     /* Get the number of frames of the current movie */
     uint64_t nbFrames();
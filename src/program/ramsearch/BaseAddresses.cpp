@@ -177,6 +177,14 @@ std::pair<uintptr_t,uintptr_t> BaseAddresses::getExecutableSection()
     return std::make_pair(sectionExecutable.addr, sectionExecutable.endaddr);
 }
 
+const std::map<std::string,std::pair<uintptr_t,uintptr_t>>& BaseAddresses::getAll()
+{
+    if (library_addresses.empty())
+        load();
+
+    return library_addresses;
+}
+
 std::string BaseAddresses::getFileAndOffset(uintptr_t addr, off_t &offset)
 {
     if (library_addresses.empty())
@@ -23,6 +23,7 @@
 #include <stddef.h>
 #include <sys/types.h>
 #include <string>
+#include <map>
 #include <cstdint>
 
 /* Holds the base address for executable and each loaded library */
@@ -46,6 +47,9 @@ namespace BaseAddresses {
     /* Return the memory section of the mapped game executable */    
     std::pair<uintptr_t,uintptr_t> getExecutableSection();
 
+    /* Return the base and end addresses of all stored files */
+    const std::map<std::string,std::pair<uintptr_t,uintptr_t>>& getAll();
+
     /* Get the file and offset from an address */
     std::string getFileAndOffset(uintptr_t addr, off_t &offset);
 
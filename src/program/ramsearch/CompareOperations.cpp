@@ -29,39 +29,39 @@
 static MemValueType compare_value;
 static MemValueType different_value;
 
-typedef bool (*compare_t)(const MemValueType*);
+typedef bool (*compare_t)(const MemValueType*, const MemValueType*);
 static compare_t compare_method;
 
 static int value_type;
 
 #define DEFINE_CHECK_TYPED(T) \
-static bool check_equal_##T(const MemValueType* value) \
+static bool check_equal_##T(const MemValueType* value, const MemValueType* ref) \
 {\
-    return value->v_##T == compare_value.v_##T;\
+    return value->v_##T == ref->v_##T;\
 }\
-static bool check_notequal_##T(const MemValueType* value) \
+static bool check_notequal_##T(const MemValueType* value, const MemValueType* ref) \
 {\
-    return value->v_##T != compare_value.v_##T;\
+    return value->v_##T != ref->v_##T;\
 }\
-static bool check_less_##T(const MemValueType* value) \
+static bool check_less_##T(const MemValueType* value, const MemValueType* ref) \
 {\
-    return value->v_##T < compare_value.v_##T;\
+    return value->v_##T < ref->v_##T;\
 }\
-static bool check_greater_##T(const MemValueType* value) \
+static bool check_greater_##T(const MemValueType* value, const MemValueType* ref) \
 {\
-    return value->v_##T > compare_value.v_##T;\
+    return value->v_##T > ref->v_##T;\
 }\
-static bool check_lessequal_##T(const MemValueType* value) \
+static bool check_lessequal_##T(const MemValueType* value, const MemValueType* ref) \
 {\
-    return value->v_##T <= compare_value.v_##T;\
+    return value->v_##T <= ref->v_##T;\
 }\
-static bool check_greaterequal_##T(const MemValueType* value) \
+static bool check_greaterequal_##T(const MemValueType* value, const MemValueType* ref) \
 {\
-    return value->v_##T>= compare_value.v_##T;\
+    return value->v_##T>= ref->v_##T;\
 }\
-static bool check_different_##T(const MemValueType* value) \
+static bool check_different_##T(const MemValueType* value, const MemValueType* ref) \
 {\
-    return (value->v_##T - compare_value.v_##T) == different_value.v_##T;\
+    return (value->v_##T - ref->v_##T) == different_value.v_##T;\
 }\
 
 DEFINE_CHECK_TYPED(int8_t)
@@ -79,35 +79,198 @@ DEFINE_CHECK_TYPED(double)
 switch(compare_operator) {\
     case CompareOperator::Equal:\
         compare_method = &check_equal_##T;\
+        select_scan_methods<T, CompareOperator::Equal>();\
         break;\
     case CompareOperator::NotEqual:\
         compare_method = &check_notequal_##T;\
+        select_scan_methods<T, CompareOperator::NotEqual>();\
         break;\
     case CompareOperator::Less:\
         compare_method = &check_less_##T;\
+        select_scan_methods<T, CompareOperator::Less>();\
         break;\
     case CompareOperator::Greater:\
         compare_method = &check_greater_##T;\
+        select_scan_methods<T, CompareOperator::Greater>();\
         break;\
     case CompareOperator::LessEqual:\
         compare_method = &check_lessequal_##T;\
+        select_scan_methods<T, CompareOperator::LessEqual>();\
         break;\
     case CompareOperator::GreaterEqual:\
         compare_method = &check_greaterequal_##T;\
+        select_scan_methods<T, CompareOperator::GreaterEqual>();\
         break;\
     case CompareOperator::Different:\
         compare_method = &check_different_##T;\
+        select_scan_methods<T, CompareOperator::Different>();\
         break;\
 }\
 
-static bool check_equal_array(const MemValueType* value)
+static bool check_equal_array(const MemValueType* value, const MemValueType* ref)
 {
-    return 0 == memcmp(value->v_array, compare_value.v_array, compare_value.v_array[RAM_ARRAY_MAX_SIZE]);
+    return 0 == memcmp(value->v_array, ref->v_array, compare_value.v_array[RAM_ARRAY_MAX_SIZE]);
 }
 
-static bool check_equal_string(const MemValueType* value)
+static bool check_equal_string(const MemValueType* value, const MemValueType* ref)
 {
-    return 0 == strncmp(value->v_cstr, compare_value.v_cstr, RAM_ARRAY_MAX_SIZE);
+    return 0 == strncmp(value->v_cstr, ref->v_cstr, RAM_ARRAY_MAX_SIZE);
+}
+
+/* Scanning a block of memory is done by kernels that are instantiated for each
+ * value type and operator, so that the comparison is inlined. Values are
+ * compared by vectors using the GCC vector extensions, which are compiled
+ * for the default instruction set and for AVX2 when available. */
+typedef int (*scan_t)(const uint8_t*, const uint8_t*, int, int, int, uint32_t*);
+static scan_t scan_value_method;
+static scan_t scan_previous_method;
+
+template <typename T, int W>
+struct Vector {
+    typedef T type __attribute__((vector_size(W)));
+};
+
+template <typename T>
+static inline __attribute__((always_inline)) void load(const uint8_t* addr, T& value)
+{
+    memcpy(&value, addr, sizeof(T));
+}
+
+/* Comparison of values or vectors of values. Vectors are not returned by
+ * these helpers, because the calling convention depends on the instruction
+ * set */
+template <CompareOperator Op, typename T, typename R>
+static inline __attribute__((always_inline)) void compare(const T& value, const T& ref, const T& diff, R& result)
+{
+    if constexpr (Op == CompareOperator::Equal)
+        result = value == ref;
+    else if constexpr (Op == CompareOperator::NotEqual)
+        result = value != ref;
+    else if constexpr (Op == CompareOperator::Less)
+        result = value < ref;
+    else if constexpr (Op == CompareOperator::Greater)
+        result = value > ref;
+    else if constexpr (Op == CompareOperator::LessEqual)
+        result = value <= ref;
+    else if constexpr (Op == CompareOperator::GreaterEqual)
+        result = value >= ref;
+    else
+        result = (value - ref) == diff;
+}
+
+template <typename T, CompareOperator Op, CompareType Type, int W>
+static inline __attribute__((always_inline)) int scan_typed(const uint8_t* memory, const uint8_t* old_memory, int size, int alignment, uint32_t* matches)
+{
+    typedef typename Vector<T, W>::type vec;
+    typedef typename Vector<uint64_t, W>::type mask_vec;
+    typedef decltype(vec{} == vec{}) result_vec;
+    constexpr int type_size = sizeof(T);
+    constexpr int lanes = W / type_size;
+
+    T ref, diff;
+    load(reinterpret_cast<const uint8_t*>(&compare_value), ref);
+    load(reinterpret_cast<const uint8_t*>(&different_value), diff);
+
+    int count = 0;
+    int v = 0;
+
+    /* Small integer types are promoted before being substracted, which does
+     * not wrap around like with vectors */
+    if constexpr ((Op != CompareOperator::Different) || (type_size >= static_cast<int>(sizeof(int)))) {
+        vec ref_v = vec{} + ref;
+        vec diff_v = vec{} + diff;
+
+        /* Values starting at each aligned offset of a block of W bytes are
+         * compared in type_size/alignment passes, and matching offsets are
+         * gathered in a bitmask to be written in order */
+        int passes = type_size / alignment;
+        int last_block = size - W - (type_size - alignment);
+        for (; v <= last_block; v += W) {
+            uint64_t block_matches = 0;
+            for (int p = 0; p < passes; p++) {
+                int offset = v + p * alignment;
+                if constexpr (Type == CompareType::Previous)
+                    load(old_memory + offset, ref_v);
+
+                vec values;
+                load(memory + offset, values);
+                result_vec result;
+                compare<Op>(values, ref_v, diff_v, result);
+
+                mask_vec mask = (mask_vec) result;
+                uint64_t any = 0;
+                for (int i = 0; i < W/8; i++)
+                    any |= mask[i];
+                if (!any)
+                    continue;
+
+                for (int l = 0; l < lanes; l++)
+                    if (result[l])
+                        block_matches |= 1ull << (p * alignment + l * type_size);
+            }
+
+            while (block_matches) {
+                matches[count++] = v + __builtin_ctzll(block_matches);
+                block_matches &= block_matches - 1;
+            }
+        }
+    }
+
+    /* Compare the remaining values one by one */
+    for (; v + type_size <= size; v += alignment) {
+        if constexpr (Type == CompareType::Previous)
+            load(old_memory + v, ref);
+        T value;
+        load(memory + v, value);
+        bool result;
+        compare<Op>(value, ref, diff, result);
+        if (result)
+            matches[count++] = v;
+    }
+
+    return count;
+}
+
+template <typename T, CompareOperator Op, CompareType Type>
+static int scan_default(const uint8_t* memory, const uint8_t* old_memory, int size, int, int alignment, uint32_t* matches)
+{
+    return scan_typed<T, Op, Type, 16>(memory, old_memory, size, alignment, matches);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+template <typename T, CompareOperator Op, CompareType Type>
+__attribute__((target("avx2")))
+static int scan_avx2(const uint8_t* memory, const uint8_t* old_memory, int size, int, int alignment, uint32_t* matches)
+{
+    return scan_typed<T, Op, Type, 32>(memory, old_memory, size, alignment, matches);
+}
+#endif
+
+/* Kernel for arrays and strings, using the comparison method */
+template <CompareType Type>
+static int scan_generic(const uint8_t* memory, const uint8_t* old_memory, int size, int value_size, int alignment, uint32_t* matches)
+{
+    int count = 0;
+    for (int v = 0; v + value_size <= size; v += alignment) {
+        if (((Type == CompareType::Previous) && CompareOperations::check_previous(memory + v, old_memory + v)) ||
+            ((Type == CompareType::Value) && CompareOperations::check_value(memory + v)))
+            matches[count++] = v;
+    }
+    return count;
+}
+
+template <typename T, CompareOperator Op>
+static void select_scan_methods()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("avx2")) {
+        scan_value_method = &scan_avx2<T, Op, CompareType::Value>;
+        scan_previous_method = &scan_avx2<T, Op, CompareType::Previous>;
+        return;
+    }
+#endif
+    scan_value_method = &scan_default<T, Op, CompareType::Value>;
+    scan_previous_method = &scan_default<T, Op, CompareType::Previous>;
 }
 
 void CompareOperations::init(int vt, CompareOperator compare_operator, MemValueType compare_v, MemValueType different_v)
@@ -150,9 +313,13 @@ void CompareOperations::init(int vt, CompareOperator compare_operator, MemValueT
             break;
         case RamArray:
             compare_method = check_equal_array;
+            scan_value_method = &scan_generic<CompareType::Value>;
+            scan_previous_method = &scan_generic<CompareType::Previous>;
             break;
         case RamCString:
             compare_method = check_equal_string;
+            scan_value_method = &scan_generic<CompareType::Value>;
+            scan_previous_method = &scan_generic<CompareType::Previous>;
             break;
     }
 }
@@ -164,11 +331,20 @@ void CompareOperations::init(CompareOperator compare_operator, MemValueType comp
 
 bool CompareOperations::check_value(const void* value)
 {
-    return compare_method(static_cast<const MemValueType*>(value));
+    return compare_method(static_cast<const MemValueType*>(value), &compare_value);
 }
 
 bool CompareOperations::check_previous(const void* value, const void* old_value)
 {
-    compare_value = *static_cast<const MemValueType*>(old_value);
-    return compare_method(static_cast<const MemValueType*>(value));
+    return compare_method(static_cast<const MemValueType*>(value), static_cast<const MemValueType*>(old_value));
+}
+
+int CompareOperations::scan_value(const uint8_t* memory, int size, int value_size, int alignment, uint32_t* matches)
+{
+    return scan_value_method(memory, nullptr, size, value_size, alignment, matches);
+}
+
+int CompareOperations::scan_previous(const uint8_t* memory, const uint8_t* old_memory, int size, int value_size, int alignment, uint32_t* matches)
+{
+    return scan_previous_method(memory, old_memory, size, value_size, alignment, matches);
 }
@@ -48,6 +48,17 @@ namespace CompareOperations {
 
     /* Compute the comparaison between the content of value and the old value */
     bool check_previous(const void* value, const void* old_value);
+
+    /* Compare all values of `value_size` bytes that start every `alignment`
+     * bytes inside a block of memory of `size` bytes with the stored constant
+     * value. Offsets of matching values are written in increasing order into
+     * `matches`, which must hold `size/alignment` entries. Returns the number
+     * of matches */
+    int scan_value(const uint8_t* memory, int size, int value_size, int alignment, uint32_t* matches);
+
+    /* Same as above, but compare with the old values stored at the same
+     * offsets inside `old_memory` */
+    int scan_previous(const uint8_t* memory, const uint8_t* old_memory, int size, int value_size, int alignment, uint32_t* matches);
 }
 
 #endif
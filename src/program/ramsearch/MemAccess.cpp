@@ -21,8 +21,12 @@
 
 #include <stdint.h>
 #include <iostream>
+#include <vector>
+#include <numeric>
+#include <algorithm>
 #ifdef __unix__
 #include <sys/uio.h>
+#include <limits.h>
 #elif defined(__APPLE__) && defined(__MACH__)
 #include <mach/vm_map.h>
 #include <mach/mach_traps.h>
@@ -126,3 +130,127 @@ size_t MemAccess::write(void* local_addr, void* remote_addr, size_t size)
     return size;
 #endif
 }
+
+#ifdef __unix__
+typedef ssize_t (*transfer_t)(pid_t, const struct iovec*, unsigned long, const struct iovec*, unsigned long, unsigned long);
+
+static size_t transfer_batch(transfer_t transfer, MemAccess::Request* requests, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
+        requests[i].result = 0;
+
+    if (!game_pid)
+        return 0;
+
+    /* Requests are merged in address order, without moving them */
+    std::vector<size_t> order(count);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [requests](size_t a, size_t b) {
+        return requests[a].remote_addr < requests[b].remote_addr;
+    });
+
+    size_t max_iov = std::min(count, static_cast<size_t>(IOV_MAX));
+    std::vector<struct iovec> local(max_iov);
+    std::vector<struct iovec> remote(max_iov);
+
+    /* Index in `order` of the first request of each remote iovec */
+    std::vector<size_t> first(max_iov + 1);
+
+    size_t o = 0;
+    while (o < count) {
+        /* Each request has its own local iovec, and requests with adjacent
+         * addresses share the same remote iovec */
+        size_t liovcnt = 0;
+        size_t riovcnt = 0;
+        while ((o < count) && (liovcnt < max_iov)) {
+            MemAccess::Request& r = requests[order[o]];
+            if (r.size == 0) {
+                o++;
+                continue;
+            }
+
+            if ((riovcnt > 0) && ((reinterpret_cast<uintptr_t>(remote[riovcnt-1].iov_base) + remote[riovcnt-1].iov_len) == r.remote_addr)) {
+                remote[riovcnt-1].iov_len += r.size;
+            }
+            else {
+                first[riovcnt] = o;
+                remote[riovcnt].iov_base = reinterpret_cast<void*>(r.remote_addr);
+                remote[riovcnt].iov_len = r.size;
+                riovcnt++;
+            }
+
+            local[liovcnt].iov_base = r.local_addr;
+            local[liovcnt].iov_len = r.size;
+            liovcnt++;
+            o++;
+        }
+        first[riovcnt] = o;
+
+        if (riovcnt == 0)
+            break;
+
+        ssize_t ret = transfer(game_pid, local.data(), liovcnt, remote.data(), riovcnt, 0);
+        size_t transferred = (ret < 0) ? 0 : ret;
+
+        /* The transfer stops at the first remote iovec that could not be
+         * fully transferred */
+        size_t v;
+        for (v = 0; v < riovcnt; v++) {
+            if (transferred < remote[v].iov_len)
+                break;
+            transferred -= remote[v].iov_len;
+            for (size_t k = first[v]; k < first[v+1]; k++)
+                requests[order[k]].result = requests[order[k]].size;
+        }
+
+        if (v < riovcnt) {
+            /* Transfer the requests of the failed iovec one by one, to know
+             * which ones succeeded, and continue after them */
+            for (size_t k = first[v]; k < first[v+1]; k++) {
+                MemAccess::Request& r = requests[order[k]];
+                struct iovec l = {r.local_addr, r.size};
+                struct iovec rem = {reinterpret_cast<void*>(r.remote_addr), r.size};
+                ssize_t single = transfer(game_pid, &l, 1, &rem, 1, 0);
+                r.result = (single < 0) ? 0 : single;
+            }
+            o = first[v+1];
+        }
+    }
+
+    size_t done = 0;
+    for (size_t i = 0; i < count; i++)
+        if (requests[i].result == requests[i].size)
+            done++;
+    return done;
+}
+#endif
+
+size_t MemAccess::readv(Request* requests, size_t count)
+{
+#ifdef __unix__
+    return transfer_batch(process_vm_readv, requests, count);
+#else
+    size_t done = 0;
+    for (size_t i = 0; i < count; i++) {
+        requests[i].result = read(requests[i].local_addr, reinterpret_cast<void*>(requests[i].remote_addr), requests[i].size);
+        if (requests[i].result == requests[i].size)
+            done++;
+    }
+    return done;
+#endif
+}
+
+size_t MemAccess::writev(Request* requests, size_t count)
+{
+#ifdef __unix__
+    return transfer_batch(process_vm_writev, requests, count);
+#else
+    size_t done = 0;
+    for (size_t i = 0; i < count; i++) {
+        requests[i].result = write(requests[i].local_addr, reinterpret_cast<void*>(requests[i].remote_addr), requests[i].size);
+        if (requests[i].result == requests[i].size)
+            done++;
+    }
+    return done;
+#endif
+}
@@ -21,10 +21,19 @@
 #define LIBTAS_MEMACCESS_H_INCLUDED
 
 #include <stddef.h>
+#include <stdint.h>
 #include <sys/types.h>
 
 /* Functions to read/write into game memroy */
 namespace MemAccess {
+
+    /* A single access of a batch */
+    struct Request {
+        void* local_addr;
+        uintptr_t remote_addr;
+        size_t size;
+        size_t result; // number of bytes transferred, filled by the call
+    };
     
     void init(pid_t pid, int addr_size);
     void fini();
@@ -38,6 +47,14 @@ namespace MemAccess {
     size_t readAddr(void* local_addr, bool* valid);
 
     size_t write(void* local_addr, void* remote_addr, size_t size);    
+
+    /* Read or write a batch of requests, using as few system calls as
+     * possible. Requests of adjacent addresses are merged, and up to IOV_MAX
+     * requests are sent in each call. The number of bytes transferred for
+     * each request is stored in its `result` field. Returns the number of
+     * requests that were fully transferred */
+    size_t readv(Request* requests, size_t count);
+    size_t writev(Request* requests, size_t count);
 }
 
 #endif
@@ -0,0 +1,223 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MemScanStore.h"
+
+#include "../external/lz4.h"
+
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Maximum size of an encoded address */
+static const int MAX_VARINT_SIZE = 10;
+
+MemScanStore::MemScanStore(const char* name) : file_name(name) {}
+
+MemScanStore::~MemScanStore()
+{
+    clear();
+}
+
+void MemScanStore::reset(const std::filesystem::path& dir, int segment_count, int vs, uint64_t b)
+{
+    clear();
+
+    segments.resize(segment_count);
+    value_size = vs;
+    budget = b;
+    file_path = dir / file_name;
+
+    /* Open the file now, so that threads don't need to synchronize */
+    fd = open(file_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        std::cerr << "Could not open file " << file_path << ", keeping scan results in memory" << std::endl;
+}
+
+void MemScanStore::clear()
+{
+    segments.clear();
+    blocks.clear();
+    used_memory = 0;
+    file_size = 0;
+
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+        std::filesystem::remove(file_path);
+    }
+}
+
+void MemScanStore::store(int segment, Block& block)
+{
+    block.file_offset = -1;
+
+    if ((used_memory + block.size) > budget) {
+        if (fd >= 0) {
+            off_t offset = file_size.fetch_add(block.size);
+            if (pwrite(fd, block.data.data(), block.size, offset) == static_cast<ssize_t>(block.size)) {
+                block.file_offset = offset;
+                block.data = std::vector<uint8_t>();
+            }
+            else {
+                std::cerr << "Could not write scan results to file " << file_path << std::endl;
+            }
+        }
+    }
+
+    if (block.file_offset < 0)
+        used_memory += block.size;
+
+    segments[segment].push_back(std::move(block));
+}
+
+void MemScanStore::append_addresses(int segment, const uintptr_t* addresses, const uint8_t* values, int count)
+{
+    if (count == 0)
+        return;
+
+    Block block;
+    block.address = addresses[0];
+    block.count = count;
+    block.raw_size = count * value_size;
+    block.compressed = false;
+    block.data.resize((count-1) * MAX_VARINT_SIZE + count * value_size);
+
+    /* Addresses are increasing, so each one is stored as a variable-length
+     * difference from the previous one */
+    uint8_t* p = block.data.data();
+    for (int i = 1; i < count; i++) {
+        uint64_t delta = addresses[i] - addresses[i-1];
+        while (delta >= 0x80) {
+            *p++ = static_cast<uint8_t>(delta) | 0x80;
+            delta >>= 7;
+        }
+        *p++ = static_cast<uint8_t>(delta);
+    }
+
+    memcpy(p, values, count * value_size);
+    p += count * value_size;
+
+    block.size = p - block.data.data();
+    block.data.resize(block.size);
+    block.data.shrink_to_fit();
+
+    store(segment, block);
+}
+
+void MemScanStore::append_region(int segment, uintptr_t address, const uint8_t* memory, int count, int extra)
+{
+    Block block;
+    block.address = address;
+    block.count = count;
+    block.raw_size = count + extra;
+
+    block.data.resize(LZ4_compressBound(block.raw_size));
+    int compressed_size = LZ4_compress_default(reinterpret_cast<const char*>(memory), reinterpret_cast<char*>(block.data.data()), block.raw_size, block.data.size());
+
+    /* Keep the raw memory if it does not compress */
+    block.compressed = (compressed_size > 0) && (static_cast<uint32_t>(compressed_size) < block.raw_size);
+    if (block.compressed) {
+        block.size = compressed_size;
+        block.data.resize(block.size);
+        block.data.shrink_to_fit();
+    }
+    else {
+        block.size = block.raw_size;
+        block.data.assign(memory, memory + block.raw_size);
+    }
+
+    store(segment, block);
+}
+
+void MemScanStore::finalize()
+{
+    size_t count = 0;
+    for (const auto& s : segments)
+        count += s.size();
+
+    blocks.reserve(count);
+    for (auto& s : segments)
+        for (auto& b : s)
+            blocks.push_back(std::move(b));
+
+    segments.clear();
+}
+
+const uint8_t* MemScanStore::load(const Block& block, std::vector<uint8_t>& buffer) const
+{
+    if (block.file_offset < 0)
+        return block.data.data();
+
+    buffer.resize(block.size);
+    if (pread(fd, buffer.data(), block.size, block.file_offset) != static_cast<ssize_t>(block.size)) {
+        std::cerr << "Could not read scan results from file " << file_path << std::endl;
+        return nullptr;
+    }
+    return buffer.data();
+}
+
+bool MemScanStore::read_addresses(size_t index, std::vector<uintptr_t>& addresses, std::vector<uint8_t>& values) const
+{
+    const Block& block = blocks[index];
+
+    std::vector<uint8_t> buffer;
+    const uint8_t* p = load(block, buffer);
+    if (!p)
+        return false;
+
+    addresses.resize(block.count);
+    addresses[0] = block.address;
+    for (uint32_t i = 1; i < block.count; i++) {
+        uint64_t delta = 0;
+        int shift = 0;
+        do {
+            delta |= static_cast<uint64_t>(*p & 0x7f) << shift;
+            shift += 7;
+        } while (*p++ & 0x80);
+        addresses[i] = addresses[i-1] + delta;
+    }
+
+    values.assign(p, p + block.raw_size);
+    return true;
+}
+
+bool MemScanStore::read_region(size_t index, std::vector<uint8_t>& memory) const
+{
+    const Block& block = blocks[index];
+
+    std::vector<uint8_t> buffer;
+    const uint8_t* p = load(block, buffer);
+    if (!p)
+        return false;
+
+    memory.resize(block.raw_size);
+    if (!block.compressed) {
+        memcpy(memory.data(), p, block.raw_size);
+        return true;
+    }
+
+    int size = LZ4_decompress_safe(reinterpret_cast<const char*>(p), reinterpret_cast<char*>(memory.data()), block.size, block.raw_size);
+    if (size != static_cast<int>(block.raw_size)) {
+        std::cerr << "Could not decompress scan results at address " << std::hex << block.address << std::dec << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,109 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_MEMSCANSTORE_H_INCLUDED
+#define LIBTAS_MEMSCANSTORE_H_INCLUDED
+
+#include <vector>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <sys/types.h>
+
+/* Store the results of a memory scan, split into blocks.
+ *
+ * Results are either a list of addresses with their values, or a snapshot of
+ * whole memory regions when searching for an unknown value. Each scanner
+ * thread appends blocks to its own segment, and segments are joined in
+ * address order at the end of the scan without copying any data.
+ *
+ * Addresses of a block are delta-encoded, followed by all values packed.
+ * Memory regions are compressed using LZ4. Blocks are kept in memory, until
+ * their total size exceeds a budget, then new blocks are written into a file.
+ */
+class MemScanStore {
+    public:
+
+        struct Block {
+            uintptr_t address; // first address of the block
+            uint32_t count; // number of addresses, or size of the memory region
+            uint32_t raw_size; // size of the decoded data
+            uint32_t size; // size of the encoded data
+            bool compressed; // if the memory region is compressed
+            off_t file_offset; // offset of the data in the file, or -1 if in memory
+            std::vector<uint8_t> data; // encoded data if in memory
+        };
+
+        /* Create a store that uses the file `name` when above budget */
+        explicit MemScanStore(const char* name);
+        ~MemScanStore();
+
+        /* Remove all results and prepare `segment_count` segments for a new
+         * scan. Blocks above `budget` bytes are written into the file inside
+         * directory `dir` */
+        void reset(const std::filesystem::path& dir, int segment_count, int value_size, uint64_t budget);
+
+        /* Remove all results and the file */
+        void clear();
+
+        /* Append sorted addresses and their values at the end of a segment */
+        void append_addresses(int segment, const uintptr_t* addresses, const uint8_t* values, int count);
+
+        /* Append a snapshot of `count` bytes of memory at the end of a segment,
+         * followed by `extra` bytes that overlap with the next region, for
+         * values that are not aligned */
+        void append_region(int segment, uintptr_t address, const uint8_t* memory, int count, int extra);
+
+        /* Join all segments, after all threads have finished */
+        void finalize();
+
+        size_t block_count() const {return blocks.size();}
+        const Block& block(size_t index) const {return blocks[index];}
+
+        /* Decode the addresses and values of a block */
+        bool read_addresses(size_t index, std::vector<uintptr_t>& addresses, std::vector<uint8_t>& values) const;
+
+        /* Decode the memory snapshot of a block, including extra bytes */
+        bool read_region(size_t index, std::vector<uint8_t>& memory) const;
+
+        /* Returns the size of blocks kept in memory (in bytes) */
+        uint64_t memory_size() const {return used_memory;}
+
+    private:
+        /* Keep a block in memory if inside the budget, or write it into the
+         * file, and append it to a segment */
+        void store(int segment, Block& block);
+
+        /* Get the encoded data of a block */
+        const uint8_t* load(const Block& block, std::vector<uint8_t>& buffer) const;
+
+        std::vector<std::vector<Block>> segments;
+        std::vector<Block> blocks;
+
+        int value_size = 0;
+        uint64_t budget = 0;
+        std::atomic<uint64_t> used_memory = 0;
+        std::atomic<uint64_t> file_size = 0;
+
+        const char* file_name;
+        std::filesystem::path file_path;
+        int fd = -1;
+};
+
+#endif
@@ -24,19 +24,29 @@
 #include "MemValue.h"
 
 #include <sstream>
-#include <fstream>
+#include <cstring>
 #include <iostream>
 #include <thread>
 
 std::filesystem::path MemScanner::memscan_path;
-std::filesystem::path MemScanner::addresses_path;
-std::filesystem::path MemScanner::values_path;
 
 void MemScanner::init(std::filesystem::path path)
 {
     memscan_path = path;
-    values_path = memscan_path / "memory.bin";
-    addresses_path = memscan_path / "addresses.bin";
+}
+
+int MemScanner::set_source(const std::filesystem::path& path, const std::filesystem::path& base_path)
+{
+    snapshot.reset();
+    if (path.empty())
+        return MemScannerThread::ENOERROR;
+
+    snapshot = std::make_unique<MemSnapshot>();
+    if (!snapshot->open(path, base_path)) {
+        snapshot.reset();
+        return MemScannerThread::ESNAPSHOT;
+    }
+    return MemScannerThread::ENOERROR;
 }
 
 int MemScanner::first_scan(int mem_flags, int type, int align, CompareType ct, CompareOperator co, MemValueType cv, MemValueType dv, uintptr_t begin_address, uintptr_t end_address)
@@ -66,14 +76,25 @@ int MemScanner::first_scan(int mem_flags, int type, int align, CompareType ct, C
     begin_address &= (~page_mask);
     end_address = (end_address + page_mask) & (~page_mask);
 
-    /* Read the whole memory layout */
-    std::unique_ptr<MemLayout> memlayout (new MemLayout());
+    /* Read the whole memory layout, from the game or from the savestate */
+    std::vector<MemSection> all_sections;
+    if (snapshot) {
+        snapshot->sections(all_sections);
+    }
+    else {
+        std::unique_ptr<MemLayout> memlayout (new MemLayout());
+        MemSection section;
+        while (memlayout->nextSection(MemSection::MemAll, mem_flags, section))
+            all_sections.push_back(section);
+    }
 
     memsections.clear();
     
-    MemSection section;
     total_size = 0;
-    while (memlayout->nextSection(MemSection::MemAll, mem_flags, section)) {
+    for (MemSection& section : all_sections) {
+        if (!(section.type & MemSection::MemAll) || !section.followFlags(mem_flags))
+            continue;
+
         /* Filter for begin/end address here */
         if (section.addr >= end_address)
             continue;
@@ -107,53 +128,66 @@ int MemScanner::scan(bool first, CompareType ct, CompareOperator co, MemValueTyp
     /* Split the work between threads */
     std::vector<MemScannerThread> memscanners;
     std::vector<std::thread> memscan_threads;
-    uint64_t block_size = (total_size / THREAD_COUNT) & 0xfffffffffffff000;
+    int thread_count = THREAD_COUNT;
 
-    size_t beg_region = 0;
-    size_t end_region = 0;
-    uintptr_t beg_address = 0;
-    uintptr_t end_address = 0;
-    size_t cur_region_offset = 0;
+    if (first) {
+        uint64_t block_size = (total_size / THREAD_COUNT) & 0xfffffffffffff000;
 
-    int thread_count = THREAD_COUNT;
-    if (block_size == 0)
-        thread_count = 1;
-    
-    for (int t = 0; t < thread_count-1; t++) {
-        uint64_t cur_block_size = memsections[beg_region].size - cur_region_offset;    
-        while ((cur_block_size < block_size) && (end_region < memsections.size())) {
-            end_region++;
-            cur_block_size += memsections[end_region].size;
-        }
-        
-        cur_region_offset = memsections[end_region].size - (cur_block_size - block_size);
-        end_address = memsections[end_region].addr + cur_region_offset;
-        
-        /* Sanitize beg and end addresses */
-        if (beg_address < memsections[beg_region].addr)
-            beg_address = memsections[beg_region].addr;
-        if (end_address > memsections[end_region].endaddr)
-            end_address = memsections[end_region].endaddr;
-
-        /* Configure the scanner thread */
-        memscanners.emplace_back(*this, beg_region, end_region, beg_address, end_address, t*block_size, block_size);
+        size_t beg_region = 0;
+        size_t end_region = 0;
+        uintptr_t beg_address = 0;
+        uintptr_t end_address = 0;
+        size_t cur_region_offset = 0;
+
+        if (block_size == 0)
+            thread_count = 1;
         
-        /* Set the beg variables for the next thread */
-        if (cur_block_size == block_size) {
-            /* Nothing left in this section, skip to the beginning of the next section */
-            beg_region = end_region + 1;
-            beg_address = memsections[beg_region].addr;
-        }
-        else {
-            beg_region = end_region;
-            beg_address = end_address;
+        for (int t = 0; t < thread_count-1; t++) {
+            uint64_t cur_block_size = memsections[beg_region].size - cur_region_offset;    
+            while ((cur_block_size < block_size) && (end_region < memsections.size())) {
+                end_region++;
+                cur_block_size += memsections[end_region].size;
+            }
+            
+            cur_region_offset = memsections[end_region].size - (cur_block_size - block_size);
+            end_address = memsections[end_region].addr + cur_region_offset;
+            
+            /* Sanitize beg and end addresses */
+            if (beg_address < memsections[beg_region].addr)
+                beg_address = memsections[beg_region].addr;
+            if (end_address > memsections[end_region].endaddr)
+                end_address = memsections[end_region].endaddr;
+
+            /* Configure the scanner thread */
+            memscanners.emplace_back(*this, t, beg_region, end_region, beg_address, end_address);
+            
+            /* Set the beg variables for the next thread */
+            if (cur_block_size == block_size) {
+                /* Nothing left in this section, skip to the beginning of the next section */
+                beg_region = end_region + 1;
+                beg_address = memsections[beg_region].addr;
+            }
+            else {
+                beg_region = end_region;
+                beg_address = end_address;
+            }
         }
+        
+        /* Last scanner thread gets the remaining memory */
+        end_region = memsections.size() - 1;
+        end_address = memsections.back().endaddr;
+        memscanners.emplace_back(*this, thread_count-1, beg_region, end_region, beg_address, end_address);
     }
-    
-    /* Last scanner thread gets the remaining memory */
-    end_region = memsections.size() - 1;
-    end_address = memsections.back().endaddr;
-    memscanners.emplace_back(*this, beg_region, end_region, beg_address, end_address, (thread_count-1)*block_size, total_size-((thread_count-1)*block_size));
+    else {
+        /* Each thread gets a range of blocks of the previous results. Blocks
+         * are in address order, so results of each thread stay in order */
+        size_t block_count = results->block_count();
+        for (int t = 0; t < thread_count; t++)
+            memscanners.emplace_back(*this, t, block_count*t/thread_count, block_count*(t+1)/thread_count);
+    }
+
+    /* Each thread fills its own segment of the new results */
+    new_results->reset(memscan_path, thread_count, value_type_size, MEMORY_BUDGET);
     
     /* Start all threads */
     for (int t = 0; t < thread_count; t++) {
@@ -192,113 +226,49 @@ int MemScanner::scan(bool first, CompareType ct, CompareOperator co, MemValueTyp
 
     /* Wait for the thread to finish, and read error codes. */
     total_size = 0;
-    total_processed_size = 0;
     int error = 0;
     for (int t = 0; t < thread_count; t++) {
         memscan_threads[t].join();
 
-        /* If the scanner thread encounter an error, don't read the file */
         if (memscanners[t].error < 0) {
             error = memscanners[t].error;
             continue;
         }
 
-        /* Compute total size and processed size (for display) */
         total_size += memscanners[t].new_memory_size;
-        total_processed_size += memscanners[t].processed_memory_size;
-    }
-
-    /* If user requested a stop or an error occured, skip the file merging
-     * and report as if we didn't find any result */
-    if (is_stopped && (error < 0)) {
-        addresses.clear();
-        old_values.clear();
-        total_size = 0;
-        return error;
-    }
-
-    /* Wait for each thread to finish and merge all individual files created
-     * by each thread into a single file, and inside vectors to be displayed. */
-    /* TODO: this can take a bit of time, do this in another thread if we don't
-     * need to display values (above threshold).
-     * Prevent a new search until the file merge is completed */
-    std::ofstream ovfs(values_path, std::ofstream::binary);
-    std::ofstream oafs;
-    if (!last_scan_was_region) {
-        oafs.open(addresses_path, std::ofstream::binary);
     }
 
-    /* Reset progress bar to show progression of file merging */
-    emit signalProgress(0);
-    uint64_t cur_size = 0;
-
-    for (int t = 0; t < thread_count; t++) {
-        const MemScannerThread& mst = memscanners[t];
-        
-        /* For some reason, trying to append an empty file messes up the stream */
-        if (memscanners[t].new_memory_size == 0)
-            continue;
-            
-        /* Append memscan_thread file to unique file */
-        if (!last_scan_was_region) {
-            std::ifstream iafs(mst.addresses_path, std::ios_base::binary);
-            oafs << iafs.rdbuf();
-            uint64_t recorded_size = memscanners[t].new_memory_size * sizeof(uintptr_t) / value_type_size;
-            if (iafs.tellg() != (std::streamoff) recorded_size) {
-                std::cerr << "Mismatch size between recorded (" << recorded_size << ") and file (" <<  iafs.tellg() << ") sizes" << std::endl;
-                error = MemScannerThread::EOUTPUT;
-                break;
-            }
-            if (!oafs) {
-                error = MemScannerThread::EOUTPUT;
-                break;
-            }
-        }
-        std::ifstream ivfs(mst.values_path, std::ios_base::binary);
-        ovfs << ivfs.rdbuf();
-        if (ivfs.tellg() != (std::streamoff) memscanners[t].new_memory_size) {
-            std::cerr << "Mismatch size between recorded (" << memscanners[t].new_memory_size << ") and file (" <<  ivfs.tellg() << ") sizes" << std::endl;
-            error = MemScannerThread::EOUTPUT;
-            break;
-        }
-        if (!ovfs) {
-            error = MemScannerThread::EOUTPUT;
-            break;
-        }
-        
-        if (is_stopped) {
-            error = MemScannerThread::ESTOPPED;
-            break;
-        }
+    /* If user requested a stop or an error occured, report as if we didn't
+     * find any result */
+    addresses.clear();
+    old_values.clear();
 
-        /* Some math to reuse progress bar that has the old size for total */
-        cur_size += memscanners[t].new_memory_size;
-        emit signalProgress(cur_size*total_processed_size/total_size);
-    }
-    
     if (error < 0) {
-        addresses.clear();
-        old_values.clear();
+        results->clear();
+        new_results->clear();
         total_size = 0;
         return error;
     }
 
+    /* Segments of each thread are joined in place, and the new results
+     * replace the previous ones */
+    new_results->finalize();
+    std::swap(results, new_results);
+    new_results->clear();
+
     /* If the total size is below threshold, load all data (except if region data) */
     if (last_scan_was_region) return MemScannerThread::ENOERROR;
 
-    addresses.clear();
-    old_values.clear();
-    
     if (total_size < (DISPLAY_THRESHOLD*value_type_size)) {
-        /* Close the streams before reading the files */
-        oafs.close();
-        ovfs.close();
-        
-        std::ifstream iafs(addresses_path, std::ios::in | std::ios::binary);
-        addresses = std::vector<char>(std::istreambuf_iterator<char>(iafs), std::istreambuf_iterator<char>());
-
-        std::ifstream ivfs(values_path, std::ios::in | std::ios::binary);
-        old_values = std::vector<char>(std::istreambuf_iterator<char>(ivfs), std::istreambuf_iterator<char>());
+        std::vector<uintptr_t> block_addresses;
+        std::vector<uint8_t> block_values;
+        for (size_t b = 0; b < results->block_count(); b++) {
+            if (!results->read_addresses(b, block_addresses, block_values))
+                break;
+            const char* a = reinterpret_cast<const char*>(block_addresses.data());
+            addresses.insert(addresses.end(), a, a + block_addresses.size()*sizeof(uintptr_t));
+            old_values.insert(old_values.end(), block_values.begin(), block_values.end());
+        }
     }
     
     return MemScannerThread::ENOERROR;
@@ -354,4 +324,6 @@ void MemScanner::clear()
     addresses.clear();
     old_values.clear();
     memsections.clear();
+    results->clear();
+    new_results->clear();
 }
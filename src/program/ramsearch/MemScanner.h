@@ -22,9 +22,12 @@
 
 #include "CompareOperations.h"
 #include "MemSection.h"
+#include "MemScanStore.h"
+#include "MemSnapshot.h"
 
 #include <QtCore/QObject>
 #include <atomic>
+#include <memory>
 #include <string>
 #include <vector>
 #include <cstdint>
@@ -38,6 +41,11 @@ class MemScanner : public QObject {
         /* Initialize the memory scanner with the memory scan path */
         static void init(std::filesystem::path path);
 
+        /* Select the memory that is scanned by the next scans: the game
+         * memory if `path` is empty, or the memory stored inside the savestate
+         * at `path`. Returns 0 if no error, or error code */
+        int set_source(const std::filesystem::path& path, const std::filesystem::path& base_path);
+
         /* First memory scan. Returns 0 if no error, or error code */
         int first_scan(int mem_flags, int type, int align, CompareType ct, CompareOperator co, MemValueType cv, MemValueType dv, uintptr_t begin_address, uintptr_t end_address);
 
@@ -71,10 +79,14 @@ class MemScanner : public QObject {
         
         const int THREAD_COUNT = 4;
         const uint64_t DISPLAY_THRESHOLD = 10000; // don't display results when above threshold
+        const uint64_t MEMORY_BUDGET = 1024*1024*1024; // results above this size are written in files
         
         static std::filesystem::path memscan_path; // directory containing all scan files
-        static std::filesystem::path addresses_path; // output file containing all scan addresses
-        static std::filesystem::path values_path; // output file containing all scan values
+
+        std::unique_ptr<MemScanStore> results = std::make_unique<MemScanStore>("results-0.bin"); // results of the last scan
+        std::unique_ptr<MemSnapshot> snapshot; // savestate that is scanned instead of the game memory, or nullptr
+
+        std::unique_ptr<MemScanStore> new_results = std::make_unique<MemScanStore>("results-1.bin"); // results of the current scan
         
         int value_type;
         int value_type_size;
@@ -24,48 +24,71 @@
 #include "CompareOperations.h"
 
 #include <cstring>
-#include <fstream>
 #include <iostream>
 #include <vector>
-#include <thread>
-#include <filesystem>
+#include <algorithm>
 #include <unistd.h>
 
 static const size_t MEMORY_CHUNK_SIZE = 1024*1024;
 static const size_t OUTPUT_CHUNK_SIZE = 4096;
-static const size_t MAX_TYPE_SIZE = 8;
-/* Upper bound of possible page size values */
-static const size_t MAX_PAGE_SIZE = 65536;
 
-MemScannerThread::MemScannerThread(MemScanner& ms, int br, int er, uintptr_t ba, uintptr_t ea, off_t mo, uint64_t mem) : memscanner(ms), beg_region(br), end_region(er), beg_address(ba), end_address(ea), memory_offset(mo), memory_size(mem), error(ENOERROR)
+MemScannerThread::MemScannerThread(MemScanner& ms, int i, int br, int er, uintptr_t ba, uintptr_t ea) : memscanner(ms), index(i), beg_region(br), end_region(er), beg_address(ba), end_address(ea), beg_block(0), end_block(0), error(ENOERROR)
 {
     finished = false;
     page_size = sysconf(_SC_PAGESIZE);
+    batch_index = 0;
+    if (ms.snapshot)
+        snapshot_reader = std::make_unique<MemSnapshot::Reader>(*ms.snapshot);
 }
 
-MemScannerThread::~MemScannerThread()
+MemScannerThread::MemScannerThread(MemScanner& ms, int i, size_t bb, size_t eb) : memscanner(ms), index(i), beg_region(0), end_region(-1), beg_address(0), end_address(0), beg_block(bb), end_block(eb), error(ENOERROR)
 {
-    if (!addresses_path.empty())
-        std::filesystem::remove(addresses_path);
-    if (!values_path.empty())
-        std::filesystem::remove(values_path);
+    finished = false;
+    page_size = sysconf(_SC_PAGESIZE);
+    batch_index = 0;
+    if (ms.snapshot)
+        snapshot_reader = std::make_unique<MemSnapshot::Reader>(*ms.snapshot);
+}
+
+size_t MemScannerThread::read_memory(void* local_addr, uintptr_t addr, size_t size)
+{
+    if (snapshot_reader)
+        return snapshot_reader->read(local_addr, addr, size);
+
+    return MemAccess::read(local_addr, reinterpret_cast<void*>(addr), size);
 }
 
-void MemScannerThread::create_output_files()
+void MemScannerThread::push_result(uintptr_t addr, const uint8_t* value)
 {
-    /* Create the files with names from the thread tid */
-    addresses_path = memscanner.memscan_path / ("addresses-" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp");
-    values_path = memscanner.memscan_path / ("memory-" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp");
+    if (batch_addresses.empty()) {
+        batch_addresses.resize(OUTPUT_CHUNK_SIZE);
+        batch_values.resize(OUTPUT_CHUNK_SIZE*memscanner.value_type_size);
+    }
+
+    batch_addresses[batch_index] = addr;
+    memcpy(&batch_values[batch_index*memscanner.value_type_size], value, memscanner.value_type_size);
+    batch_index++;
+    if (batch_index == OUTPUT_CHUNK_SIZE)
+        flush_results();
+}
+
+void MemScannerThread::flush_results()
+{
+    memscanner.new_results->append_addresses(index, batch_addresses.data(), batch_values.data(), batch_index);
+    new_memory_size += batch_index*memscanner.value_type_size;
+    batch_index = 0;
 }
 
 void MemScannerThread::first_region_scan()
 {
-    create_output_files();    
-    std::ofstream vfs(values_path, std::ofstream::binary);
-    
     new_memory_size = 0;
     processed_memory_size = 0;
-    
+
+    /* Values that are not aligned may cross the end of a chunk, so we store
+     * a few bytes of the next chunk with each chunk */
+    int extra = memscanner.value_type_size - memscanner.alignment;
+    std::vector<uint8_t> chunk(MEMORY_CHUNK_SIZE + extra);
+
     /* Start searching from beg_address to end_address, which were split evenly
      * between all threads. Read memory by chunks */
     uintptr_t cur_beg_addr = beg_address;
@@ -89,23 +112,31 @@ void MemScannerThread::first_region_scan()
             cur_end_addr = ms.endaddr;
         }
         
-        /* Write data */
-        uint8_t chunk[MAX_PAGE_SIZE];
-        
-        for (uintptr_t ca = cur_beg_addr; ca < cur_end_addr; ca += page_size) {
-            int readValues = MemAccess::read(chunk, reinterpret_cast<void*>(ca), page_size);
-            if (readValues < 0) {
-                std::cerr << "Cound not read game process at address " << std::hex << ca << std::endl;
-                ms.print();
-            }
-            vfs.write((char*)chunk, page_size);
-            if (!vfs) {
-                finished = true;
-                error = EOUTPUT;
-                return;
+        for (uintptr_t ca = cur_beg_addr; ca < cur_end_addr; ca += MEMORY_CHUNK_SIZE) {
+            size_t chunk_size = MEMORY_CHUNK_SIZE;
+            if ((cur_end_addr - ca) < chunk_size)
+                chunk_size = cur_end_addr - ca;
+            int chunk_extra = (ca + chunk_size + extra) <= ms.endaddr ? extra : 0;
+            size_t read_size = chunk_size + chunk_extra;
+
+            /* If the chunk cannot be read at once, read the rest page by page */
+            size_t chunk_read = read_memory(chunk.data(), ca, read_size);
+            if (chunk_read != read_size) {
+                if (chunk_read > read_size)
+                    chunk_read = 0;
+                for (size_t p = chunk_read & ~(page_size-1); p < read_size; p += page_size) {
+                    size_t page_read_size = std::min(page_size, read_size - p);
+                    if (read_memory(&chunk[p], ca + p, page_read_size) != page_read_size) {
+                        std::cerr << "Cound not read game process at address " << std::hex << (ca + p) << std::dec << std::endl;
+                        ms.print();
+                        memset(&chunk[p], 0, page_read_size);
+                    }
+                }
             }
-            new_memory_size += page_size;
-            processed_memory_size += page_size;
+
+            memscanner.new_results->append_region(index, ca, chunk.data(), chunk_size, chunk_extra);
+            new_memory_size += chunk_size;
+            processed_memory_size += chunk_size;
             
             if (memscanner.is_stopped) {
                 finished = true;
@@ -119,17 +150,14 @@ void MemScannerThread::first_region_scan()
 
 void MemScannerThread::first_address_scan()
 {
-    create_output_files();    
-    std::ofstream afs(addresses_path, std::ofstream::binary);
-    std::ofstream vfs(values_path, std::ofstream::binary);
-    
     new_memory_size = 0;
     processed_memory_size = 0;
 
-    /* Save in files by batches */
-    uintptr_t batch_addresses[OUTPUT_CHUNK_SIZE];
-    uint8_t batch_values[OUTPUT_CHUNK_SIZE*MAX_TYPE_SIZE];
-    int batch_index = 0;
+    /* Extra size for unaligned search */
+    std::vector<uint8_t> chunk(page_size + memscanner.value_type_size);
+
+    /* Offsets of matching values inside a page */
+    std::vector<uint32_t> matches(chunk.size()/memscanner.alignment);
     
     /* Start searching from beg_address to end_address, which were split evenly
      * between all threads. Read memory by chunks */
@@ -154,9 +182,6 @@ void MemScannerThread::first_address_scan()
             cur_end_addr = ms.endaddr;
         }
         
-        /* Write data */
-        uint8_t chunk[MAX_PAGE_SIZE+MAX_TYPE_SIZE]; // extra size for unaligned search
-        
         for (uintptr_t ca = cur_beg_addr; ca < cur_end_addr; ca += page_size) {
             processed_memory_size += page_size;
 
@@ -164,257 +189,103 @@ void MemScannerThread::first_address_scan()
              * search, which does not apply for the end of the region */
             int extra_read = (page_size+ca)<cur_end_addr ? memscanner.value_type_size-memscanner.alignment : 0;
             
-            int readValues = MemAccess::read(chunk, reinterpret_cast<void*>(ca), page_size+extra_read);
+            int readValues = read_memory(chunk.data(), ca, page_size+extra_read);
             if (readValues < 0)
                 continue;
-            for (int v = 0; v < readValues-(memscanner.value_type_size-memscanner.alignment); v += memscanner.alignment) {
-                if (CompareOperations::check_value(chunk+v)) {
-                    batch_addresses[batch_index] = ca + v;
-                    memcpy(batch_values+(batch_index*memscanner.value_type_size), chunk+v, memscanner.value_type_size);
-                    batch_index++;
-                    if (batch_index == OUTPUT_CHUNK_SIZE) {
-                        afs.write((char*)batch_addresses, OUTPUT_CHUNK_SIZE*sizeof(uintptr_t));
-                        vfs.write((char*)batch_values, OUTPUT_CHUNK_SIZE*memscanner.value_type_size);
-                        if (!afs || !vfs) {
-                            error = EOUTPUT;
-                            finished = true;
-                            return;
-                        }
-                        new_memory_size += OUTPUT_CHUNK_SIZE*memscanner.value_type_size;
-                        batch_index = 0;
-                    }
-                }
 
-                if (memscanner.is_stopped) {
-                    error = ESTOPPED;
-                    finished = true;
-                    return;                
-                }
+            int match_count = CompareOperations::scan_value(chunk.data(), readValues, memscanner.value_type_size, memscanner.alignment, matches.data());
+            for (int m = 0; m < match_count; m++)
+                push_result(ca + matches[m], &chunk[matches[m]]);
+
+            if (memscanner.is_stopped) {
+                error = ESTOPPED;
+                finished = true;
+                return;
             }
         }
     }
     
-    /* Flush the remaining values on the batch */
-    afs.write((char*)batch_addresses, batch_index*sizeof(uintptr_t));
-    vfs.write((char*)batch_values, batch_index*memscanner.value_type_size);
-    if (!afs || !vfs) {
-        error = EOUTPUT;
-        finished = true;
-        return;
-    }
-    new_memory_size += batch_index*memscanner.value_type_size;
+    /* Store the remaining results of the batch */
+    flush_results();
     finished = true;
 }
 
 void MemScannerThread::next_scan_from_region()
 {
-    create_output_files();    
-    std::ofstream afs(addresses_path, std::ofstream::binary);
-    std::ofstream vfs(values_path, std::ofstream::binary);
-    
     new_memory_size = 0;
     processed_memory_size = 0;
 
     std::vector<uint8_t> new_memory;
-    new_memory.resize(MEMORY_CHUNK_SIZE+memscanner.value_type_size-memscanner.alignment);
-
-    /* If we compare from previous memory, read and process saved memory by
-     * chunks and by region, because all threads access to the same file. */
-    std::vector<char> old_memory;
-    std::ifstream ivfs;
-    if (memscanner.compare_type == CompareType::Previous) {
-        old_memory.resize(MEMORY_CHUNK_SIZE+memscanner.value_type_size-memscanner.alignment);
-        
-        ivfs.open(memscanner.values_path, std::ofstream::binary);
-        ivfs.seekg(memory_offset);
-    }
-    
-    /* Save in files by batches */
-    uintptr_t batch_addresses[OUTPUT_CHUNK_SIZE];
-    uint8_t batch_values[OUTPUT_CHUNK_SIZE*MAX_TYPE_SIZE];
-    int batch_index = 0;
+    std::vector<uint8_t> old_memory;
+    std::vector<uint32_t> matches;
 
-    uintptr_t cur_beg_addr = beg_address;
-    uintptr_t cur_end_addr;
-    for (int r = beg_region; r <= end_region; r++) {
-        const MemSection& ms = memscanner.memsections[r];
+    /* Each block of previous results is a snapshot of a memory chunk */
+    for (size_t b = beg_block; b < end_block; b++) {
+        const MemScanStore::Block& block = memscanner.results->block(b);
+        processed_memory_size += block.count;
 
-        /* Determine region start and end addresses */
-        if (r > beg_region) cur_beg_addr = ms.addr;
-    
-        if (r == end_region) {
-            if ((end_address <= ms.addr) || (end_address > ms.endaddr)) {
-                error = EPROCESS;
+        if (memscanner.compare_type == CompareType::Previous) {
+            if (!memscanner.results->read_region(b, old_memory)) {
+                error = EINPUT;
                 finished = true;
-                std::cerr << "Wrong end address" << std::endl;
                 return;
             }
-            cur_end_addr = end_address;
         }
-        else {
-            cur_end_addr = ms.endaddr;
+
+        new_memory.resize(block.raw_size);
+        int readValues = read_memory(new_memory.data(), block.address, block.raw_size);
+        if (readValues < 0) {
+            std::cerr << "Cound not read game process at address " << std::hex << block.address << std::dec << std::endl;
+            continue;
+        }
+        if (static_cast<uint32_t>(readValues) < block.raw_size) {
+            std::cerr << "Could only read " << readValues << " bytes from address range " << std::hex << block.address << " - " << std::hex << (block.address+block.raw_size) << std::dec << std::endl;
         }
         
-        /* Read chunks of memory */
-        while (cur_beg_addr < cur_end_addr) {
-            uint64_t chunk_size = MEMORY_CHUNK_SIZE;
-            uint64_t chunk_size_with_extra = chunk_size + memscanner.value_type_size-memscanner.alignment;
-            if ((cur_end_addr - cur_beg_addr) < chunk_size_with_extra) {
-                chunk_size = cur_end_addr - cur_beg_addr;
-                chunk_size_with_extra = chunk_size;
-            }
-            
-            processed_memory_size += chunk_size;
+        matches.resize(block.raw_size/memscanner.alignment);
 
-            if (memscanner.compare_type == CompareType::Previous) {
-                /* We need to seek each time, because we may need to read data
-                 * multiple times due to unaligned search */ 
-                ivfs.seekg(memory_offset);
-                ivfs.read(old_memory.data(), chunk_size_with_extra);
-                memory_offset += chunk_size;
-            }
-            
-            int readValues = MemAccess::read(new_memory.data(), reinterpret_cast<void*>(cur_beg_addr), chunk_size_with_extra);
-            if (readValues < 0) {
-                std::cerr << "Cound not read game process at address " << cur_beg_addr << std::endl;
-                ms.print();
-                cur_beg_addr += chunk_size;
-                continue;
-            }
-            if ((uint64_t)readValues < chunk_size_with_extra) {
-                std::cerr << "Could only read " << readValues << " bytes from address range " << std::hex << cur_beg_addr << " - " << std::hex << (cur_beg_addr+chunk_size_with_extra) << std::endl;
-                ms.print();
-            }
-            
-            for (unsigned int v = 0; v < static_cast<unsigned int>(readValues-(memscanner.value_type_size-memscanner.alignment)); v += memscanner.alignment) {
-                if (((memscanner.compare_type == CompareType::Previous) && 
-                    CompareOperations::check_previous(&new_memory[v], &old_memory[v])) ||
-                    ((memscanner.compare_type == CompareType::Value) && 
-                    CompareOperations::check_value(&new_memory[v]))) {
-                    batch_addresses[batch_index] = cur_beg_addr + v;
-                    memcpy(batch_values+(batch_index*memscanner.value_type_size), &new_memory[v], memscanner.value_type_size);
-                    batch_index++;
-                    if (batch_index == OUTPUT_CHUNK_SIZE) {
-                        afs.write((char*)batch_addresses, OUTPUT_CHUNK_SIZE*sizeof(uintptr_t));
-                        vfs.write((char*)batch_values, OUTPUT_CHUNK_SIZE*memscanner.value_type_size);
-                        if (!afs || !vfs) {
-                            error = EOUTPUT;
-                            finished = true;
-                            return;
-                        }
-                        new_memory_size += OUTPUT_CHUNK_SIZE*memscanner.value_type_size;
-                        batch_index = 0;
-                    }
-                }
-                
-                if (memscanner.is_stopped) {
-                    error = ESTOPPED;
-                    finished = true;
-                    return;                
-                }
-            }
-            
-            cur_beg_addr += chunk_size;
+        int match_count;
+        if (memscanner.compare_type == CompareType::Previous)
+            match_count = CompareOperations::scan_previous(new_memory.data(), old_memory.data(), readValues, memscanner.value_type_size, memscanner.alignment, matches.data());
+        else
+            match_count = CompareOperations::scan_value(new_memory.data(), readValues, memscanner.value_type_size, memscanner.alignment, matches.data());
+
+        for (int m = 0; m < match_count; m++)
+            push_result(block.address + matches[m], &new_memory[matches[m]]);
+
+        if (memscanner.is_stopped) {
+            error = ESTOPPED;
+            finished = true;
+            return;
         }
     }
     
-    /* Flush the remaining values on the batch */
-    afs.write((char*)batch_addresses, batch_index*sizeof(uintptr_t));
-    vfs.write((char*)batch_values, batch_index*memscanner.value_type_size);
-    if (!afs || !vfs) {
-        error = EOUTPUT;
-        finished = true;
-        return;
-    }
-    new_memory_size += batch_index*memscanner.value_type_size;
+    /* Store the remaining results of the batch */
+    flush_results();
     finished = true;
 }
 
 void MemScannerThread::next_scan_from_address()
 {
-    create_output_files();
-    std::ofstream afs(addresses_path, std::ofstream::binary);
-    std::ofstream vfs(values_path, std::ofstream::binary);
-    
     new_memory_size = 0;
     processed_memory_size = 0;
 
-    int size_ratio = sizeof(uintptr_t)/memscanner.value_type_size;
-
     std::vector<uint8_t> new_memory;
-    new_memory.resize(page_size+memscanner.value_type_size-memscanner.alignment);
-
-    /* If we compare from previous memory, read and process saved memory by
-     * chunks and by region, because all threads access to the same file. */
-    uint64_t max_chunk_size = MEMORY_CHUNK_SIZE;
-    if (memory_size < max_chunk_size)
-        max_chunk_size = memory_size;
-
-    std::vector<char> old_memory;
-
-    std::ifstream ivfs;
-    if (memscanner.compare_type == CompareType::Previous) {
-        old_memory.resize(max_chunk_size+memscanner.value_type_size-memscanner.alignment);
-        
-        ivfs.open(memscanner.values_path, std::ifstream::binary);
-    }
+    new_memory.resize(page_size+memscanner.value_type_size);
 
     std::vector<uintptr_t> old_addresses;
-    old_addresses.resize(max_chunk_size/memscanner.value_type_size);
+    std::vector<uint8_t> old_values;
 
-    std::ifstream iafs(memscanner.addresses_path, std::ifstream::binary);
-    if (!iafs)
-        std::cerr << "error: could not open file " << memscanner.addresses_path << std::endl;
-    
-    /* Save in files by batches */
-    uintptr_t batch_addresses[OUTPUT_CHUNK_SIZE];
-    uint8_t batch_values[OUTPUT_CHUNK_SIZE*MAX_TYPE_SIZE];
-    int batch_index = 0;
-
-    /* Read chunks of memory */
-    uint64_t remaining_memory_size = memory_size;
-    while (remaining_memory_size > 0) {
-        uint64_t chunk_size = MEMORY_CHUNK_SIZE;
-        uint64_t chunk_size_with_extra = chunk_size + memscanner.value_type_size-memscanner.alignment;
-        if (remaining_memory_size < chunk_size_with_extra) {
-            chunk_size = remaining_memory_size;
-            chunk_size_with_extra = chunk_size;
-        }
-        
-        if (memscanner.compare_type == CompareType::Previous) {
-            /* We need to seek each time, because we may need to read data
-             * multiple times due to unaligned search */ 
-            ivfs.seekg(memory_offset);
-            if (!ivfs)
-                std::cerr << "error: could not seek to offset " << memory_offset << std::endl;
-            ivfs.read(old_memory.data(), chunk_size_with_extra);
-            if (!ivfs) {
-                std::cerr << "error: only " << ivfs.gcount() << " could be read from " << chunk_size << std::endl;
-                error = EINPUT;
-                finished = true;
-                return;
-            }
-        }
-        iafs.seekg(memory_offset*size_ratio);
-        if (!iafs)
-            std::cerr << "error: could not seek to offset " << memory_offset*size_ratio << std::endl;
-
-        iafs.read((char*)old_addresses.data(), chunk_size_with_extra*size_ratio);
-        if (!iafs) {
-            std::cerr << "error: only " << iafs.gcount() << " could be read from " << chunk_size << std::endl;
+    for (size_t b = beg_block; b < end_block; b++) {
+        if (!memscanner.results->read_addresses(b, old_addresses, old_values)) {
             error = EINPUT;
             finished = true;
             return;
         }
         
-        memory_offset += chunk_size;
-        
         int addr_beg_index = 0;
-        int addr_end_index = chunk_size / memscanner.value_type_size;
+        int addr_end_index = old_addresses.size();
 
-        // std::cout << "Index " << addr_beg_index << " to " << addr_end_index << " for thread " << std::this_thread::get_id() << std::endl;
-        // std::cout << "Chunk " << old_addresses[addr_beg_index] << " to " << old_addresses[addr_end_index-1] << " for thread " << std::this_thread::get_id() << std::endl;
-        
         while (addr_beg_index < addr_end_index) {
             
             /* Look at all old addresses that are inside the same memory page.
@@ -438,12 +309,12 @@ void MemScannerThread::next_scan_from_address()
 
             /* If only one address in page, load that address */
             if ((addr_cur_index-addr_beg_index) == 1) {
-                readValues = MemAccess::read(new_memory.data(), reinterpret_cast<void*>(beg_addr), memscanner.value_type_size);
+                readValues = read_memory(new_memory.data(), beg_addr, memscanner.value_type_size);
             }
             else {
                 /* Load all values from first to last address */
                 uintptr_t last_addr = old_addresses[addr_cur_index-1];
-                readValues = MemAccess::read(new_memory.data(), reinterpret_cast<void*>(beg_addr), (last_addr-beg_addr)+memscanner.value_type_size);
+                readValues = read_memory(new_memory.data(), beg_addr, (last_addr-beg_addr)+memscanner.value_type_size);
             }
             if (readValues < 0) {
                 addr_beg_index = addr_cur_index;
@@ -455,45 +326,24 @@ void MemScannerThread::next_scan_from_address()
                 int mem_index = addr-beg_addr;
                 
                 if (((memscanner.compare_type == CompareType::Previous) && 
-                    CompareOperations::check_previous(&new_memory[mem_index], &old_memory[i*memscanner.value_type_size])) ||
+                    CompareOperations::check_previous(&new_memory[mem_index], &old_values[i*memscanner.value_type_size])) ||
                     ((memscanner.compare_type == CompareType::Value) && 
                     CompareOperations::check_value(&new_memory[mem_index]))) {
-                    batch_addresses[batch_index] = addr;
-                    memcpy(batch_values+(batch_index*memscanner.value_type_size), &new_memory[mem_index], memscanner.value_type_size);
-                    batch_index++;
-                    if (batch_index == OUTPUT_CHUNK_SIZE) {
-                        afs.write((char*)batch_addresses, OUTPUT_CHUNK_SIZE*sizeof(uintptr_t));
-                        vfs.write((char*)batch_values, OUTPUT_CHUNK_SIZE*memscanner.value_type_size);
-                        if (!afs || !vfs) {
-                            error = EOUTPUT;
-                            finished = true;
-                            return;
-                        }
-                        new_memory_size += OUTPUT_CHUNK_SIZE*memscanner.value_type_size;
-                        batch_index = 0;
-                    }
-                }
-                
-                if (memscanner.is_stopped) {
-                    error = ESTOPPED;
-                    finished = true;
-                    return;                
+                    push_result(addr, &new_memory[mem_index]);
                 }
             }
             
+            if (memscanner.is_stopped) {
+                error = ESTOPPED;
+                finished = true;
+                return;                
+            }
+            
             addr_beg_index = addr_cur_index;
         }
-        remaining_memory_size -= chunk_size;
     }
     
-    /* Flush the remaining values on the batch */
-    afs.write((char*)batch_addresses, batch_index*sizeof(uintptr_t));
-    vfs.write((char*)batch_values, batch_index*memscanner.value_type_size);
-    if (!afs || !vfs) {
-        error = EOUTPUT;
-        finished = true;
-        return;
-    }
-    new_memory_size += batch_index*memscanner.value_type_size;
+    /* Store the remaining results of the batch */
+    flush_results();
     finished = true;
 }
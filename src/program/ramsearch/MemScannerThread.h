@@ -21,10 +21,11 @@
 #define LIBTAS_MEMSCANNERTHREAD_H_INCLUDED
 
 #include "MemScanner.h"
+#include "MemSnapshot.h"
 
-#include <string>
+#include <memory>
+#include <vector>
 #include <cstdint>
-#include <filesystem>
 
 /* Store a section of the game memory */
 class MemScannerThread {
@@ -35,15 +36,17 @@ class MemScannerThread {
             ESTOPPED = -1,
             EOUTPUT = -2,
             EINPUT = -3,
-            EPROCESS = -4
+            EPROCESS = -4,
+            ESNAPSHOT = -5
         };
         
-        MemScannerThread(MemScanner& ms, int br, int er, uintptr_t ba, uintptr_t ea, off_t mo, uint64_t mem);
-        ~MemScannerThread();
+        /* Scanner thread of a first scan, between two addresses */
+        MemScannerThread(MemScanner& ms, int i, int br, int er, uintptr_t ba, uintptr_t ea);
+
+        /* Scanner thread of a subsequent scan, on a range of blocks of the
+         * previous results */
+        MemScannerThread(MemScanner& ms, int i, size_t bb, size_t eb);
 
-        /* Create the output files that are named based on the scanning thread id */
-        void create_output_files();
-        
         /* First scan that will store the full memory when user set 'unknown value' */
         void first_region_scan();
 
@@ -58,21 +61,34 @@ class MemScannerThread {
         void next_scan_from_address();
 
         const MemScanner& memscanner; // Reference to the scanner controller
+        int index; // Index of the thread, which is the segment of results it fills
         int beg_region, end_region; // Range of memory regions to search into
         uintptr_t beg_address, end_address; // Range of memory addresses to search into
-        
-        off_t memory_offset; // Offset in the memory file pointed by the starting address
-        uint64_t memory_size; // Size of the memory file portion to process (in bytes)
+        size_t beg_block, end_block; // Range of blocks of previous results to process
         
         uint64_t new_memory_size; // New size after the scan (in bytes)
         volatile uint64_t processed_memory_size; // Current processed size (in bytes), used for progress bar
         
-        std::filesystem::path addresses_path; // Output file of addresses
-        std::filesystem::path values_path; // Output file of values
-
         size_t page_size; // page size of the system
         volatile bool finished; // indicate if scan is finished, used for progress bar
         int error;
+
+    private:
+        /* Read memory from the game or from the scanned savestate */
+        size_t read_memory(void* local_addr, uintptr_t addr, size_t size);
+
+        /* Add a result to the batch, and store the batch when full */
+        void push_result(uintptr_t addr, const uint8_t* value);
+
+        /* Store all results of the batch */
+        void flush_results();
+
+        std::vector<uintptr_t> batch_addresses;
+        std::vector<uint8_t> batch_values;
+        int batch_index;
+
+        /* Reader of the scanned savestate, if any */
+        std::unique_ptr<MemSnapshot::Reader> snapshot_reader;
 };
 
 #endif
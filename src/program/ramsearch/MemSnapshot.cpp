@@ -0,0 +1,457 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MemSnapshot.h"
+
+#include "../library/checkpoint/MemArea.h"
+#include "../library/checkpoint/StateHeader.h"
+#include "../shared/SharedConfig.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+/* Size of each read of the pages file */
+static const size_t READ_CHUNK_SIZE = 4*1024*1024;
+
+/* Size of the LZ4 dictionary */
+static const size_t LZ4_HISTORY_SIZE = 64*1024;
+
+/* Number of pages decoded before moving the LZ4 dictionary */
+static const size_t STREAM_PAGES = 256;
+
+/* Maximum size of a compressed page, same as SaveStateCodec::compressBound() */
+static int compress_bound(int size)
+{
+    return size + (size / 255) + 64;
+}
+
+/* Decompress a zstd page using the system libzstd, which is loaded the first
+ * time. Returns the decompressed size or -1 */
+static int zstd_decompress(const uint8_t* src, uint8_t* dst, int compressed_size, int size)
+{
+    typedef size_t (*decompress_t)(void*, size_t, const void*, size_t);
+    typedef unsigned (*iserror_t)(size_t);
+
+    static decompress_t zstd_decompress_f = nullptr;
+    static iserror_t zstd_iserror_f = nullptr;
+    static bool loaded = [] {
+        void* handle = dlopen("libzstd.so.1", RTLD_LAZY | RTLD_LOCAL);
+        if (!handle) {
+            std::cerr << "Could not load libzstd to read the savestate" << std::endl;
+            return false;
+        }
+        zstd_decompress_f = reinterpret_cast<decompress_t>(dlsym(handle, "ZSTD_decompress"));
+        zstd_iserror_f = reinterpret_cast<iserror_t>(dlsym(handle, "ZSTD_isError"));
+        return (zstd_decompress_f != nullptr) && (zstd_iserror_f != nullptr);
+    }();
+
+    if (!loaded)
+        return -1;
+
+    size_t ret = zstd_decompress_f(dst, size, src, compressed_size);
+    return zstd_iserror_f(ret) ? -1 : static_cast<int>(ret);
+}
+
+bool MemSnapshot::open(const std::filesystem::path& path, const std::filesystem::path& base_path)
+{
+    areas.clear();
+    base.reset();
+    page_size = sysconf(_SC_PAGESIZE);
+
+    std::filesystem::path pagemap_path = path;
+    pagemap_path += ".pm";
+    pages_path = path;
+    pages_path += ".p";
+
+    std::ifstream pmfile(pagemap_path, std::ios::binary);
+    if (!pmfile || !std::filesystem::exists(pages_path)) {
+        std::cerr << "Could not open savestate " << path << ", it may be stored in memory" << std::endl;
+        return false;
+    }
+
+    libtas::StateHeader sh;
+    if (!pmfile.read(reinterpret_cast<char*>(&sh), sizeof(sh))) {
+        std::cerr << "Could not read savestate header of " << pagemap_path << std::endl;
+        return false;
+    }
+    codec = sh.codec;
+    independent_blocks = sh.flags & libtas::StateHeader::SH_INDEPENDENT_BLOCKS;
+
+    if (sh.flags & libtas::StateHeader::SH_PAGE_STORE)
+        std::cerr << "Pages of savestate " << path << " stored inside the page store cannot be scanned" << std::endl;
+
+    bool has_base_pages = false;
+    while (true) {
+        libtas::Area area;
+        if (!pmfile.read(reinterpret_cast<char*>(&area), sizeof(area))) {
+            std::cerr << "Could not read savestate areas of " << pagemap_path << std::endl;
+            return false;
+        }
+
+        if (!area)
+            break;
+
+        /* Savestates of a game with a different architecture have a
+         * different layout */
+        uintptr_t addr = reinterpret_cast<uintptr_t>(area.addr);
+        uintptr_t endaddr = reinterpret_cast<uintptr_t>(area.endAddr);
+        if ((endaddr <= addr) || (area.size != (endaddr - addr)) || (area.page_offset < 0)) {
+            std::cerr << "Savestate " << path << " has an unsupported format" << std::endl;
+            return false;
+        }
+
+        SavedArea sa;
+        sa.addr = addr;
+        sa.endaddr = endaddr;
+        sa.offset = area.offset;
+        sa.prot = area.prot;
+        sa.flags = area.flags;
+        sa.devmajor = area.devmajor;
+        sa.devminor = area.devminor;
+        sa.inode = area.inodenum;
+        sa.uncommitted = area.uncommitted;
+        sa.page_offset = area.page_offset;
+        area.name[libtas::Area::FILENAMESIZE-1] = '\0';
+        sa.filename = area.name;
+
+        if (!area.skip && !area.uncommitted) {
+            sa.page_flags.resize((area.size + page_size - 1) / page_size);
+            if (!pmfile.read(sa.page_flags.data(), sa.page_flags.size())) {
+                std::cerr << "Could not read savestate pages of " << pagemap_path << std::endl;
+                return false;
+            }
+            has_base_pages |= std::find(sa.page_flags.begin(), sa.page_flags.end(), libtas::Area::BASE_PAGE) != sa.page_flags.end();
+        }
+
+        /* Skipped areas and savefiles are not part of the game memory */
+        if (area.skip || (area.flags & libtas::Area::AREA_SAVEFILE))
+            continue;
+
+        areas.push_back(std::move(sa));
+    }
+
+    std::sort(areas.begin(), areas.end(), [](const SavedArea& a, const SavedArea& b) {
+        return a.addr < b.addr;
+    });
+
+    if (has_base_pages) {
+        if (base_path.empty() || (base_path == path)) {
+            std::cerr << "Savestate " << path << " has no base savestate" << std::endl;
+            return false;
+        }
+
+        base = std::make_unique<MemSnapshot>();
+        if (!base->open(base_path, std::filesystem::path())) {
+            base.reset();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void MemSnapshot::sections(std::vector<MemSection>& sections) const
+{
+    /* Build the same lines as /proc/pid/maps, so that sections get the same
+     * type as when reading the game memory layout */
+    MemSection::reset();
+
+    for (const SavedArea& area : areas) {
+        std::ostringstream oss;
+        oss << std::hex << area.addr << '-' << area.endaddr << ' ';
+        oss << ((area.prot & PROT_READ) ? 'r' : '-');
+        oss << ((area.prot & PROT_WRITE) ? 'w' : '-');
+        oss << ((area.prot & PROT_EXEC) ? 'x' : '-');
+        oss << ((area.flags & libtas::Area::AREA_SHARED) ? 's' : 'p');
+        oss << ' ' << area.offset << ' ' << area.devmajor << ':' << area.devminor;
+        oss << ' ' << std::dec << area.inode << ' ' << area.filename;
+
+        std::string line = oss.str();
+        MemSection section;
+        section.readMap(line);
+        sections.push_back(section);
+    }
+}
+
+MemSnapshot::Reader::Reader(const MemSnapshot& s) : snapshot(s)
+{
+    pfd = ::open(snapshot.pages_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (pfd < 0)
+        std::cerr << "Could not open savestate file " << snapshot.pages_path << std::endl;
+    else
+        posix_fadvise(pfd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    if (snapshot.base)
+        base_reader = std::make_unique<Reader>(*snapshot.base);
+
+    buffer.resize(READ_CHUNK_SIZE);
+    buffer_offset = 0;
+    buffer_size = 0;
+
+    area_index = snapshot.areas.size();
+    page_index = 0;
+    page_offset = 0;
+
+    file_fd = -1;
+    file_area_index = snapshot.areas.size();
+
+    last_addr = UINTPTR_MAX;
+    last_page = nullptr;
+    page_data.resize(snapshot.page_size);
+    zero_page.resize(snapshot.page_size);
+
+    stream.resize(LZ4_HISTORY_SIZE + STREAM_PAGES * snapshot.page_size);
+    stream_pos = LZ4_HISTORY_SIZE;
+    LZ4_setStreamDecode(&lz4s, nullptr, 0);
+}
+
+MemSnapshot::Reader::~Reader()
+{
+    if (pfd >= 0)
+        close(pfd);
+    if (file_fd >= 0)
+        close(file_fd);
+}
+
+const uint8_t* MemSnapshot::Reader::fetch(off_t offset, size_t size)
+{
+    if ((offset >= buffer_offset) && ((offset + size) <= (buffer_offset + buffer_size)))
+        return &buffer[offset - buffer_offset];
+
+    ssize_t ret = pread(pfd, buffer.data(), buffer.size(), offset);
+    if (ret < 0) {
+        buffer_size = 0;
+        return nullptr;
+    }
+
+    buffer_offset = offset;
+    buffer_size = ret;
+    if (buffer_size < size)
+        return nullptr;
+
+    return buffer.data();
+}
+
+void MemSnapshot::Reader::start_area(size_t index)
+{
+    area_index = index;
+    page_index = 0;
+    page_offset = snapshot.areas[index].page_offset;
+
+    /* The LZ4 stream is reset for each area */
+    LZ4_setStreamDecode(&lz4s, nullptr, 0);
+}
+
+const uint8_t* MemSnapshot::Reader::next_page(bool decode)
+{
+    const SavedArea& area = snapshot.areas[area_index];
+    size_t page_size = snapshot.page_size;
+    uintptr_t addr = area.addr + page_index * page_size;
+
+    if (area.uncommitted) {
+        page_index++;
+        return zero_page.data();
+    }
+
+    char flag = area.page_flags[page_index++];
+
+    switch (flag) {
+        case libtas::Area::NO_PAGE:
+        case libtas::Area::ZERO_PAGE:
+            return zero_page.data();
+
+        case libtas::Area::FULL_PAGE: {
+            const uint8_t* data = decode ? fetch(page_offset, page_size) : nullptr;
+            page_offset += page_size;
+            if (!decode || !data)
+                return nullptr;
+            memcpy(page_data.data(), data, page_size);
+            return page_data.data();
+        }
+
+        case libtas::Area::COMPRESSED_PAGE: {
+            const uint8_t* length_data = fetch(page_offset, sizeof(int));
+            if (!length_data) {
+                /* Don't read past the end of the file for the next pages */
+                page_index = area.page_flags.size();
+                return nullptr;
+            }
+
+            int compressed_length;
+            memcpy(&compressed_length, length_data, sizeof(int));
+            if ((compressed_length <= 0) || (compressed_length > compress_bound(page_size))) {
+                std::cerr << "Invalid compressed page length " << compressed_length << " at address " << std::hex << addr << std::dec << std::endl;
+                page_index = area.page_flags.size();
+                return nullptr;
+            }
+
+            off_t data_offset = page_offset + sizeof(int);
+            page_offset = data_offset + compressed_length;
+
+            /* Pages of the LZ4 stream must all be decoded */
+            if (!decode && snapshot.independent_blocks)
+                return nullptr;
+
+            const uint8_t* compressed = fetch(data_offset, compressed_length);
+            if (!compressed)
+                return nullptr;
+
+            int ret;
+            if (snapshot.independent_blocks) {
+                if (snapshot.codec == SharedConfig::SC_ZSTD)
+                    ret = zstd_decompress(compressed, page_data.data(), compressed_length, page_size);
+                else
+                    ret = LZ4_decompress_safe(reinterpret_cast<const char*>(compressed), reinterpret_cast<char*>(page_data.data()), compressed_length, page_size);
+            }
+            else {
+                /* Pages are decoded one after the other in a buffer, which
+                 * matches the dictionary used by the LZ4 stream even when
+                 * pages are not contiguous. When the buffer is full, the
+                 * last 64 KB are moved to the beginning */
+                if ((stream_pos + page_size) > stream.size()) {
+                    memmove(stream.data(), &stream[stream_pos - LZ4_HISTORY_SIZE], LZ4_HISTORY_SIZE);
+                    LZ4_setStreamDecode(&lz4s, reinterpret_cast<const char*>(stream.data()), LZ4_HISTORY_SIZE);
+                    stream_pos = LZ4_HISTORY_SIZE;
+                }
+
+                ret = LZ4_decompress_safe_continue(&lz4s, reinterpret_cast<const char*>(compressed), reinterpret_cast<char*>(&stream[stream_pos]), compressed_length, page_size);
+                if (ret == static_cast<int>(page_size))
+                    memcpy(page_data.data(), &stream[stream_pos], page_size);
+                stream_pos += page_size;
+            }
+
+            if (ret != static_cast<int>(page_size)) {
+                std::cerr << "Could not decompress savestate page at address " << std::hex << addr << std::dec << std::endl;
+                return nullptr;
+            }
+            return decode ? page_data.data() : nullptr;
+        }
+
+        case libtas::Area::STORE_PAGE:
+            page_offset += sizeof(uint32_t);
+            return nullptr;
+
+        case libtas::Area::BASE_PAGE: {
+            if (!decode || !base_reader)
+                return nullptr;
+            const uint8_t* data = base_reader->page(addr);
+            if (!data)
+                return nullptr;
+            memcpy(page_data.data(), data, page_size);
+            return page_data.data();
+        }
+
+        case libtas::Area::FILE_PAGE: {
+            if (!decode)
+                return nullptr;
+
+            if (file_area_index != area_index) {
+                if (file_fd >= 0)
+                    close(file_fd);
+                file_fd = ::open(area.filename.c_str(), O_RDONLY | O_CLOEXEC);
+                file_area_index = area_index;
+            }
+            if (file_fd < 0)
+                return nullptr;
+
+            /* Part of the page after the end of the file is zero */
+            ssize_t ret = pread(file_fd, page_data.data(), page_size, (page_index-1) * page_size + area.offset);
+            if (ret < 0)
+                return nullptr;
+            memset(&page_data[ret], 0, page_size - ret);
+            return page_data.data();
+        }
+
+        default:
+            return nullptr;
+    }
+}
+
+const uint8_t* MemSnapshot::Reader::page(uintptr_t addr)
+{
+    size_t page_size = snapshot.page_size;
+    addr &= ~(page_size - 1);
+
+    /* Values may overlap two pages, so the same page is often read twice */
+    if (addr == last_addr)
+        return last_page;
+
+    if (pfd < 0)
+        return nullptr;
+
+    /* Look for the area containing the page, starting from the beginning of
+     * the area if we need to go backwards */
+    bool in_area = (area_index < snapshot.areas.size()) &&
+        (addr >= snapshot.areas[area_index].addr) &&
+        (addr < snapshot.areas[area_index].endaddr);
+
+    if (!in_area || (addr < (snapshot.areas[area_index].addr + page_index * page_size))) {
+        auto it = std::upper_bound(snapshot.areas.begin(), snapshot.areas.end(), addr, [](uintptr_t a, const SavedArea& area) {
+            return a < area.addr;
+        });
+        if ((it == snapshot.areas.begin()) || (addr >= (it-1)->endaddr))
+            return nullptr;
+
+        start_area((it-1) - snapshot.areas.begin());
+    }
+
+    last_addr = addr;
+
+    const SavedArea& area = snapshot.areas[area_index];
+    size_t target = (addr - area.addr) / page_size;
+    size_t page_count = area.uncommitted ? target + 1 : area.page_flags.size();
+
+    while ((page_index < target) && (page_index < page_count))
+        next_page(false);
+
+    if (page_index != target)
+        last_page = nullptr;
+    else
+        last_page = next_page(true);
+    return last_page;
+}
+
+size_t MemSnapshot::Reader::read(void* local_addr, uintptr_t addr, size_t size)
+{
+    size_t page_size = snapshot.page_size;
+    uint8_t* local = static_cast<uint8_t*>(local_addr);
+
+    size_t read_size = 0;
+    while (read_size < size) {
+        const uint8_t* data = page(addr);
+        if (!data)
+            break;
+
+        size_t page_pos = addr & (page_size - 1);
+        size_t copy_size = std::min(page_size - page_pos, size - read_size);
+        memcpy(local + read_size, data + page_pos, copy_size);
+
+        read_size += copy_size;
+        addr += copy_size;
+    }
+
+    return read_size;
+}
@@ -0,0 +1,147 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_MEMSNAPSHOT_H_INCLUDED
+#define LIBTAS_MEMSNAPSHOT_H_INCLUDED
+
+#include "MemSection.h"
+#include "../external/lz4.h"
+
+#include <vector>
+#include <memory>
+#include <string>
+#include <cstdint>
+#include <filesystem>
+#include <sys/types.h>
+
+/* Game memory stored inside a savestate, which can be scanned instead of the
+ * memory of the running game.
+ *
+ * The pagemap file of the savestate is parsed when opening, to get the list
+ * of saved areas and the flag of each page. Pages are then decoded by a
+ * Reader, which reads the pages file by large chunks. Pages compressed with
+ * the LZ4 stream depend on the previous pages of the same area, so memory is
+ * meant to be read with increasing addresses. Each scanner thread uses its
+ * own Reader.
+ *
+ * Pages of incremental savestates that were not modified are read from the
+ * base savestate. Savestates stored in memory and pages stored inside the
+ * page store only exist in the game process, and cannot be read. */
+class MemSnapshot {
+    public:
+
+        /* Open the savestate files at `path` (without extension). Pages
+         * that are identical to the base savestate are read from `base_path`.
+         * Returns false if the savestate could not be read */
+        bool open(const std::filesystem::path& path, const std::filesystem::path& base_path);
+
+        /* Fill the memory sections of all saved areas */
+        void sections(std::vector<MemSection>& sections) const;
+
+        class Reader {
+            public:
+                explicit Reader(const MemSnapshot& snapshot);
+                ~Reader();
+
+                /* Read memory at address `addr`, like MemAccess::read().
+                 * Returns the number of bytes read, which stops at the first
+                 * page that is not stored in the savestate */
+                size_t read(void* local_addr, uintptr_t addr, size_t size);
+
+            private:
+                /* Returns the content of the page at `addr`, or nullptr if
+                 * the page is not stored */
+                const uint8_t* page(uintptr_t addr);
+
+                /* Move to the first page of area `index` */
+                void start_area(size_t index);
+
+                /* Go to the next page of the current area, and returns the
+                 * content of the skipped page if `decode` is set */
+                const uint8_t* next_page(bool decode);
+
+                /* Returns `size` bytes at `offset` of the pages file, reading
+                 * the file by large chunks. Returns nullptr if the file is too
+                 * short */
+                const uint8_t* fetch(off_t offset, size_t size);
+
+                const MemSnapshot& snapshot;
+
+                /* Reader of the base savestate */
+                std::unique_ptr<Reader> base_reader;
+
+                int pfd;
+
+                /* Chunk of the pages file */
+                std::vector<uint8_t> buffer;
+                off_t buffer_offset;
+                size_t buffer_size;
+
+                /* Current area and page, and offset of the page inside the
+                 * pages file */
+                size_t area_index;
+                size_t page_index;
+                off_t page_offset;
+
+                /* File mapped by the current area */
+                int file_fd;
+                size_t file_area_index;
+
+                /* Last decoded page */
+                uintptr_t last_addr;
+                const uint8_t* last_page;
+                std::vector<uint8_t> page_data;
+                std::vector<uint8_t> zero_page;
+
+                /* Decoded pages of the LZ4 stream, which must keep the last
+                 * 64 KB of previous pages */
+                LZ4_streamDecode_t lz4s;
+                std::vector<uint8_t> stream;
+                size_t stream_pos;
+        };
+
+    private:
+        struct SavedArea {
+            uintptr_t addr;
+            uintptr_t endaddr;
+            off_t offset; // offset of the mapped file
+            int prot;
+            int flags;
+            unsigned long devmajor;
+            unsigned long devminor;
+            ino_t inode;
+            bool uncommitted; // no page was committed, area is all zeros
+            off_t page_offset; // offset of the first page in the pages file
+            std::string filename;
+            std::vector<char> page_flags;
+        };
+
+        /* Saved areas sorted by address */
+        std::vector<SavedArea> areas;
+
+        /* Base savestate for incremental savestates */
+        std::unique_ptr<MemSnapshot> base;
+
+        std::filesystem::path pages_path;
+        size_t page_size;
+        int codec;
+        bool independent_blocks;
+};
+
+#endif
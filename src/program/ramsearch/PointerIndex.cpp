@@ -0,0 +1,508 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PointerIndex.h"
+#include "MemAccess.h"
+
+#include <algorithm>
+#include <thread>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Number of pages read in a single call */
+static const size_t CHUNK_PAGES = 256;
+
+/* Number of bits sorted by each pass of the radix sort */
+static const int RADIX_BITS = 8;
+static const size_t RADIX_SIZE = 1 << RADIX_BITS;
+
+/* Below this number of pointers, sorting is done by a single thread */
+static const size_t MIN_PARALLEL_SORT = 1 << 16;
+
+/* Header of saved index files. The header is followed by the table of loaded
+ * files, then by the dynamic and static pointers */
+struct IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t pointer_size;
+    uint64_t target;
+    uint64_t module_count;
+    uint64_t modules_size; // size of the table of files, padded to 8 bytes
+    uint64_t counts[PointerIndex::KIND_COUNT];
+};
+
+static const char INDEX_MAGIC[8] = {'L', 'T', 'A', 'S', 'P', 'I', 'D', 'X'};
+static const uint32_t INDEX_VERSION = 1;
+
+static const int STATIC_TYPES = MemSection::MemDataRW | MemSection::MemBSS | MemSection::MemStack;
+
+typedef PointerIndex::Pointer Pointer;
+typedef std::vector<std::pair<uintptr_t, uintptr_t>> Ranges;
+
+/* Memory read by a single call */
+struct Chunk {
+    uintptr_t addr;
+    size_t page_count;
+    bool is_static;
+};
+
+/* Run `func(t)` for each thread index `t`, the first one on the calling thread */
+template <typename F>
+static void run_threads(int thread_count, F func)
+{
+    std::vector<std::thread> threads;
+    for (int t = 1; t < thread_count; t++)
+        threads.emplace_back(func, t);
+    func(0);
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+/* Store all pointers of chunks [beg, end) into `found`, one vector per kind */
+static void scan_chunks(const std::vector<Chunk>& chunks, size_t beg, size_t end, int addr_size,
+    const Ranges& targets, std::vector<Pointer>* found, std::atomic<uint64_t>& progress)
+{
+    if (targets.empty())
+        return;
+
+    size_t page_size = sysconf(_SC_PAGESIZE);
+    std::vector<uint8_t> memory(CHUNK_PAGES * page_size);
+    std::vector<MemAccess::Request> requests(CHUNK_PAGES);
+
+    uintptr_t min_target = targets.front().first;
+    uintptr_t max_target = targets.back().second;
+
+    for (size_t c = beg; c < end; c++) {
+        const Chunk& chunk = chunks[c];
+
+        /* One request per page, so that pages that cannot be read are skipped */
+        for (size_t p = 0; p < chunk.page_count; p++)
+            requests[p] = {&memory[p * page_size], chunk.addr + p * page_size, page_size, 0};
+
+        MemAccess::readv(requests.data(), chunk.page_count);
+
+        std::vector<Pointer>& out = found[chunk.is_static ? PointerIndex::STATIC : PointerIndex::DYNAMIC];
+
+        for (size_t p = 0; p < chunk.page_count; p++) {
+            const uint8_t* page = &memory[p * page_size];
+            size_t value_count = requests[p].result / addr_size;
+
+            for (size_t i = 0; i < value_count; i++) {
+                uintptr_t value;
+                if (addr_size == 4) {
+                    uint32_t value32;
+                    memcpy(&value32, page + i*addr_size, sizeof(uint32_t));
+                    value = static_cast<uintptr_t>(value32);
+                }
+                else {
+                    uint64_t value64;
+                    memcpy(&value64, page + i*addr_size, sizeof(uint64_t));
+                    value = static_cast<uintptr_t>(value64);
+                }
+
+                /* Most values are not even close to the game memory */
+                if ((value < min_target) || (value >= max_target))
+                    continue;
+
+                /* Get the first target range that ends after the value */
+                auto it = std::upper_bound(targets.begin(), targets.end(), value,
+                    [](uintptr_t v, const std::pair<uintptr_t, uintptr_t>& r) {return v < r.second;});
+
+                if (value >= it->first)
+                    out.push_back({value, requests[p].remote_addr + i*addr_size});
+            }
+        }
+
+        progress += chunk.page_count * page_size;
+    }
+}
+
+/* Stable sort of `count` pointers by value, using `tmp` as a buffer of the
+ * same size. Returns the buffer which contains the sorted pointers. */
+static Pointer* radix_sort(Pointer* data, Pointer* tmp, size_t count, int thread_count)
+{
+    if (count < 2)
+        return data;
+
+    if (count < MIN_PARALLEL_SORT)
+        thread_count = 1;
+
+    /* Skip the digits that are identical for all values, which includes the
+     * upper bits of all pointers */
+    uintptr_t diff = 0;
+    for (size_t i = 0; i < count; i++)
+        diff |= data[i].value ^ data[0].value;
+
+    Pointer* src = data;
+    Pointer* dst = tmp;
+    std::vector<size_t> offsets(thread_count * RADIX_SIZE);
+
+    for (unsigned int shift = 0; shift < 8*sizeof(uintptr_t); shift += RADIX_BITS) {
+        if (((diff >> shift) & (RADIX_SIZE - 1)) == 0)
+            continue;
+
+        /* Each thread counts the digits of its own part */
+        std::fill(offsets.begin(), offsets.end(), 0);
+        run_threads(thread_count, [&](int t) {
+            size_t* counts = &offsets[t * RADIX_SIZE];
+            for (size_t i = count*t/thread_count; i < count*(t+1)/thread_count; i++)
+                counts[(src[i].value >> shift) & (RADIX_SIZE - 1)]++;
+        });
+
+        /* Compute where each thread writes each digit. Parts of threads are
+         * written in order inside each digit, which keeps the sort stable */
+        size_t sum = 0;
+        for (size_t d = 0; d < RADIX_SIZE; d++) {
+            for (int t = 0; t < thread_count; t++) {
+                size_t digit_count = offsets[t * RADIX_SIZE + d];
+                offsets[t * RADIX_SIZE + d] = sum;
+                sum += digit_count;
+            }
+        }
+
+        run_threads(thread_count, [&](int t) {
+            size_t* positions = &offsets[t * RADIX_SIZE];
+            for (size_t i = count*t/thread_count; i < count*(t+1)/thread_count; i++)
+                dst[positions[(src[i].value >> shift) & (RADIX_SIZE - 1)]++] = src[i];
+        });
+
+        std::swap(src, dst);
+    }
+
+    return src;
+}
+
+PointerIndex::~PointerIndex()
+{
+    clear();
+}
+
+void PointerIndex::build(const std::vector<MemSection>& sections, int addr_size, int thread_count,
+    const std::filesystem::path& dir, uint64_t budget, std::atomic<uint64_t>& progress)
+{
+    clear();
+
+    if (thread_count < 1)
+        thread_count = 1;
+
+    size_t page_size = sysconf(_SC_PAGESIZE);
+
+    /* Pointers can only point inside non-static sections */
+    Ranges targets;
+    for (const MemSection& section : sections)
+        if (!(section.type & STATIC_TYPES))
+            targets.emplace_back(section.addr, section.endaddr);
+    std::sort(targets.begin(), targets.end());
+
+    /* Merge adjacent ranges */
+    Ranges merged_targets;
+    for (const auto& target : targets) {
+        if (!merged_targets.empty() && (merged_targets.back().second >= target.first))
+            merged_targets.back().second = std::max(merged_targets.back().second, target.second);
+        else
+            merged_targets.push_back(target);
+    }
+
+    std::vector<Chunk> chunks;
+    for (const MemSection& section : sections) {
+        for (uintptr_t addr = section.addr; addr < section.endaddr; addr += CHUNK_PAGES * page_size) {
+            size_t page_count = std::min(CHUNK_PAGES, (section.endaddr - addr) / page_size);
+            chunks.push_back({addr, page_count, (section.type & STATIC_TYPES) != 0});
+        }
+    }
+
+    /* Each thread reads a contiguous range of chunks, so that pointers
+     * are kept in address order when joining the results of all threads */
+    std::vector<std::vector<Pointer>> found(thread_count * KIND_COUNT);
+    run_threads(thread_count, [&](int t) {
+        scan_chunks(chunks, chunks.size()*t/thread_count, chunks.size()*(t+1)/thread_count,
+            addr_size, merged_targets, &found[t * KIND_COUNT], progress);
+    });
+
+    static const char* file_names[KIND_COUNT] = {"pointers-dynamic.bin", "pointers-static.bin"};
+    static const char* scratch_name = "pointers-scratch.bin";
+
+    for (int k = 0; k < KIND_COUNT; k++) {
+        size_t count = 0;
+        for (int t = 0; t < thread_count; t++)
+            count += found[t * KIND_COUNT + k].size();
+
+        Table& table = tables[k];
+        if (!allocate(table, count, dir.empty() ? dir : (dir / file_names[k]), budget))
+            continue;
+
+        /* Join the results of all threads, and release them as we go */
+        size_t offset = 0;
+        for (int t = 0; t < thread_count; t++) {
+            std::vector<Pointer>& pointers = found[t * KIND_COUNT + k];
+            std::copy(pointers.begin(), pointers.end(), table.data + offset);
+            offset += pointers.size();
+            pointers = std::vector<Pointer>();
+        }
+
+        /* The sort buffer counts in the budget as well, and is inside a file
+         * like the table when over budget */
+        uint64_t table_memory = table.file_path.empty() ? table.mapped_size : 0;
+        uint64_t scratch_budget = (budget > table_memory) ? (budget - table_memory) : 0;
+
+        Table scratch;
+        if (allocate(scratch, count, dir.empty() ? dir : (dir / scratch_name), scratch_budget)) {
+            Pointer* sorted = radix_sort(table.data, scratch.data, count, thread_count);
+            if (sorted != table.data)
+                std::copy(sorted, sorted + count, table.data);
+            release(scratch);
+        }
+        else {
+            /* Same order as the stable radix sort, as pointers were in
+             * address order */
+            std::sort(table.data, table.data + count, [](const Pointer& a, const Pointer& b) {
+                return (a.value < b.value) || ((a.value == b.value) && (a.address < b.address));
+            });
+        }
+    }
+}
+
+void PointerIndex::clear()
+{
+    for (Table& table : tables)
+        release(table);
+}
+
+std::pair<const Pointer*, const Pointer*> PointerIndex::find(Kind kind, uintptr_t min, uintptr_t max) const
+{
+    const Pointer* begin = tables[kind].data;
+    const Pointer* end = begin + tables[kind].count;
+
+    const Pointer* first = std::lower_bound(begin, end, min,
+        [](const Pointer& p, uintptr_t v) {return p.value < v;});
+    const Pointer* last = std::upper_bound(first, end, max,
+        [](uintptr_t v, const Pointer& p) {return v < p.value;});
+
+    return std::make_pair(first, last);
+}
+
+bool PointerIndex::allocate(Table& table, size_t count, const std::filesystem::path& file_path, uint64_t budget)
+{
+    /* Mapping an empty array is not allowed */
+    size_t size = std::max(count * sizeof(Pointer), sizeof(Pointer));
+
+    int fd = -1;
+    if ((size > budget) && !file_path.empty()) {
+        fd = open(file_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd >= 0 && ftruncate(fd, size) < 0) {
+            close(fd);
+            std::filesystem::remove(file_path);
+            fd = -1;
+        }
+        if (fd < 0)
+            std::cerr << "Could not create file " << file_path << ", keeping pointers in memory" << std::endl;
+    }
+
+    void* data;
+    if (fd >= 0) {
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+    }
+    else {
+        data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+
+    if (data == MAP_FAILED) {
+        std::cerr << "Could not allocate " << size << " bytes for the pointer index" << std::endl;
+        if (fd >= 0)
+            std::filesystem::remove(file_path);
+        return false;
+    }
+
+    table.data = static_cast<Pointer*>(data);
+    table.count = count;
+    table.mapping = data;
+    table.mapped_size = size;
+    table.file_path = (fd >= 0) ? file_path : std::filesystem::path();
+    return true;
+}
+
+void PointerIndex::release(Table& table)
+{
+    if (table.mapping)
+        munmap(table.mapping, table.mapped_size);
+
+    if (!table.file_path.empty()) {
+        std::error_code ec;
+        std::filesystem::remove(table.file_path, ec);
+    }
+
+    table = Table();
+}
+
+bool PointerIndex::save(const std::filesystem::path& path, uintptr_t target, const Modules& modules) const
+{
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    if (!ofs)
+        return false;
+
+    /* Each file is stored as its address range, then its name size and name */
+    std::vector<char> module_table;
+    for (const auto& module : modules) {
+        uint64_t range[2] = {module.second.first, module.second.second};
+        uint32_t name_size = module.first.size();
+        module_table.insert(module_table.end(), reinterpret_cast<char*>(range), reinterpret_cast<char*>(range) + sizeof(range));
+        module_table.insert(module_table.end(), reinterpret_cast<char*>(&name_size), reinterpret_cast<char*>(&name_size) + sizeof(name_size));
+        module_table.insert(module_table.end(), module.first.begin(), module.first.end());
+    }
+    module_table.resize((module_table.size() + 7) & ~static_cast<size_t>(7), 0);
+
+    IndexHeader header;
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    header.version = INDEX_VERSION;
+    header.pointer_size = sizeof(uintptr_t);
+    header.target = target;
+    header.module_count = modules.size();
+    header.modules_size = module_table.size();
+    for (int k = 0; k < KIND_COUNT; k++)
+        header.counts[k] = tables[k].count;
+
+    ofs.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    ofs.write(module_table.data(), module_table.size());
+    for (int k = 0; k < KIND_COUNT; k++)
+        ofs.write(reinterpret_cast<const char*>(tables[k].data), tables[k].count * sizeof(Pointer));
+
+    return static_cast<bool>(ofs);
+}
+
+bool PointerIndex::load(const std::filesystem::path& path, uintptr_t& target, Modules& modules)
+{
+    clear();
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if ((fstat(fd, &st) < 0) || (static_cast<size_t>(st.st_size) < sizeof(IndexHeader))) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = st.st_size;
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    IndexHeader header;
+    memcpy(&header, bytes, sizeof(header));
+
+    /* Check that the file was saved with the same pointer size, and that
+     * all tables fit inside the file */
+    bool valid = (memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) == 0) &&
+        (header.version == INDEX_VERSION) &&
+        (header.pointer_size == sizeof(uintptr_t)) &&
+        (header.modules_size <= (size - sizeof(header))) &&
+        ((header.modules_size % 8) == 0);
+
+    size_t offset = sizeof(header) + header.modules_size;
+    for (int k = 0; valid && (k < KIND_COUNT); k++) {
+        if (header.counts[k] > ((size - offset) / sizeof(Pointer)))
+            valid = false;
+        else
+            offset += header.counts[k] * sizeof(Pointer);
+    }
+
+    /* Read the table of files */
+    modules.clear();
+    const uint8_t* module_ptr = bytes + sizeof(header);
+    const uint8_t* module_end = module_ptr + (valid ? header.modules_size : 0);
+    for (uint64_t m = 0; valid && (m < header.module_count); m++) {
+        uint64_t range[2];
+        uint32_t name_size;
+        if ((module_end - module_ptr) < static_cast<ptrdiff_t>(sizeof(range) + sizeof(name_size))) {
+            valid = false;
+            break;
+        }
+        memcpy(range, module_ptr, sizeof(range));
+        memcpy(&name_size, module_ptr + sizeof(range), sizeof(name_size));
+        module_ptr += sizeof(range) + sizeof(name_size);
+        if ((module_end - module_ptr) < static_cast<ptrdiff_t>(name_size)) {
+            valid = false;
+            break;
+        }
+        std::string name(reinterpret_cast<const char*>(module_ptr), name_size);
+        module_ptr += name_size;
+        modules[name] = std::make_pair(static_cast<uintptr_t>(range[0]), static_cast<uintptr_t>(range[1]));
+    }
+
+    if (!valid) {
+        std::cerr << "Pointer index file " << path << " is invalid" << std::endl;
+        munmap(data, size);
+        modules.clear();
+        return false;
+    }
+
+    target = header.target;
+
+    /* Tables point inside the mapping, which is released with the first one */
+    offset = sizeof(header) + header.modules_size;
+    for (int k = 0; k < KIND_COUNT; k++) {
+        tables[k].data = reinterpret_cast<Pointer*>(const_cast<uint8_t*>(bytes) + offset);
+        tables[k].count = header.counts[k];
+        offset += header.counts[k] * sizeof(Pointer);
+    }
+    tables[0].mapping = data;
+    tables[0].mapped_size = size;
+
+    return true;
+}
+
+bool PointerIndex::has_chain(uintptr_t base_address, const std::vector<int>& offsets, uintptr_t target) const
+{
+    if (offsets.empty())
+        return false;
+
+    return match_chain(base_address, offsets, 0, target);
+}
+
+bool PointerIndex::match_chain(uintptr_t base_address, const std::vector<int>& offsets, size_t level, uintptr_t addr) const
+{
+    /* Value of the pointer that leads to `addr` at this level */
+    uintptr_t value = addr - offsets[level];
+
+    /* The last pointer must be the static base address */
+    if (level == (offsets.size() - 1)) {
+        auto range = find(STATIC, value, value);
+        for (const Pointer* p = range.first; p != range.second; p++)
+            if (p->address == base_address)
+                return true;
+        return false;
+    }
+
+    /* Several pointers may hold the same value */
+    auto range = find(DYNAMIC, value, value);
+    for (const Pointer* p = range.first; p != range.second; p++)
+        if (match_chain(base_address, offsets, level+1, p->address))
+            return true;
+
+    return false;
+}
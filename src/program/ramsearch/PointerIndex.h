@@ -0,0 +1,118 @@
+/*
+    Copyright 2015-2026 Clément Gallet <clement.gallet@ens-lyon.org>
+
+    This file is part of libTAS.
+
+    libTAS is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    libTAS is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with libTAS.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBTAS_POINTERINDEX_H_INCLUDED
+#define LIBTAS_POINTERINDEX_H_INCLUDED
+
+#include "MemSection.h"
+
+#include <vector>
+#include <map>
+#include <string>
+#include <atomic>
+#include <utility>
+#include <cstdint>
+#include <filesystem>
+
+/* Index of all values of the game memory that look like pointers, used by
+ * the pointer scan.
+ *
+ * Memory is read by several threads, each one on a contiguous range of
+ * memory. Pointers are then radix-sorted by value into a flat array, so that
+ * all pointers to a range of addresses are found with a binary search. There
+ * is one array for pointers stored in static sections (data, bss and stack),
+ * and one for all other pointers. Arrays are kept in anonymous memory, and
+ * are mapped to a file when their size exceeds a budget.
+ *
+ * The index can be saved into a file, together with the address that was
+ * searched and the address range of each loaded file, so that chains found
+ * in another run of the game can be checked against it. */
+class PointerIndex {
+    public:
+
+        /* A value pointing inside the game memory, and its address */
+        struct Pointer {
+            uintptr_t value;
+            uintptr_t address;
+        };
+
+        enum Kind {
+            DYNAMIC = 0, // pointer stored in heap or anonymous memory
+            STATIC = 1, // pointer stored in data, bss or stack
+            KIND_COUNT = 2,
+        };
+
+        /* Address range of each loaded file, indexed by file name */
+        typedef std::map<std::string, std::pair<uintptr_t, uintptr_t>> Modules;
+
+        ~PointerIndex();
+
+        /* Store all pointers from `sections` of the game memory, with
+         * `addr_size` bytes per pointer and using `thread_count` threads.
+         * Only values pointing to non-static sections are kept. Arrays above
+         * `budget` bytes are mapped to a file in directory `dir`. The size of
+         * memory read so far is stored in `progress` */
+        void build(const std::vector<MemSection>& sections, int addr_size, int thread_count,
+            const std::filesystem::path& dir, uint64_t budget, std::atomic<uint64_t>& progress);
+
+        /* Remove all pointers */
+        void clear();
+
+        /* Returns the number of pointers of `kind` */
+        size_t size(Kind kind) const {return tables[kind].count;}
+
+        /* Returns the range of pointers of `kind` whose value is between
+         * `min` and `max` (included), sorted by value then by address */
+        std::pair<const Pointer*, const Pointer*> find(Kind kind, uintptr_t min, uintptr_t max) const;
+
+        /* Save the index into a file, with the searched address `target`
+         * and the address range of loaded files. Returns false on error */
+        bool save(const std::filesystem::path& path, uintptr_t target, const Modules& modules) const;
+
+        /* Map an index saved in a file, and get the searched address and the
+         * address range of loaded files. Returns false on error */
+        bool load(const std::filesystem::path& path, uintptr_t& target, Modules& modules);
+
+        /* Returns if the pointer chain starting from the static pointer at
+         * `base_address`, with `offsets` stored in reverse order, leads to
+         * `target` */
+        bool has_chain(uintptr_t base_address, const std::vector<int>& offsets, uintptr_t target) const;
+
+    private:
+        struct Table {
+            Pointer* data = nullptr;
+            size_t count = 0;
+            void* mapping = nullptr; // mapping to release, if any
+            size_t mapped_size = 0;
+            std::filesystem::path file_path; // file to remove, if any
+        };
+
+        /* Map an array of `count` pointers, inside a file if above budget */
+        bool allocate(Table& table, size_t count, const std::filesystem::path& file_path, uint64_t budget);
+
+        /* Unmap an array and remove its file */
+        void release(Table& table);
+
+        /* Check the chain from level `level`, where the pointed address is `addr` */
+        bool match_chain(uintptr_t base_address, const std::vector<int>& offsets, size_t level, uintptr_t addr) const;
+
+        Table tables[KIND_COUNT];
+};
+
+#endif
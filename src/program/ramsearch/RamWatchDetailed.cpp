@@ -29,59 +29,129 @@
 #include <fstream>
 #include <iostream>
 #include <cstring>
+#include <algorithm>
 
-MemValueType RamWatchDetailed::get_value(bool& is_valid)
+int RamWatchDetailed::value_size() const
 {
-    MemValueType value;
-    value.v_uint64_t = 0;
+    if (value_type == RamType::RamArray)
+        return array_size;
+    if (value_type == RamType::RamCString)
+        return RAM_ARRAY_MAX_SIZE;
+    return MemValue::type_size(value_type);
+}
 
-    if (!MemAccess::isInited()) {
-        is_valid = false;
-        return value;
-    }
+void RamWatchDetailed::read_values(RamWatchDetailed* const* watches, size_t count)
+{
+    std::vector<MemAccess::Request> requests;
+    std::vector<RamWatchDetailed*> readers;
+    std::vector<uint64_t> pointers;
+    size_t max_depth = 0;
+    int addr_size = MemAccess::getAddrSize();
+
+    for (size_t w = 0; w < count; w++) {
+        RamWatchDetailed* watch = watches[w];
+        watch->last_value.v_uint64_t = 0;
+        watch->last_valid = MemAccess::isInited();
+        watch->has_last_value = true;
+
+        if (!watch->last_valid || !watch->is_pointer)
+            continue;
 
-    is_valid = true;
-    
-    /* Update the actual address to look at (in case of pointer chain) */
-    if (is_pointer) {
         /* Update the base address from the file and file offset */
-        if (!base_address) {
+        if (!watch->base_address) {
 
             /* If file is empty, address is absolute */
-            if (base_file.empty()) {
-                base_address = base_file_offset;
+            if (watch->base_file.empty()) {
+                watch->base_address = watch->base_file_offset;
             }
             else {
-                base_address = BaseAddresses::getAddress(base_file, base_file_offset);
+                watch->base_address = BaseAddresses::getAddress(watch->base_file, watch->base_file_offset);
+            }
+        }
+
+        watch->pointer_addresses.assign(watch->pointer_offsets.size(), 0);
+        watch->address = watch->base_address;
+        max_depth = std::max(max_depth, watch->pointer_offsets.size());
+    }
+
+    /* Update the actual address to look at (in case of pointer chain), by
+     * reading the same level of all chains in one batch */
+    for (size_t depth = 0; depth < max_depth; depth++) {
+        requests.clear();
+        readers.clear();
+        for (size_t w = 0; w < count; w++) {
+            RamWatchDetailed* watch = watches[w];
+            if (watch->last_valid && watch->is_pointer && (depth < watch->pointer_offsets.size())) {
+                readers.push_back(watch);
+                requests.push_back({nullptr, watch->address, static_cast<size_t>(addr_size), 0});
             }
         }
-        
-        pointer_addresses.assign(pointer_offsets.size(), 0);
-
-        address = base_address;
-        int i=0;
-        for (auto offset : pointer_offsets) {
-            uintptr_t next_address = MemAccess::readAddr(reinterpret_cast<void*>(address), &is_valid);
-            if (is_valid)
-                pointer_addresses[i++] = next_address;
-            else
-                return value;
-
-            address = next_address + offset;
+
+        pointers.assign(requests.size(), 0);
+        for (size_t r = 0; r < requests.size(); r++)
+            requests[r].local_addr = &pointers[r];
+
+        MemAccess::readv(requests.data(), requests.size());
+
+        for (size_t r = 0; r < requests.size(); r++) {
+            RamWatchDetailed* watch = readers[r];
+            if (requests[r].result != requests[r].size) {
+                watch->last_valid = false;
+                continue;
+            }
+
+            uintptr_t next_address;
+            if (addr_size == 4) {
+                uint32_t value32;
+                memcpy(&value32, &pointers[r], sizeof(uint32_t));
+                next_address = static_cast<uintptr_t>(value32);
+            }
+            else {
+                next_address = static_cast<uintptr_t>(pointers[r]);
+            }
+
+            watch->pointer_addresses[depth] = next_address;
+            watch->address = next_address + watch->pointer_offsets[depth];
         }
     }
-    
-    if (value_type == RamType::RamArray) {
-        is_valid = (MemAccess::read(value.v_array, reinterpret_cast<void*>(address), array_size) == (size_t)array_size);
-        value.v_array[RAM_ARRAY_MAX_SIZE] = array_size;
+
+    /* Read all values */
+    requests.clear();
+    readers.clear();
+    for (size_t w = 0; w < count; w++) {
+        RamWatchDetailed* watch = watches[w];
+        if (watch->last_valid) {
+            readers.push_back(watch);
+            requests.push_back({&watch->last_value, watch->address, static_cast<size_t>(watch->value_size()), 0});
+        }
     }
-    else if (value_type == RamType::RamCString) {
-        is_valid = (MemAccess::read(value.v_cstr, reinterpret_cast<void*>(address), RAM_ARRAY_MAX_SIZE) > 0); 
-        value.v_cstr[RAM_ARRAY_MAX_SIZE] = 0;
+
+    MemAccess::readv(requests.data(), requests.size());
+
+    for (size_t r = 0; r < requests.size(); r++) {
+        RamWatchDetailed* watch = readers[r];
+        if (watch->value_type == RamType::RamArray) {
+            watch->last_valid = (requests[r].result == requests[r].size);
+            watch->last_value.v_array[RAM_ARRAY_MAX_SIZE] = watch->array_size;
+        }
+        else if (watch->value_type == RamType::RamCString) {
+            watch->last_valid = (requests[r].result > 0);
+            watch->last_value.v_cstr[RAM_ARRAY_MAX_SIZE] = 0;
+        }
+        else {
+            watch->last_valid = (requests[r].result == requests[r].size);
+        }
     }
-    else
-        is_valid = (MemAccess::read(&value, reinterpret_cast<void*>(address), MemValue::type_size(value_type)) == (size_t)MemValue::type_size(value_type));
-    return value;
+}
+
+void RamWatchDetailed::read_values(const std::vector<std::unique_ptr<RamWatchDetailed>>& watches)
+{
+    std::vector<RamWatchDetailed*> list;
+    list.reserve(watches.size());
+    for (const auto& w : watches)
+        list.push_back(w.get());
+
+    read_values(list.data(), list.size());
 }
 
 const char* RamWatchDetailed::value_str()
@@ -90,12 +160,26 @@ const char* RamWatchDetailed::value_str()
         return "";
     }
 
-    bool is_valid = true;
-    MemValueType value = get_value(is_valid);
-    if (!is_valid)
+    RamWatchDetailed* self = this;
+    read_values(&self, 1);
+    return last_value_str();
+}
+
+const char* RamWatchDetailed::last_value_str()
+{
+    if (!MemAccess::isInited()) {
+        return "";
+    }
+
+    if (!has_last_value) {
+        RamWatchDetailed* self = this;
+        read_values(&self, 1);
+    }
+
+    if (!last_valid)
         return "??????";
 
-    return MemValue::to_string(&value, value_type, hex);
+    return MemValue::to_string(&last_value, value_type, hex);
 }
 
 int RamWatchDetailed::poke_value(const char* str_value)
@@ -119,9 +203,27 @@ int RamWatchDetailed::poke_value(MemValueType value)
         return MemAccess::write(&value, reinterpret_cast<void*>(address), MemValue::type_size(value_type));
 }
 
-void RamWatchDetailed::keep_frozen()
+void RamWatchDetailed::keep_frozen(const std::vector<std::unique_ptr<RamWatchDetailed>>& watches)
 {
-    if (is_frozen) {
-        poke_value(frozen_value);
+    if (!MemAccess::isInited()) {
+        return;
+    }
+
+    std::vector<MemAccess::Request> requests;
+    for (const auto& w : watches) {
+        if (!w->is_frozen)
+            continue;
+
+        size_t size;
+        if (w->value_type == RamType::RamArray)
+            size = w->frozen_value.v_array[RAM_ARRAY_MAX_SIZE];
+        else if (w->value_type == RamType::RamCString)
+            size = strlen(w->frozen_value.v_cstr)+1;
+        else
+            size = MemValue::type_size(w->value_type);
+
+        requests.push_back({&w->frozen_value, w->address, size, 0});
     }
+
+    MemAccess::writev(requests.data(), requests.size());
 }
@@ -22,6 +22,7 @@
 
 #include <string>
 #include <vector>
+#include <memory>
 #include <cstdint>
 
 #include "MemValue.h"
@@ -33,13 +34,22 @@ public:
     /* Return the current value of the ram watch as a string */
     const char* value_str();
 
+    /* Return the value of the ram watch from the last call to read_values(),
+     * or the current value if it was never read */
+    const char* last_value_str();
+
+    /* Read the current value of all ram watches, using as few system calls
+     * as possible. Pointer chains are followed one level at a time for all
+     * watches at once */
+    static void read_values(const std::vector<std::unique_ptr<RamWatchDetailed>>& watches);
+
+    /* Poke the value of all frozen ram watches at once */
+    static void keep_frozen(const std::vector<std::unique_ptr<RamWatchDetailed>>& watches);
+
     /* Poke a value (given as a string) into the ram watch address. Return
      * the result of process_vm_writev call */
     int poke_value(const char* str_value);
 
-    /* If value is frozen, poke the value into ram watch */
-    void keep_frozen();
-
     int value_type;
     uintptr_t address;
     std::string label;
@@ -58,8 +68,16 @@ public:
     MemValueType frozen_value;
 
 private:
-    /* Return the current value of the ram watch as a MemValueType */
-    MemValueType get_value(bool& is_valid);
+    /* Read the current value of ram watches into `last_value` */
+    static void read_values(RamWatchDetailed* const* watches, size_t count);
+
+    /* Returns the size of the value to read */
+    int value_size() const;
+
+    /* Value read by the last call to read_values() */
+    MemValueType last_value;
+    bool last_valid;
+    bool has_last_value = false;
 
     /* Poke a value (given as a MemValueType) into the ram watch address. Return
      * the result of process_vm_writev call */
@@ -94,6 +94,10 @@ EncodeWindow::EncodeWindow(Context* c, QWidget *parent) : QDialog(parent), conte
 
     ffmpegOptions = new QLineEdit();
 
+    encodeBackend = new QComboBox();
+    encodeBackend->addItem("ffmpeg process", SharedConfig::ENCODE_BACKEND_FFMPEG);
+    encodeBackend->addItem("Inside the game (libavcodec)", SharedConfig::ENCODE_BACKEND_LIBAV);
+
     QGroupBox *codecGroupBox = new QGroupBox(tr("Encode codec settings"));
     QGridLayout *encodeCodecLayout = new QGridLayout;
     encodeCodecLayout->addWidget(new QLabel(tr("Video codec:")), 0, 0);
@@ -109,6 +113,9 @@ EncodeWindow::EncodeWindow(Context* c, QWidget *parent) : QDialog(parent), conte
     encodeCodecLayout->addWidget(new QLabel(tr("ffmpeg options:")), 2, 0);
     encodeCodecLayout->addWidget(ffmpegOptions, 2, 1, 1, 4);
 
+    encodeCodecLayout->addWidget(new QLabel(tr("Encoder:")), 3, 0);
+    encodeCodecLayout->addWidget(encodeBackend, 3, 1);
+
     encodeCodecLayout->setColumnMinimumWidth(2, 50);
     encodeCodecLayout->setColumnStretch(2, 1);
     codecGroupBox->setLayout(encodeCodecLayout);
@@ -163,6 +170,22 @@ EncodeWindow::EncodeWindow(Context* c, QWidget *parent) : QDialog(parent), conte
     connect(saveDefaultButton, &QAbstractButton::clicked, this, &EncodeWindow::slotDefault);
     connect(buttonBox, &QDialogButtonBox::rejected, this, &EncodeWindow::reject);
 
+    queueSize = new QSpinBox();
+    queueSize->setMaximum(64);
+    queueSize->setSpecialValueText(tr("Disabled"));
+
+    queuePolicy = new QComboBox();
+    queuePolicy->addItem("Wait for the encoder", SharedConfig::ENCODE_QUEUE_WAIT);
+    queuePolicy->addItem("Repeat the previous frame", SharedConfig::ENCODE_QUEUE_DROP);
+
+    QGroupBox *queueGroupBox = new QGroupBox(tr("Encode queue - frames are scaled and encoded by a separate thread"));
+    QGridLayout *queueLayout = new QGridLayout;
+    queueLayout->addWidget(new QLabel(tr("Queued frames:")), 0, 0);
+    queueLayout->addWidget(queueSize, 0, 1);
+    queueLayout->addWidget(new QLabel(tr("When full:")), 0, 2);
+    queueLayout->addWidget(queuePolicy, 0, 3);
+    queueGroupBox->setLayout(queueLayout);
+
     /* Create the main layout */
     QVBoxLayout *mainLayout = new QVBoxLayout;
 
@@ -170,6 +193,7 @@ EncodeWindow::EncodeWindow(Context* c, QWidget *parent) : QDialog(parent), conte
     mainLayout->addWidget(codecGroupBox);
     mainLayout->addWidget(framerateGroupBox);
     mainLayout->addWidget(resizeGroupBox);
+    mainLayout->addWidget(queueGroupBox);
     mainLayout->addStretch(1);
     mainLayout->addWidget(buttonBox);
 
@@ -222,6 +246,12 @@ void EncodeWindow::update_config()
         videoFilter->setCurrentIndex(0);
     }
 
+    /* Set encode queue */
+    queueSize->setValue(context->config.sc.video_queue_size);
+    queuePolicy->setCurrentIndex(queuePolicy->findData(context->config.sc.video_queue_policy));
+
+    encodeBackend->setCurrentIndex(encodeBackend->findData(context->config.sc.encode_backend));
+
     if (context->config.ffmpegoptions.empty()) {
         slotUpdate();
     }
@@ -310,6 +340,10 @@ void EncodeWindow::slotOk()
         context->config.sc.video_filter = 0;
     }
 
+    context->config.sc.video_queue_size = queueSize->value();
+    context->config.sc.video_queue_policy = queuePolicy->currentData().toInt();
+    context->config.sc.encode_backend = encodeBackend->currentData().toInt();
+
     context->config.sc_modified = true;
 
     /* Close window */
@@ -54,6 +54,9 @@ private:
     QSpinBox *videoWidth;
     QSpinBox *videoHeight;
     QComboBox *videoFilter;
+    QSpinBox *queueSize;
+    QComboBox *queuePolicy;
+    QComboBox *encodeBackend;
     QGroupBox *framerateGroupBox;
     QGroupBox *resizeGroupBox;
 
@@ -23,16 +23,22 @@
 #include "Context.h"
 #include "ramsearch/MemAccess.h"
 #include "ramsearch/MemLayout.h"
+#include "ramsearch/MemScanner.h"
 #include "ramsearch/BaseAddresses.h"
 
 #include <sstream>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
 #include <unistd.h>
 
-/* Upper bound of possible page size values */
-static const size_t MAX_PAGE_SIZE = 65536;
+/* Pointers above this size are mapped to files */
+static const uint64_t MEMORY_BUDGET = 1024*1024*1024;
 
 PointerScanModel::PointerScanModel(Context* c, QObject *parent) : QAbstractTableModel(parent), context(c)
 {
@@ -41,8 +47,7 @@ PointerScanModel::PointerScanModel(Context* c, QObject *parent) : QAbstractTable
 
 void PointerScanModel::locatePointers()
 {
-    pointer_map.clear();
-    static_pointer_map.clear();
+    pointer_index.clear();
 
     std::unique_ptr<MemLayout> memlayout (new MemLayout(context->game_pid));
     
@@ -64,75 +69,13 @@ void PointerScanModel::locatePointers()
     }
 
     /* Read all memory and store all pointers */
-    int cur_size = 0;
-    int game_addr_size = MemAccess::getAddrSize();
-    for (const MemSection &section : memory_sections) {
-
-        for (uintptr_t addr = section.addr; addr < section.endaddr; addr += page_size) {
-
-            /* Read values in chunks of page_size bytes so we lower the number of calls. */
-            
-            /* The following code is a bit awkward to support both 32-bit and
-             * 64-bit pointers while conforming aliasing rules. A better coder
-             * than me may write more elegant code */
-            uint64_t chunk64[MAX_PAGE_SIZE/sizeof(uint64_t)];
-            uint32_t chunk32[MAX_PAGE_SIZE/sizeof(uint32_t)];
-            int readValues;
-
-            if (game_addr_size == 4) {
-                readValues = MemAccess::read(chunk32, reinterpret_cast<void*>(addr), page_size);
-            }
-            else {
-                readValues = MemAccess::read(chunk64, reinterpret_cast<void*>(addr), page_size);
-            }
-            
-            if (readValues < 0) {
-                continue;
-            }
-
-            /* Update progress bar */
-            emit signalProgress((int)(100 * ((float)cur_size / total_size)));
-
-            unsigned int chunk_data_size = readValues/game_addr_size;
-
-            for (unsigned int i = 0; i < chunk_data_size; i++, cur_size += game_addr_size) {
-                /* Check if the value could be a pointer */
-                bool is_pointer = false;
-                
-                uintptr_t value;
-                if (game_addr_size == 4)
-                    value = static_cast<uintptr_t>(chunk32[i]);
-                else
-                    value = static_cast<uintptr_t>(chunk64[i]);
-
-                for (const MemSection &ms : memory_sections) {
-                    /* If pointing to a static section, we can skip it */
-                    if (ms.type & (MemSection::MemDataRW | MemSection::MemBSS | MemSection::MemStack)) {
-                        continue;
-                    }
-
-                    /* We take advantage of the fact that sections are ordered */
-                    if (value < ms.addr) {
-                        break;
-                    }
-                    if (value < ms.endaddr) {
-                        is_pointer = true;
-                        break;
-                    }
-                }
-
-                if (is_pointer) {
-                    uintptr_t stored_addr = addr + i*game_addr_size;
-                    if (section.type & (MemSection::MemDataRW | MemSection::MemBSS | MemSection::MemStack)) {
-                        static_pointer_map.insert(std::make_pair(value, stored_addr));
-                    }
-                    else {
-                        pointer_map.insert(std::make_pair(value, stored_addr));
-                    }
-                }
-            }
-        }
-    }
+    std::atomic<uint64_t> processed_size = 0;
+    runWithProgress([&]() {
+        pointer_index.build(memory_sections, MemAccess::getAddrSize(), threadCount(),
+            MemScanner::memscan_path, MEMORY_BUDGET, processed_size);
+    }, [&]() {
+        return (int)(100 * ((float)processed_size / total_size));
+    });
 }
 
 void PointerScanModel::findPointerChain(uintptr_t addr, int ml, int max_offset)
@@ -147,12 +90,52 @@ void PointerScanModel::findPointerChain(uintptr_t addr, int ml, int max_offset)
     beginResetModel();
 
     max_level = ml;
+    target_address = addr;
     pointer_chains.clear();
-    int offsets[10];
 
-    // std::cout << "max offset " << max_offset << std::endl;
+    uintptr_t min_addr = (addr > static_cast<uintptr_t>(max_offset)) ? (addr - max_offset) : 0;
+
+    /* Search inside static data */
+    auto static_range = pointer_index.find(PointerIndex::STATIC, min_addr, addr);
+    for (const PointerIndex::Pointer* p = static_range.first; p != static_range.second; p++) {
+        pointer_chains.emplace_back(p->address, std::vector<int>(1, addr - p->value));
+    }
 
-    recursiveFind(addr, 0, offsets, max_offset);
+    if (max_level > 1) {
+        /* Each pointer to the address starts a separate search. The size of
+         * searches is very uneven, so threads take the next pointer from a
+         * shared counter when done */
+        auto range = pointer_index.find(PointerIndex::DYNAMIC, min_addr, addr);
+        size_t candidate_count = range.second - range.first;
+        std::atomic<size_t> next_candidate = 0;
+        std::atomic<size_t> finished_count = 0;
+
+        int thread_count = static_cast<int>(std::min(static_cast<size_t>(threadCount()), candidate_count));
+        std::vector<std::vector<std::pair<uintptr_t, std::vector<int>>>> thread_chains(thread_count);
+
+        runWithProgress([&]() {
+            std::vector<std::thread> threads;
+            for (int t = 0; t < thread_count; t++) {
+                threads.emplace_back([&, t]() {
+                    int offsets[10];
+                    size_t c;
+                    while ((c = next_candidate++) < candidate_count) {
+                        offsets[0] = addr - range.first[c].value;
+                        recursiveFind(range.first[c].address, 1, offsets, max_offset, thread_chains[t]);
+                        finished_count++;
+                    }
+                });
+            }
+            for (std::thread& thread : threads)
+                thread.join();
+        }, [&]() {
+            return (candidate_count == 0) ? 100 : (int)(100 * ((float)finished_count / candidate_count));
+        });
+
+        for (auto& chains : thread_chains) {
+            std::move(chains.begin(), chains.end(), std::back_inserter(pointer_chains));
+        }
+    }
 
     /* Sort pointers so that we can intersect with saved pointers */
     std::sort(pointer_chains.begin(), pointer_chains.end());
@@ -160,17 +143,18 @@ void PointerScanModel::findPointerChain(uintptr_t addr, int ml, int max_offset)
     endResetModel();
 }
 
-void PointerScanModel::recursiveFind(uintptr_t addr, int level, int offsets[], int max_offset)
+void PointerScanModel::recursiveFind(uintptr_t addr, int level, int offsets[], int max_offset,
+    std::vector<std::pair<uintptr_t, std::vector<int>>>& chains) const
 {
+    uintptr_t min_addr = (addr > static_cast<uintptr_t>(max_offset)) ? (addr - max_offset) : 0;
+
     /* Search inside static data */
-    auto iter = static_pointer_map.lower_bound(addr - max_offset);
-    while ((iter != static_pointer_map.end()) && (iter->first <= addr)) {
-        offsets[level] = addr - iter->first;
-        uintptr_t base_address = iter->second;
-        // std::cout << "Found static chain with last offset " << std::dec << offsets[level] << " and base address " << std::hex << base_address << std::endl;
+    auto range = pointer_index.find(PointerIndex::STATIC, min_addr, addr);
+    for (const PointerIndex::Pointer* p = range.first; p != range.second; p++) {
+        offsets[level] = addr - p->value;
+        // std::cout << "Found static chain with last offset " << std::dec << offsets[level] << " and base address " << std::hex << p->address << std::endl;
         std::vector<int> offset_vec(offsets, offsets + level + 1);
-        pointer_chains.emplace_back(base_address, std::move(offset_vec));
-        iter++;
+        chains.emplace_back(p->address, std::move(offset_vec));
     }
 
     /* Stop if we reached the last level */
@@ -178,16 +162,36 @@ void PointerScanModel::recursiveFind(uintptr_t addr, int level, int offsets[], i
         return;
 
     /* Search inside dynamic data */
-    iter = pointer_map.lower_bound(addr - max_offset);
-    while ((iter != pointer_map.end()) && (iter->first <= addr)) {
-        offsets[level] = addr - iter->first;
-        uintptr_t base_address = iter->second;
-        // std::cout << "Found chain with offset " << std::dec << offsets[level] << " and base address " << std::hex << base_address << std::endl;
-        recursiveFind(base_address, level+1, offsets, max_offset);
-        iter++;
+    range = pointer_index.find(PointerIndex::DYNAMIC, min_addr, addr);
+    for (const PointerIndex::Pointer* p = range.first; p != range.second; p++) {
+        offsets[level] = addr - p->value;
+        recursiveFind(p->address, level+1, offsets, max_offset, chains);
     }
 }
 
+int PointerScanModel::threadCount()
+{
+    int count = std::thread::hardware_concurrency();
+    return (count > 0) ? count : 1;
+}
+
+void PointerScanModel::runWithProgress(const std::function<void()>& work, const std::function<int()>& progress)
+{
+    std::atomic_bool finished = false;
+    std::thread thread([&]() {
+        work();
+        finished = true;
+    });
+
+    /* We check periodically if the work has finished, to update the
+     * progress bar in the meantime */
+    while (!finished) {
+        emit signalProgress(progress());
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    thread.join();
+}
+
 int PointerScanModel::saveChains(const std::string& file)
 {    
     std::ofstream ofs(file, std::ios::binary | std::ios::trunc);
@@ -252,6 +256,46 @@ int PointerScanModel::loadChains(const std::string& file)
     return 0;
 }
 
+int PointerScanModel::savePointerIndex(const std::string& file)
+{
+    if (!pointer_index.save(file, target_address, BaseAddresses::getAll()))
+        return -1;
+
+    return 0;
+}
+
+int PointerScanModel::intersectPointerIndex(const std::string& file)
+{
+    PointerIndex saved_index;
+    uintptr_t saved_target;
+    PointerIndex::Modules saved_modules;
+
+    if (!saved_index.load(file, saved_target, saved_modules))
+        return -1;
+
+    beginResetModel();
+
+    /* Check each chain inside the saved index, using the base address of
+     * the same file in the saved run. Chains stay sorted */
+    auto removed = std::remove_if(pointer_chains.begin(), pointer_chains.end(),
+        [&](const std::pair<uintptr_t, std::vector<int>>& chain) {
+        off_t offset;
+        std::string base_file = BaseAddresses::getFileAndOffset(chain.first, offset);
+        auto module = saved_modules.find(base_file);
+        if (module == saved_modules.end())
+            return true;
+
+        /* Stack offsets are relative to the end address */
+        uintptr_t base_address = (offset < 0) ? (module->second.second + offset) : (module->second.first + offset);
+        return !saved_index.has_chain(base_address, chain.second, saved_target);
+    });
+    pointer_chains.erase(removed, pointer_chains.end());
+
+    endResetModel();
+
+    return 0;
+}
+
 int PointerScanModel::rowCount(const QModelIndex & /*parent*/) const
 {
     return pointer_chains.size();
@@ -21,12 +21,13 @@
 #define LIBTAS_POINTERSCANMODEL_H_INCLUDED
 
 #include "ramsearch/MemSection.h"
+#include "ramsearch/PointerIndex.h"
 
 #include <QtCore/QAbstractTableModel>
 #include <vector>
-#include <map>
 #include <memory>
 #include <string>
+#include <functional>
 #include <sys/types.h>
 #include <stdint.h>
 
@@ -39,11 +40,8 @@ class PointerScanModel : public QAbstractTableModel {
 public:
     PointerScanModel(Context* c, QObject *parent = Q_NULLPTR);
 
-    /* Map of pointers (key) and addresses (value) */
-    std::multimap<uintptr_t,uintptr_t> pointer_map;
-
-    /* Map of pointers (key) and addresses (value) that are in a static area */
-    std::multimap<uintptr_t,uintptr_t> static_pointer_map;
+    /* All pointers of the game memory, sorted by value */
+    PointerIndex pointer_index;
 
     /* Results of pointer scan */
     std::vector<std::pair<uintptr_t, std::vector<int>>> pointer_chains;
@@ -51,7 +49,10 @@ public:
     /* Max size of pointer chain */
     int max_level = 5;
 
-    /* Store all pointers from the game memory into a map */
+    /* Address of the last pointer scan */
+    uintptr_t target_address = 0;
+
+    /* Store all pointers from the game memory into the index */
     void locatePointers();
 
     /* Find all chains of pointers that start from a static address and
@@ -64,6 +65,13 @@ public:
 
     int loadChains(const std::string& file);
 
+    /* Save all pointers with the address of the last scan */
+    int savePointerIndex(const std::string& file);
+
+    /* Only keep pointer chains that also lead to the scanned address inside
+     * a saved pointer index */
+    int intersectPointerIndex(const std::string& file);
+
 private:
     Context *context;
 
@@ -73,8 +81,16 @@ private:
     /* Page size */
     size_t page_size;
     
-    /* Recursive call for the pointer chain search */
-    void recursiveFind(uintptr_t addr, int level, int offsets[], int max_offset);
+    /* Recursive call for the pointer chain search, storing results in `chains` */
+    void recursiveFind(uintptr_t addr, int level, int offsets[], int max_offset,
+        std::vector<std::pair<uintptr_t, std::vector<int>>>& chains) const;
+
+    /* Number of threads used to locate pointers and search chains */
+    static int threadCount();
+
+    /* Run `work` in a separate thread, and update the progress bar using
+     * `progress` until it is finished */
+    void runWithProgress(const std::function<void()>& work, const std::function<int()>& progress);
 
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
 
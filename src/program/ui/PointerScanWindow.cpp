@@ -105,11 +105,19 @@ PointerScanWindow::PointerScanWindow(Context* c, RamWatchWindow *ramWatchWindow,
     QPushButton *loadButton = new QPushButton(tr("Intersect with other Scan"));
     connect(loadButton, &QAbstractButton::clicked, this, &PointerScanWindow::slotLoad);
 
+    QPushButton *saveIndexButton = new QPushButton(tr("Save Pointers"));
+    connect(saveIndexButton, &QAbstractButton::clicked, this, &PointerScanWindow::slotSaveIndex);
+
+    QPushButton *intersectIndexButton = new QPushButton(tr("Intersect with saved Pointers"));
+    connect(intersectIndexButton, &QAbstractButton::clicked, this, &PointerScanWindow::slotIntersectIndex);
+
     QDialogButtonBox *buttonBox = new QDialogButtonBox();
     buttonBox->addButton(searchButton, QDialogButtonBox::ActionRole);
     buttonBox->addButton(addButton, QDialogButtonBox::ActionRole);
     buttonBox->addButton(saveButton, QDialogButtonBox::ActionRole);
     buttonBox->addButton(loadButton, QDialogButtonBox::ActionRole);
+    buttonBox->addButton(saveIndexButton, QDialogButtonBox::ActionRole);
+    buttonBox->addButton(intersectIndexButton, QDialogButtonBox::ActionRole);
 
     /* Create the layouts */
 
@@ -227,3 +235,55 @@ void PointerScanWindow::slotLoad()
 
     scanCount->setText(QString("%1 results").arg(pointerScanModel->pointer_chains.size()));
 }
+
+void PointerScanWindow::slotSaveIndex()
+{
+    if (pointerScanModel->target_address == 0) {
+        QMessageBox::warning(this, "Error", "You must perform a pointer scan first");
+        return;
+    }
+
+    if (defaultIndexPath.isEmpty()) {
+        defaultIndexPath = context->gamepath.c_str();
+        defaultIndexPath.append(".pidx");
+    }
+
+    QString filename = QFileDialog::getSaveFileName(this, tr("Save pointers"), defaultIndexPath, tr("pointer index files (*.pidx)"));
+
+    if (filename.isNull())
+        return;
+
+    defaultIndexPath = filename;
+
+    int ret = pointerScanModel->savePointerIndex(filename.toStdString());
+    if (ret < 0) {
+        QMessageBox::warning(this, "Error", "Could not save pointer index file");
+    }
+}
+
+void PointerScanWindow::slotIntersectIndex()
+{
+    if (defaultIndexPath.isEmpty()) {
+        defaultIndexPath = context->gamepath.c_str();
+        defaultIndexPath.append(".pidx");
+    }
+
+    QStringList filenames = QFileDialog::getOpenFileNames(this, tr("Open pointer indexes"), defaultIndexPath, tr("pointer index files (*.pidx)"));
+
+    if (filenames.isEmpty())
+        return;
+
+    defaultIndexPath = filenames.first();
+
+    /* Indexes are checked one after the other, so that only one is mapped
+     * at a time */
+    for (const QString& filename : filenames) {
+        int ret = pointerScanModel->intersectPointerIndex(filename.toStdString());
+        if (ret < 0) {
+            QMessageBox::warning(this, "Error", QString("Could not open pointer index file %1").arg(filename));
+            break;
+        }
+    }
+
+    scanCount->setText(QString("%1 results").arg(pointerScanModel->pointer_chains.size()));
+}
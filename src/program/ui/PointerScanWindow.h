@@ -59,12 +59,15 @@ private:
     QSpinBox *maxOffsetInput;
 
     QString defaultPath;
+    QString defaultIndexPath;
     
 private slots:
     void slotSearch();
     void slotAdd();
     void slotSave();
     void slotLoad();
+    void slotSaveIndex();
+    void slotIntersectIndex();
 
 };
 
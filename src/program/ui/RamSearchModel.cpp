@@ -26,6 +26,7 @@
 
 #include <QtWidgets/QMessageBox>
 #include <memory>
+#include <filesystem>
 
 RamSearchModel::RamSearchModel(Context* c, QObject *parent) : QAbstractTableModel(parent), context(c)
 {
@@ -97,8 +98,35 @@ QVariant RamSearchModel::data(const QModelIndex &index, int role) const
     return QVariant();
 }
 
+int RamSearchModel::setSource(int slot)
+{
+    if (slot < 0)
+        return memscanner.set_source(std::filesystem::path(), std::filesystem::path());
+
+    /* Same paths as savestates, with the base savestate of incremental
+     * savestates in slot 0 */
+    std::filesystem::path path = context->config.savestatedir;
+    path /= context->gamename;
+    std::filesystem::path base_path = path;
+    path += ".state" + std::to_string(slot);
+    base_path += ".state0";
+
+    return memscanner.set_source(path, base_path);
+}
+
 int RamSearchModel::predictScanCount(int mem_flags)
 {
+    if (memscanner.snapshot) {
+        std::vector<MemSection> sections;
+        memscanner.snapshot->sections(sections);
+
+        uint64_t total_size = 0;
+        for (const MemSection& section : sections)
+            if ((section.type & MemSection::MemAll) && section.followFlags(mem_flags))
+                total_size += section.size;
+        return total_size;
+    }
+
     std::unique_ptr<MemLayout> memlayout (new MemLayout(context->game_pid));
     return memlayout->totalSize(MemSection::MemAll, mem_flags);
 }
@@ -57,6 +57,10 @@ public:
      * removed by the search */
     CompareType compare_type;
 
+    /* Scan the game memory if `slot` is negative, or the memory stored
+     * inside savestate `slot`. Returns the error code */
+    int setSource(int slot);
+
     /* Perform a new search and returns the error code */
     int newWatches(int mem_flags, int type, int alignment, CompareType ct, CompareOperator co, MemValueType cv, MemValueType dv, uintptr_t ba, uintptr_t ea);
 
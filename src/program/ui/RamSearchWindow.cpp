@@ -99,6 +99,17 @@ RamSearchWindow::RamSearchWindow(Context* c, HexViewWindow* view, RamWatchWindow
     watchLayout->addWidget(watchCount);
     watchLayout->addWidget(buttonBox);
 
+    /* Memory source */
+    sourceBox = new QComboBox();
+    sourceBox->addItem("Game memory", -1);
+    for (int i = 1; i <= 10; i++)
+        sourceBox->addItem(QString("Savestate %1").arg(i), i);
+
+    QGroupBox *sourceGroupBox = new QGroupBox(tr("Memory Source"));
+    QVBoxLayout *sourceLayout = new QVBoxLayout;
+    sourceLayout->addWidget(sourceBox);
+    sourceGroupBox->setLayout(sourceLayout);
+
     /* Memory regions */
     memSpecialBox = new QCheckBox("Exclude special regions");
     memSpecialBox->setChecked(true);
@@ -205,6 +216,7 @@ RamSearchWindow::RamSearchWindow(Context* c, HexViewWindow* view, RamWatchWindow
 
     /* Create the options layout */
     QVBoxLayout *optionLayout = new QVBoxLayout;
+    optionLayout->addWidget(sourceGroupBox);
     optionLayout->addWidget(memGroupBox);
     optionLayout->addWidget(compareGroupBox);
     optionLayout->addWidget(operatorGroupBox);
@@ -245,6 +257,17 @@ void RamSearchWindow::update()
     ramSearchModel->update();
 }
 
+bool RamSearchWindow::selectSource()
+{
+    /* Each scan can read from a different source, so that values can be
+     * compared between two savestates */
+    if (ramSearchModel->setSource(sourceBox->currentData().toInt()) < 0) {
+        watchCount->setText(tr("The savestate could not be read"));
+        return false;
+    }
+    return true;
+}
+
 void RamSearchWindow::getCompareParameters(CompareType& compare_type, CompareOperator& compare_operator, MemValueType& compare_value, MemValueType& different_value)
 {
     compare_type = CompareType::Previous;
@@ -290,6 +313,9 @@ void RamSearchWindow::slotNew()
         return;
     }
 
+    if (!selectSource())
+        return;
+
     isSearching = true;
 
     /* Disable buttons during the process */
@@ -348,6 +374,9 @@ void RamSearchWindow::threadedNew(int memflags)
         case MemScannerThread::EPROCESS:
             watchCount->setText(tr("There was an error in the search process"));
             break;
+        case MemScannerThread::ESNAPSHOT:
+            watchCount->setText(tr("The savestate could not be read"));
+            break;
         default:
             /* Don't display values if too many results */
             if ((ramSearchModel->memscanner.display_scan_count() == 0) && (ramSearchModel->scanCount() != 0))
@@ -381,6 +410,9 @@ void RamSearchWindow::slotSearch()
     if (isSearching)
         return;
 
+    if (!selectSource())
+        return;
+
     isSearching = true;
 
     /* Disable buttons during the process */
@@ -422,6 +454,9 @@ void RamSearchWindow::threadedSearch()
         case MemScannerThread::EPROCESS:
             watchCount->setText(tr("There was an error in the search process"));
             break;
+        case MemScannerThread::ESNAPSHOT:
+            watchCount->setText(tr("The savestate could not be read"));
+            break;
         default:
             /* Don't display values if too many results */
             if ((ramSearchModel->memscanner.display_scan_count() == 0) && (ramSearchModel->scanCount() != 0))
@@ -62,6 +62,8 @@ private:
     QProgressBar *searchProgress;
     QLabel *watchCount;
 
+    QComboBox *sourceBox;
+
     QGroupBox *memGroupBox;
     QCheckBox *memSpecialBox;
     QCheckBox *memROBox;
@@ -99,6 +101,9 @@ private:
 
     std::atomic<bool> isSearching;
 
+    /* Select the scanned memory. Returns false if the savestate could not be read */
+    bool selectSource();
+
     void getCompareParameters(CompareType& compare_type, CompareOperator& compare_operator, MemValueType& compare_value, MemValueType& different_value);
 
     /* Actual RAM search done in another thread */
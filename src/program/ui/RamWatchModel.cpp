@@ -82,7 +82,7 @@ QVariant RamWatchModel::data(const QModelIndex &index, int role) const
                 else
                     return QString("%1").arg(watch->address, 0, 16);
             case 1:
-                return QString(watch->value_str());
+                return QString(watch->last_value_str());
             case 2:
                 return QString(watch->label.c_str());
             default:
@@ -298,12 +298,12 @@ void RamWatchModel::loadSettings(QSettings& watchSettings)
 
 void RamWatchModel::update()
 {
+    /* Read all values at once, which are then used when displaying */
+    RamWatchDetailed::read_values(ramwatches);
     emit dataChanged(index(0,0), index(rowCount()-1,1), QVector<int>(Qt::DisplayRole));
 }
 
 void RamWatchModel::update_frozen()
 {
-    for (std::unique_ptr<RamWatchDetailed>& w : ramwatches) {
-        w->keep_frozen();
-    }
+    RamWatchDetailed::keep_frozen(ramwatches);
 }
@@ -72,6 +72,12 @@ void MoviePane::initLayout()
 
     generalLayout->addRow(new QLabel(tr("On Movie End:")), endChoice);
 
+    formatChoice = new ToolTipComboBox();
+    formatChoice->addItem(tr("Legacy (tar.gz)"), Config::MOVIEFORMAT_LEGACY);
+    formatChoice->addItem(tr("Native (binary)"), Config::MOVIEFORMAT_NATIVE);
+
+    generalLayout->addRow(new QLabel(tr("Movie format:")), formatChoice);
+
     QVBoxLayout* const mainLayout = new QVBoxLayout;
     mainLayout->addWidget(generalBox);
     mainLayout->addWidget(autosaveBox);
@@ -87,6 +93,7 @@ void MoviePane::initSignals()
     connect(autosaveFrames, QOverload<int>::of(&QSpinBox::valueChanged), this, &MoviePane::saveConfig);
     connect(autosaveCount, QOverload<int>::of(&QSpinBox::valueChanged), this, &MoviePane::saveConfig);
     connect(endChoice, static_cast<void (QComboBox::*)(int)>(&QComboBox::activated), this, &MoviePane::saveConfig);    
+    connect(formatChoice, static_cast<void (QComboBox::*)(int)>(&QComboBox::activated), this, &MoviePane::saveConfig);
 }
 
 void MoviePane::initToolTips()
@@ -97,6 +104,15 @@ void MoviePane::initToolTips()
     "<b>Keep Reading:</b> Stay in playback mode, and send blank inputs on each frame."
     "A blank input is defined as all bool inputs set to false, all value inputs set to 0.<br><br>"
     "<b>Switch to Writing:</b> Switch to writing mode.");
+
+    formatChoice->setTitle("Movie format");
+    formatChoice->setDescription("Format used when saving a movie. Both formats "
+    "can be opened.<br><br>"
+    "<b>Legacy (tar.gz):</b> Compressed archive with text inputs, which can be "
+    "read by older versions of libTAS and by external tools.<br><br>"
+    "<b>Native (binary):</b> Binary inputs with fast compression, which are "
+    "much faster to open and save for long movies. Savestate movies always "
+    "use this format.");
 }
 
 
@@ -122,6 +138,9 @@ void MoviePane::loadConfig()
 
     int index = endChoice->findData(context->config.on_movie_end);
     if (index != -1) endChoice->setCurrentIndex(index);
+
+    index = formatChoice->findData(context->config.movie_format);
+    if (index != -1) formatChoice->setCurrentIndex(index);
 }
 
 void MoviePane::saveConfig()
@@ -132,6 +151,7 @@ void MoviePane::saveConfig()
     context->config.autosave_count = autosaveCount->value();
 
     context->config.on_movie_end = endChoice->itemData(endChoice->currentIndex()).toInt();
+    context->config.movie_format = formatChoice->itemData(formatChoice->currentIndex()).toInt();
     context->config.sc_modified = true;
 }
 
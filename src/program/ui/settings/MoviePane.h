@@ -50,6 +50,7 @@ private:
     QSpinBox *autosaveCount;
 
     ToolTipComboBox* endChoice;
+    ToolTipComboBox* formatChoice;
 
 public slots:
     void loadConfig();
@@ -29,6 +29,7 @@
 #include <QtWidgets/QGroupBox>
 #include <QtWidgets/QGridLayout>
 #include <QtWidgets/QVBoxLayout>
+#include <QtWidgets/QHBoxLayout>
 #include <QtWidgets/QFormLayout>
 #include <QtWidgets/QComboBox>
 #include <QtWidgets/QCheckBox>
@@ -73,11 +74,13 @@ void RuntimePane::initLayout()
     writingBox = new ToolTipCheckBox(tr("Prevent writing to disk"));
     steamBox = new ToolTipCheckBox(tr("Virtual Steam client"));
     downloadsBox = new ToolTipCheckBox(tr("Allow downloading missing libraries"));
+    sharedMemoryBox = new ToolTipCheckBox(tr("Communicate with the game through shared memory"));
 
     generalLayout->addLayout(localeLayout);
     generalLayout->addWidget(writingBox);
     generalLayout->addWidget(steamBox);
     generalLayout->addWidget(downloadsBox);
+    generalLayout->addWidget(sharedMemoryBox);
     
     savestateBox = new QGroupBox(tr("Savestates"));
     QGridLayout* savestateLayout = new QGridLayout;
@@ -87,11 +90,62 @@ void RuntimePane::initLayout()
     stateCompressedBox = new ToolTipCheckBox(tr("Compressed savestates"));
     stateUnmappedBox = new ToolTipCheckBox(tr("Skip unmapped pages"));
     stateForkBox = new ToolTipCheckBox(tr("Fork to save states"));
+    stateParallelBox = new ToolTipCheckBox(tr("Multi-threaded savestates"));
+    stateMemoryBox = new ToolTipCheckBox(tr("Store savestates in memory"));
+    stateDedupBox = new ToolTipCheckBox(tr("Share identical pages between savestates"));
+    stateWriteProtectBox = new ToolTipCheckBox(tr("Track modified pages with userfaultfd"));
+    stateHugePageBox = new ToolTipCheckBox(tr("Restore heap with huge pages"));
+
+    stateBudgetBox = new ToolTipSpinBox();
+    stateBudgetBox->setRange(0, 1024 * 1024);
+    stateBudgetBox->setSuffix(tr(" MB"));
+    stateBudgetBox->setValue(0);
 
     savestateLayout->addWidget(stateIncrementalBox, 0, 0);
     savestateLayout->addWidget(stateCompressedBox, 0, 1);
     savestateLayout->addWidget(stateUnmappedBox, 1, 0);
     savestateLayout->addWidget(stateForkBox, 1, 1);
+    savestateLayout->addWidget(stateParallelBox, 2, 0);
+    savestateLayout->addWidget(stateMemoryBox, 2, 1);
+    savestateLayout->addWidget(stateDedupBox, 3, 0);
+    savestateLayout->addWidget(stateWriteProtectBox, 3, 1);
+    savestateLayout->addWidget(stateHugePageBox, 4, 0);
+    savestateLayout->addWidget(new QLabel(tr("Memory budget:")), 5, 0);
+    savestateLayout->addWidget(stateBudgetBox, 5, 1);
+
+    stateCodecChoice = new ToolTipComboBox();
+    stateArchiveCodecChoice = new ToolTipComboBox();
+    for (ToolTipComboBox* choice : {stateCodecChoice, stateArchiveCodecChoice}) {
+        choice->addItem(tr("LZ4"), SharedConfig::SC_LZ4);
+        choice->addItem(tr("LZ4 high compression"), SharedConfig::SC_LZ4HC);
+        choice->addItem(tr("zstd"), SharedConfig::SC_ZSTD);
+    }
+
+    stateCodecLevelBox = new ToolTipSpinBox();
+    stateCodecLevelBox->setRange(-5, 19);
+    stateCodecLevelBox->setPrefix(tr("Level "));
+    stateArchiveLevelBox = new ToolTipSpinBox();
+    stateArchiveLevelBox->setRange(-5, 19);
+    stateArchiveLevelBox->setPrefix(tr("Level "));
+
+    QHBoxLayout* codecLayout = new QHBoxLayout;
+    codecLayout->addWidget(stateCodecChoice);
+    codecLayout->addWidget(stateCodecLevelBox);
+    QHBoxLayout* archiveCodecLayout = new QHBoxLayout;
+    archiveCodecLayout->addWidget(stateArchiveCodecChoice);
+    archiveCodecLayout->addWidget(stateArchiveLevelBox);
+    QHBoxLayout* archiveSlotsLayout = new QHBoxLayout;
+    for (int i = 0; i < 10; i++) {
+        stateArchiveSlotBoxes[i] = new QCheckBox(QString::number(i + 1));
+        archiveSlotsLayout->addWidget(stateArchiveSlotBoxes[i]);
+    }
+
+    savestateLayout->addWidget(new QLabel(tr("Compression:")), 6, 0);
+    savestateLayout->addLayout(codecLayout, 6, 1);
+    savestateLayout->addWidget(new QLabel(tr("Archive compression:")), 7, 0);
+    savestateLayout->addLayout(archiveCodecLayout, 7, 1);
+    savestateLayout->addWidget(new QLabel(tr("Archive slots:")), 8, 0);
+    savestateLayout->addLayout(archiveSlotsLayout, 8, 1);
 
     timingBox = new QGroupBox(tr("Timing"));
     QVBoxLayout* timingMainLayout = new QVBoxLayout;
@@ -181,11 +235,24 @@ void RuntimePane::initSignals()
     connect(writingBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
     connect(steamBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
     connect(downloadsBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
+    connect(sharedMemoryBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
 
     connect(stateIncrementalBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
     connect(stateCompressedBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
     connect(stateUnmappedBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
     connect(stateForkBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
+    connect(stateParallelBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
+    connect(stateMemoryBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
+    connect(stateDedupBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
+    connect(stateWriteProtectBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
+    connect(stateHugePageBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
+    connect(stateBudgetBox, QOverload<int>::of(&QSpinBox::valueChanged), this, &RuntimePane::saveConfig);
+    connect(stateCodecChoice, static_cast<void (QComboBox::*)(int)>(&QComboBox::activated), this, &RuntimePane::saveConfig);
+    connect(stateCodecLevelBox, QOverload<int>::of(&QSpinBox::valueChanged), this, &RuntimePane::saveConfig);
+    connect(stateArchiveCodecChoice, static_cast<void (QComboBox::*)(int)>(&QComboBox::activated), this, &RuntimePane::saveConfig);
+    connect(stateArchiveLevelBox, QOverload<int>::of(&QSpinBox::valueChanged), this, &RuntimePane::saveConfig);
+    for (QCheckBox* box : stateArchiveSlotBoxes)
+        connect(box, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
 
     connect(trackingTimeBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
     connect(trackingGettimeofdayBox, &QAbstractButton::clicked, this, &RuntimePane::saveConfig);
@@ -230,6 +297,12 @@ void RuntimePane::initToolTips()
     "will detect the missing libraries, download the registered ones and load "
     "them when running the game");
 
+    sharedMemoryBox->setDescription("Exchange data with the game through "
+    "ring buffers in shared memory instead of the socket, which makes each frame "
+    "faster, especially in fast-forward. The socket is used if the game cannot "
+    "create the shared memory. Disabled by default. Takes effect when the game "
+    "is launched.");
+
     stateIncrementalBox->setDescription("Optimize savestate size by only storing "
     "the memory pages that have been modified, at the cost of slightly more processing. "
     "This requires running on a native Linux installation (won't work on WSL2).<br><br>"
@@ -237,8 +310,8 @@ void RuntimePane::initToolTips()
     "experimental and won't work for everyone."
     "<br><br><em>If unsure, leave this unchecked</em>");
 
-    stateCompressedBox->setDescription("Compress savestates on-the-fly using a "
-    "fast compression routine (lz4). In addition to saving space, it can even "
+    stateCompressedBox->setDescription("Compress savestates on-the-fly using the "
+    "selected codec (fast lz4 by default). In addition to saving space, it can even "
     "lower the state saving time when the original state is very big. "
     "For some reasons, it fails to work for some people with a 'stack smashing' error <code>:(</code>"
     "<br><br><em>If unsure, leave this unchecked</em>");
@@ -250,9 +323,57 @@ void RuntimePane::initToolTips()
     stateForkBox->setDescription("Fork the game process when saving a state, "
     "so that the forked process is doing the saving, and you can resume the game "
     "almost instantly without altering the state that is being saved, thanks to "
-    "Linux copy-on-write magic. Useful for games that take a long time to save."
+    "Linux copy-on-write magic. Useful for games that take a long time to save. "
+    "Timings of the last savestate are shown in the profiler window."
+    "<br><br><em>If unsure, leave this unchecked</em>");
+
+    stateParallelBox->setDescription("Use several threads to scan, compress "
+    "and write memory pages when saving a state, and to decompress and copy "
+    "memory pages when loading a state. This mostly helps games that "
+    "use a lot of memory. It has no effect on forked savestates."
+    "<br><br><em>If unsure, leave this unchecked</em>");
+
+    stateMemoryBox->setDescription("Keep savestates inside the game process "
+    "memory instead of writing them to the savestate directory, which makes "
+    "saving and loading faster but uses more memory. Savestates are lost when "
+    "the game is closed."
+    "<br><br><em>If unsure, leave this unchecked</em>");
+
+    stateDedupBox->setDescription("Store each memory page only once when it "
+    "is identical in several savestates, so that keeping many savestates of "
+    "the same area uses much less space. It has no effect on forked savestates."
     "<br><br><em>If unsure, leave this unchecked</em>");
 
+    stateWriteProtectBox->setDescription("For incremental savestates, detect "
+    "the memory pages that were modified since the last savestate using "
+    "write-protection from userfaultfd, instead of soft-dirty bits. This is "
+    "faster for games using a lot of memory, but requires Linux 6.7 or later. "
+    "It has no effect on forked savestates."
+    "<br><br><em>If unsure, leave this unchecked</em>");
+
+    stateHugePageBox->setDescription("When loading a state, let the system "
+    "allocate transparent huge pages for the restored heap memory, instead of "
+    "fragmenting it into small pages. This can make the game faster after "
+    "loading a state, but uses more memory."
+    "<br><br><em>If unsure, leave this unchecked</em>");
+
+    stateBudgetBox->setTitle("Memory budget");
+    stateBudgetBox->setDescription("Maximum size of savestates stored in memory. "
+    "When exceeded, the least recently used savestates are moved to the "
+    "savestate directory. 0 for no limit.");
+
+    stateCodecChoice->setTitle("Compression");
+    stateCodecChoice->setDescription("Codec used for compressed savestates. "
+    "LZ4 is the fastest, and its level is an acceleration factor which trades "
+    "size for speed. LZ4 high compression and zstd produce smaller savestates "
+    "but are slower to save, higher levels giving smaller savestates. They "
+    "require the liblz4 and libzstd libraries, otherwise LZ4 is used.");
+
+    stateArchiveCodecChoice->setTitle("Archive compression");
+    stateArchiveCodecChoice->setDescription("Codec used for compressed savestates "
+    "of the archive slots, for savestates that are kept for a long time and where "
+    "size matters more than speed.");
+
     trackingBox->setDescription("By checking a specific function, time will advance "
     "a bit when too many calls of that function have been made from the main thread. "
     "This prevents softlocks when a game wait in a loop for time to advance.<br><br>"
@@ -348,11 +469,31 @@ void RuntimePane::loadConfig()
     writingBox->setChecked(context->config.sc.prevent_savefiles);
     steamBox->setChecked(context->config.sc.virtual_steam);
     downloadsBox->setChecked(context->config.allow_downloads);
+    sharedMemoryBox->setChecked(context->config.shared_memory_transport);
 
     stateIncrementalBox->setChecked(context->config.sc.savestate_settings & SharedConfig::SS_INCREMENTAL);
     stateCompressedBox->setChecked(context->config.sc.savestate_settings & SharedConfig::SS_COMPRESSED);
     stateUnmappedBox->setChecked(context->config.sc.savestate_settings & SharedConfig::SS_PRESENT);
     stateForkBox->setChecked(context->config.sc.savestate_settings & SharedConfig::SS_FORK);
+    stateParallelBox->setChecked(context->config.sc.savestate_settings & SharedConfig::SS_PARALLEL);
+    stateMemoryBox->setChecked(context->config.sc.savestate_settings & SharedConfig::SS_MEMORY);
+    stateDedupBox->setChecked(context->config.sc.savestate_settings & SharedConfig::SS_DEDUP);
+    stateWriteProtectBox->setChecked(context->config.sc.savestate_settings & SharedConfig::SS_WRITEPROTECT);
+    stateHugePageBox->setChecked(context->config.sc.savestate_settings & SharedConfig::SS_HUGEPAGE);
+    stateBudgetBox->setValue(context->config.sc.savestate_memory_budget);
+
+    index = stateCodecChoice->findData(context->config.sc.savestate_codec);
+    if (index >= 0)
+        stateCodecChoice->setCurrentIndex(index);
+    stateCodecLevelBox->setValue(context->config.sc.savestate_codec_level);
+
+    index = stateArchiveCodecChoice->findData(context->config.sc.savestate_archive_codec);
+    if (index >= 0)
+        stateArchiveCodecChoice->setCurrentIndex(index);
+    stateArchiveLevelBox->setValue(context->config.sc.savestate_archive_level);
+
+    for (int i = 0; i < 10; i++)
+        stateArchiveSlotBoxes[i]->setChecked(context->config.sc.savestate_archive_slots & (1 << (i + 1)));
 
     trackingTimeBox->setChecked(context->config.sc.main_gettimes_threshold[SharedConfig::TIMETYPE_TIME] != -1);
     trackingGettimeofdayBox->setChecked(context->config.sc.main_gettimes_threshold[SharedConfig::TIMETYPE_GETTIMEOFDAY] != -1);
@@ -390,12 +531,26 @@ void RuntimePane::saveConfig()
     context->config.sc.prevent_savefiles = writingBox->isChecked();
     context->config.sc.virtual_steam = steamBox->isChecked();
     context->config.allow_downloads = downloadsBox->isChecked();
+    context->config.shared_memory_transport = sharedMemoryBox->isChecked();
 
     context->config.sc.savestate_settings = 0;
     context->config.sc.savestate_settings |= stateIncrementalBox->isChecked() ? SharedConfig::SS_INCREMENTAL : 0;
     context->config.sc.savestate_settings |= stateCompressedBox->isChecked() ? SharedConfig::SS_COMPRESSED : 0;
     context->config.sc.savestate_settings |= stateUnmappedBox->isChecked() ? SharedConfig::SS_PRESENT : 0;
     context->config.sc.savestate_settings |= stateForkBox->isChecked() ? SharedConfig::SS_FORK : 0;
+    context->config.sc.savestate_settings |= stateParallelBox->isChecked() ? SharedConfig::SS_PARALLEL : 0;
+    context->config.sc.savestate_settings |= stateMemoryBox->isChecked() ? SharedConfig::SS_MEMORY : 0;
+    context->config.sc.savestate_settings |= stateDedupBox->isChecked() ? SharedConfig::SS_DEDUP : 0;
+    context->config.sc.savestate_settings |= stateWriteProtectBox->isChecked() ? SharedConfig::SS_WRITEPROTECT : 0;
+    context->config.sc.savestate_settings |= stateHugePageBox->isChecked() ? SharedConfig::SS_HUGEPAGE : 0;
+    context->config.sc.savestate_memory_budget = stateBudgetBox->value();
+    context->config.sc.savestate_codec = stateCodecChoice->currentData().toInt();
+    context->config.sc.savestate_codec_level = stateCodecLevelBox->value();
+    context->config.sc.savestate_archive_codec = stateArchiveCodecChoice->currentData().toInt();
+    context->config.sc.savestate_archive_level = stateArchiveLevelBox->value();
+    context->config.sc.savestate_archive_slots = 0;
+    for (int i = 0; i < 10; i++)
+        context->config.sc.savestate_archive_slots |= stateArchiveSlotBoxes[i]->isChecked() ? (1 << (i + 1)) : 0;
 
     context->config.sc.main_gettimes_threshold[SharedConfig::TIMETYPE_TIME] = trackingTimeBox->isChecked() ? 100 : -1;
     context->config.sc.main_gettimes_threshold[SharedConfig::TIMETYPE_GETTIMEOFDAY] = trackingGettimeofdayBox->isChecked() ? 100 : -1;
@@ -56,11 +56,23 @@ private:
     ToolTipCheckBox* writingBox;
     ToolTipCheckBox* steamBox;
     ToolTipCheckBox* downloadsBox;
+    ToolTipCheckBox* sharedMemoryBox;
 
     ToolTipCheckBox* stateIncrementalBox;
     ToolTipCheckBox* stateCompressedBox;
     ToolTipCheckBox* stateUnmappedBox;
     ToolTipCheckBox* stateForkBox;
+    ToolTipCheckBox* stateParallelBox;
+    ToolTipCheckBox* stateMemoryBox;
+    ToolTipCheckBox* stateDedupBox;
+    ToolTipCheckBox* stateWriteProtectBox;
+    ToolTipCheckBox* stateHugePageBox;
+    ToolTipSpinBox* stateBudgetBox;
+    ToolTipComboBox* stateCodecChoice;
+    ToolTipSpinBox* stateCodecLevelBox;
+    ToolTipComboBox* stateArchiveCodecChoice;
+    ToolTipSpinBox* stateArchiveLevelBox;
+    QCheckBox* stateArchiveSlotBoxes[10];
 
     ToolTipGroupBox* trackingBox;
 
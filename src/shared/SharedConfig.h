@@ -115,6 +115,18 @@ struct __attribute__((packed, aligned(8))) SharedConfig {
         ACODEC_PCM,
     };
 
+    /* What to do when the encode queue is full */
+    enum EncodeQueuePolicy {
+        ENCODE_QUEUE_WAIT, // wait for the encoder thread
+        ENCODE_QUEUE_DROP, // repeat the previous image instead of the new one
+    };
+
+    /* How frames are encoded */
+    enum EncodeBackend {
+        ENCODE_BACKEND_FFMPEG, // pipe frames to an ffmpeg process
+        ENCODE_BACKEND_LIBAV, // encode inside the game process using libavcodec
+    };
+
     /* Encode config */
     int video_codec = VCODEC_X264;
     int video_bitrate = 4000;
@@ -125,6 +137,9 @@ struct __attribute__((packed, aligned(8))) SharedConfig {
     int video_filter = VFILTER_POINT;
     int audio_codec = ACODEC_AAC;
     int audio_bitrate = 128;
+    int video_queue_size = 4; // frames encoded by a separate thread, or 0 to encode on the game thread
+    int video_queue_policy = ENCODE_QUEUE_WAIT;
+    int encode_backend = ENCODE_BACKEND_FFMPEG;
 
     /* An enum indicating which time-getting function query the time */
     enum TimeCallType
@@ -267,11 +282,37 @@ struct __attribute__((packed, aligned(8))) SharedConfig {
         SS_COMPRESSED = 0x08, /* Compress savestates */
         SS_PRESENT = 0x10, /* Skip unmapped pages */
         SS_FORK = 0x20, /* Use a forked process to save the state */
+        SS_PARALLEL = 0x40, /* Use helper threads to process memory pages */
+        SS_MEMORY = 0x80, /* Store savestates in memory instead of files */
+        SS_DEDUP = 0x100, /* Share identical pages between savestates */
+        SS_WRITEPROTECT = 0x200, /* Track modified pages using userfaultfd */
+        SS_HUGEPAGE = 0x400, /* Use transparent huge pages for restored heap areas */
     };
 
     /* Savestate settings */
     int savestate_settings = SS_COMPRESSED;
 
+    /* Maximum size in MB of savestates stored in memory, 0 for no limit */
+    int savestate_memory_budget = 0;
+
+    /* Compression codecs of savestates */
+    enum SaveStateCodec
+    {
+        SC_LZ4 = 0, /* Fast LZ4, level is the acceleration factor */
+        SC_LZ4HC = 1, /* LZ4 with high compression */
+        SC_ZSTD = 2, /* Zstandard */
+    };
+
+    /* Codec and level of compressed savestates */
+    int savestate_codec = SC_LZ4;
+    int savestate_codec_level = 1;
+
+    /* Bitmask of savestate slots using a separate codec, for states that are
+     * kept for a long time and where size matters more than speed */
+    int savestate_archive_slots = 0;
+    int savestate_archive_codec = SC_ZSTD;
+    int savestate_archive_level = 9;
+
     /* Stacktrace hash to advance time */
     uint64_t busy_loop_hash = 0;
 
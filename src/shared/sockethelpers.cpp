@@ -28,23 +28,103 @@
 #endif
 
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
 #include <cstdlib>
 #include <unistd.h>
 #include <sys/un.h>
 #include <iostream>
 #include <vector>
 #include <mutex>
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <cstdint>
+#include <ctime>
 #include <errno.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif
 
 
 #define SOCKET_FILENAME "/tmp/libTAS.socket"
+#define SOCKET_INSTANCE_FILENAME "/tmp/libTAS-%d.socket"
 
 #ifndef MSG_NOSIGNAL
 #define MSG_NOSIGNAL 0
 #endif
 
+/* Version of the data sent over the socket. It is exchanged when connecting,
+ * and must be increased when the framing below changes.
+ *
+ * After the version, the program sends the transport it wants to use, and
+ * the library answers with the transport that will be used. For the shared
+ * memory transport, the answer comes with the file descriptor of the
+ * shared memory.
+ *
+ * With the socket transport, data is sent in frames, made of a 32-bit payload
+ * size followed by the payload. The payload is the concatenation of all data
+ * sent by sendData() since the last frame, so messages can span several
+ * frames.
+ *
+ * With the shared memory transport, data is written into one ring buffer for
+ * each direction, and the socket is only used to detect that the other side
+ * has exited. */
+static const int SOCKET_PROTOCOL_VERSION = 2;
+
+enum SocketTransport {
+    TRANSPORT_SOCKET = 0,
+    TRANSPORT_SHARED_MEMORY = 1,
+};
+
+/* Size of buffered data above which it is sent, and of the receive buffer */
+static const size_t SOCKET_BUFFER_SIZE = 64 * 1024;
+
+/* Size of each ring buffer, must be a power of two */
+static const uint32_t RING_SIZE = 1024 * 1024;
+
+/* Number of checks before sleeping when waiting on a ring buffer. The other
+ * side usually answers in a few microseconds, which is much less than the
+ * cost of sleeping and being woken up. We don't spin with a single processor,
+ * because the other side cannot run in the meantime */
+static const int RING_SPIN_COUNT = 1000;
+
+/* Timeout of each sleep when waiting on a ring buffer, after which we check
+ * if the other side is still alive */
+static const long RING_SLEEP_TIMEOUT_NS = 100L * 1000L * 1000L;
+
+/* Ring buffer with a single producer and a single consumer, shared between
+ * the program and the game. Positions only increase, and wrap around at 2^32.
+ * Members are aligned the same way for 32-bit and 64-bit processes. */
+struct SharedRing {
+    /* Read position, only written by the consumer */
+    alignas(64) std::atomic<uint32_t> head;
+
+    /* Write position, only written by the producer */
+    alignas(64) std::atomic<uint32_t> tail;
+
+    /* Futex words increased after each write and read, and flags set while
+     * the consumer or the producer sleeps on them */
+    alignas(64) std::atomic<uint32_t> written;
+    std::atomic<uint32_t> consumer_sleeping;
+    std::atomic<uint32_t> read;
+    std::atomic<uint32_t> producer_sleeping;
+
+    alignas(64) char data[RING_SIZE];
+};
+
+struct SharedRings {
+    SharedRing to_program;
+    SharedRing to_game;
+};
+
+static_assert(sizeof(SharedRing) == (3 * 64 + RING_SIZE), "SharedRing layout must not depend on the architecture");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "SharedRing positions must be lock-free");
+
 #ifdef LIBTAS_LIBRARY
 using namespace libtas;
 #endif
@@ -52,23 +132,255 @@ using namespace libtas;
 /* Socket to communicate between the program and the game */
 static int socket_fd = 0;
 
+/* Path of the socket file, which depends on the libTAS instance */
+static char socket_path[sizeof(sockaddr_un::sun_path)] = SOCKET_FILENAME;
+
 static std::mutex mutex;
 
+/* Sent data is buffered until flushSocket() is called */
+static bool buffering = false;
+static std::vector<char> send_buffer;
+
+/* Received bytes, including frame headers, between receive_pos and
+ * receive_end, and remaining payload size of the current frame */
+static std::vector<char> receive_buffer;
+static size_t receive_pos = 0;
+static size_t receive_end = 0;
+static uint32_t frame_remaining = 0;
+
+/* Shared memory and ring buffers of each direction, when used */
+static SharedRings* shared_rings = nullptr;
+static SharedRing* send_ring = nullptr;
+static SharedRing* receive_ring = nullptr;
+static int ring_spin_count = 0;
+
+/* Size of data written into the send ring but not yet visible to the other
+ * side. It is always zero when a savestate is made, because receiving
+ * anything first publishes the written data */
+static uint32_t send_ring_pending = 0;
+
+static void resetBuffers()
+{
+    buffering = false;
+    send_buffer.clear();
+    send_ring_pending = 0;
+    receive_buffer.resize(SOCKET_BUFFER_SIZE);
+    receive_pos = 0;
+    receive_end = 0;
+    frame_remaining = 0;
+}
+
+/* Returns if the other side has closed the socket */
+static bool peerClosed()
+{
+    char c;
+    ssize_t ret;
+    do {
+        ret = recv(socket_fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    } while ((ret == -1) && (errno == EINTR));
+
+    return (ret == 0) || ((ret == -1) && (errno != EAGAIN) && (errno != EWOULDBLOCK));
+}
+
+static inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+/* Sleep until `word` is different from `value`, or until the timeout. The
+ * futex is not private because the memory is shared between processes */
+static void futexWait(std::atomic<uint32_t>& word, uint32_t value)
+{
+#ifdef __linux__
+    struct timespec timeout = {0, RING_SLEEP_TIMEOUT_NS};
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAIT, value, &timeout, nullptr, 0);
+#else
+    (void) word;
+    (void) value;
+#endif
+}
+
+static void futexWake(std::atomic<uint32_t>& word)
+{
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(&word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#else
+    (void) word;
+#endif
+}
+
+/* Wait until `ready()` returns true. We first spin for a short time, then
+ * sleep on the futex `word`, setting `sleeping` so that the other side knows
+ * it must wake us. Returns false if the other side has exited */
+template <typename F>
+static bool ringWait(std::atomic<uint32_t>& word, std::atomic<uint32_t>& sleeping, F ready)
+{
+    for (int i = 0; i < ring_spin_count; i++) {
+        if (ready())
+            return true;
+        cpuRelax();
+    }
+
+    while (true) {
+        uint32_t value = word.load();
+        sleeping.store(1);
+
+        /* Check again after setting the flag, in case the other side
+         * changed the ring before seeing it */
+        if (ready()) {
+            sleeping.store(0);
+            return true;
+        }
+
+        futexWait(word, value);
+        sleeping.store(0);
+
+        if (ready())
+            return true;
+
+        if (peerClosed())
+            return false;
+    }
+}
+
+/* Make all data written into the send ring visible to the other side */
+static void ringPublish()
+{
+    if (send_ring_pending == 0)
+        return;
+
+    send_ring->tail.store(send_ring->tail.load(std::memory_order_relaxed) + send_ring_pending);
+    send_ring_pending = 0;
+
+    send_ring->written.fetch_add(1);
+    if (send_ring->consumer_sleeping.load())
+        futexWake(send_ring->written);
+}
+
+/* Write data into the send ring, after the data that is not published yet.
+ * If the ring is full, we publish and wait for the other side to read.
+ * Returns false if the other side has exited */
+static bool ringWrite(const void* elem, unsigned int size)
+{
+    const char* data = static_cast<const char*>(elem);
+    SharedRing* ring = send_ring;
+
+    while (size > 0) {
+        uint32_t tail = ring->tail.load(std::memory_order_relaxed) + send_ring_pending;
+        uint32_t free_size = RING_SIZE - (tail - ring->head.load(std::memory_order_acquire));
+
+        if (free_size == 0) {
+            ringPublish();
+            bool ready = ringWait(ring->read, ring->producer_sleeping, [ring, tail]() {
+                return (tail - ring->head.load(std::memory_order_acquire)) < RING_SIZE;
+            });
+            if (!ready)
+                return false;
+            continue;
+        }
+
+        uint32_t count = std::min(free_size, static_cast<uint32_t>(size));
+        uint32_t offset = tail & (RING_SIZE - 1);
+        uint32_t first = std::min(count, RING_SIZE - offset);
+        std::memcpy(ring->data + offset, data, first);
+        std::memcpy(ring->data, data + first, count - first);
+
+        send_ring_pending += count;
+        data += count;
+        size -= count;
+    }
+
+    return true;
+}
+
+/* Read data from the receive ring. Same arguments and return value as
+ * receivePayload() */
+static ssize_t ringRead(void* elem, unsigned int size, int flags)
+{
+    char* data = static_cast<char*>(elem);
+    SharedRing* ring = receive_ring;
+    unsigned int received = 0;
+
+    while (received < size) {
+        uint32_t head = ring->head.load(std::memory_order_relaxed);
+        uint32_t available = ring->tail.load(std::memory_order_acquire) - head;
+
+        if (available == 0) {
+            if ((flags & MSG_DONTWAIT) && (received == 0)) {
+                if (peerClosed())
+                    return 0;
+                errno = EAGAIN;
+                return -1;
+            }
+
+            bool ready = ringWait(ring->written, ring->consumer_sleeping, [ring, head]() {
+                return ring->tail.load(std::memory_order_acquire) != head;
+            });
+            if (!ready)
+                return 0;
+            continue;
+        }
+
+        uint32_t count = std::min(available, static_cast<uint32_t>(size - received));
+        uint32_t offset = head & (RING_SIZE - 1);
+        uint32_t first = std::min(count, RING_SIZE - offset);
+        std::memcpy(data + received, ring->data + offset, first);
+        std::memcpy(data + received + first, ring->data, count - first);
+
+        ring->head.store(head + count);
+        received += count;
+
+        ring->read.fetch_add(1);
+        if (ring->producer_sleeping.load())
+            futexWake(ring->read);
+    }
+
+    return received;
+}
+
+static void releaseSharedRings()
+{
+    if (shared_rings)
+        munmap(shared_rings, sizeof(SharedRings));
+    shared_rings = nullptr;
+    send_ring = nullptr;
+    receive_ring = nullptr;
+}
+
+void setSocketInstance(int instance)
+{
+    if (instance == 0)
+        snprintf(socket_path, sizeof(socket_path), SOCKET_FILENAME);
+    else
+        snprintf(socket_path, sizeof(socket_path), SOCKET_INSTANCE_FILENAME, instance);
+}
+
+static struct sockaddr_un socketAddress(void)
+{
+    struct sockaddr_un addr = {};
+#if defined(__APPLE__) && defined(__MACH__)
+    addr.sun_len = sizeof(struct sockaddr_un);
+#endif
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+    return addr;
+}
+
 int removeSocket(void) {
-    int ret = unlink(SOCKET_FILENAME);
+    int ret = unlink(socket_path);
     if ((ret == -1) && (errno != ENOENT))
         return errno;
     return 0;
 }
 
 #ifndef LIBTAS_LIBRARY
-bool initSocketProgram(pid_t fork_pid)
+bool initSocketProgram(pid_t fork_pid, bool shared_memory)
 {
-#ifdef __unix__
-    const struct sockaddr_un addr = { AF_UNIX, SOCKET_FILENAME };
-#elif defined(__APPLE__) && defined(__MACH__)
-    const struct sockaddr_un addr = { sizeof(struct sockaddr_un), AF_UNIX, SOCKET_FILENAME };
-#endif
+    const struct sockaddr_un addr = socketAddress();
     socket_fd = socket(AF_UNIX, SOCK_STREAM, 0);
 
     struct timespec tim = {0, 500L*1000L*1000L};
@@ -102,29 +414,138 @@ bool initSocketProgram(pid_t fork_pid)
     }
     std::cout << "Attempt " << retry + 1 << ": Connected." << std::endl;
 
+    /* Check that the game speaks the same protocol */
+    int version = 0;
+    ssize_t ret;
+    do {
+        ret = recv(socket_fd, &version, sizeof(int), MSG_WAITALL);
+    } while ((ret == -1) && (errno == EINTR));
+
+    if (ret != sizeof(int)) {
+        std::cerr << "Could not receive the socket protocol version" << std::endl;
+        return false;
+    }
+    if (version != SOCKET_PROTOCOL_VERSION) {
+        std::cerr << "Socket protocol version of the library (" << version << ") does not match the program (" << SOCKET_PROTOCOL_VERSION << ")" << std::endl;
+        return false;
+    }
+
+    /* Ask for the shared memory transport. The game falls back to the socket
+     * if it cannot create the shared memory */
+    int transport = shared_memory ? TRANSPORT_SHARED_MEMORY : TRANSPORT_SOCKET;
+    if (send(socket_fd, &transport, sizeof(int), MSG_NOSIGNAL) != sizeof(int)) {
+        std::cerr << "Could not send the socket transport" << std::endl;
+        return false;
+    }
+
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+
+    struct iovec iov;
+    iov.iov_base = &transport;
+    iov.iov_len = sizeof(int);
+
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    do {
+        ret = recvmsg(socket_fd, &msg, MSG_WAITALL);
+    } while ((ret == -1) && (errno == EINTR));
+
+    if (ret != sizeof(int)) {
+        std::cerr << "Could not receive the socket transport" << std::endl;
+        return false;
+    }
+
+    resetBuffers();
+    releaseSharedRings();
+
+    if (transport == TRANSPORT_SHARED_MEMORY) {
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        if (!cmsg || (cmsg->cmsg_level != SOL_SOCKET) || (cmsg->cmsg_type != SCM_RIGHTS)) {
+            std::cerr << "Could not receive the shared memory of the game" << std::endl;
+            return false;
+        }
+
+        int fd;
+        std::memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+        void* addr = mmap(nullptr, sizeof(SharedRings), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+
+        if (addr == MAP_FAILED) {
+            std::cerr << "Could not map the shared memory of the game: " << strerror(errno) << std::endl;
+            return false;
+        }
+
+        shared_rings = static_cast<SharedRings*>(addr);
+        send_ring = &shared_rings->to_game;
+        receive_ring = &shared_rings->to_program;
+        ring_spin_count = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? RING_SPIN_COUNT : 0;
+    }
+
     return true;
 }
 
 #else
 
+/* Create the shared memory holding the ring buffers, and returns its file
+ * descriptor, or -1 on error */
+static int createSharedRings(void)
+{
+#ifdef __linux__
+    int fd = syscall(SYS_memfd_create, "libtas_transport", MFD_CLOEXEC);
+    if (fd < 0) {
+        LOG(LL_WARN, LCF_SOCKET, "Couldn't create the shared memory %s", strerror(errno));
+        return -1;
+    }
+
+    if (ftruncate(fd, sizeof(SharedRings)) < 0) {
+        LOG(LL_WARN, LCF_SOCKET, "Couldn't resize the shared memory %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    void* addr = mmap(nullptr, sizeof(SharedRings), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        LOG(LL_WARN, LCF_SOCKET, "Couldn't map the shared memory %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    shared_rings = static_cast<SharedRings*>(addr);
+    send_ring = &shared_rings->to_program;
+    receive_ring = &shared_rings->to_game;
+    ring_spin_count = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? RING_SPIN_COUNT : 0;
+    return fd;
+#else
+    return -1;
+#endif
+}
+
 bool initSocketGame(void)
 {
     GlobalNative gn;
+
+    /* Use the socket of the libTAS instance that started us */
+    const char* instance = getenv("LIBTAS_INSTANCE");
+    if (instance)
+        setSocketInstance(atoi(instance));
     
     /* Check if socket file already exists. If so, it is probably because
      * the link is already done in another process of the game.
      * In this case, we just return immediately.
      */
     struct stat st;
-    int result = stat(SOCKET_FILENAME, &st);
+    int result = stat(socket_path, &st);
     if (result == 0)
         return false;
 
-#ifdef __unix__
-    const struct sockaddr_un addr = { AF_UNIX, SOCKET_FILENAME };
-#elif defined(__APPLE__) && defined(__MACH__)
-    const struct sockaddr_un addr = { sizeof(struct sockaddr_un), AF_UNIX, SOCKET_FILENAME };
-#endif
+    const struct sockaddr_un addr = socketAddress();
     const int tmp_fd = socket(AF_UNIX, SOCK_STREAM, 0);
     if (bind(tmp_fd, reinterpret_cast<const struct sockaddr*>(&addr), sizeof(struct sockaddr_un)))
     {
@@ -155,9 +576,81 @@ bool initSocketGame(void)
 #endif
     
     close(tmp_fd);
+
+    /* Tell the program which protocol we speak */
+    if (send(socket_fd, &SOCKET_PROTOCOL_VERSION, sizeof(int), MSG_NOSIGNAL) != sizeof(int))
+    {
+        LOG(LL_ERROR, LCF_SOCKET, "Couldn't send the socket protocol version %s", strerror(errno));
+        exit(-1);
+    }
+
+    /* Use the transport asked by the program if we can */
+    int transport;
+    ssize_t ret;
+    do {
+        ret = recv(socket_fd, &transport, sizeof(int), MSG_WAITALL);
+    } while ((ret == -1) && (errno == EINTR));
+
+    if (ret != sizeof(int))
+    {
+        LOG(LL_ERROR, LCF_SOCKET, "Couldn't receive the socket transport %s", strerror(errno));
+        exit(-1);
+    }
+
+    resetBuffers();
+    releaseSharedRings();
+
+    int fd = -1;
+    if (transport == TRANSPORT_SHARED_MEMORY)
+        fd = createSharedRings();
+    if (fd < 0)
+        transport = TRANSPORT_SOCKET;
+
+    union {
+        char buf[CMSG_SPACE(sizeof(int))];
+        struct cmsghdr align;
+    } control;
+
+    struct iovec iov;
+    iov.iov_base = &transport;
+    iov.iov_len = sizeof(int);
+
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    /* Pass the file descriptor of the shared memory */
+    if (fd >= 0) {
+        msg.msg_control = control.buf;
+        msg.msg_controllen = sizeof(control.buf);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    }
+
+    ret = sendmsg(socket_fd, &msg, MSG_NOSIGNAL);
+
+    /* The mapping stays valid after closing */
+    if (fd >= 0)
+        close(fd);
+
+    if (ret != sizeof(int))
+    {
+        LOG(LL_ERROR, LCF_SOCKET, "Couldn't send the socket transport %s", strerror(errno));
+        exit(-1);
+    }
+
+    LOG(LL_DEBUG, LCF_SOCKET, "Using the %s transport", (transport == TRANSPORT_SHARED_MEMORY) ? "shared memory" : "socket");
     return true;
 }
 
+bool isSocketSharedMemory(const void* addr)
+{
+    return shared_rings && (addr == shared_rings);
+}
+
 #endif
 
 void closeSocket(void)
@@ -165,7 +658,10 @@ void closeSocket(void)
 #ifdef LIBTAS_LIBRARY
     GlobalNative gn;
 #endif
+    flushSocket();
     close(socket_fd);
+    resetBuffers();
+    releaseSharedRings();
 }
 
 void lockSocket(void)
@@ -178,33 +674,106 @@ void unlockSocket(void)
     mutex.unlock();
 }
 
-int sendData(const void* elem, unsigned int size)
+/* Send the buffered data followed by `size` bytes of `elem` in a single
+ * frame. Returns the number of bytes of `elem` that were sent, or -1 */
+static int sendFrame(const void* elem, unsigned int size)
 {
+    uint32_t payload_size = send_buffer.size() + size;
+
+    struct iovec iov[3];
+    iov[0].iov_base = &payload_size;
+    iov[0].iov_len = sizeof(uint32_t);
+    iov[1].iov_base = send_buffer.data();
+    iov[1].iov_len = send_buffer.size();
+    iov[2].iov_base = const_cast<void*>(elem);
+    iov[2].iov_len = size;
+
+    struct msghdr msg = {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 3;
+
+    size_t total = sizeof(uint32_t) + payload_size;
+    size_t sent = 0;
+    while (sent < total) {
+        ssize_t ret = sendmsg(socket_fd, &msg, MSG_NOSIGNAL);
+        if (ret == -1) {
+            if (errno == EINTR)
+                continue;
 #ifdef LIBTAS_LIBRARY
-    LOG(LL_DEBUG, LCF_SOCKET, "Send socket data of size %u", size);
+            LOG(LL_ERROR, LCF_SOCKET, "sendmsg() returns -1 with error %s", strerror(errno));
+#else
+            std::cerr << "sendmsg() returns -1 with error " << strerror(errno) << std::endl;
 #endif
+            send_buffer.clear();
+            return -1;
+        }
+        sent += ret;
+
+        /* Skip what was sent if interrupted in the middle */
+        while ((ret > 0) && (msg.msg_iovlen > 0)) {
+            size_t skipped = std::min(static_cast<size_t>(ret), msg.msg_iov[0].iov_len);
+            msg.msg_iov[0].iov_base = static_cast<char*>(msg.msg_iov[0].iov_base) + skipped;
+            msg.msg_iov[0].iov_len -= skipped;
+            ret -= skipped;
+            if (msg.msg_iov[0].iov_len == 0) {
+                msg.msg_iov++;
+                msg.msg_iovlen--;
+            }
+        }
+    }
 
-    ssize_t ret = 0;
-    do {
-        ret = send(socket_fd, elem, size, MSG_NOSIGNAL);
-    } while ((ret == -1) && (errno == EINTR));
+    send_buffer.clear();
+    return size;
+}
 
-    if (ret == -1) {
+/* Send all buffered data */
+static void sendPending()
+{
+    if (send_ring)
+        ringPublish();
+    else if (!send_buffer.empty())
+        sendFrame(nullptr, 0);
+}
+
+int sendData(const void* elem, unsigned int size)
+{
 #ifdef LIBTAS_LIBRARY
-        LOG(LL_ERROR, LCF_SOCKET, "send() returns -1 with error %s", strerror(errno));
-#else
-        std::cerr << "send() returns -1 with error " << strerror(errno) << std::endl;
+    LOG(LL_DEBUG, LCF_SOCKET, "Send socket data of size %u", size);
 #endif
-    }
-    else if (ret != static_cast<ssize_t>(size)) {
+
+    if (send_ring) {
+        if (!ringWrite(elem, size)) {
 #ifdef LIBTAS_LIBRARY
-        LOG(LL_ERROR, LCF_SOCKET, "send() %u bytes instead of %u", ret, size);
+            LOG(LL_ERROR, LCF_SOCKET, "Couldn't send data, the program has exited");
 #else
-        std::cerr << "send() " << ret << " bytes instead of " << size << std::endl;
+            std::cerr << "Couldn't send data, the game has exited" << std::endl;
 #endif
+            return -1;
+        }
+        if (!buffering)
+            ringPublish();
+        return size;
     }
-    
-    return ret;
+
+    /* Large data is sent right away with the buffered data, without copying */
+    if (buffering && ((send_buffer.size() + size) < SOCKET_BUFFER_SIZE)) {
+        const char* data = static_cast<const char*>(elem);
+        send_buffer.insert(send_buffer.end(), data, data + size);
+        return size;
+    }
+
+    return sendFrame(elem, size);
+}
+
+void bufferSocket(void)
+{
+    buffering = true;
+}
+
+void flushSocket(void)
+{
+    buffering = false;
+    sendPending();
 }
 
 int sendMessage(int message)
@@ -226,16 +795,99 @@ void sendString(const std::string& str)
         sendData(str.c_str(), str_size);
 }
 
+/* Receive bytes until at least `size` bytes are available in the receive
+ * buffer. Returns the value of the last recv() call, which is 0 if the socket
+ * was closed, or -1 on error */
+static ssize_t fillReceiveBuffer(size_t size, int flags)
+{
+    /* Move the remaining bytes at the beginning */
+    if (receive_pos == receive_end) {
+        receive_pos = 0;
+        receive_end = 0;
+    }
+    else if ((receive_buffer.size() - receive_pos) < size) {
+        std::memmove(receive_buffer.data(), receive_buffer.data() + receive_pos, receive_end - receive_pos);
+        receive_end -= receive_pos;
+        receive_pos = 0;
+    }
+
+    ssize_t ret = 1;
+    while ((receive_end - receive_pos) < size) {
+        ret = recv(socket_fd, receive_buffer.data() + receive_end, receive_buffer.size() - receive_end, flags);
+        if ((ret == -1) && (errno == EINTR))
+            continue;
+        if (ret <= 0)
+            return ret;
+        receive_end += ret;
+    }
+    return ret;
+}
+
+/* Receive the payload of frames. Same arguments and return value as
+ * recv(), where flags can only contain MSG_DONTWAIT. When set, it only
+ * applies until the first byte of payload is received */
+static ssize_t receivePayload(void* elem, unsigned int size, int flags)
+{
+    if (receive_ring)
+        return ringRead(elem, size, flags);
+
+    char* data = static_cast<char*>(elem);
+    unsigned int received = 0;
+
+    while (received < size) {
+        if (received > 0)
+            flags = 0;
+
+        /* Read the header of the next frame */
+        if (frame_remaining == 0) {
+            ssize_t ret = fillReceiveBuffer(sizeof(uint32_t), flags);
+            if (ret <= 0)
+                return ret;
+            std::memcpy(&frame_remaining, receive_buffer.data() + receive_pos, sizeof(uint32_t));
+            receive_pos += sizeof(uint32_t);
+            continue;
+        }
+
+        size_t available = std::min(static_cast<size_t>(frame_remaining), static_cast<size_t>(size - received));
+        if (receive_pos == receive_end) {
+            /* Receive large data directly */
+            if (available >= receive_buffer.size()) {
+                ssize_t ret;
+                do {
+                    ret = recv(socket_fd, data + received, available, MSG_WAITALL);
+                } while ((ret == -1) && (errno == EINTR));
+                if (ret <= 0)
+                    return ret;
+                received += ret;
+                frame_remaining -= ret;
+                continue;
+            }
+
+            ssize_t ret = fillReceiveBuffer(1, flags);
+            if (ret <= 0)
+                return ret;
+        }
+
+        available = std::min(available, receive_end - receive_pos);
+        std::memcpy(data + received, receive_buffer.data() + receive_pos, available);
+        receive_pos += available;
+        frame_remaining -= available;
+        received += available;
+    }
+
+    return received;
+}
+
 int receiveData(void* elem, unsigned int size)
 {
 #ifdef LIBTAS_LIBRARY
     LOG(LL_DEBUG, LCF_SOCKET, "Receive socket data of size %u", size);
 #endif
 
-    ssize_t ret = 0;
-    do {
-        ret = recv(socket_fd, elem, size, MSG_WAITALL);
-    } while ((ret == -1) && (errno == EINTR));
+    /* The other side may wait for our data before answering */
+    sendPending();
+
+    ssize_t ret = receivePayload(elem, size, 0);
 
     if (ret == -1) {
 #ifdef LIBTAS_LIBRARY
@@ -249,13 +901,6 @@ int receiveData(void* elem, unsigned int size)
         LOG(LL_WARN, LCF_SOCKET, "recv() returns 0 -> socket closed");
 #else
         std::cerr << "recv() returns 0 -> socket closed" << std::endl;
-#endif
-    }
-    else if (ret != static_cast<ssize_t>(size)) {
-#ifdef LIBTAS_LIBRARY
-        LOG(LL_ERROR, LCF_SOCKET, "recv() %u bytes instead of %u", ret, size);
-#else
-        std::cerr << "recv() " << ret << " bytes instead of " << size << std::endl;
 #endif
     }
     return ret;
@@ -279,8 +924,10 @@ int receiveMessage()
 
 int receiveMessageNonBlocking()
 {
+    sendPending();
+
     int msg;
-    int ret = recv(socket_fd, &msg, sizeof(int), MSG_WAITALL | MSG_DONTWAIT);
+    int ret = receivePayload(&msg, sizeof(int), MSG_DONTWAIT);
     if (ret < 0)
         return ret;
 #ifdef LIBTAS_LIBRARY
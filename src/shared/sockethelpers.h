@@ -24,15 +24,28 @@
 #include <string>
 #include <sys/types.h>
 
+/* Use the socket file of a libTAS instance, so that several instances can
+ * run at the same time. Instance 0 uses the default file. The game gets its
+ * instance from the LIBTAS_INSTANCE environment variable */
+void setSocketInstance(int instance);
+
 /* Remove the socket file and return error */
 int removeSocket();
 
 #ifndef LIBTAS_LIBRARY
-/* Initiate a socket connection with the game */
-bool initSocketProgram(pid_t fork_pid);
+/* Initiate a socket connection with the game. If `shared_memory` is set,
+ * data is exchanged through ring buffers in shared memory when the game
+ * supports it.
+ */
+bool initSocketProgram(pid_t fork_pid, bool shared_memory);
 #else
 /* Initiate a socket connection with libTAS */
 bool initSocketGame(void);
+
+/* Returns if `addr` is the start of the memory shared with libTAS, which
+ * must not be saved or restored by savestates.
+ */
+bool isSocketSharedMemory(const void* addr);
 #endif
 
 /* Close the socket connection */
@@ -49,6 +62,15 @@ void unlockSocket(void);
  */
 int sendData(const void* elem, unsigned int size);
 
+/* Buffer all sent data until flushSocket() is called, so that the messages
+ * of a frame are sent in a single system call. Buffered data is also sent
+ * before receiving anything, because the other side may need it to answer.
+ */
+void bufferSocket(void);
+
+/* Send all buffered data and stop buffering */
+void flushSocket(void);
+
 /* Send a string object through the socket. It first sends the string length,
  * followed by the char array.
  */
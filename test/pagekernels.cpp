@@ -0,0 +1,207 @@
+/* Check that all implementations of the savestate page kernels give the same
+ * results, and compare their speed on 4 KiB and 2 MiB buffers.
+ *
+ * Build with `make pagekernels`, then run `./pagekernels`. Returns a non-zero
+ * value if implementations disagree. */
+
+#include "Utils.h"
+#include "logging.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace libtas;
+
+/* Utils.cpp logs errors of writeAll() and readAll(), which are not used here */
+namespace libtas {
+void debuglogfull(LogLevel, LogCategoryFlag, const char*, int, ...) {}
+}
+
+static const struct {
+    Utils::PageKernelSet set;
+    const char* name;
+} kernel_sets[] = {
+    {Utils::PAGE_KERNELS_SCALAR, "scalar"},
+    {Utils::PAGE_KERNELS_SSE2, "sse2"},
+    {Utils::PAGE_KERNELS_AVX2, "avx2"},
+    {Utils::PAGE_KERNELS_AVX512, "avx512"},
+    {Utils::PAGE_KERNELS_NEON, "neon"},
+};
+
+static const int CHECK_PAGES = 1000;
+
+/* Bytes to process for each measure */
+static const size_t BENCH_BYTES = 1ULL << 30;
+
+static char* allocBuffer(size_t size)
+{
+    void* buf = nullptr;
+    if (posix_memalign(&buf, 64, size) != 0) {
+        perror("posix_memalign");
+        exit(1);
+    }
+    memset(buf, 0, size);
+    return static_cast<char*>(buf);
+}
+
+/* Fill pages with random data, or with a few random bytes in a zero page */
+static void fillPage(char* page, size_t page_size, std::mt19937_64& rng, bool sparse)
+{
+    if (!sparse) {
+        for (size_t i = 0; i < page_size; i += sizeof(uint64_t)) {
+            uint64_t v = rng();
+            memcpy(page + i, &v, sizeof(v));
+        }
+        return;
+    }
+
+    memset(page, 0, page_size);
+    int count = rng() % 4;
+    for (int i = 0; i < count; i++)
+        page[rng() % page_size] = static_cast<char>(rng() | 1);
+}
+
+/* Results of each kernel on a set of pages, which must not depend on the
+ * instruction set */
+struct Results {
+    std::vector<bool> zero;
+    std::vector<bool> zero_or_hash;
+    std::vector<uint64_t> hash;
+    std::vector<bool> equal;
+};
+
+static Results computeResults(const char* pages, const char* copies, size_t page_size, int count)
+{
+    Results results;
+    for (int p = 0; p < count; p++) {
+        const char* page = pages + p * page_size;
+        uint64_t hash = 0;
+        results.zero.push_back(Utils::isZeroPage(page));
+        results.zero_or_hash.push_back(Utils::isZeroPageOrHash(page, &hash));
+        results.hash.push_back(Utils::hashPage(page));
+        results.equal.push_back(Utils::isEqualPage(page, copies + p * page_size));
+
+        /* The fused kernel must give the same hash as hashPage() */
+        if (!results.zero_or_hash.back() && (hash != results.hash.back()))
+            results.hash.back() = ~results.hash.back();
+    }
+    return results;
+}
+
+template <typename F>
+static double measure(size_t size, F kernel)
+{
+    size_t iterations = BENCH_BYTES / size;
+    if (iterations == 0)
+        iterations = 1;
+
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++)
+        kernel();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    /* GB/s */
+    return (iterations * size) / elapsed.count() / 1e9;
+}
+
+static volatile uint64_t sink;
+
+static void benchmark(const char* name, size_t size)
+{
+    size_t page_size = Utils::getPageSize();
+    size_t nb_pages = size / page_size;
+    if (nb_pages == 0)
+        return;
+
+    /* Worst cases, which read the whole buffer: a zero buffer for isZero,
+     * identical buffers for isEqual */
+    char* zero = allocBuffer(size);
+    char* data = allocBuffer(size);
+    char* copy = allocBuffer(size);
+    std::mt19937_64 rng(size);
+    for (size_t p = 0; p < nb_pages; p++)
+        fillPage(data + p * page_size, page_size, rng, false);
+    memcpy(copy, data, size);
+
+    double zero_speed = measure(size, [&]() {
+        sink = sink + Utils::isZeroPages(zero, nb_pages);
+    });
+
+    double hash_speed = measure(size, [&]() {
+        uint64_t hash = 0;
+        for (size_t p = 0; p < nb_pages; p++)
+            Utils::isZeroPageOrHash(data + p * page_size, &hash);
+        sink = sink + hash;
+    });
+
+    double equal_speed = measure(size, [&]() {
+        bool equal = true;
+        for (size_t p = 0; p < nb_pages; p++)
+            equal &= Utils::isEqualPage(data + p * page_size, copy + p * page_size);
+        sink = sink + equal;
+    });
+
+    printf("%-8s %8zu KiB   isZero %7.2f GB/s   isZeroOrHash %7.2f GB/s   isEqual %7.2f GB/s\n",
+        name, size / 1024, zero_speed, hash_speed, equal_speed);
+
+    free(zero);
+    free(data);
+    free(copy);
+}
+
+int main()
+{
+    size_t page_size = Utils::getPageSize();
+
+    /* Random and sparse pages, and their copies with a byte changed in some
+     * of them */
+    char* pages = allocBuffer(2 * CHECK_PAGES * page_size);
+    char* copies = allocBuffer(2 * CHECK_PAGES * page_size);
+    std::mt19937_64 rng(0);
+    for (int p = 0; p < 2 * CHECK_PAGES; p++)
+        fillPage(pages + p * page_size, page_size, rng, p >= CHECK_PAGES);
+    memcpy(copies, pages, 2 * CHECK_PAGES * page_size);
+    for (int p = 0; p < 2 * CHECK_PAGES; p += 3)
+        copies[p * page_size + rng() % page_size] ^= 0x10;
+
+    Utils::setPageKernels(Utils::PAGE_KERNELS_SCALAR);
+    Results reference = computeResults(pages, copies, page_size, 2 * CHECK_PAGES);
+
+    int failures = 0;
+    for (const auto& kernel_set : kernel_sets) {
+        if (!Utils::setPageKernels(kernel_set.set)) {
+            printf("%-8s not supported\n", kernel_set.name);
+            continue;
+        }
+
+        Results results = computeResults(pages, copies, page_size, 2 * CHECK_PAGES);
+        for (int p = 0; p < 2 * CHECK_PAGES; p++) {
+            if ((results.zero[p] != reference.zero[p]) ||
+                (results.zero_or_hash[p] != reference.zero_or_hash[p]) ||
+                (results.hash[p] != reference.hash[p]) ||
+                (results.equal[p] != reference.equal[p])) {
+                printf("%-8s differs from scalar on %s page %d\n", kernel_set.name,
+                    (p < CHECK_PAGES) ? "random" : "sparse", p % CHECK_PAGES);
+                failures++;
+                break;
+            }
+        }
+
+        benchmark(kernel_set.name, 4 * 1024);
+        benchmark(kernel_set.name, 2 * 1024 * 1024);
+    }
+
+    free(pages);
+    free(copies);
+
+    if (failures) {
+        printf("%d implementations differ\n", failures);
+        return 1;
+    }
+    printf("All implementations give the same results\n");
+    return 0;
+}
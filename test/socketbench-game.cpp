@@ -0,0 +1,67 @@
+/* Game side of the socket benchmark, see socketbench.cpp. It is started by
+ * socketbench and sends a frame boundary on each frame, like the library. */
+
+#include "sockethelpers.h"
+#include "messages.h"
+#include "../library/GlobalState.h"
+#include "../library/logging.h"
+
+#include <cstdint>
+#include <cstdlib>
+
+/* Library symbols used by sockethelpers.cpp */
+namespace libtas {
+GlobalNative::GlobalNative() {}
+GlobalNative::~GlobalNative() {}
+void debuglogfull(LogLevel, LogCategoryFlag, const char*, int, ...) {}
+}
+
+int main()
+{
+    if (!initSocketGame())
+        return 1;
+
+    bool buffered = !getenv("SOCKETBENCH_UNBUFFERED");
+    uint64_t framecount = 0;
+    uint64_t current_time[4] = {};
+    float fps = 60, lfps = 60;
+    char inputs[64];
+
+    while (true) {
+        if (buffered)
+            bufferSocket();
+
+        sendMessage(MSGB_FRAMECOUNT_TIME);
+        sendData(&framecount, sizeof(uint64_t));
+        for (int i = 0; i < 4; i++)
+            sendData(&current_time[i], sizeof(uint64_t));
+
+        sendMessage(MSGB_FPS);
+        sendData(&fps, sizeof(float));
+        sendData(&lfps, sizeof(float));
+
+        sendMessage(MSGB_START_FRAMEBOUNDARY);
+
+        int message = receiveMessage();
+        while (message != MSGN_END_FRAMEBOUNDARY) {
+            switch (message) {
+                case MSGN_ALL_INPUTS:
+                    receiveData(inputs, sizeof(inputs));
+                    break;
+                case MSGN_USERQUIT:
+                    closeSocket();
+                    return 0;
+                default:
+                    closeSocket();
+                    return 1;
+            }
+            message = receiveMessage();
+        }
+
+        if (buffered)
+            flushSocket();
+
+        framecount++;
+        current_time[1] += 16666666;
+    }
+}
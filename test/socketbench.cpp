@@ -0,0 +1,141 @@
+/* Throughput of the program/game socket protocol.
+ *
+ * The program side runs here and starts socketbench-game, which plays the
+ * game side. On each frame, they exchange a typical frame boundary: the game
+ * sends the frame count and time, fps and the start of the frame boundary,
+ * and the program answers with six input messages and the end of the frame
+ * boundary. It is measured with unbuffered messages (each sendData() is a
+ * separate frame), with buffered messages, and with the shared memory
+ * transport.
+ *
+ * Build with `make socketbench`, then run `./socketbench [frames]` from this
+ * directory. */
+
+#include "sockethelpers.h"
+#include "messages.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <unistd.h>
+#include <sys/wait.h>
+
+/* Receive the messages of the game until the start of the frame boundary.
+ * Returns false if an unexpected message was received */
+static bool receiveFrameBoundary()
+{
+    uint64_t framecount_time[5];
+    float fps[2];
+
+    int message = receiveMessage();
+    while (message != MSGB_START_FRAMEBOUNDARY) {
+        switch (message) {
+            case MSGB_FRAMECOUNT_TIME:
+                for (int i = 0; i < 5; i++)
+                    receiveData(&framecount_time[i], sizeof(uint64_t));
+                break;
+            case MSGB_FPS:
+                receiveData(&fps[0], sizeof(float));
+                receiveData(&fps[1], sizeof(float));
+                break;
+            default:
+                fprintf(stderr, "Unexpected message %d\n", message);
+                return false;
+        }
+        message = receiveMessage();
+    }
+    return true;
+}
+
+/* Run the benchmark in one mode. Returns the number of frames per second,
+ * or a negative value on error */
+static double run(const char* name, bool buffered, bool shared_memory, int frames)
+{
+    /* Use a socket file of our own, so that a running libTAS is not disturbed */
+    int instance = 1000 + getpid() % 1000;
+    setSocketInstance(instance);
+    removeSocket();
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        setenv("LIBTAS_INSTANCE", std::to_string(instance).c_str(), 1);
+        if (!buffered)
+            setenv("SOCKETBENCH_UNBUFFERED", "1", 1);
+        execl("./socketbench-game", "socketbench-game", nullptr);
+        perror("Could not start socketbench-game");
+        _exit(1);
+    }
+
+    if (!initSocketProgram(pid, shared_memory)) {
+        fprintf(stderr, "%s: could not connect to socketbench-game\n", name);
+        waitpid(pid, nullptr, 0);
+        removeSocket();
+        return -1;
+    }
+
+    char inputs[64] = {};
+    bool success = true;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int f = 0; (f < frames) && success; f++) {
+        success = receiveFrameBoundary();
+
+        if (buffered)
+            bufferSocket();
+        for (int i = 0; i < 6; i++) {
+            sendMessage(MSGN_ALL_INPUTS);
+            sendData(inputs, sizeof(inputs));
+        }
+        sendMessage(MSGN_END_FRAMEBOUNDARY);
+        if (buffered)
+            flushSocket();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (success && receiveFrameBoundary())
+        sendMessage(MSGN_USERQUIT);
+    closeSocket();
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+    removeSocket();
+
+    if (!success || !WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+        fprintf(stderr, "%s: frame boundary exchange failed\n", name);
+        return -1;
+    }
+
+    return frames / elapsed.count();
+}
+
+int main(int argc, char** argv)
+{
+    int frames = (argc > 1) ? atoi(argv[1]) : 200000;
+    if (frames <= 0) {
+        fprintf(stderr, "Usage: %s [frames]\n", argv[0]);
+        return 1;
+    }
+
+    static const struct {
+        const char* name;
+        bool buffered;
+        bool shared_memory;
+    } modes[] = {
+        {"unbuffered", false, false},
+        {"buffered", true, false},
+        {"shared memory", true, true},
+    };
+
+    int ret = 0;
+    for (const auto& mode : modes) {
+        double speed = run(mode.name, mode.buffered, mode.shared_memory, frames);
+        if (speed < 0) {
+            ret = 1;
+            continue;
+        }
+        printf("%-14s %8d frames in %7.3f s: %8.0f frames/s\n", mode.name, frames, frames / speed, speed);
+    }
+    return ret;
+}